@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NFC_CAPTURE_H
+#define NFC_CAPTURE_H
+
+#include "nfc_types.h"
+
+G_BEGIN_DECLS
+
+/*
+ * In-memory capture of the RF and LLCP traffic. Frames are stored
+ * in a fixed size ring buffer, the oldest ones get overwritten once
+ * it's full. Each frame is timestamped and truncated to 256 bytes.
+ * Capturing is off by default and costs nothing when it's off.
+ *
+ * nfc_capture_start() discards the previously captured frames.
+ * Zero max_frames selects the default size (1024 frames).
+ *
+ * nfc_capture_pcapng() returns the captured frames as a pcapng file,
+ * suitable for Wireshark, with three interfaces: RF frames in poll
+ * mode (we are the reader), RF frames in listen mode (we are the card)
+ * and LLCP PDUs. The first two use LINKTYPE_ISO_14443 and the third
+ * one LINKTYPE_NFC_LLCP. Returns NULL if nothing is being captured.
+ */
+
+gboolean
+nfc_capture_start(
+    guint max_frames) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+void
+nfc_capture_stop(
+    void) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+gboolean
+nfc_capture_active(
+    void) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+GBytes*
+nfc_capture_pcapng(
+    void) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+G_END_DECLS
+
+#endif /* NFC_CAPTURE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -110,6 +110,12 @@ nfc_peer_deactivate(
     NfcPeer* peer)
     NFCD_EXPORT;
 
+/* NULL if the peer is not accessed via NfcTarget (i.e. we are the target) */
+const NfcTargetStats*
+nfc_peer_stats(
+    NfcPeer* peer) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 gulong
 nfc_peer_add_wks_changed_handler(
     NfcPeer* peer,
@@ -102,6 +102,14 @@ nfc_tag_add_initialized_handler(
     void* user_data)
     NFCD_EXPORT;
 
+/* Invoked when tag->ndef changes after the tag has been initialized */
+gulong
+nfc_tag_add_ndef_changed_handler(
+    NfcTag* tag,
+    NfcTagFunc func,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 void
 nfc_tag_remove_handler(
     NfcTag* tag,
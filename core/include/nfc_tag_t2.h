@@ -94,6 +94,24 @@ nfc_tag_t2_read(
     void* user_data)
     NFCD_EXPORT;
 
+/*
+ * Reads count blocks starting at the given block of the sector, using
+ * FAST_READ if the tag supports it. Completion receives exactly count
+ * blocks on success. Blocks belonging to the NFC Forum memory area are
+ * cached. The range must not cross the sector boundary.
+ */
+guint
+nfc_tag_t2_read_blocks(
+    NfcTagType2* tag,
+    guint sector,
+    guint block,
+    guint count,
+    NfcTargetSequence* seq,
+    NfcTagType2ReadFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 guint
 nfc_tag_t2_write(
     NfcTagType2* tag,
@@ -171,6 +189,16 @@ nfc_tag_t2_read_data_seq(
     void* user_data) /* Since 1.0.17 */
     NFCD_EXPORT;
 
+/*
+ * Cancels the read started by nfc_tag_t2_read_blocks() or
+ * nfc_tag_t2_read_data(). The completion callback is not invoked.
+ */
+gboolean
+nfc_tag_t2_cancel_read(
+    NfcTagType2* tag,
+    guint id) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 NFC_TAG_T2_IO_STATUS
 nfc_tag_t2_read_data_sync(
     NfcTagType2* tag,
@@ -148,6 +148,51 @@ nfc_isodep_transmit(
     void* user_data)
     NFCD_EXPORT;
 
+/*
+ * With NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 61xx responses are followed
+ * by GET RESPONSE and 6Cxx ones make the command repeated with the
+ * right Le. The response data are concatenated and delivered together
+ * with the final status word in one callback. All that happens within
+ * the sequence (a private one if NULL is passed in). The returned id
+ * can be passed to nfc_isodep_cancel() to cancel the whole thing, while
+ * nfc_target_cancel_transmit() would only cancel the first command.
+ *
+ * Non-zero timeout_ms is passed to nfc_target_transmit2() as a hint
+ * for commands which are known to take long. It applies to each
+ * command sent on behalf of this call, including GET RESPONSE.
+ */
+typedef enum nfc_isodep_tx_flags {
+    NFC_ISODEP_TX_FLAGS_NONE = 0x00,
+    NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE = 0x01
+} NFC_ISODEP_TX_FLAGS; /* Since 1.2.1 */
+
+guint
+nfc_isodep_transmit2(
+    NfcTagType4* tag,
+    guint8 cla,             /* Class byte */
+    guint8 ins,             /* Instruction byte */
+    guint8 p1,              /* Parameter byte 1 */
+    guint8 p2,              /* Parameter byte 2 */
+    const GUtilData* data,  /* Command data */
+    guint le,               /* Expected length, zero if none */
+    NFC_ISODEP_TX_FLAGS flags,
+    guint timeout_ms,       /* Timeout hint, zero if none */
+    NfcTargetSequence* seq,
+    NfcTagType4ResponseFunc resp,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/*
+ * Cancels nfc_isodep_transmit() or nfc_isodep_transmit2() together
+ * with the chained commands (if any). Response callback is not invoked.
+ */
+gboolean
+nfc_isodep_cancel(
+    NfcTagType4* tag,
+    guint id) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 gboolean
 nfc_isodep_reset(
     NfcTagType4* tag,
@@ -157,6 +202,44 @@ nfc_isodep_reset(
     void* user_data) /* Since 1.0.44 */
     NFCD_EXPORT;
 
+/*
+ * Since 1.2.1 the tag is reactivated after reading NDEF lazily, right
+ * before the first nfc_isodep_transmit() call. Those who talk to the
+ * tag bypassing nfc_isodep_transmit() (e.g. with nfc_target_transmit)
+ * should call this function first. Returns TRUE if reactivation has
+ * been queued.
+ */
+gboolean
+nfc_isodep_deferred_reset(
+    NfcTagType4* tag,
+    NfcTargetSequence* seq) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/*
+ * Writes NDEF message into the NDEF file found while initializing
+ * the tag. The callback receives ISO_SW_OK on success, the status
+ * of the failed command otherwise (ISO_SW_IO_ERR if it's not even
+ * an ISO/IEC 7816-4 failure). On success, tag's NDEF is updated
+ * accordingly. Returns FALSE if the tag has no writable NDEF file,
+ * the message doesn't fit or another write is in progress.
+ */
+typedef
+void
+(*NfcTagType4WriteNdefFunc)(
+    NfcTagType4* tag,
+    guint sw,  /* 16 bits (SW1 << 8)|SW2 */
+    void* user_data); /* Since 1.2.1 */
+
+gboolean
+nfc_tag_t4_write_ndef(
+    NfcTagType4* tag,
+    GBytes* ndef,  /* Raw NDEF message, without NLEN */
+    NfcTargetSequence* seq,
+    NfcTagType4WriteNdefFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 G_END_DECLS
 
 #endif /* NFC_TAG_T4_H */
@@ -94,6 +94,12 @@ nfc_target_unref(
  * -1: Use default timeout
  *  0: No timeout at all
  * >0: Transmision timeout in milliseconds
+ *
+ * Since 1.2.1 the default timeout is adaptive. It's derived from the
+ * round-trip times measured for this target and is kept between 100
+ * and 2500 ms. It starts at 500 ms, shrinks for fast targets and grows
+ * for slow ones. Commands known to take much longer than the usual
+ * ones should be sent with an explicit timeout.
  */
 void
 nfc_target_set_transmit_timeout(
@@ -174,12 +180,154 @@ nfc_target_transmit(
     void* user_data)
     NFCD_EXPORT;
 
+/*
+ * Same as nfc_target_transmit() but with a timeout hint for commands
+ * which are known to take long (e.g. crypto operations). The hint
+ * extends the timeout applied to this request, it never shortens it.
+ * Zero means no hint. If the timeout is disabled, the hint is ignored.
+ */
+guint
+nfc_target_transmit2(
+    NfcTarget* target,
+    const void* data,
+    guint len,
+    NfcTargetSequence* seq,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/*
+ * Requests of higher priority are submitted first, unless there is
+ * an active sequence. Requests of the same priority, as well as all
+ * requests within a sequence, are submitted in the order they were
+ * queued. A lower priority request can be overtaken only a few times
+ * in a row, so it never waits forever.
+ */
+typedef enum nfc_target_priority {
+    NFC_TARGET_PRIORITY_HIGH,    /* Internal requests, presence checks */
+    NFC_TARGET_PRIORITY_NORMAL,  /* Interactive client requests */
+    NFC_TARGET_PRIORITY_LOW      /* Bulk and background transfers */
+} NFC_TARGET_PRIORITY; /* Since 1.2.1 */
+
+/*
+ * Same as nfc_target_transmit2() with priority. Requests submitted by
+ * nfc_target_transmit() and nfc_target_transmit2() have normal priority.
+ */
+guint
+nfc_target_transmit_full(
+    NfcTarget* target,
+    const void* data,
+    guint len,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/* Number of queued requests of the given priority, for diagnostics */
+guint
+nfc_target_queue_depth(
+    NfcTarget* target,
+    NFC_TARGET_PRIORITY priority) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/*
+ * Same as nfc_target_transmit() but takes a reference to the caller's
+ * buffer instead of copying the data, if the request can't be submitted
+ * right away. The bytes are passed to NfcTargetClass::transmit_bytes
+ * as is, if the implementation provides one.
+ */
+guint
+nfc_target_transmit_bytes(
+    NfcTarget* target,
+    GBytes* bytes,
+    NfcTargetSequence* seq,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/* Same as nfc_target_transmit_bytes() with priority and timeout hint */
+guint
+nfc_target_transmit_bytes_full(
+    NfcTarget* target,
+    GBytes* bytes,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
+/*
+ * Transmits several frames one after another, nothing else gets
+ * transmitted in between. Each frame gets its own completion callback.
+ * If a frame fails, the remaining frames are not transmitted and their
+ * callbacks are invoked with NFC_TRANSMIT_STATUS_ERROR. The destroy
+ * callback is invoked once, after the whole batch is done. The data
+ * are copied, the frames array can be released right after the call.
+ * Like nfc_target_transmit(), returns zero without invoking any
+ * callbacks if the batch can't be submitted.
+ */
+typedef struct nfc_target_batch_frame {
+    const void* data;
+    guint len;
+    NfcTargetTransmitFunc complete;
+    void* user_data;
+} NfcTargetBatchFrame; /* Since 1.2.1 */
+
+guint
+nfc_target_transmit_batch(
+    NfcTarget* target,
+    const NfcTargetBatchFrame* frames,
+    guint count,
+    NfcTargetSequence* seq,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 gboolean
 nfc_target_cancel_transmit(
     NfcTarget* target,
     guint id)
     NFCD_EXPORT;
 
+/*
+ * Request statistics, collected for the lifetime of the target.
+ *
+ * Latencies (from submission to completion) are counted in log2
+ * buckets. Bucket 0 counts requests completed in less than 1 ms,
+ * bucket N counts those which took [2^(N-1), 2^N) ms and the last
+ * bucket counts everything slower than that. Successful, failed and
+ * timed out requests are all counted, cancelled requests and those
+ * which failed to submit are not. Batches are counted as transmissions.
+ */
+#define NFC_TARGET_LATENCY_BUCKETS (16)
+
+typedef struct nfc_target_op_stats {
+    guint ok;
+    guint errors;
+    guint timeouts;
+    guint cancelled;
+    guint latency[NFC_TARGET_LATENCY_BUCKETS];
+} NfcTargetOpStats; /* Since 1.2.1 */
+
+struct nfc_target_stats {
+    NfcTargetOpStats transmit;
+    NfcTargetOpStats reactivate;
+    guint max_queue_depth;
+}; /* Since 1.2.1 */
+
+const NfcTargetStats*
+nfc_target_stats(
+    NfcTarget* target) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 G_END_DECLS
 
 #endif /* NFC_TARGET_H */
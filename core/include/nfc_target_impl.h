@@ -63,9 +63,22 @@ typedef struct nfc_target_class {
      * Reactivation isn't cancellable, it either succeeds or fails. */
     gboolean (*reactivate)(NfcTarget* target);  /* Since 1.0.27 */
 
+    /* Optional alternative to transmit() which receives a reference to
+     * the data rather than a pointer. If it's provided, it's used instead
+     * of transmit(). The implementation may keep the reference until the
+     * transmission completes, e.g. to avoid copying the data. */
+    gboolean (*transmit_bytes)(NfcTarget* target, GBytes* bytes);
+        /* Since 1.2.1 */
+
+    /* Optional, transmits several frames in one go. The implementation
+     * calls nfc_target_transmit_done() for each frame, in order. After
+     * a frame fails, the base class calls cancel_transmit() and fails
+     * the rest of the batch. Without it, the frames are transmitted one
+     * by one with transmit() or transmit_bytes(). */
+    gboolean (*transmit_batch)(NfcTarget* target, GBytes* const* frames,
+        guint count); /* Since 1.2.1 */
+
     /* Padding for future expansion */
-    void (*_reserved1)(void);
-    void (*_reserved2)(void);
     void (*_reserved3)(void);
     void (*_reserved4)(void);
     void (*_reserved5)(void);
@@ -96,6 +109,18 @@ nfc_target_gone(
     NfcTarget* target)
     NFCD_EXPORT;
 
+/* By default, the next queued request is submitted on the next main
+ * loop iteration. Implementations which can handle transmit() being
+ * invoked from within their completion path may allow the base class
+ * to submit the next request of the active sequence straight from
+ * nfc_target_transmit_done() and nfc_target_reactivated(), as soon as
+ * the completion callback returns. */
+void
+nfc_target_set_direct_continuation(
+    NfcTarget* target,
+    gboolean enabled) /* Since 1.2.1 */
+    NFCD_EXPORT;
+
 G_END_DECLS
 
 #endif /* NFC_TARGET_IMPL_H */
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nfc_capture_p.h"
+#include "nfc_log.h"
+
+#include <gutil_macros.h>
+
+#define CAPTURE_DEFAULT_FRAMES (1024)
+#define CAPTURE_MAX_FRAMES (0x10000)
+#define CAPTURE_SNAPLEN (256)
+
+/* pcapng block types and options */
+#define PCAPNG_BLOCK_SHB (0x0a0d0d0a)
+#define PCAPNG_BLOCK_IDB (0x00000001)
+#define PCAPNG_BLOCK_EPB (0x00000006)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1a2b3c4d)
+#define PCAPNG_OPT_ENDOFOPT (0)
+#define PCAPNG_OPT_IF_NAME (2)
+#define PCAPNG_OPT_EPB_FLAGS (2)
+#define PCAPNG_EPB_FLAG_INBOUND (0x01)
+#define PCAPNG_EPB_FLAG_OUTBOUND (0x02)
+
+/* https://www.tcpdump.org/linktypes.html */
+#define LINKTYPE_NFC_LLCP (245)
+#define LINKTYPE_ISO_14443 (264)
+
+/* LINKTYPE_ISO_14443 pseudo-header events */
+#define ISO_14443_EVENT_PCD_TO_PICC (0xfa) /* CRC dropped */
+#define ISO_14443_EVENT_PICC_TO_PCD (0xfb) /* CRC dropped */
+#define ISO_14443_HEADER_SIZE (4)
+
+/* LINKTYPE_NFC_LLCP pseudo-header flags */
+#define NFC_LLCP_FLAG_SENT (0x01)
+#define NFC_LLCP_HEADER_SIZE (2)
+
+typedef struct nfc_capture_record {
+    gint64 time;
+    guint len;
+    guint8 link;
+    guint8 dir;
+    guint8 data[CAPTURE_SNAPLEN];
+} NfcCaptureRecord;
+
+/*
+ * nfcd is single-threaded, the ring is only touched by the main loop
+ * and doesn't need any locking.
+ */
+typedef struct nfc_capture {
+    NfcCaptureRecord* ring;
+    guint size;
+    guint count;
+    guint next;
+} NfcCapture;
+
+static NfcCapture nfc_capture = { NULL, 0, 0, 0 };
+
+static const char* const nfc_capture_if_name[] = {
+    "rf-poll",      /* NFC_CAPTURE_LINK_POLL */
+    "rf-listen",    /* NFC_CAPTURE_LINK_LISTEN */
+    "llcp"          /* NFC_CAPTURE_LINK_LLCP */
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+nfc_capture_append_u16(
+    GByteArray* buf,
+    guint16 value)
+{
+    g_byte_array_append(buf, (void*)&value, sizeof(value));
+}
+
+static
+void
+nfc_capture_append_u32(
+    GByteArray* buf,
+    guint32 value)
+{
+    g_byte_array_append(buf, (void*)&value, sizeof(value));
+}
+
+static
+void
+nfc_capture_append_padding(
+    GByteArray* buf)
+{
+    static const guint8 zeros[3] = { 0, 0, 0 };
+    const guint pad = (4 - (buf->len & 3)) & 3;
+
+    if (pad) {
+        g_byte_array_append(buf, zeros, pad);
+    }
+}
+
+static
+void
+nfc_capture_append_option(
+    GByteArray* buf,
+    guint16 code,
+    const void* value,
+    guint16 len)
+{
+    nfc_capture_append_u16(buf, code);
+    nfc_capture_append_u16(buf, len);
+    g_byte_array_append(buf, value, len);
+    nfc_capture_append_padding(buf);
+}
+
+static
+guint
+nfc_capture_block_start(
+    GByteArray* buf,
+    guint32 type)
+{
+    const guint start = buf->len;
+
+    nfc_capture_append_u32(buf, type);
+    nfc_capture_append_u32(buf, 0); /* Length, updated at the end */
+    return start;
+}
+
+static
+void
+nfc_capture_block_end(
+    GByteArray* buf,
+    guint start)
+{
+    guint32 len;
+
+    /* Block Total Length appears at both ends of the block */
+    len = buf->len + sizeof(len) - start;
+    memcpy(buf->data + start + 4, &len, sizeof(len));
+    nfc_capture_append_u32(buf, len);
+}
+
+static
+void
+nfc_capture_append_shb(
+    GByteArray* buf)
+{
+    const guint start = nfc_capture_block_start(buf, PCAPNG_BLOCK_SHB);
+    const gint64 section_len = -1; /* Unspecified */
+
+    nfc_capture_append_u32(buf, PCAPNG_BYTE_ORDER_MAGIC);
+    nfc_capture_append_u16(buf, 1); /* Major version */
+    nfc_capture_append_u16(buf, 0); /* Minor version */
+    g_byte_array_append(buf, (void*)&section_len, sizeof(section_len));
+    nfc_capture_block_end(buf, start);
+}
+
+static
+void
+nfc_capture_append_idb(
+    GByteArray* buf,
+    guint16 linktype,
+    guint32 snaplen,
+    const char* name)
+{
+    const guint start = nfc_capture_block_start(buf, PCAPNG_BLOCK_IDB);
+
+    nfc_capture_append_u16(buf, linktype);
+    nfc_capture_append_u16(buf, 0); /* Reserved */
+    nfc_capture_append_u32(buf, snaplen);
+    nfc_capture_append_option(buf, PCAPNG_OPT_IF_NAME, name, strlen(name));
+    nfc_capture_append_option(buf, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    nfc_capture_block_end(buf, start);
+}
+
+static
+void
+nfc_capture_append_epb(
+    GByteArray* buf,
+    const NfcCaptureRecord* rec,
+    gint64 time_offset)
+{
+    const guint start = nfc_capture_block_start(buf, PCAPNG_BLOCK_EPB);
+    const guint64 ts = rec->time + time_offset; /* Microseconds */
+    const guint caplen = MIN(rec->len, CAPTURE_SNAPLEN);
+    const gboolean out = (rec->dir == NFC_CAPTURE_OUT);
+    const guint32 flags = out ?
+        PCAPNG_EPB_FLAG_OUTBOUND :
+        PCAPNG_EPB_FLAG_INBOUND;
+    guint8 hdr[ISO_14443_HEADER_SIZE];
+    guint hdrlen;
+
+    if (rec->link == NFC_CAPTURE_LINK_LLCP) {
+        hdr[0] = 0; /* Adapter number */
+        hdr[1] = out ? NFC_LLCP_FLAG_SENT : 0;
+        hdrlen = NFC_LLCP_HEADER_SIZE;
+    } else {
+        /* What the reader sends is PCD to PICC, regardless of who we are */
+        hdr[0] = 0; /* Version */
+        hdr[1] = ((rec->link == NFC_CAPTURE_LINK_POLL) == out) ?
+            ISO_14443_EVENT_PCD_TO_PICC :
+            ISO_14443_EVENT_PICC_TO_PCD;
+        hdr[2] = (guint8)(caplen >> 8);
+        hdr[3] = (guint8)caplen;
+        hdrlen = ISO_14443_HEADER_SIZE;
+    }
+
+    nfc_capture_append_u32(buf, rec->link); /* Interface id */
+    nfc_capture_append_u32(buf, (guint32)(ts >> 32));
+    nfc_capture_append_u32(buf, (guint32)ts);
+    nfc_capture_append_u32(buf, hdrlen + caplen);
+    nfc_capture_append_u32(buf, hdrlen + rec->len);
+    g_byte_array_append(buf, hdr, hdrlen);
+    g_byte_array_append(buf, rec->data, caplen);
+    nfc_capture_append_padding(buf);
+    nfc_capture_append_option(buf, PCAPNG_OPT_EPB_FLAGS, &flags,
+        sizeof(flags));
+    nfc_capture_append_option(buf, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    nfc_capture_block_end(buf, start);
+}
+
+/*==========================================================================*
+ * Internal interface
+ *==========================================================================*/
+
+void
+nfc_capture_frame(
+    NFC_CAPTURE_LINK link,
+    NFC_CAPTURE_DIR dir,
+    const void* data,
+    guint len)
+{
+    NfcCapture* capture = &nfc_capture;
+
+    if (G_UNLIKELY(capture->ring)) {
+        NfcCaptureRecord* rec = capture->ring + capture->next;
+
+        rec->time = g_get_monotonic_time();
+        rec->len = len;
+        rec->link = link;
+        rec->dir = dir;
+        if (len) {
+            memcpy(rec->data, data, MIN(len, CAPTURE_SNAPLEN));
+        }
+        capture->next = (capture->next + 1) % capture->size;
+        if (capture->count < capture->size) {
+            capture->count++;
+        }
+    }
+}
+
+void
+nfc_capture_bytes(
+    NFC_CAPTURE_LINK link,
+    NFC_CAPTURE_DIR dir,
+    GBytes* bytes)
+{
+    if (G_UNLIKELY(nfc_capture.ring) && bytes) {
+        gsize size;
+        const void* data = g_bytes_get_data(bytes, &size);
+
+        nfc_capture_frame(link, dir, data, (guint)size);
+    }
+}
+
+/*==========================================================================*
+ * Interface
+ *==========================================================================*/
+
+gboolean
+nfc_capture_start(
+    guint max_frames)
+{
+    NfcCapture* capture = &nfc_capture;
+
+    if (!max_frames) {
+        max_frames = CAPTURE_DEFAULT_FRAMES;
+    }
+    if (max_frames <= CAPTURE_MAX_FRAMES) {
+        nfc_capture_stop();
+        GDEBUG("Capturing up to %u frames", max_frames);
+        capture->ring = g_new(NfcCaptureRecord, max_frames);
+        capture->size = max_frames;
+        return TRUE;
+    }
+    GWARN("Too many frames to capture (%u)", max_frames);
+    return FALSE;
+}
+
+void
+nfc_capture_stop(
+    void)
+{
+    NfcCapture* capture = &nfc_capture;
+
+    if (capture->ring) {
+        GDEBUG("Capture stopped");
+        g_free(capture->ring);
+        memset(capture, 0, sizeof(*capture));
+    }
+}
+
+gboolean
+nfc_capture_active(
+    void)
+{
+    return nfc_capture.ring != NULL;
+}
+
+GBytes*
+nfc_capture_pcapng(
+    void)
+{
+    const NfcCapture* capture = &nfc_capture;
+
+    if (capture->ring) {
+        GByteArray* buf = g_byte_array_sized_new(64 + capture->count *
+            (48 + ISO_14443_HEADER_SIZE + CAPTURE_SNAPLEN));
+        const gint64 time_offset = g_get_real_time() -
+            g_get_monotonic_time();
+        guint i, pos = (capture->next + capture->size - capture->count) %
+            capture->size;
+
+        /* Interface ids match NFC_CAPTURE_LINK values */
+        nfc_capture_append_shb(buf);
+        nfc_capture_append_idb(buf, LINKTYPE_ISO_14443, ISO_14443_HEADER_SIZE +
+            CAPTURE_SNAPLEN, nfc_capture_if_name[NFC_CAPTURE_LINK_POLL]);
+        nfc_capture_append_idb(buf, LINKTYPE_ISO_14443, ISO_14443_HEADER_SIZE +
+            CAPTURE_SNAPLEN, nfc_capture_if_name[NFC_CAPTURE_LINK_LISTEN]);
+        nfc_capture_append_idb(buf, LINKTYPE_NFC_LLCP, NFC_LLCP_HEADER_SIZE +
+            CAPTURE_SNAPLEN, nfc_capture_if_name[NFC_CAPTURE_LINK_LLCP]);
+        for (i = 0; i < capture->count; i++) {
+            nfc_capture_append_epb(buf, capture->ring + pos, time_offset);
+            pos = (pos + 1) % capture->size;
+        }
+        return g_byte_array_free_to_bytes(buf);
+    }
+    return NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
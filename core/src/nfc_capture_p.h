@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NFC_CAPTURE_PRIVATE_H
+#define NFC_CAPTURE_PRIVATE_H
+
+#include "nfc_types_p.h"
+
+#include "nfc_capture.h"
+
+typedef enum nfc_capture_link {
+    NFC_CAPTURE_LINK_POLL,      /* RF, we are the reader */
+    NFC_CAPTURE_LINK_LISTEN,    /* RF, we are the card */
+    NFC_CAPTURE_LINK_LLCP
+} NFC_CAPTURE_LINK;
+
+typedef enum nfc_capture_dir {
+    NFC_CAPTURE_IN,
+    NFC_CAPTURE_OUT
+} NFC_CAPTURE_DIR;
+
+/* Both are no-op unless capture is active */
+
+void
+nfc_capture_frame(
+    NFC_CAPTURE_LINK link,
+    NFC_CAPTURE_DIR dir,
+    const void* data,
+    guint len)
+    NFCD_INTERNAL;
+
+void
+nfc_capture_bytes(
+    NFC_CAPTURE_LINK link,
+    NFC_CAPTURE_DIR dir,
+    GBytes* bytes)
+    NFCD_INTERNAL;
+
+#endif /* NFC_CAPTURE_PRIVATE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
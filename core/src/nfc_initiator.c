@@ -39,6 +39,7 @@
 
 #include "nfc_initiator_p.h"
 #include "nfc_initiator_impl.h"
+#include "nfc_capture_p.h"
 #include "nfc_log.h"
 
 #include <gutil_macros.h>
@@ -218,6 +219,8 @@ nfc_transmission_respond(
             self->done = done;
             self->user_data = user_data;
             nfc_transmission_ref(self);
+            nfc_capture_frame(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_OUT,
+                data, len);
             if (GET_THIS_CLASS(owner)->respond(owner, data, len)) {
                 nfc_transmission_unref(self);
                 return TRUE;
@@ -244,6 +247,7 @@ nfc_transmission_respond_bytes(
             self->done = done;
             self->user_data = user_data;
             nfc_transmission_ref(self);
+            nfc_capture_bytes(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_OUT, data);
             if (GET_THIS_CLASS(owner)->respond_bytes(owner, data)) {
                 nfc_transmission_unref(self);
                 return TRUE;
@@ -371,6 +375,8 @@ nfc_initiator_transmit(
     if (G_LIKELY(self)) {
         NfcInitiatorPriv* priv = self->priv;
 
+        nfc_capture_frame(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_IN,
+            bytes, size);
         if (priv->current) {
             /*
              * This can only legitimately happen if we have already responded
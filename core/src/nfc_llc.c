@@ -98,6 +98,18 @@ typedef struct nfc_llc_connect_req {
     void* user_data;
 } NfcLlcConnectReq;
 
+typedef struct nfc_llc_pdu NfcLlcPdu;
+struct nfc_llc_pdu {
+    NfcLlcPdu* next;
+    GBytes* bytes;
+    NfcPeerConnection* conn; /* Only for I PDUs */
+};
+
+typedef struct nfc_llc_pdu_queue {
+    NfcLlcPdu* first;
+    NfcLlcPdu* last;
+} NfcLlcPduQueue;
+
 typedef struct nfc_llc_object {
     GObject object;
     NfcLlc pub;
@@ -109,7 +121,7 @@ typedef struct nfc_llc_object {
     guint miu;
     guint lto;
     guint packets_handled;
-    GList* pdu_queue;
+    NfcLlcPduQueue pdu_queue;
     GSList* connect_queue;
     GHashTable* conn_table;
 } NfcLlcObject;
@@ -294,19 +306,75 @@ nfc_llc_connect_req_free(
 }
 
 static
-GBytes*
+void
+nfc_llc_pdu_free(
+    NfcLlcPdu* pdu)
+{
+    nfc_peer_connection_unref(pdu->conn);
+    g_bytes_unref(pdu->bytes);
+    g_slice_free1(sizeof(*pdu), pdu);
+}
+
+static
+void
+nfc_llc_enqueue_pdu(
+    NfcLlcObject* self,
+    GBytes* bytes,
+    NfcPeerConnection* conn)
+{
+    NfcLlcPduQueue* queue = &self->pdu_queue;
+    NfcLlcPdu* pdu = g_slice_new(NfcLlcPdu);
+
+    pdu->next = NULL;
+    pdu->bytes = g_bytes_ref(bytes);
+    if (conn) {
+        /* Count I PDUs queued for this connection */
+        pdu->conn = nfc_peer_connection_ref(conn);
+        nfc_peer_connection_ps(conn)->queued++;
+    } else {
+        pdu->conn = NULL;
+    }
+    if (queue->last) {
+        queue->last->next = pdu;
+    } else {
+        queue->first = pdu;
+    }
+    queue->last = pdu;
+}
+
+static
+NfcLlcPdu*
 nfc_llc_dequeue_pdu(
     NfcLlcObject* self)
 {
-    GList* first = g_list_first(self->pdu_queue);
+    NfcLlcPduQueue* queue = &self->pdu_queue;
+    NfcLlcPdu* pdu = queue->first;
 
-    if (first) {
-        GBytes* bytes = first->data;
+    if (pdu) {
+        if (!(queue->first = pdu->next)) {
+            queue->last = NULL;
+        }
+        pdu->next = NULL;
+        if (pdu->conn) {
+            NfcPeerConnectionLlcpState* ps = nfc_peer_connection_ps(pdu->conn);
 
-        self->pdu_queue = g_list_delete_link(self->pdu_queue, first);
-        return bytes;
+            GASSERT(ps->queued);
+            ps->queued--;
+        }
+    }
+    return pdu;
+}
+
+static
+void
+nfc_llc_clear_pdu_queue(
+    NfcLlcObject* self)
+{
+    NfcLlcPdu* pdu;
+
+    while ((pdu = nfc_llc_dequeue_pdu(self)) != NULL) {
+        nfc_llc_pdu_free(pdu);
     }
-    return NULL;
 }
 
 static
@@ -381,16 +449,26 @@ nfc_llc_pdu_new(
 
 static
 void
-nfc_llc_submit(
+nfc_llc_submit_full(
     NfcLlcObject* self,
-    GBytes* pdu)
+    GBytes* pdu,
+    NfcPeerConnection* conn)
 {
-    self->pdu_queue = g_list_append(self->pdu_queue, g_bytes_ref(pdu));
+    nfc_llc_enqueue_pdu(self, pdu, conn);
     if (self->io->can_send) {
         nfc_llc_send_next_pdu(self);
     }
 }
 
+static
+void
+nfc_llc_submit(
+    NfcLlcObject* self,
+    GBytes* pdu)
+{
+    nfc_llc_submit_full(self, pdu, NULL);
+}
+
 static
 void
 nfc_llc_submit_frmr(
@@ -1356,7 +1434,7 @@ nfc_llc_receive(
         nfc_llc_send_next_pdu(self);
     }
     if (self->packets_handled == packets_handled && io->can_send) {
-        nfc_llc_set_idle(self, !self->pdu_queue && !self->connect_queue);
+        nfc_llc_set_idle(self, !self->pdu_queue.first && !self->connect_queue);
         return LLC_IO_IGNORE;
     } else {
         nfc_llc_set_idle(self, FALSE);
@@ -1379,9 +1457,10 @@ void
 nfc_llc_send_next_pdu(
     NfcLlcObject* self)
 {
-    GBytes* packet = nfc_llc_dequeue_pdu(self);
+    NfcLlcPdu* pdu = nfc_llc_dequeue_pdu(self);
 
-    if (packet) {
+    if (pdu) {
+        GBytes* packet = pdu->bytes;
         gsize pktsize;
         const guint8* pkt = g_bytes_get_data(packet, &pktsize);
         const guint hdr = (((guint)(pkt[0])) << 8) | pkt[1];
@@ -1451,7 +1530,7 @@ nfc_llc_send_next_pdu(
             GDEBUG("LLC transmit failed");
             nfc_llc_set_state(self, NFC_LLC_STATE_PEER_LOST);
         }
-        g_bytes_unref(packet);
+        nfc_llc_pdu_free(pdu);
     }
 }
 
@@ -1671,25 +1750,8 @@ nfc_llc_i_pdu_queued(
 {
     NfcLlcObject* self = nfc_llc_object_cast(llc);
 
-    if (G_LIKELY(self) && G_LIKELY(conn)) {
-        GList* l = g_list_first(self->pdu_queue);
-
-        if (l) {
-            const guint8 dsap = conn->rsap;
-            const guint8 ssap = conn->service->sap;
-            const guint hdr = LLCP_MAKE_HDR(dsap, LLCP_PTYPE_I, ssap);
-
-            do {
-                const guint8* pkt = g_bytes_get_data((GBytes*)l->data, NULL);
-
-                if (((((guint)(pkt[0])) << 8) | pkt[1]) == hdr) {
-                    return TRUE;
-                }
-                l = l->next;
-            } while (l);
-        }
-    }
-    return FALSE;
+    return G_LIKELY(self) && G_LIKELY(conn) &&
+        nfc_peer_connection_ps(conn)->queued > 0;
 }
 
 void
@@ -1775,7 +1837,7 @@ nfc_llc_submit_i_pdu(
          */
         ps->vra = ps->vr;
 
-        nfc_llc_submit(self, pdu);
+        nfc_llc_submit_full(self, pdu, conn);
         g_bytes_unref(pdu);
     }
 }
@@ -1824,7 +1886,7 @@ nfc_llc_object_finalize(
     nfc_llc_io_remove_all_handlers(self->io, self->io_event);
     nfc_llc_io_unref(self->io);
     g_hash_table_unref(self->conn_table);
-    g_list_free_full(self->pdu_queue, (GDestroyNotify) g_bytes_unref);
+    nfc_llc_clear_pdu_queue(self);
     g_slist_free_full(self->connect_queue, (GDestroyNotify)
         nfc_llc_connect_req_free);
     gutil_idle_pool_destroy(self->pool);
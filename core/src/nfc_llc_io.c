@@ -31,6 +31,7 @@
  */
 
 #include "nfc_llc_io_impl.h"
+#include "nfc_capture_p.h"
 
 #define GLOG_MODULE_NAME NFC_LLC_LOG_MODULE
 #include <gutil_log.h>
@@ -86,6 +87,8 @@ nfc_llc_io_receive(
 {
     gboolean ret = FALSE;
 
+    nfc_capture_frame(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_IN, data->bytes,
+        data->size);
     g_signal_emit(self, nfc_llc_io_signals[SIGNAL_RECEIVE], 0, data, &ret);
     return ret;
 }
@@ -128,6 +131,7 @@ nfc_llc_io_send(
     if (G_LIKELY(self)) {
         GASSERT(self->can_send);
         if (self->can_send) {
+            nfc_capture_bytes(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_OUT, data);
             return NFC_LLC_IO_GET_CLASS(self)->send(self, data);
         }
     }
@@ -32,6 +32,7 @@
 
 #include "nfc_llc_io_impl.h"
 #include "nfc_target_p.h"
+#include "nfc_capture_p.h"
 
 #define GLOG_MODULE_NAME NFC_LLC_LOG_MODULE
 #include <gutil_log.h>
@@ -164,6 +165,8 @@ nfc_llc_io_initiator_send_symm(
 
     GASSERT(!self->tx_id);
     io->can_send = FALSE;
+    nfc_capture_frame(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_OUT, SYMM,
+        sizeof(SYMM));
     self->tx_id = nfc_target_transmit(self->target, SYMM, sizeof(SYMM), NULL,
         nfc_llc_io_initiator_symm_transmit_done, NULL, self);
     if (self->tx_id) {
@@ -210,8 +213,6 @@ nfc_llc_io_initiator_send(
     NfcLlcIo* io,
     GBytes* send)
 {
-    gsize size;
-    const guint8* data = g_bytes_get_data(send, &size);
     NfcLlcIoInitiator* self = THIS(io);
 
     GASSERT(io->can_send);
@@ -222,7 +223,7 @@ nfc_llc_io_initiator_send(
     }
 
     io->can_send = FALSE;
-    self->tx_id = nfc_target_transmit(self->target, data, size, NULL,
+    self->tx_id = nfc_target_transmit_bytes(self->target, send, NULL,
         nfc_llc_io_initiator_pdu_transmit_done, NULL, self);
     if (self->tx_id) {
         return TRUE;
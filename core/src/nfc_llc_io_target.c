@@ -32,6 +32,7 @@
 
 #include "nfc_llc_io_impl.h"
 #include "nfc_initiator_p.h"
+#include "nfc_capture_p.h"
 
 #define GLOG_MODULE_NAME NFC_LLC_LOG_MODULE
 #include <gutil_log.h>
@@ -103,6 +104,8 @@ nfc_llc_io_target_transmission_handler(
             /* LLC isn't sending anything, respond with a SYMM */
             GDEBUG("< SYMM");
             io->can_send = FALSE;
+            nfc_capture_frame(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_OUT, SYMM,
+                sizeof(SYMM));
             if (nfc_transmission_respond(transmission, SYMM, sizeof(SYMM),
                 nfc_llc_io_target_response_sent, self)) {
             } else {
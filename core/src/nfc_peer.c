@@ -323,6 +323,13 @@ nfc_peer_deactivate(
     }
 }
 
+const NfcTargetStats*
+nfc_peer_stats(
+    NfcPeer* self) /* Since 1.2.1 */
+{
+    return G_LIKELY(self) ? GET_THIS_CLASS(self)->stats(self) : NULL;
+}
+
 gulong
 nfc_peer_add_wks_changed_handler(
     NfcPeer* self,
@@ -553,6 +560,14 @@ nfc_peer_nop(
 {
 }
 
+static
+const NfcTargetStats*
+nfc_peer_no_stats(
+    NfcPeer* self)
+{
+    return NULL;
+}
+
 static
 void
 nfc_peer_default_gone(
@@ -614,6 +629,7 @@ nfc_peer_class_init(
     g_type_class_add_private(klass, sizeof(NfcPeerPriv));
     klass->deactivate = nfc_peer_nop;
     klass->gone = nfc_peer_default_gone;
+    klass->stats = nfc_peer_no_stats;
     G_OBJECT_CLASS(klass)->finalize = nfc_peer_finalize;
     nfc_peer_signals[SIGNAL_WKS_CHANGED] =
         g_signal_new(SIGNAL_WKS_CHANGED_NAME, type,
@@ -53,6 +53,9 @@ typedef struct nfc_peer_connection_llcp_state {
      */
     guint8 rwr;         /* Remote Receive Window Size, RW(R) */
     guint16 rmiu;       /* Remote Maximum Information Unit size for I PDUs */
+
+    /* Not part of the spec */
+    guint queued;       /* Number of I PDUs sitting in NfcLlc queue */
 } NfcPeerConnectionLlcpState;
 
 #define LLCP_CONN_KEY(lsap,rsap)  GINT_TO_POINTER(\
@@ -114,6 +114,14 @@ nfc_peer_initiator_deactivate(
     NFC_PEER_CLASS(PARENT_CLASS)->deactivate(peer);
 }
 
+static
+const NfcTargetStats*
+nfc_peer_initiator_stats(
+    NfcPeer* peer)
+{
+    return nfc_target_stats(THIS(peer)->target);
+}
+
 /*==========================================================================*
  * Internals
  *==========================================================================*/
@@ -144,6 +152,7 @@ nfc_peer_initiator_class_init(
     NfcPeerInitiatorClass* klass)
 {
     klass->deactivate = nfc_peer_initiator_deactivate;
+    klass->stats = nfc_peer_initiator_stats;
     G_OBJECT_CLASS(klass)->finalize = nfc_peer_initiator_finalize;
 }
 
@@ -40,6 +40,7 @@ typedef struct nfc_peer_class {
     GObjectClass object;
     void (*deactivate)(NfcPeer* peer);
     void (*gone)(NfcPeer* peer);
+    const NfcTargetStats* (*stats)(NfcPeer* peer);
 } NfcPeerClass;
 
 #define NFC_PEER_CLASS(klass) G_TYPE_CHECK_CLASS_CAST((klass), \
@@ -65,11 +65,13 @@ G_DEFINE_TYPE(NfcTag, nfc_tag, PARENT_TYPE)
 enum nfc_tag_signal {
     SIGNAL_INITIALIZED,
     SIGNAL_GONE,
+    SIGNAL_NDEF_CHANGED,
     SIGNAL_COUNT
 };
 
 #define SIGNAL_INITIALIZED_NAME "nfc-tag-initialized"
 #define SIGNAL_GONE_NAME        "nfc-tag-gone"
+#define SIGNAL_NDEF_CHANGED_NAME "nfc-tag-ndef-changed"
 
 static guint nfc_tag_signals[SIGNAL_COUNT] = { 0 };
 
@@ -158,6 +160,16 @@ nfc_tag_add_gone_handler(
         SIGNAL_GONE_NAME, G_CALLBACK(func), user_data) : 0;
 }
 
+gulong
+nfc_tag_add_ndef_changed_handler(
+    NfcTag* self,
+    NfcTagFunc func,
+    void* user_data) /* Since 1.2.1 */
+{
+    return (G_LIKELY(self) && G_LIKELY(func)) ? g_signal_connect(self,
+        SIGNAL_NDEF_CHANGED_NAME, G_CALLBACK(func), user_data) : 0;
+}
+
 void
 nfc_tag_remove_handler(
     NfcTag* self,
@@ -268,6 +280,18 @@ nfc_tag_set_initialized(
     }
 }
 
+void
+nfc_tag_set_ndef(
+    NfcTag* self,
+    NfcNdefRec* ndef) /* Takes ownership */
+{
+    ndef_rec_unref(self->ndef);
+    self->ndef = ndef;
+    if (self->flags & NFC_TAG_FLAG_INITIALIZED) {
+        g_signal_emit(self, nfc_tag_signals[SIGNAL_NDEF_CHANGED], 0);
+    }
+}
+
 /*==========================================================================*
  * Methods
  *==========================================================================*/
@@ -325,6 +349,9 @@ nfc_tag_class_init(
     nfc_tag_signals[SIGNAL_GONE] =
         g_signal_new(SIGNAL_GONE_NAME, G_OBJECT_CLASS_TYPE(klass),
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+    nfc_tag_signals[SIGNAL_NDEF_CHANGED] =
+        g_signal_new(SIGNAL_NDEF_CHANGED_NAME, G_OBJECT_CLASS_TYPE(klass),
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 
 /*
@@ -0,0 +1,572 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nfc_tag_cache.h"
+#include "nfc_log.h"
+
+#include <gutil_misc.h>
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * Cache file layout (multi-byte numbers are big-endian):
+ *
+ * +-----------------------------------------+
+ * | Magic "NFCT"                 (4 bytes)  |
+ * | Format version               (1 byte)   |
+ * | Reserved, zero               (1 byte)   |
+ * | Key size                     (2 bytes)  |
+ * | Data size                    (4 bytes)  |
+ * | Key                          (N bytes)  |
+ * | Data                         (M bytes)  |
+ * +-----------------------------------------+
+ *
+ * The whole file gets mapped into memory, key and data are used in place.
+ * The file modification time is updated on each cache hit, which keeps
+ * the least recently used files at the beginning of the list sorted by
+ * modification time.
+ *
+ * Files are named <type>-<UID in hex> and live in their own subdirectory
+ * of the configured directory. Nothing else gets evicted. The directory
+ * is only scanned when the cache is configured, after that the sizes
+ * and access times are tracked in memory.
+ *
+ * A few most recently used entries can also be kept in memory, keyed
+ * by whatever the tag type considers appropriate. Like the files, the
+ * memory entries are only there while the cache is configured.
+ */
+
+#define NFC_TAG_CACHE_VERSION (1)
+#define NFC_TAG_CACHE_HEADER_SIZE (12)
+#define NFC_TAG_CACHE_DIR_PERM (0700)
+#define NFC_TAG_CACHE_FILE_PERM (0600)
+#define NFC_TAG_CACHE_MEM_SIZE (16)
+
+static const guint8 nfc_tag_cache_magic[] = { 'N', 'F', 'C', 'T' };
+
+typedef struct nfc_tag_cache_config {
+    char* dir;
+    gsize max_size;
+    gsize total;        /* Total size of the indexed files */
+    GHashTable* files;  /* Name => NfcTagCacheFile */
+    GHashTable* mem;    /* Type + id => NfcTagCacheMem */
+    GQueue mem_lru;     /* NfcTagCacheMem, most recently used first */
+} NfcTagCacheConfig;
+
+typedef struct nfc_tag_cache_entry_priv {
+    NfcTagCacheEntry pub;
+    GMappedFile* map;
+    void* buf;          /* Copy of the key and data, if not mapped */
+} NfcTagCacheEntryPriv;
+
+typedef struct nfc_tag_cache_file {
+    char* name;
+    gint64 atime;       /* Last access, microseconds since the epoch */
+    gsize size;
+} NfcTagCacheFile;
+
+typedef struct nfc_tag_cache_mem {
+    GList link;         /* Node in the LRU queue */
+    GBytes* id;         /* Type + id, also the hashtable key */
+    NfcTagCacheEntry* entry;
+} NfcTagCacheMem;
+
+static NfcTagCacheConfig nfc_tag_cache_config = {
+    NULL, 0, 0, NULL, NULL, G_QUEUE_INIT
+};
+
+static
+char*
+nfc_tag_cache_name(
+    const char* type,
+    const GUtilData* uid)
+{
+    if (nfc_tag_cache_config.dir && uid && uid->size) {
+        GString* buf = g_string_new(type);
+        gsize i;
+
+        g_string_append_c(buf, '-');
+        for (i = 0; i < uid->size; i++) {
+            g_string_append_printf(buf, "%02X", uid->bytes[i]);
+        }
+        return g_string_free(buf, FALSE);
+    }
+    return NULL;
+}
+
+static
+gboolean
+nfc_tag_cache_name_valid(
+    const char* name)
+{
+    const char* sep = strrchr(name, '-');
+    const char* ptr;
+
+    /* Must be <type>-<UID> where UID is an even number of hex digits */
+    if (!sep || sep == name || !sep[1] || (strlen(sep + 1) % 2)) {
+        return FALSE;
+    }
+    for (ptr = name; ptr < sep; ptr++) {
+        if (!g_ascii_isalnum(*ptr)) {
+            return FALSE;
+        }
+    }
+    for (ptr = sep + 1; *ptr; ptr++) {
+        if (!g_ascii_isxdigit(*ptr) || g_ascii_islower(*ptr)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+void
+nfc_tag_cache_file_free(
+    gpointer data)
+{
+    NfcTagCacheFile* file = data;
+
+    g_free(file->name);
+    g_slice_free(NfcTagCacheFile, file);
+}
+
+static
+void
+nfc_tag_cache_index_update(
+    const char* name,
+    gsize size,
+    gint64 atime)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+    NfcTagCacheFile* file = g_hash_table_lookup(config->files, name);
+
+    if (file) {
+        config->total -= file->size;
+    } else {
+        file = g_slice_new(NfcTagCacheFile);
+        file->name = g_strdup(name);
+        g_hash_table_insert(config->files, file->name, file);
+    }
+    file->atime = atime;
+    file->size = size;
+    config->total += size;
+}
+
+static
+void
+nfc_tag_cache_index_remove(
+    const char* name)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+    NfcTagCacheFile* file = g_hash_table_lookup(config->files, name);
+
+    if (file) {
+        config->total -= file->size;
+        g_hash_table_remove(config->files, name);
+    }
+}
+
+static
+void
+nfc_tag_cache_scan(
+    void)
+{
+    const char* dir = nfc_tag_cache_config.dir;
+    GDir* d = g_dir_open(dir, 0, NULL);
+
+    if (d) {
+        const char* name;
+
+        while ((name = g_dir_read_name(d)) != NULL) {
+            if (nfc_tag_cache_name_valid(name)) {
+                char* path = g_build_filename(dir, name, NULL);
+                GStatBuf st;
+
+                if (!g_stat(path, &st) && S_ISREG(st.st_mode)) {
+                    nfc_tag_cache_index_update(name, st.st_size,
+                        (gint64)st.st_mtime * G_USEC_PER_SEC);
+                }
+                g_free(path);
+            }
+        }
+        g_dir_close(d);
+    }
+}
+
+static
+gint
+nfc_tag_cache_file_compare(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const NfcTagCacheFile* f1 = a;
+    const NfcTagCacheFile* f2 = b;
+
+    return (f1->atime < f2->atime) ? (-1) : (f1->atime > f2->atime) ? 1 : 0;
+}
+
+static
+void
+nfc_tag_cache_evict(
+    void)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+
+    if (config->max_size && config->total > config->max_size) {
+        GList* files = g_list_sort(g_hash_table_get_values(config->files),
+            nfc_tag_cache_file_compare);
+        GList* l;
+
+        /* Delete the least recently used files first */
+        for (l = files; l && config->total > config->max_size; l = l->next) {
+            NfcTagCacheFile* file = l->data;
+            char* path = g_build_filename(config->dir, file->name, NULL);
+
+            GDEBUG("Evicting %s", path);
+            if (!g_unlink(path) || errno == ENOENT) {
+                nfc_tag_cache_index_remove(file->name);
+            }
+            g_free(path);
+        }
+        g_list_free(files);
+    }
+}
+
+static
+void
+nfc_tag_cache_mem_free(
+    gpointer data)
+{
+    NfcTagCacheMem* mem = data;
+
+    g_queue_unlink(&nfc_tag_cache_config.mem_lru, &mem->link);
+    g_bytes_unref(mem->id);
+    nfc_tag_cache_entry_free(mem->entry);
+    g_slice_free(NfcTagCacheMem, mem);
+}
+
+static
+GBytes*
+nfc_tag_cache_mem_id(
+    const char* type,
+    const GUtilData* id)
+{
+    const gsize type_len = strlen(type) + 1; /* Including NUL */
+    guint8* buf = g_malloc(type_len + id->size);
+
+    memcpy(buf, type, type_len);
+    memcpy(buf + type_len, id->bytes, id->size);
+    return g_bytes_new_take(buf, type_len + id->size);
+}
+
+/*==========================================================================*
+ * Internal interface
+ *==========================================================================*/
+
+void
+nfc_tag_cache_configure(
+    const char* dir,
+    gsize max_size)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+
+    g_free(config->dir);
+    if (config->files) {
+        g_hash_table_destroy(config->files);
+        config->files = NULL;
+    }
+    if (config->mem) {
+        g_hash_table_destroy(config->mem);
+        config->mem = NULL;
+    }
+    config->total = 0;
+    config->max_size = max_size;
+    if (dir) {
+        config->dir = g_build_filename(dir, NFC_TAG_CACHE_SUBDIR, NULL);
+        config->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+            NULL, nfc_tag_cache_file_free);
+        GDEBUG("Tag cache %s (%lu bytes max)", config->dir, (gulong)
+            max_size);
+        nfc_tag_cache_scan();
+        nfc_tag_cache_evict();
+    } else {
+        config->dir = NULL;
+    }
+}
+
+NfcTagCacheEntry*
+nfc_tag_cache_entry_new(
+    const GUtilData* key,
+    const GUtilData* data)
+{
+    NfcTagCacheEntryPriv* priv = g_slice_new(NfcTagCacheEntryPriv);
+    NfcTagCacheEntry* entry = &priv->pub;
+    guint8* buf = g_malloc(key->size + data->size);
+
+    /* Key and data share the same buffer */
+    memcpy(buf, key->bytes, key->size);
+    memcpy(buf + key->size, data->bytes, data->size);
+    priv->map = NULL;
+    priv->buf = buf;
+    entry->key.bytes = buf;
+    entry->key.size = key->size;
+    entry->data.bytes = buf + key->size;
+    entry->data.size = data->size;
+    return entry;
+}
+
+NfcTagCacheEntry*
+nfc_tag_cache_get(
+    const char* type,
+    const GUtilData* uid)
+{
+    char* name = nfc_tag_cache_name(type, uid);
+    NfcTagCacheEntry* entry = NULL;
+
+    if (name) {
+        char* path = g_build_filename(nfc_tag_cache_config.dir, name, NULL);
+        GMappedFile* map = g_mapped_file_new(path, FALSE, NULL);
+
+        if (map) {
+            const guint8* ptr = (guint8*) g_mapped_file_get_contents(map);
+            const gsize size = g_mapped_file_get_length(map);
+
+            if (size >= NFC_TAG_CACHE_HEADER_SIZE &&
+                !memcmp(ptr, nfc_tag_cache_magic, sizeof(nfc_tag_cache_magic))
+                && ptr[4] == NFC_TAG_CACHE_VERSION) {
+                const gsize key_size = ((gsize)ptr[6] << 8) | ptr[7];
+                const gsize data_size = ((gsize)ptr[8] << 24) |
+                    ((gsize)ptr[9] << 16) | ((gsize)ptr[10] << 8) | ptr[11];
+
+                if (size == NFC_TAG_CACHE_HEADER_SIZE + key_size + data_size) {
+                    NfcTagCacheEntryPriv* priv =
+                        g_slice_new(NfcTagCacheEntryPriv);
+
+                    entry = &priv->pub;
+                    priv->map = map;
+                    priv->buf = NULL;
+                    entry->key.bytes = ptr + NFC_TAG_CACHE_HEADER_SIZE;
+                    entry->key.size = key_size;
+                    entry->data.bytes = entry->key.bytes + key_size;
+                    entry->data.size = data_size;
+
+                    /* Most recently used */
+                    g_utime(path, NULL);
+                    nfc_tag_cache_index_update(name, size,
+                        g_get_real_time());
+                    GDEBUG("Cache hit %s", path);
+                }
+            }
+            if (!entry) {
+                GWARN("Dropping invalid cache file %s", path);
+                g_mapped_file_unref(map);
+                g_unlink(path);
+                nfc_tag_cache_index_remove(name);
+            }
+        }
+        g_free(path);
+        g_free(name);
+    }
+    return entry;
+}
+
+void
+nfc_tag_cache_entry_free(
+    NfcTagCacheEntry* entry)
+{
+    if (entry) {
+        NfcTagCacheEntryPriv* priv = G_CAST(entry, NfcTagCacheEntryPriv, pub);
+
+        if (priv->map) {
+            g_mapped_file_unref(priv->map);
+        }
+        g_free(priv->buf);
+        g_slice_free(NfcTagCacheEntryPriv, priv);
+    }
+}
+
+void
+nfc_tag_cache_put(
+    const char* type,
+    const GUtilData* uid,
+    const GUtilData* key,
+    const GUtilData* data)
+{
+    char* name = nfc_tag_cache_name(type, uid);
+
+    if (name) {
+        const char* dir = nfc_tag_cache_config.dir;
+        char* path = g_build_filename(dir, name, NULL);
+
+        if (g_mkdir_with_parents(dir, NFC_TAG_CACHE_DIR_PERM) < 0) {
+            GWARN("Failed to create %s: %s", dir, strerror(errno));
+        } else {
+            const gsize size = NFC_TAG_CACHE_HEADER_SIZE + key->size +
+                data->size;
+            guint8* buf = g_malloc(size);
+            guint8* ptr = buf;
+            GError* error = NULL;
+
+            memcpy(ptr, nfc_tag_cache_magic, sizeof(nfc_tag_cache_magic));
+            ptr += sizeof(nfc_tag_cache_magic);
+            *ptr++ = NFC_TAG_CACHE_VERSION;
+            *ptr++ = 0;
+            *ptr++ = (guint8)(key->size >> 8);
+            *ptr++ = (guint8)key->size;
+            *ptr++ = (guint8)(data->size >> 24);
+            *ptr++ = (guint8)(data->size >> 16);
+            *ptr++ = (guint8)(data->size >> 8);
+            *ptr++ = (guint8)data->size;
+            memcpy(ptr, key->bytes, key->size);
+            ptr += key->size;
+            memcpy(ptr, data->bytes, data->size);
+
+            /* g_file_set_contents() replaces the file atomically */
+            if (g_file_set_contents(path, (char*)buf, size, &error)) {
+                g_chmod(path, NFC_TAG_CACHE_FILE_PERM);
+                GDEBUG("Cached %u byte(s) in %s", (guint)data->size, path);
+                nfc_tag_cache_index_update(name, size, g_get_real_time());
+                nfc_tag_cache_evict();
+            } else {
+                GWARN("%s", GERRMSG(error));
+                g_error_free(error);
+            }
+            g_free(buf);
+        }
+        g_free(path);
+        g_free(name);
+    }
+}
+
+NfcTagCacheEntry*
+nfc_tag_cache_mem_get(
+    const char* type,
+    const GUtilData* id)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+
+    if (config->mem) {
+        GBytes* key = nfc_tag_cache_mem_id(type, id);
+        NfcTagCacheMem* mem = g_hash_table_lookup(config->mem, key);
+
+        g_bytes_unref(key);
+        if (mem) {
+            /* Most recently used */
+            g_queue_unlink(&config->mem_lru, &mem->link);
+            g_queue_push_head_link(&config->mem_lru, &mem->link);
+            return nfc_tag_cache_entry_new(&mem->entry->key,
+                &mem->entry->data);
+        }
+    }
+    return NULL;
+}
+
+void
+nfc_tag_cache_mem_put(
+    const char* type,
+    const GUtilData* id,
+    const GUtilData* key,
+    const GUtilData* data)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+
+    if (config->dir) {
+        NfcTagCacheMem* mem = g_slice_new0(NfcTagCacheMem);
+
+        if (!config->mem) {
+            config->mem = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                NULL, nfc_tag_cache_mem_free);
+        }
+        mem->link.data = mem;
+        mem->id = nfc_tag_cache_mem_id(type, id);
+        mem->entry = nfc_tag_cache_entry_new(key, data);
+
+        /* This frees the old entry (and its key), if there was one */
+        g_hash_table_replace(config->mem, mem->id, mem);
+        g_queue_push_head_link(&config->mem_lru, &mem->link);
+        while (config->mem_lru.length > NFC_TAG_CACHE_MEM_SIZE) {
+            mem = g_queue_peek_tail(&config->mem_lru);
+            g_hash_table_remove(config->mem, mem->id);
+        }
+    }
+}
+
+void
+nfc_tag_cache_mem_drop(
+    const char* type,
+    const GUtilData* id)
+{
+    NfcTagCacheConfig* config = &nfc_tag_cache_config;
+
+    if (config->mem) {
+        GBytes* key = nfc_tag_cache_mem_id(type, id);
+
+        g_hash_table_remove(config->mem, key);
+        g_bytes_unref(key);
+    }
+}
+
+void
+nfc_tag_cache_drop(
+    const char* type,
+    const GUtilData* uid)
+{
+    char* name = nfc_tag_cache_name(type, uid);
+
+    if (name) {
+        char* path = g_build_filename(nfc_tag_cache_config.dir, name, NULL);
+
+        if (!g_unlink(path)) {
+            GDEBUG("Dropped %s", path);
+        }
+        nfc_tag_cache_index_remove(name);
+        g_free(path);
+        g_free(name);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
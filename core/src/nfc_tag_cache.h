@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef NFC_TAG_CACHE_H
+#define NFC_TAG_CACHE_H
+
+#include "nfc_types_p.h"
+
+#include "internal/nfc_tag_cache_i.h"
+
+/*
+ * Persistent tag cache maps tag UIDs to the contents of tags. Each tag
+ * gets a file containing a key (something that has to match before
+ * the cached data can be trusted, e.g. lock bytes and CC) and the data.
+ * The least recently used files are deleted when the total size of
+ * the cache exceeds the limit.
+ */
+
+/* Subdirectory of the configured directory where the files are kept */
+#define NFC_TAG_CACHE_SUBDIR "tags"
+
+typedef struct nfc_tag_cache_entry {
+    GUtilData key;
+    GUtilData data;
+} NfcTagCacheEntry;
+
+/* Makes a standalone copy, not backed by a file */
+NfcTagCacheEntry*
+nfc_tag_cache_entry_new(
+    const GUtilData* key,
+    const GUtilData* data)
+    NFCD_INTERNAL;
+
+NfcTagCacheEntry*
+nfc_tag_cache_get(
+    const char* type,
+    const GUtilData* uid)
+    NFCD_INTERNAL;
+
+void
+nfc_tag_cache_entry_free(
+    NfcTagCacheEntry* entry)
+    NFCD_INTERNAL;
+
+void
+nfc_tag_cache_put(
+    const char* type,
+    const GUtilData* uid,
+    const GUtilData* key,
+    const GUtilData* data)
+    NFCD_INTERNAL;
+
+void
+nfc_tag_cache_drop(
+    const char* type,
+    const GUtilData* uid)
+    NFCD_INTERNAL;
+
+/*
+ * Small in-memory LRU in front of the files, with arbitrary ids.
+ * Also only works if the cache is configured.
+ */
+NfcTagCacheEntry*
+nfc_tag_cache_mem_get(
+    const char* type,
+    const GUtilData* id)
+    NFCD_INTERNAL;
+
+void
+nfc_tag_cache_mem_put(
+    const char* type,
+    const GUtilData* id,
+    const GUtilData* key,
+    const GUtilData* data)
+    NFCD_INTERNAL;
+
+void
+nfc_tag_cache_mem_drop(
+    const char* type,
+    const GUtilData* id)
+    NFCD_INTERNAL;
+
+#endif /* NFC_TAG_CACHE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -57,6 +57,15 @@ nfc_tag_t2_new(
     const NfcParamPollA* poll_a)
     NFCD_INTERNAL;
 
+/*
+ * Number of command contexts allocated by Type 2 tags. The contexts
+ * are recycled, in a steady transmit/complete loop it doesn't grow.
+ */
+guint
+nfc_tag_t2_alloc_count(
+    void)
+    NFCD_INTERNAL;
+
 void
 nfc_tag_init_base(
     NfcTag* tag,
@@ -75,6 +84,12 @@ nfc_tag_set_initialized(
     NfcTag* tag)
     NFCD_INTERNAL;
 
+void
+nfc_tag_set_ndef(
+    NfcTag* tag,
+    NfcNdefRec* ndef) /* Takes ownership */
+    NFCD_INTERNAL;
+
 #endif /* NFC_TAG_PRIVATE_H */
 
 /*
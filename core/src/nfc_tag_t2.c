@@ -40,10 +40,13 @@
 
 #include "nfc_tag_p.h"
 #include "nfc_tag_t2.h"
+#include "nfc_tag_cache.h"
 #include "nfc_target_p.h"
 #include "nfc_util.h"
 #include "nfc_log.h"
 
+#include "internal/nfc_tag_t2_i.h"
+
 #include <nfcdef.h>
 
 #include <gutil_misc.h>
@@ -58,6 +61,16 @@
 #define NFC_TAG_T2_CC_MIN_VERSION (0x10)
 
 #define NXP_MANUFACTURER_ID (0x04)
+#define NXP_PRODUCT_TYPE_ULTRALIGHT (0x03)
+#define NXP_PRODUCT_TYPE_NTAG (0x04)
+
+/*
+ * Each sector contains 256 blocks. Only the first sector has a header
+ * (UID, lock bytes and CC), in the following sectors data continue
+ * from the block 0.
+ */
+#define NFC_TAG_T2_SECTOR_BLOCKS (256)
+#define NFC_TAG_T2_SECTOR_UNKNOWN ((guint)-1)
 
 /*
  * Command set.
@@ -67,25 +80,89 @@
  */
 #define NFC_TAG_T2_CMD_READ (0x30)
 #define NFC_TAG_T2_CMD_WRITE (0xa2)
+#define NFC_TAG_T2_CMD_SECTOR_SELECT (0xc2)
+
+/* READ always returns 4 blocks */
+#define NFC_TAG_T2_READ_BLOCKS (4)
+
+/*
+ * NXP extensions (NTAG21x, NTAG I2C, MIFARE Ultralight EV1)
+ *
+ * FAST_READ returns the requested range of blocks in one frame. The
+ * range is limited by the maximum frame size which the reader accepts
+ * (FSD). It's 256 bytes including 2 bytes of CRC, i.e. 63 blocks.
+ */
+#define NFC_TAG_T2_CMD_GET_VERSION (0x60)
+#define NFC_TAG_T2_CMD_FAST_READ (0x3a)
+#define NFC_TAG_T2_VERSION_SIZE (8)
+#define NFC_TAG_T2_FAST_READ_MAX_BLOCKS (63)
+
+#define NFC_TAG_T2_ACK (0x0a)
+#define NFC_TAG_T2_ACK_MASK (0x0f)
+
+/* NFCForum-TS-Type-2-Tag 2.3 "TLV blocks" */
+#define NFC_TAG_T2_TLV_NULL (0x00)
+#define NFC_TAG_T2_TLV_NDEF (0x03)
+#define NFC_TAG_T2_TLV_TERMINATOR (0xfe)
+
+/* Persistent cache entries are keyed by UID and the first 4 blocks */
+#define NFC_TAG_T2_CACHE_TYPE "t2"
+#define NFC_TAG_T2_CACHE_KEY_SIZE (16)
+
+/* How long the target has to stay idle before we start prefetching */
+#define NFC_TAG_T2_PREFETCH_DELAY_MS (100)
+
+/* Limit for backing off while others keep the target busy */
+#define NFC_TAG_T2_PREFETCH_MAX_DELAY_MS (3200)
+
+/* Number of command contexts kept for reuse */
+#define NFC_TAG_T2_CMD_POOL_SIZE (4)
+
+typedef struct nfc_tag_t2_sector_select NfcTagType2SectorSelect;
 
-typedef struct nfc_tag_t2_cmd_data {
+typedef struct nfc_tag_t2_cmd_data NfcTagType2Cmd;
+struct nfc_tag_t2_cmd_data {
+    NfcTagType2Cmd* next;   /* Only used by the pool */
     NfcTagType2* t2;
     NfcTagType2ReadFunc resp;
     GDestroyNotify destroy;
     void* user_data;
-} NfcTagType2Cmd;
+    NfcTagType2SectorSelect* select;
+};
+
+struct nfc_tag_t2_sector_select {
+    NfcTagType2* t2;
+    guint sector;
+    guint select_id;        /* SECTOR_SELECT packet 1 */
+    guint ack_id;           /* SECTOR_SELECT packet 2 */
+    guint cmd_id;           /* The command following SECTOR_SELECT */
+    NfcTagType2Cmd* cmd;
+};
+
+/* Data blocks being read by a command which is in progress */
+typedef struct nfc_tag_t2_fetch {
+    guint block;
+    guint count;
+    NfcTargetSequence* seq; /* Not referenced, owned by the reader */
+} NfcTagType2Fetch;
 
 typedef struct nfc_tag_t2_read_data {
     NfcTagType2* t2;
     guint8* buffer;
     guint size;
     guint read;
-    guint offset;
+    guint sector;   /* Only for block reads */
+    guint offset;   /* Data offset or sector offset for block reads */
     guint complete_id;
     guint cmd_id;
     guint seq_id;
     NfcTargetSequence* seq;
-    NfcTagType2ReadDataFunc complete;
+    NfcTagType2Fetch fetch;
+    union nfc_tag_t2_read_data_complete {
+        GCallback cb;
+        NfcTagType2ReadFunc read_cb;
+        NfcTagType2ReadDataFunc read_data_cb;
+    } complete;
     GDestroyNotify destroy;
     void* user_data;
 } NfcTagType2ReadData;
@@ -98,8 +175,18 @@ typedef struct nfc_tag_t2_write_data {
     guint written;
     guint cmd_id;
     guint seq_id;
+    guint complete_id;
     gulong start_id;
     NfcTargetSequence* seq;
+    guint8* image;      /* New contents of the affected data blocks */
+    guint first_block;  /* The first affected data block */
+    guint nblocks;      /* Number of affected data blocks */
+    guint fetch_block;  /* The first data block being fetched */
+    guint* order;       /* Data blocks to write, in this order */
+    const guint8** src; /* Contents of each block in the order */
+    guint8* len_data;   /* NDEF length blocks, zeroed and final */
+    guint count;        /* Number of blocks to write */
+    guint pos;          /* Index of the block being written */
     union nfc_tag_t2_write_data_complete {
         GCallback cb;
         NfcTagType2WriteFunc write_cb;
@@ -109,20 +196,49 @@ typedef struct nfc_tag_t2_write_data {
     void* user_data;
 } NfcTagType2WriteData;
 
+#define VALID_WORD_BITS (64)
+#define VALID_WORD(block) ((block) / VALID_WORD_BITS)
+#define VALID_BIT(block) (G_GUINT64_CONSTANT(1) << ((block) % VALID_WORD_BITS))
+
 typedef struct nfc_tag_t2_sector {
     guint size;             /* Number of bytes in the sector */
     guint8* bytes;          /* Sector's contents (not necessarily valid) */
-    guint8* valid;          /* One bit per block, 1 = cached, 0 = dirty */
+    guint64* valid;         /* One bit per block, 1 = cached, 0 = dirty */
     GUtilData data;         /* Data portion of the sector */
 } NfcTagType2Sector;
 
+/* Maps data block number to the sector and block within the sector */
+typedef struct nfc_tag_t2_block_map {
+    guint16 sector;
+    guint16 block;
+} NfcTagType2BlockMap;
+
 struct nfc_tag_t2_priv {
     NfcTargetSequence* init_seq;
     GHashTable* reads;
     GHashTable* writes;
-    GByteArray* cached_blocks;
+    guint8* mem;            /* Contents of all sectors */
     guint sector_count;
     NfcTagType2Sector* sectors;
+    guint data_blocks;
+    NfcTagType2BlockMap* block_map;
+    guint sector;           /* Currently selected sector */
+    GSList* selects;        /* Pending SECTOR_SELECT commands */
+    gboolean fast_read;     /* FAST_READ is supported */
+    guint ndef_end;         /* End of the NDEF TLV in the data area */
+    NfcTagCacheEntry* cache; /* Persistent cache entry to validate */
+    GBytes* select_cmd;     /* SECTOR_SELECT packet 1 */
+    guint prefetch_block;   /* Data block to continue prefetching from */
+    guint prefetch_id;
+    guint prefetch_timer;
+    guint prefetch_delay;   /* Current back-off interval, milliseconds */
+    gulong prefetch_seq_id; /* Waiting for the sequence to finish */
+    NfcTargetSequence* prefetch_seq;
+    NfcTagType2Fetch prefetch;
+    GSList* fetches;        /* NfcTagType2Fetch, reads in progress */
+    GSList* waiters;        /* NfcTagType2ReadData waiting for fetches */
+    GSList* waking;         /* Waiters being resumed */
+    guint wake_id;          /* Resumes the waiters if a fetch is aborted */
     guint init_id;
 };
 
@@ -137,6 +253,92 @@ typedef struct nfc_tag_t2_class {
 
 G_DEFINE_TYPE(NfcTagType2, nfc_tag_t2, PARENT_TYPE)
 
+/*
+ * Command contexts are recycled. The pool is shared by all tags because
+ * a command may complete after the tag that has sent it is gone.
+ */
+static NfcTagType2Cmd* nfc_tag_t2_cmd_pool = NULL;
+static guint nfc_tag_t2_cmd_pool_size = 0;
+static guint nfc_tag_t2_cmd_allocs = 0;
+static gboolean nfc_tag_t2_prefetch_enabled = FALSE;
+
+static inline
+guint
+nfc_tag_t2_ctz64(
+    guint64 word) /* Must be non-zero */
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    guint n = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline
+gboolean
+nfc_tag_t2_sector_block_valid(
+    const NfcTagType2Sector* sector,
+    guint block)
+{
+    return (sector->valid[VALID_WORD(block)] & VALID_BIT(block)) != 0;
+}
+
+static
+void
+nfc_tag_t2_sector_mark_blocks(
+    NfcTagType2Sector* sector,
+    guint block,
+    guint num_blocks,
+    gboolean valid)
+{
+    while (num_blocks > 0) {
+        const guint bit = block % VALID_WORD_BITS;
+        const guint n = MIN(num_blocks, VALID_WORD_BITS - bit);
+        const guint64 mask = ((n == VALID_WORD_BITS) ? G_MAXUINT64 :
+            ((G_GUINT64_CONSTANT(1) << n) - 1)) << bit;
+
+        if (valid) {
+            sector->valid[VALID_WORD(block)] |= mask;
+        } else {
+            sector->valid[VALID_WORD(block)] &= ~mask;
+        }
+        block += n;
+        num_blocks -= n;
+    }
+}
+
+/* Returns the number of consecutive valid blocks (up to max) */
+static
+guint
+nfc_tag_t2_sector_valid_run(
+    const NfcTagType2Sector* sector,
+    guint block,
+    guint max)
+{
+    guint run = 0;
+
+    while (run < max) {
+        const guint bit = block % VALID_WORD_BITS;
+        const guint64 invalid = ~sector->valid[VALID_WORD(block)] >> bit;
+
+        if (invalid) {
+            /* Found the end of the run */
+            run += nfc_tag_t2_ctz64(invalid);
+            break;
+        } else {
+            run += VALID_WORD_BITS - bit;
+            block += VALID_WORD_BITS - bit;
+        }
+    }
+    return MIN(run, max);
+}
+
 static
 NfcTagType2Sector*
 nfc_tag_t2_data_block_to_sector(
@@ -145,49 +347,119 @@ nfc_tag_t2_data_block_to_sector(
     guint* bno, /* block number relative to the start of sector */
     gboolean* cached)
 {
-    guint i;
-    guint sector_start = 0;
-    const guint block_size = self->block_size;
     NfcTagType2Priv* priv = self->priv;
 
+    if (block < priv->data_blocks) {
+        const NfcTagType2BlockMap* map = priv->block_map + block;
+        NfcTagType2Sector* sector = priv->sectors + map->sector;
+
+        if (bno) {
+            *bno = map->block;
+        }
+        if (cached) {
+            *cached = nfc_tag_t2_sector_block_valid(sector, map->block);
+        }
+        return sector;
+    }
+    return NULL;
+}
+
+static
+void
+nfc_tag_t2_update_block_map(
+    NfcTagType2* self)
+{
+    NfcTagType2Priv* priv = self->priv;
+    const guint block_size = self->block_size;
+    guint i, k = 0;
+
+    priv->data_blocks = 0;
+    for (i = 0; i < priv->sector_count; i++) {
+        priv->data_blocks += priv->sectors[i].data.size / block_size;
+    }
+
+    g_free(priv->block_map);
+    priv->block_map = g_new(NfcTagType2BlockMap, priv->data_blocks);
     for (i = 0; i < priv->sector_count; i++) {
-        NfcTagType2Sector* sector = priv->sectors + i;
+        const NfcTagType2Sector* sector = priv->sectors + i;
         const GUtilData* data = &sector->data;
-        const guint data_blocks = data->size / block_size;
+        const guint first = (data->bytes - sector->bytes) / block_size;
+        const guint last = first + data->size / block_size;
+        guint b;
 
-        if (block < (sector_start + data_blocks)) {
-            const guint header = data->bytes - sector->bytes;
-            const guint rel_block = block - sector_start + header / block_size;
+        for (b = first; b < last; b++) {
+            NfcTagType2BlockMap* map = priv->block_map + (k++);
 
-            if (bno) {
-                *bno = rel_block;
-            }
-            if (cached) {
-                const guint8 bit = (1 << (rel_block % 8));
+            map->sector = i;
+            map->block = b;
+        }
+    }
+}
+
+/*
+ * Copies (if buffer isn't NULL) cached data starting at the given offset,
+ * stops at the first block which isn't cached. Returns the number of
+ * bytes available in the cache, up to size.
+ */
+static
+guint
+nfc_tag_t2_read_cached(
+    NfcTagType2* self,
+    guint offset,
+    guint size,
+    guint8* buffer)
+{
+    const guint block_size = self->block_size;
+    guint done = 0;
+
+    while (done < size) {
+        const guint pos = offset + done;
+        guint bno;
+        NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self,
+            pos / block_size, &bno, NULL);
 
-                *cached = ((sector->valid[rel_block / 8] & bit) != 0);
+        if (sector) {
+            const GUtilData* data = &sector->data;
+            const guint data_end = (data->bytes - sector->bytes +
+                data->size) / block_size;
+            const guint nb = nfc_tag_t2_sector_valid_run(sector, bno,
+                data_end - bno);
+            const guint skip = pos % block_size;
+            const guint n = MIN(nb * block_size - MIN(nb * block_size, skip),
+                size - done);
+
+            if (n) {
+                if (buffer) {
+                    memcpy(buffer + done, sector->bytes + bno * block_size +
+                        skip, n);
+                }
+                done += n;
+                if (bno + nb == data_end) {
+                    /* Continue with the next sector */
+                    continue;
+                }
             }
-            return sector;
         }
-        sector_start += data_blocks;
+        break;
     }
-    return NULL;
+    return done;
 }
 
 static
 void
 nfc_tag_t2_sector_init(
     NfcTagType2Sector* sector,
+    guint8* bytes, /* Not owned by the sector */
     guint block_size,
     guint header_blocks,
-    guint data_blocks,
-    guint trailer_blocks)
+    guint data_blocks)
 {
-    const guint total_blocks = header_blocks + data_blocks + trailer_blocks;
+    const guint total_blocks = header_blocks + data_blocks;
 
     sector->size = total_blocks * block_size;
-    sector->bytes = g_malloc0(sector->size);
-    sector->valid = g_malloc0((total_blocks + 7) / 8);
+    sector->bytes = bytes;
+    sector->valid = g_new0(guint64, (total_blocks + VALID_WORD_BITS - 1) /
+        VALID_WORD_BITS);
     sector->data.bytes = sector->bytes + (header_blocks * block_size);
     sector->data.size = data_blocks * block_size;
 }
@@ -197,10 +469,43 @@ void
 nfc_tag_t2_sector_deinit(
     NfcTagType2Sector* sector)
 {
-    g_free(sector->bytes);
     g_free(sector->valid);
 }
 
+static
+void
+nfc_tag_t2_alloc_sectors(
+    NfcTagType2* self)
+{
+    NfcTagType2Priv* priv = self->priv;
+    const guint block_size = self->block_size;
+    guint i, remaining = self->data_size / block_size;
+
+    /*
+     * All sectors share the same buffer, which makes the data area
+     * contiguous even if it spans several sectors.
+     */
+    priv->mem = g_malloc0(NFC_TAG_T2_DATA_BLOCK0 * block_size +
+        self->data_size);
+    priv->sector_count = (NFC_TAG_T2_DATA_BLOCK0 + remaining +
+        NFC_TAG_T2_SECTOR_BLOCKS - 1) / NFC_TAG_T2_SECTOR_BLOCKS;
+    priv->sectors = g_new0(NfcTagType2Sector, priv->sector_count);
+    for (i = 0; i < priv->sector_count; i++) {
+        const guint header_blocks = i ? 0 : NFC_TAG_T2_DATA_BLOCK0;
+        const guint data_blocks = MIN(remaining, NFC_TAG_T2_SECTOR_BLOCKS -
+            header_blocks);
+
+        nfc_tag_t2_sector_init(priv->sectors + i, priv->mem +
+            i * NFC_TAG_T2_SECTOR_BLOCKS * block_size, block_size,
+            header_blocks, data_blocks);
+        remaining -= data_blocks;
+    }
+    if (priv->sector_count > 1) {
+        GDEBUG("%u sectors", priv->sector_count);
+    }
+    nfc_tag_t2_update_block_map(self);
+}
+
 static
 void
 nfc_tag_t2_sector_set_data(
@@ -213,19 +518,13 @@ nfc_tag_t2_sector_set_data(
     const guint total_blocks = sector->size / block_size;
 
     if (block < total_blocks) {
-        guint i;
-
         if ((block + num_blocks) > total_blocks) {
             num_blocks = total_blocks - block;
         }
 
         memcpy(sector->bytes + block * block_size, bytes,
             num_blocks * block_size);
-
-        /* Mark blocks as valid */
-        for (i = 0; i < num_blocks; i++) {
-            sector->valid[(block + i) / 8] |= (1 << ((block + i) % 8));
-        }
+        nfc_tag_t2_sector_mark_blocks(sector, block, num_blocks, TRUE);
     }
 }
 
@@ -237,22 +536,154 @@ nfc_tag_t2_sector_invalidate(
     guint block,
     guint num_blocks)
 {
-#pragma message("TODO: Invalidate and re-read NDEF")
     const guint total_blocks = sector->size / block_size;
 
     if (block < total_blocks) {
-        guint i;
-
         if ((block + num_blocks) > total_blocks) {
             num_blocks = total_blocks - block;
         }
 
-        memset(sector->bytes + block, 0, num_blocks * block_size);
+        memset(sector->bytes + block * block_size, 0, num_blocks * block_size);
+        nfc_tag_t2_sector_mark_blocks(sector, block, num_blocks, FALSE);
+    }
+}
+
+static
+void
+nfc_tag_t2_cache_put(
+    NfcTagType2* self,
+    guint size) /* Bytes, from the beginning of the data area */
+{
+    const guint block_size = self->block_size;
+    NfcTagType2Priv* priv = self->priv;
+    GUtilData key, data;
+
+    /* Store whole blocks */
+    key.bytes = priv->mem;
+    key.size = NFC_TAG_T2_CACHE_KEY_SIZE;
+    data.bytes = priv->sectors->data.bytes;
+    data.size = MIN((size + block_size - 1) / block_size * block_size,
+        self->data_size);
+    nfc_tag_cache_put(NFC_TAG_T2_CACHE_TYPE, &self->serial, &key, &data);
+}
+
+/* Returns the number of blocks loaded from the persistent cache */
+static
+guint
+nfc_tag_t2_cache_load(
+    NfcTagType2* self,
+    const GUtilData* first) /* What we have actually read from the tag */
+{
+    NfcTagType2Priv* priv = self->priv;
+    const GUtilData* cached = &priv->cache->data;
+    const guint block_size = self->block_size;
+    guint i, n = 0;
+
+    /*
+     * If the key (UID, lock bytes and CC) and the first data blocks
+     * match, then we assume that the rest of the TLV area matches too.
+     */
+    if (cached->size >= first->size && !(cached->size % block_size) &&
+        cached->size <= self->data_size &&
+        !memcmp(cached->bytes, first->bytes, first->size)) {
+        n = cached->size / block_size;
+        for (i = 0; i < n; i++) {
+            guint bno;
+            NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self,
+                i, &bno, NULL);
+
+            nfc_tag_t2_sector_set_data(sector, block_size, cached->bytes +
+                i * block_size, bno, 1);
+        }
+        GDEBUG("Loaded %u block(s) from cache", n);
+    } else {
+        GDEBUG("Cached data don't match");
+    }
+    nfc_tag_cache_entry_free(priv->cache);
+    priv->cache = NULL;
+    return n;
+}
+
+/*
+ * Scans TLV blocks and returns the offset right past the NDEF TLV (or
+ * the terminator TLV, if there's no NDEF). Returns zero if the data end
+ * before we know that. Running into the end of the whole data area is
+ * as good as hitting the terminator.
+ */
+static
+guint
+nfc_tag_t2_tlv_end(
+    NfcTagType2* self,
+    const GUtilData* data)
+{
+    const guint8* ptr = data->bytes;
+    const guint size = data->size;
+    guint pos = 0;
+
+    while (pos < size) {
+        const guint8 t = ptr[pos];
+
+        if (t == NFC_TAG_T2_TLV_NULL) {
+            pos++;
+        } else if (t == NFC_TAG_T2_TLV_TERMINATOR) {
+            return pos + 1;
+        } else if (pos + 1 >= size) {
+            return 0;
+        } else {
+            guint end;
+
+            if (ptr[pos + 1] == 0xff) {
+                /* 3-byte format */
+                if (pos + 3 >= size) {
+                    return 0;
+                }
+                end = pos + 4 + ((((guint)ptr[pos + 2]) << 8) | ptr[pos + 3]);
+            } else {
+                end = pos + 2 + ptr[pos + 1];
+            }
+            if (t == NFC_TAG_T2_TLV_NDEF) {
+                return (end <= size) ? end : 0;
+            }
+            pos = end;
+        }
+    }
+    return (size == self->data_size) ? size : 0;
+}
+
+/*
+ * Re-parses the NDEF after a write, if the write has touched the TLV
+ * blocks preceding the NDEF or the NDEF itself. Everything we write
+ * ends up in the cache, which normally means that the entire NDEF TLV
+ * is cached and no extra reads are needed.
+ */
+static
+void
+nfc_tag_t2_update_ndef(
+    NfcTagType2* self,
+    guint changed) /* The first modified data offset */
+{
+    NfcTagType2Priv* priv = self->priv;
+    GUtilData data;
+    guint end;
+
+    data.bytes = priv->sectors->data.bytes;
+    data.size = nfc_tag_t2_read_cached(self, 0, self->data_size, NULL);
+    end = nfc_tag_t2_tlv_end(self, &data);
+    if (changed < MAX(end, priv->ndef_end)) {
+        NfcTag* tag = &self->tag;
 
-        /* Mark blocks as invalid */
-        for (i = 0; i < num_blocks; i++) {
-            sector->valid[(block + i) / 8] &= ~(1 << ((block + i) % 8));
+        if (end) {
+            GDEBUG("Updating NDEF");
+            data.size = end;
+            nfc_tag_set_ndef(tag, ndef_rec_new_from_tlv(&data));
+            nfc_tag_t2_cache_put(self, end);
+        } else {
+            /* Whatever we had is no longer valid */
+            GDEBUG("NDEF is not cached, dropping it");
+            nfc_tag_set_ndef(tag, NULL);
+            nfc_tag_cache_drop(NFC_TAG_T2_CACHE_TYPE, &self->serial);
         }
+        priv->ndef_end = end;
     }
 }
 
@@ -274,21 +705,139 @@ nfc_tag_t2_generate_id(
     return id;
 }
 
+/*
+ * Tracking of the data blocks being read. A read may wait for someone
+ * else's fetch instead of reading the same blocks again, but only if
+ * that fetch is guaranteed to make progress, i.e. it belongs to the
+ * same sequence or to the sequence which is currently running. Waiting
+ * for anything else could block the sequence that the fetch is stuck
+ * behind (possibly our own) forever.
+ */
+
+static
+NfcTagType2Fetch*
+nfc_tag_t2_fetch_find(
+    NfcTagType2* self,
+    guint block)
+{
+    GSList* l;
+
+    for (l = self->priv->fetches; l; l = l->next) {
+        NfcTagType2Fetch* fetch = l->data;
+
+        if (block >= fetch->block && block < (fetch->block + fetch->count)) {
+            return fetch;
+        }
+    }
+    return NULL;
+}
+
+static
+gboolean
+nfc_tag_t2_fetch_can_wait(
+    NfcTagType2* self,
+    guint block,
+    NfcTargetSequence* seq)
+{
+    NfcTagType2Fetch* fetch = nfc_tag_t2_fetch_find(self, block);
+
+    return fetch && fetch->seq && (fetch->seq == seq ||
+        fetch->seq == self->tag.target->sequence);
+}
+
+static
+void
+nfc_tag_t2_fetch_start(
+    NfcTagType2* self,
+    NfcTagType2Fetch* fetch,
+    NfcTargetSequence* seq,
+    guint block,
+    guint count) /* Blocks requested */
+{
+    NfcTagType2Priv* priv = self->priv;
+    guint bno;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self, block,
+        &bno, NULL);
+    const GUtilData* sd = &sector->data;
+    const guint data_end = (sd->bytes - sector->bytes + sd->size) /
+        self->block_size;
+
+    /* READ always returns 4 blocks, FAST_READ up to 63 */
+    count = (priv->fast_read && count > NFC_TAG_T2_READ_BLOCKS) ?
+        MIN(count, NFC_TAG_T2_FAST_READ_MAX_BLOCKS) : NFC_TAG_T2_READ_BLOCKS;
+    fetch->block = block;
+    fetch->count = MIN(count, data_end - bno);
+    fetch->seq = seq;
+    priv->fetches = g_slist_prepend(priv->fetches, fetch);
+}
+
+static
+void
+nfc_tag_t2_fetch_stop(
+    NfcTagType2* self,
+    NfcTagType2Fetch* fetch)
+{
+    if (fetch->count) {
+        NfcTagType2Priv* priv = self->priv;
+
+        priv->fetches = g_slist_remove(priv->fetches, fetch);
+        fetch->count = 0;
+        fetch->seq = NULL;
+    }
+}
+
 /*==========================================================================*
  * Commands
  *==========================================================================*/
 
+static
+NfcTagType2Cmd*
+nfc_tag_t2_cmd_new(
+    void)
+{
+    NfcTagType2Cmd* cmd = nfc_tag_t2_cmd_pool;
+
+    if (cmd) {
+        nfc_tag_t2_cmd_pool = cmd->next;
+        nfc_tag_t2_cmd_pool_size--;
+        memset(cmd, 0, sizeof(*cmd));
+    } else {
+        cmd = g_slice_new0(NfcTagType2Cmd);
+        nfc_tag_t2_cmd_allocs++;
+    }
+    return cmd;
+}
+
+static
+void
+nfc_tag_t2_cmd_free(
+    NfcTagType2Cmd* cmd)
+{
+    if (nfc_tag_t2_cmd_pool_size < NFC_TAG_T2_CMD_POOL_SIZE) {
+        cmd->next = nfc_tag_t2_cmd_pool;
+        nfc_tag_t2_cmd_pool = cmd;
+        nfc_tag_t2_cmd_pool_size++;
+    } else {
+        gutil_slice_free(cmd);
+    }
+}
+
 static
 void
 nfc_tag_t2_cmd_destroy(
     void* user_data)
 {
     NfcTagType2Cmd* cmd = user_data;
+    GDestroyNotify destroy = cmd->destroy;
+    void* data = cmd->user_data;
 
-    if (cmd->destroy) {
-        cmd->destroy(cmd->user_data);
+    if (cmd->select) {
+        cmd->select->cmd = NULL;
+    }
+    nfc_tag_t2_cmd_free(cmd);
+    if (destroy) {
+        destroy(data);
     }
-    gutil_slice_free(cmd);
 }
 
 static
@@ -302,67 +851,344 @@ nfc_tag_t2_cmd_resp(
 {
     NfcTagType2Cmd* cmd = user_data;
 
-    cmd->resp(cmd->t2, status, data, len, cmd->user_data);
+    if (cmd->resp) {
+        cmd->resp(cmd->t2, status, data, len, cmd->user_data);
+    }
 }
 
 static
-guint
-nfc_tag_t2_cmd(
-    NfcTagType2* self,
-    const void* cmd,
-    guint size,
-    NfcTargetSequence* seq,
-    NfcTagType2ReadFunc resp,
-    GDestroyNotify destroy,
-    void* user_data)
+void
+nfc_tag_t2_sector_select_free(
+    gpointer user_data)
 {
-    NfcTag* tag = &self->tag;
-    NfcTagType2Cmd* data = g_slice_new(NfcTagType2Cmd);
-    guint id;
-
-    data->t2 = self;
-    data->resp = resp;
-    data->destroy = destroy;
-    data->user_data = user_data;
+    NfcTagType2SectorSelect* select = user_data;
+    NfcTagType2Priv* priv = select->t2->priv;
 
-    id = nfc_target_transmit(tag->target, cmd, size, seq,
-        resp ? nfc_tag_t2_cmd_resp : NULL, nfc_tag_t2_cmd_destroy, data);
-    if (id) {
-        return id;
-    } else {
-        g_slice_free(NfcTagType2Cmd, data);
-        return 0;
+    if (select->cmd) {
+        select->cmd->select = NULL;
     }
+    priv->selects = g_slist_remove(priv->selects, select);
+    gutil_slice_free(select);
 }
 
 static
-guint
-nfc_tag_t2_cmd_read(
-    NfcTagType2* self,
-    guint block,
-    NfcTargetSequence* seq,
-    NfcTagType2ReadFunc resp,
-    GDestroyNotify done,
-    void* user_data)
+void
+nfc_tag_t2_sector_select_failed(
+    NfcTagType2SectorSelect* select)
 {
-    if (block <= 0xff) {
-        guint8 cmd[2];
-        /*
-         * NFCForum-TS-DigitalProtocol-1.0
+    NfcTagType2* t2 = select->t2;
+    NfcTarget* target = t2->tag.target;
+    NfcTagType2Cmd* cmd = select->cmd;
+    const guint ack_id = select->ack_id;
+
+    GDEBUG("Failed to select sector %u", select->sector);
+    t2->priv->sector = NFC_TAG_T2_SECTOR_UNKNOWN;
+
+    /* Don't let the command go to a wrong sector */
+    if (cmd) {
+        NfcTagType2ReadFunc resp = cmd->resp;
+
+        cmd->resp = NULL;
+        if (resp) {
+            resp(t2, NFC_TRANSMIT_STATUS_ERROR, NULL, 0, cmd->user_data);
+        }
+        nfc_target_cancel_transmit(target, select->cmd_id);
+    }
+
+    /* This may deallocate the select structure */
+    nfc_target_cancel_transmit(target, ack_id);
+}
+
+static
+void
+nfc_tag_t2_sector_select_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2SectorSelect* select = user_data;
+    const guint8* ack = data;
+
+    select->select_id = 0;
+    if (status != NFC_TRANSMIT_STATUS_OK || len != 1 ||
+        (ack[0] & NFC_TAG_T2_ACK_MASK) != NFC_TAG_T2_ACK) {
+        NfcTag* tag = &select->t2->tag;
+
+        nfc_tag_ref(tag);
+        nfc_tag_t2_sector_select_failed(select);
+        nfc_tag_unref(tag);
+    }
+}
+
+static
+void
+nfc_tag_t2_sector_select_ack(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2SectorSelect* select = user_data;
+    NfcTagType2* t2 = select->t2;
+
+    /*
+     * NFCForum-TS-DigitalProtocol-1.0
+     * Section 9.8 "SECTOR SELECT"
+     *
+     * The second packet is acknowledged passively, i.e. the tag doesn't
+     * respond at all if it accepts the sector number. Any response is
+     * a NACK. NFCC reports the absence of response as a failure, which
+     * in this case means success.
+     */
+    select->ack_id = 0;
+    if (status == NFC_TRANSMIT_STATUS_OK && len > 0) {
+        NfcTag* tag = &t2->tag;
+
+        nfc_tag_ref(tag);
+        nfc_tag_t2_sector_select_failed(select);
+        nfc_tag_unref(tag);
+    } else {
+        GDEBUG("Selected sector %u", select->sector);
+        t2->priv->sector = select->sector;
+    }
+}
+
+static
+NfcTagType2SectorSelect*
+nfc_tag_t2_sector_select_new(
+    NfcTagType2* self,
+    guint sector,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority)
+{
+    static const guint8 cmd1[] = { NFC_TAG_T2_CMD_SECTOR_SELECT, 0xff };
+    NfcTagType2Priv* priv = self->priv;
+    NfcTarget* target = self->tag.target;
+    NfcTagType2SectorSelect* select = g_slice_new0(NfcTagType2SectorSelect);
+    guint8 cmd2[4];
+
+    if (!priv->select_cmd) {
+        /* Packet 1 never changes, share it between all the requests */
+        priv->select_cmd = g_bytes_new_static(cmd1, sizeof(cmd1));
+    }
+    cmd2[0] = (guint8)sector;
+    cmd2[1] = cmd2[2] = cmd2[3] = 0;
+    select->t2 = self;
+    select->sector = sector;
+    select->select_id = nfc_target_transmit_bytes_full(target,
+        priv->select_cmd, seq, priority, 0, nfc_tag_t2_sector_select_resp,
+        NULL, select);
+    if (select->select_id) {
+        select->ack_id = nfc_target_transmit_full(target, cmd2, sizeof(cmd2),
+            seq, priority, 0, nfc_tag_t2_sector_select_ack,
+            nfc_tag_t2_sector_select_free, select);
+        if (select->ack_id) {
+            priv->selects = g_slist_prepend(priv->selects, select);
+            return select;
+        }
+        nfc_target_cancel_transmit(target, select->select_id);
+    }
+    gutil_slice_free(select);
+    return NULL;
+}
+
+static
+gboolean
+nfc_tag_t2_need_sector_select(
+    NfcTagType2* self,
+    guint sector,
+    NfcTargetSequence* seq)
+{
+    NfcTagType2Priv* priv = self->priv;
+
+    if (priv->sector_count > 1) {
+        /*
+         * The currently selected sector is only known for sure if our
+         * sequence is already running. Otherwise someone else may switch
+         * the sector before our command gets submitted.
+         */
+        return priv->sector != sector || !seq ||
+            self->tag.target->sequence != seq;
+    } else {
+        /* Single sector tags don't necessarily support SECTOR_SELECT */
+        return FALSE;
+    }
+}
+
+static
+guint
+nfc_tag_t2_cmd_full(
+    NfcTagType2* self,
+    guint sector,
+    const void* cmd,
+    guint len,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    NfcTag* tag = &self->tag;
+    NfcTagType2Cmd* data = nfc_tag_t2_cmd_new();
+    NfcTagType2SectorSelect* select = NULL;
+    NfcTargetSequence* tmp_seq = NULL;
+    const gboolean need_select = nfc_tag_t2_need_sector_select(self,
+        sector, seq);
+    guint id = 0;
+
+    data->t2 = self;
+    data->resp = resp;
+    data->destroy = destroy;
+    data->user_data = user_data;
+
+    if (need_select) {
+        /* SECTOR_SELECT and the command must be in the same sequence */
+        if (!seq) {
+            seq = tmp_seq = nfc_target_sequence_new(tag->target);
+        }
+        select = nfc_tag_t2_sector_select_new(self, sector, seq, priority);
+    }
+
+    if (select || !need_select) {
+        /* The command is only copied if it has to wait in the queue */
+        id = nfc_target_transmit_full(tag->target, cmd, len, seq, priority,
+            0, nfc_tag_t2_cmd_resp, nfc_tag_t2_cmd_destroy, data);
+        if (select) {
+            if (id) {
+                select->cmd = data;
+                select->cmd_id = id;
+                data->select = select;
+            } else {
+                nfc_target_cancel_transmit(tag->target, select->select_id);
+                nfc_target_cancel_transmit(tag->target, select->ack_id);
+            }
+        }
+    }
+    nfc_target_sequence_unref(tmp_seq);
+    if (id) {
+        return id;
+    } else {
+        nfc_tag_t2_cmd_free(data);
+        return 0;
+    }
+}
+
+static
+guint
+nfc_tag_t2_cmd(
+    NfcTagType2* self,
+    guint sector,
+    const void* cmd,
+    guint len,
+    NfcTargetSequence* seq,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    return nfc_tag_t2_cmd_full(self, sector, cmd, len, seq,
+        NFC_TARGET_PRIORITY_NORMAL, resp, destroy, user_data);
+}
+
+static
+guint
+nfc_tag_t2_cmd_read_full(
+    NfcTagType2* self,
+    guint sector,
+    guint block,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify done,
+    void* user_data)
+{
+    if (block <= 0xff) {
+        guint8 cmd[2];
+
+        /*
+         * NFCForum-TS-DigitalProtocol-1.0
          * Section 9 "Type 2 Tag Platform"
          * 9.6 READ
          */
         cmd[0] = NFC_TAG_T2_CMD_READ;
         cmd[1] = block;
-        return nfc_tag_t2_cmd(self, cmd, 2, seq, resp, done, user_data);
+        return nfc_tag_t2_cmd_full(self, sector, cmd, sizeof(cmd), seq,
+            priority, resp, done, user_data);
     }
     return 0;
 }
 
+static
+guint
+nfc_tag_t2_cmd_read(
+    NfcTagType2* self,
+    guint sector,
+    guint block,
+    NfcTargetSequence* seq,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify done,
+    void* user_data)
+{
+    return nfc_tag_t2_cmd_read_full(self, sector, block, seq,
+        NFC_TARGET_PRIORITY_NORMAL, resp, done, user_data);
+}
+
+/* Reads up to count blocks with one command */
+static
+guint
+nfc_tag_t2_cmd_read_blocks_full(
+    NfcTagType2* self,
+    guint sector,
+    guint block,
+    guint count,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify done,
+    void* user_data)
+{
+    if (block <= 0xff && self->priv->fast_read &&
+        count > NFC_TAG_T2_READ_BLOCKS) {
+        guint8 cmd[3];
+
+        /*
+         * MIFARE Ultralight EV1 and NTAG21x datasheets
+         * FAST_READ: start and end addresses, both inclusive
+         */
+        cmd[0] = NFC_TAG_T2_CMD_FAST_READ;
+        cmd[1] = block;
+        cmd[2] = MIN(block + MIN(count, NFC_TAG_T2_FAST_READ_MAX_BLOCKS) - 1,
+            0xff);
+        return nfc_tag_t2_cmd_full(self, sector, cmd, sizeof(cmd), seq,
+            priority, resp, done, user_data);
+    }
+    return nfc_tag_t2_cmd_read_full(self, sector, block, seq, priority,
+        resp, done, user_data);
+}
+
+static
+guint
+nfc_tag_t2_cmd_read_blocks(
+    NfcTagType2* self,
+    guint sector,
+    guint block,
+    guint count,
+    NfcTargetSequence* seq,
+    NfcTagType2ReadFunc resp,
+    GDestroyNotify done,
+    void* user_data)
+{
+    return nfc_tag_t2_cmd_read_blocks_full(self, sector, block, count, seq,
+        NFC_TARGET_PRIORITY_NORMAL, resp, done, user_data);
+}
+
 static
 guint
 nfc_tag_t2_cmd_write(
     NfcTagType2* self,
+    guint sector,
     guint block,
     const guint8* data,
     NfcTargetSequence* seq,
@@ -381,7 +1207,7 @@ nfc_tag_t2_cmd_write(
         cmd[0] = NFC_TAG_T2_CMD_WRITE;
         cmd[1] = block;
         memcpy(cmd + 2, data, self->block_size);
-        return nfc_tag_t2_cmd(self, cmd, self->block_size + 2, seq,
+        return nfc_tag_t2_cmd(self, sector, cmd, self->block_size + 2, seq,
             resp, done, user_data);
     }
     return 0;
@@ -391,15 +1217,31 @@ nfc_tag_t2_cmd_write(
  * Read
  *==========================================================================*/
 
+static
+gboolean
+nfc_tag_t2_fetch_wake(
+    gpointer user_data);
+
 static
 void
 nfc_tag_t2_read_data_free(
     gpointer user_data)
 {
     NfcTagType2ReadData* read = user_data;
+    NfcTagType2* t2 = read->t2;
+    NfcTagType2Priv* priv = t2->priv;
 
+    priv->waiters = g_slist_remove(priv->waiters, read);
+    priv->waking = g_slist_remove(priv->waking, read);
+    if (read->fetch.count) {
+        /* Someone may be waiting for this fetch which is never coming */
+        nfc_tag_t2_fetch_stop(t2, &read->fetch);
+        if (priv->waiters && !priv->wake_id) {
+            priv->wake_id = g_idle_add(nfc_tag_t2_fetch_wake, t2);
+        }
+    }
     nfc_target_sequence_unref(read->seq);
-    nfc_target_cancel_transmit(read->t2->tag.target, read->cmd_id);
+    nfc_target_cancel_transmit(t2->tag.target, read->cmd_id);
     if (read->destroy) {
         read->destroy(read->user_data);
     }
@@ -410,25 +1252,147 @@ nfc_tag_t2_read_data_free(
     gutil_slice_free(read);
 }
 
+static
+void
+nfc_tag_t2_read_data_done(
+    NfcTagType2ReadData* read,
+    NFC_TAG_T2_IO_STATUS status)
+{
+    NfcTagType2Priv* priv = read->t2->priv;
+    const guint id = read->seq_id;
+
+    /* The callback may cancel the read, don't touch it afterwards */
+    if (read->complete.read_data_cb) {
+        read->complete.read_data_cb(read->t2, status, read->buffer,
+            read->read, read->user_data);
+    }
+    g_hash_table_remove(priv->reads, GUINT_TO_POINTER(id));
+}
+
 static
 gboolean
 nfc_tag_t2_read_complete(
     gpointer user_data)
 {
     NfcTagType2ReadData* read = user_data;
-    NfcTagType2* t2 = read->t2;
-    NfcTagType2Priv* priv = t2->priv;
-    NfcTag* tag = &t2->tag;
-    const guint seq_id = read->seq_id;
+    NfcTag* tag = &read->t2->tag;
 
     read->complete_id = 0;
     nfc_tag_ref(tag);
-    if (read->complete) {
-        read->complete(t2, NFC_TAG_T2_IO_STATUS_OK, read->buffer, read->read,
-            read->user_data);
+    nfc_tag_t2_read_data_done(read, NFC_TAG_T2_IO_STATUS_OK);
+    nfc_tag_unref(tag);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nfc_tag_t2_read_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data);
+
+/* Returns FALSE if the read can't continue */
+static
+gboolean
+nfc_tag_t2_read_next(
+    NfcTagType2ReadData* read)
+{
+    NfcTagType2* t2 = read->t2;
+    NfcTagType2Priv* priv = t2->priv;
+    const guint block_size = t2->block_size;
+    const guint first = (read->offset + read->read) / block_size;
+    const guint end = (read->offset + read->size + block_size - 1) /
+        block_size;
+    guint bno;
+    NfcTagType2Sector* sector;
+
+    if (nfc_tag_t2_fetch_can_wait(t2, first, read->seq)) {
+        /* Someone is already reading this block, wait for it */
+        priv->waiters = g_slist_append(priv->waiters, read);
+        return TRUE;
+    }
+
+    sector = nfc_tag_t2_data_block_to_sector(t2, first, &bno, NULL);
+    if (sector) {
+        const GUtilData* sd = &sector->data;
+        const guint sector_end = (sd->bytes - sector->bytes + sd->size) /
+            block_size;
+        guint i, count = MIN(end - first, sector_end - bno);
+
+        /*
+         * Read as much as we need, up to the end of the sector. Cached
+         * blocks in the middle don't cost much, but those which are
+         * being read by someone else will be available soon.
+         */
+        for (i = 1; i < count; i++) {
+            if (nfc_tag_t2_fetch_can_wait(t2, first + i, read->seq)) {
+                count = i;
+                break;
+            }
+        }
+        read->cmd_id = nfc_tag_t2_cmd_read_blocks(t2, sector - priv->sectors,
+            bno, count, read->seq, nfc_tag_t2_read_resp, NULL, read);
+        if (read->cmd_id) {
+            nfc_tag_t2_fetch_start(t2, &read->fetch, read->seq, first,
+                count);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Picks up the cached data and either completes or continues the read */
+static
+void
+nfc_tag_t2_read_continue(
+    NfcTagType2ReadData* read)
+{
+    read->read += nfc_tag_t2_read_cached(read->t2, read->offset + read->read,
+        read->size - read->read, read->buffer + read->read);
+    if (read->read == read->size) {
+        nfc_tag_t2_read_data_done(read, NFC_TAG_T2_IO_STATUS_OK);
+    } else if (!nfc_tag_t2_read_next(read)) {
+        nfc_tag_t2_read_data_done(read, NFC_TAG_T2_IO_STATUS_IO_ERROR);
+    }
+}
+
+/* Called when a fetch is finished, successfully or not */
+static
+void
+nfc_tag_t2_fetch_done(
+    NfcTagType2* self)
+{
+    NfcTagType2Priv* priv = self->priv;
+
+    /*
+     * Those who still need to wait will get back to the waiters list.
+     * Completion callbacks may cancel other reads, that's why we pick
+     * them one by one and let nfc_tag_t2_read_data_free() remove the
+     * cancelled ones from the list.
+     */
+    priv->waking = g_slist_concat(priv->waking, priv->waiters);
+    priv->waiters = NULL;
+    while (priv->waking) {
+        NfcTagType2ReadData* read = priv->waking->data;
+
+        priv->waking = g_slist_delete_link(priv->waking, priv->waking);
+        nfc_tag_t2_read_continue(read);
     }
+}
+
+static
+gboolean
+nfc_tag_t2_fetch_wake(
+    gpointer user_data)
+{
+    NfcTagType2* self = THIS(user_data);
+    NfcTag* tag = &self->tag;
 
-    g_hash_table_remove(priv->reads, GUINT_TO_POINTER(seq_id));
+    self->priv->wake_id = 0;
+    nfc_tag_ref(tag);
+    nfc_tag_t2_fetch_done(self);
     nfc_tag_unref(tag);
     return G_SOURCE_REMOVE;
 }
@@ -443,61 +1407,116 @@ nfc_tag_t2_read_resp(
     void* user_data)
 {
     NfcTagType2ReadData* read = user_data;
-    NfcTagType2Priv* priv = t2->priv;
     NfcTag* tag = &t2->tag;
-    const guint seq_id = read->seq_id;
+    const guint block_size = t2->block_size;
 
     read->cmd_id = 0;
     nfc_tag_ref(tag);
-    if (status == NFC_TRANSMIT_STATUS_OK && len > 0) {
-        const guint block_size = t2->block_size;
-        const guint8* bytes = data;
+    nfc_tag_t2_fetch_stop(t2, &read->fetch);
+    if (status == NFC_TRANSMIT_STATUS_OK && len >= block_size) {
         guint rel_block;
         NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
             (read->offset + read->read) / block_size, &rel_block, NULL);
+        guint nb = len / block_size;
 
-        if (sector) {
-            const guint nb = len / block_size;
-            const guint offset = (read->offset + read->read) % block_size;
-
-            nfc_tag_t2_sector_set_data(sector, block_size, bytes,
-                rel_block, nb);
-            if (len > (read->size - read->read)) {
-                len = read->size - read->read;
-            }
-            memcpy(read->buffer + read->read, bytes + offset, len);
-            read->read += len;
-            if (read->read < read->size) {
-                /* Submit the next read */
-                read->cmd_id = nfc_tag_t2_cmd_read(t2, rel_block + nb,
-                    read->seq, nfc_tag_t2_read_resp, NULL, read);
-            }
+        /* READ rolls over at the end of the sector */
+        if ((rel_block + nb) > (sector->size / block_size)) {
+            nb = sector->size / block_size - rel_block;
         }
+        nfc_tag_t2_sector_set_data(sector, block_size, data, rel_block, nb);
+        nfc_tag_t2_read_continue(read);
     } else {
         GDEBUG("Oops, read failed!");
+        nfc_tag_t2_read_data_done(read, NFC_TAG_T2_IO_STATUS_IO_ERROR);
     }
-
-    if (!read->cmd_id) {
-        if (read->complete) {
-            read->complete(t2, (status == NFC_TRANSMIT_STATUS_OK) ?
-                NFC_TAG_T2_IO_STATUS_OK : NFC_TAG_T2_IO_STATUS_IO_ERROR,
-                read->buffer, read->read, read->user_data);
-        }
-        g_hash_table_remove(priv->reads, GUINT_TO_POINTER(seq_id));
-    }
+    nfc_tag_t2_fetch_done(t2);
     nfc_tag_unref(tag);
 }
 
-/*==========================================================================*
- * Write
- *==========================================================================*/
-
 static
 void
-nfc_tag_t2_write_data_resp(
+nfc_tag_t2_read_blocks_resp(
     NfcTagType2* t2,
     NFC_TRANSMIT_STATUS status,
-    const void* resp,
+    const void* data,
+    guint len,
+    void* user_data);
+
+static
+guint
+nfc_tag_t2_read_blocks_next(
+    NfcTagType2ReadData* read)
+{
+    NfcTagType2* t2 = read->t2;
+    const guint block_size = t2->block_size;
+
+    return nfc_tag_t2_cmd_read_blocks(t2, read->sector, (read->offset +
+        read->read) / block_size, (read->size - read->read) / block_size,
+        read->seq, nfc_tag_t2_read_blocks_resp, NULL, read);
+}
+
+static
+void
+nfc_tag_t2_read_blocks_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2ReadData* read = user_data;
+    NfcTagType2Priv* priv = t2->priv;
+    NfcTag* tag = &t2->tag;
+    const guint block_size = t2->block_size;
+    const guint seq_id = read->seq_id;
+
+    read->cmd_id = 0;
+    nfc_tag_ref(tag);
+    if (status == NFC_TRANSMIT_STATUS_OK && len >= block_size) {
+        const guint block = (read->offset + read->read) / block_size;
+        const guint nb = MIN(len, read->size - read->read) / block_size;
+
+        /* Update the cache while we are at it */
+        if (read->sector < priv->sector_count) {
+            nfc_tag_t2_sector_set_data(priv->sectors + read->sector,
+                block_size, data, block, nb);
+        }
+        memcpy(read->buffer + read->read, data, nb * block_size);
+        read->read += nb * block_size;
+        if (read->read < read->size) {
+            read->cmd_id = nfc_tag_t2_read_blocks_next(read);
+            if (!read->cmd_id) {
+                status = NFC_TRANSMIT_STATUS_ERROR;
+            }
+        }
+    } else {
+        GDEBUG("Oops, block read failed!");
+        if (status == NFC_TRANSMIT_STATUS_OK) {
+            /* 4-bit NACK or garbage */
+            status = NFC_TRANSMIT_STATUS_NACK;
+        }
+    }
+
+    if (!read->cmd_id) {
+        if (read->complete.read_cb) {
+            read->complete.read_cb(t2, status, read->buffer, read->read,
+                read->user_data);
+        }
+        g_hash_table_remove(priv->reads, GUINT_TO_POINTER(seq_id));
+    }
+    nfc_tag_unref(tag);
+}
+
+/*==========================================================================*
+ * Write
+ *==========================================================================*/
+
+static
+void
+nfc_tag_t2_write_data_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* resp,
     guint len,
     void* user_data);
 
@@ -512,10 +1531,17 @@ nfc_tag_t2_write_data_free(
     nfc_target_remove_handler(target, write->start_id);
     nfc_target_sequence_unref(write->seq);
     nfc_target_cancel_transmit(target, write->cmd_id);
+    if (write->complete_id) {
+        g_source_remove(write->complete_id);
+    }
     if (write->destroy) {
         write->destroy(write->user_data);
     }
     g_bytes_unref(write->bytes);
+    g_free(write->image);
+    g_free(write->order);
+    g_free(write->src);
+    g_free(write->len_data);
     g_slice_free(NfcTagType2WriteData, write);
 }
 
@@ -553,6 +1579,22 @@ nfc_tag_t2_write_data_new(
     return write;
 }
 
+static
+void
+nfc_tag_t2_write_data_update_ndef(
+    NfcTagType2WriteData* write)
+{
+    if (write->pos) {
+        guint i, first = write->order[0];
+
+        /* The blocks are not necessarily written in ascending order */
+        for (i = 1; i < write->pos; i++) {
+            first = MIN(first, write->order[i]);
+        }
+        nfc_tag_t2_update_ndef(write->t2, first * write->t2->block_size);
+    }
+}
+
 static
 void
 nfc_tag_t2_write_data_error(
@@ -562,267 +1604,813 @@ nfc_tag_t2_write_data_error(
     NfcTagType2Priv* priv = t2->priv;
     NfcTagType2WriteDataFunc complete = write->complete.write_data_cb;
 
+    if (write->order) {
+        const guint block_size = t2->block_size;
+        const guint size = g_bytes_get_size(write->bytes);
+        guint i, end = write->first_block + write->nblocks;
+
+        /*
+         * Blocks which didn't need to be written count as written.
+         * Report everything up to the first block which we have failed
+         * to write (or haven't written yet).
+         */
+        for (i = write->pos; i < write->count; i++) {
+            end = MIN(end, write->order[i]);
+        }
+        write->written = (end * block_size > write->offset) ?
+            MIN(end * block_size - write->offset, size) : 0;
+    }
     GDEBUG("Wrote %u bytes out of %u", write->written, (guint)
         g_bytes_get_size(write->bytes));
+    nfc_tag_t2_write_data_update_ndef(write);
     if (complete) {
         write->complete.write_cb = NULL;
         complete(write->t2, NFC_TAG_T2_IO_STATUS_IO_ERROR, write->written,
             write->user_data);
     }
-    g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+    g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+}
+
+static
+void
+nfc_tag_t2_write_update_ndef(
+    NfcTagType2WriteData* write,
+    NfcTagType2Sector* sector,
+    guint written)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint8* start = sector->bytes + write->offset;
+    const guint8* data = t2->priv->sectors->data.bytes;
+
+    /* Raw writes may touch the data area too */
+    if ((start + written) > data) {
+        nfc_tag_t2_update_ndef(t2, (start > data) ? (start - data) : 0);
+    }
+}
+
+static
+void
+nfc_tag_t2_write_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* resp,
+    guint len,
+    void* user_data)
+{
+    NfcTag* tag = &t2->tag;
+    NfcTagType2WriteData* write = user_data;
+    NfcTagType2Priv* priv = t2->priv;
+    NfcTagType2Sector* sector = priv->sectors + write->sector_number;
+    gsize total_size = 0;
+    const guint block_size = t2->block_size;
+    const guint8* data = g_bytes_get_data(write->bytes, &total_size);
+
+    write->cmd_id = 0;
+
+    /* Round total size down to the nearest block boundary.
+     * Offset is rounded too (see nfc_tag_t2_write) */
+    total_size -= total_size % block_size;
+
+    nfc_tag_ref(tag);
+    if (status == NFC_TRANSMIT_STATUS_OK) {
+        /* Write-through, the block we have just written is valid */
+        nfc_tag_t2_sector_set_data(sector, block_size, data + write->written,
+            (write->offset + write->written) / block_size, 1);
+    }
+    if (status != NFC_TRANSMIT_STATUS_OK) {
+        NfcTagType2WriteFunc complete = write->complete.write_cb;
+
+        GDEBUG("Oops, write failed!");
+        nfc_tag_t2_write_update_ndef(write, sector, write->written);
+        if (complete) {
+            write->complete.write_cb = NULL;
+            complete(write->t2, status, write->written, write->user_data);
+        }
+        g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+    } else if ((write->written + block_size) >= total_size) {
+        /* Last write succeeded */
+        guint written = write->written;
+        NfcTagType2WriteFunc complete = write->complete.write_cb;
+
+        written += block_size;
+        GDEBUG("Wrote %u byte(s)", written);
+        GASSERT(written == total_size);
+        nfc_tag_t2_write_update_ndef(write, sector, written);
+        if (complete) {
+            write->complete.write_cb = NULL;
+            complete(write->t2, status, written, write->user_data);
+        }
+        g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+    } else {
+        /* Write the next block */
+        guint next_block;
+
+        write->written += block_size;
+        next_block = (write->offset + write->written)/block_size;
+        nfc_tag_t2_sector_invalidate(sector, block_size, next_block, 1);
+        write->cmd_id = nfc_tag_t2_cmd_write(t2, write->sector_number,
+            next_block, data + write->written, write->seq,
+            nfc_tag_t2_write_resp, NULL, write);
+    }
+    nfc_tag_unref(tag);
+}
+
+static
+gboolean
+nfc_tag_t2_data_block_cached(
+    NfcTagType2* self,
+    guint block)
+{
+    gboolean cached = FALSE;
+
+    nfc_tag_t2_data_block_to_sector(self, block, NULL, &cached);
+    return cached;
+}
+
+static
+const guint8*
+nfc_tag_t2_data_block_cache(
+    NfcTagType2* self,
+    guint block)
+{
+    guint bno;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self, block,
+        &bno, NULL);
+
+    return sector->bytes + bno * self->block_size;
+}
+
+/* Returns the data byte the way it's going to look after the write */
+static
+gboolean
+nfc_tag_t2_write_data_byte(
+    NfcTagType2WriteData* write,
+    guint offset,
+    guint8* byte)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint block_size = t2->block_size;
+    const guint block = offset / block_size;
+
+    if (block >= write->first_block &&
+        block < (write->first_block + write->nblocks)) {
+        *byte = write->image[offset - write->first_block * block_size];
+        return TRUE;
+    } else if (offset < t2->data_size &&
+        nfc_tag_t2_data_block_cached(t2, block)) {
+        *byte = nfc_tag_t2_data_block_cache(t2, block)[offset % block_size];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Finds the NDEF TLV in the updated data area and returns its offset
+ * and the size of its length field.
+ */
+static
+gboolean
+nfc_tag_t2_write_data_ndef_tlv(
+    NfcTagType2WriteData* write,
+    guint* tlv,
+    guint* hdr_size)
+{
+    guint pos = 0;
+    guint8 t;
+
+    while (nfc_tag_t2_write_data_byte(write, pos, &t) &&
+        t != NFC_TAG_T2_TLV_TERMINATOR) {
+        if (t == NFC_TAG_T2_TLV_NULL) {
+            pos++;
+        } else {
+            guint8 l[3];
+            guint hdr, len;
+
+            if (!nfc_tag_t2_write_data_byte(write, pos + 1, l)) {
+                break;
+            } else if (l[0] == 0xff) {
+                /* 3-byte format */
+                if (!nfc_tag_t2_write_data_byte(write, pos + 2, l + 1) ||
+                    !nfc_tag_t2_write_data_byte(write, pos + 3, l + 2)) {
+                    break;
+                }
+                hdr = 3;
+                len = (((guint)l[1]) << 8) | l[2];
+            } else {
+                hdr = 1;
+                len = l[0];
+            }
+            if (t == NFC_TAG_T2_TLV_NDEF) {
+                *tlv = pos;
+                *hdr_size = hdr;
+                return TRUE;
+            }
+            pos += 1 + hdr + len;
+        }
+    }
+    return FALSE;
+}
+
+static inline
+guint8
+nfc_tag_t2_data_byte(
+    NfcTagType2* self,
+    guint offset)
+{
+    /* The block must be cached */
+    return nfc_tag_t2_data_block_cache(self, offset / self->block_size)
+        [offset % self->block_size];
+}
+
+/*
+ * Checks whether the tag currently has a non-empty NDEF TLV at the
+ * same place and with the same length format as the new one.
+ */
+static
+gboolean
+nfc_tag_t2_write_data_ndef_present(
+    NfcTagType2* t2,
+    guint tlv,
+    guint hdr_size)
+{
+    const guint block_size = t2->block_size;
+    const guint end = tlv + hdr_size + 1;
+    guint i;
+
+    if (end > t2->data_size) {
+        return FALSE;
+    }
+    for (i = tlv / block_size; i * block_size < end; i++) {
+        if (!nfc_tag_t2_data_block_cached(t2, i)) {
+            return FALSE;
+        }
+    }
+    if (nfc_tag_t2_data_byte(t2, tlv) != NFC_TAG_T2_TLV_NDEF) {
+        return FALSE;
+    } else if (hdr_size == 3) {
+        return nfc_tag_t2_data_byte(t2, tlv + 1) == 0xff &&
+            (nfc_tag_t2_data_byte(t2, tlv + 2) ||
+             nfc_tag_t2_data_byte(t2, tlv + 3));
+    } else {
+        const guint8 l = nfc_tag_t2_data_byte(t2, tlv + 1);
+
+        return l && l != 0xff;
+    }
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_block_changed(
+    NfcTagType2WriteData* write,
+    guint block)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint block_size = t2->block_size;
+
+    return block >= write->first_block &&
+        block < (write->first_block + write->nblocks) &&
+        memcmp(write->image + (block - write->first_block) * block_size,
+            nfc_tag_t2_data_block_cache(t2, block), block_size);
+}
+
+static
+void
+nfc_tag_t2_write_data_complete(
+    NfcTagType2WriteData* write)
+{
+    NfcTagType2Priv* priv = write->t2->priv;
+    NfcTagType2WriteDataFunc complete = write->complete.write_data_cb;
+    const guint size = g_bytes_get_size(write->bytes);
+
+    GDEBUG("Wrote %u byte(s), %u block(s)", size, write->count);
+    nfc_tag_t2_write_data_update_ndef(write);
+    if (complete) {
+        write->complete.write_cb = NULL;
+        complete(write->t2, NFC_TAG_T2_IO_STATUS_OK, size, write->user_data);
+    }
+    g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_complete_cb(
+    gpointer user_data)
+{
+    NfcTagType2WriteData* write = user_data;
+    NfcTag* tag = &write->t2->tag;
+
+    write->complete_id = 0;
+    nfc_tag_ref(tag);
+    nfc_tag_t2_write_data_complete(write);
+    nfc_tag_unref(tag);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_next(
+    NfcTagType2WriteData* write)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint block_size = t2->block_size;
+    const guint block = write->order[write->pos];
+    guint bno;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2, block,
+        &bno, NULL);
+
+    nfc_tag_t2_sector_invalidate(sector, block_size, bno, 1);
+    write->cmd_id = nfc_tag_t2_cmd_write(t2, sector - t2->priv->sectors, bno,
+        write->src[write->pos], write->seq, nfc_tag_t2_write_data_resp,
+        NULL, write);
+    return write->cmd_id != 0;
+}
+
+static
+void
+nfc_tag_t2_write_data_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* resp,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2WriteData* write = user_data;
+    NfcTag* tag = &t2->tag;
+
+    write->cmd_id = 0;
+    nfc_tag_ref(tag);
+    if (status != NFC_TRANSMIT_STATUS_OK) {
+        GDEBUG("Oops, write failed!");
+        nfc_tag_t2_write_data_error(write);
+    } else {
+        /* Write-through, the block we have just written is valid */
+        const guint block_size = t2->block_size;
+        const guint block = write->order[write->pos];
+        guint bno;
+        NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
+            block, &bno, NULL);
+
+        nfc_tag_t2_sector_set_data(sector, block_size,
+            write->src[write->pos], bno, 1);
+        if (++write->pos < write->count) {
+            /* Write the next block */
+            if (!nfc_tag_t2_write_data_next(write)) {
+                nfc_tag_t2_write_data_error(write);
+            }
+        } else {
+            /* Last write succeeded */
+            nfc_tag_t2_write_data_complete(write);
+        }
+    }
+    nfc_tag_unref(tag);
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_plan(
+    NfcTagType2WriteData* write)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint block_size = t2->block_size;
+    const guint end = write->first_block + write->nblocks;
+    gsize size;
+    const guint8* data = g_bytes_get_data(write->bytes, &size);
+    guint i, tlv, hdr, len_first = 0, len_last = 0, nlen = 0, ndata = 0;
+    gboolean len_known, len_changed = FALSE, zero_len = FALSE;
+
+    /* Everything is cached now, apply the changes */
+    for (i = 0; i < write->nblocks; i++) {
+        memcpy(write->image + i * block_size, nfc_tag_t2_data_block_cache(t2,
+            write->first_block + i), block_size);
+    }
+    memcpy(write->image + write->offset % block_size, data, size);
+
+    /*
+     * Only write the blocks which have actually changed. The blocks
+     * containing the NDEF length are written last, so that the NDEF
+     * never points to the half-written data.
+     */
+    len_known = nfc_tag_t2_write_data_ndef_tlv(write, &tlv, &hdr);
+    if (len_known) {
+        len_first = (tlv + 1) / block_size;
+        len_last = (tlv + hdr) / block_size;
+        nlen = len_last - len_first + 1;
+        for (i = len_first; i <= len_last; i++) {
+            if (nfc_tag_t2_write_data_block_changed(write, i)) {
+                len_changed = TRUE;
+            }
+        }
+        for (i = write->first_block; i < end; i++) {
+            if ((i < len_first || i > len_last) &&
+                nfc_tag_t2_write_data_block_changed(write, i)) {
+                if (i < len_first) {
+                    /* TLV may move, the current NDEF can't be trusted */
+                    ndata = 0;
+                    break;
+                }
+                ndata++;
+            }
+        }
+
+        /*
+         * If the update takes more than one WRITE, the current NDEF
+         * length is zeroed first, as recommended by NFC Forum. If the
+         * write gets interrupted, the tag ends up with an empty NDEF
+         * rather than with the old length on top of the new data.
+         */
+        zero_len = ndata && (ndata > 1 || len_changed) &&
+            nfc_tag_t2_write_data_ndef_present(t2, tlv, hdr);
+    }
+
+    write->order = g_new(guint, write->nblocks + 2 * nlen);
+    write->src = g_new(const guint8*, write->nblocks + 2 * nlen);
+    if (zero_len) {
+        /* The first half gets zeroed, the second half is written last */
+        guint8* zero = write->len_data = g_malloc(2 * nlen * block_size);
+        guint8* last = zero + nlen * block_size;
+
+        for (i = 0; i < nlen; i++) {
+            const guint block = len_first + i;
+
+            memcpy(zero + i * block_size, nfc_tag_t2_data_block_cache(t2,
+                block), block_size);
+            memcpy(last + i * block_size, (block >= write->first_block &&
+                block < end) ? (write->image + (block - write->first_block) *
+                block_size) : (zero + i * block_size), block_size);
+        }
+        if (hdr == 3) {
+            zero[tlv + 2 - len_first * block_size] = 0;
+            zero[tlv + 3 - len_first * block_size] = 0;
+        } else {
+            zero[tlv + 1 - len_first * block_size] = 0;
+        }
+        for (i = 0; i < nlen; i++) {
+            write->order[write->count] = len_first + i;
+            write->src[write->count++] = zero + i * block_size;
+        }
+    }
+    for (i = write->first_block; i < end; i++) {
+        if ((!len_known || i < len_first || i > len_last) &&
+            nfc_tag_t2_write_data_block_changed(write, i)) {
+            write->order[write->count] = i;
+            write->src[write->count++] = write->image +
+                (i - write->first_block) * block_size;
+        }
+    }
+    for (i = len_first; i < len_first + nlen; i++) {
+        if (zero_len) {
+            write->order[write->count] = i;
+            write->src[write->count++] = write->len_data +
+                (nlen + i - len_first) * block_size;
+        } else if (nfc_tag_t2_write_data_block_changed(write, i)) {
+            write->order[write->count] = i;
+            write->src[write->count++] = write->image +
+                (i - write->first_block) * block_size;
+        }
+    }
+
+    GDEBUG("%u block(s) out of %u need to be written", write->count,
+        write->nblocks);
+    if (write->count) {
+        write->pos = 0;
+        return nfc_tag_t2_write_data_next(write);
+    } else {
+        /* Nothing to write - call completion on a fresh stack */
+        write->complete_id = g_idle_add(nfc_tag_t2_write_data_complete_cb,
+            write);
+        return TRUE;
+    }
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_fetch(
+    NfcTagType2WriteData* write);
+
+static
+void
+nfc_tag_t2_write_data_fetch_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2WriteData* write = user_data;
+    NfcTag* tag = &t2->tag;
+    const guint block_size = t2->block_size;
+    guint bno;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
+        write->fetch_block, &bno, NULL);
+
+    write->cmd_id = 0;
+    nfc_tag_ref(tag);
+    if (status == NFC_TRANSMIT_STATUS_OK && len >= block_size) {
+        nfc_tag_t2_sector_set_data(sector, block_size, data, bno,
+            len / block_size);
+        /* At least the first requested block must be there now */
+        if (!nfc_tag_t2_data_block_cached(t2, write->fetch_block) ||
+            !nfc_tag_t2_write_data_fetch(write)) {
+            nfc_tag_t2_write_data_error(write);
+        }
+    } else {
+        GDEBUG("Oops, fetch failed!");
+        nfc_tag_t2_write_data_error(write);
+    }
+    nfc_tag_unref(tag);
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_fetch(
+    NfcTagType2WriteData* write)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint end = write->first_block + write->nblocks;
+    guint first = write->first_block;
+
+    while (first < end && nfc_tag_t2_data_block_cached(t2, first)) {
+        first++;
+    }
+
+    if (first < end) {
+        guint last = end - 1, bno;
+        NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
+            first, &bno, NULL);
+
+        /* Fetch all unknown blocks with as few reads as possible */
+        while (last > first && nfc_tag_t2_data_block_cached(t2, last)) {
+            last--;
+        }
+        write->fetch_block = first;
+        write->cmd_id = nfc_tag_t2_cmd_read_blocks(t2, sector -
+            t2->priv->sectors, bno, MIN(last - first + 1, sector->size /
+            t2->block_size - bno), write->seq,
+            nfc_tag_t2_write_data_fetch_resp, NULL, write);
+        return write->cmd_id != 0;
+    } else {
+        return nfc_tag_t2_write_data_plan(write);
+    }
+}
+
+static
+gboolean
+nfc_tag_t2_write_data_start(
+    NfcTagType2WriteData* write)
+{
+    NfcTagType2* t2 = write->t2;
+    const guint block_size = t2->block_size;
+    const guint size = g_bytes_get_size(write->bytes);
+
+    GASSERT(!write->cmd_id);
+    write->first_block = write->offset / block_size;
+    write->nblocks = (write->offset + size + block_size - 1) / block_size -
+        write->first_block;
+    write->image = g_malloc(write->nblocks * block_size);
+
+    /*
+     * Even partially overwritten blocks have to be compared with
+     * the current contents, fetch whatever isn't cached.
+     */
+    return nfc_tag_t2_write_data_fetch(write);
+}
+
+static
+void
+nfc_tag_t2_write_data_wait(
+    NfcTarget* target,
+    void* user_data)
+{
+    NfcTagType2WriteData* write = user_data;
+
+    if (target->sequence == write->seq) {
+        GDEBUG("Starting write #%u", write->seq_id);
+        nfc_target_remove_handler(target, write->start_id);
+        write->start_id = 0;
+        if (!nfc_tag_t2_write_data_start(write)) {
+            nfc_tag_t2_write_data_error(write);
+        }
+    }
+}
+
+/*==========================================================================*
+ * Prefetch
+ *
+ * Once the tag is initialized, the rest of its data area is read in
+ * the background, one command at a time, with low priority. Nothing
+ * is sent while anyone else has something queued or the target is
+ * running a sequence. Then we wait until the target becomes idle.
+ * The end of a sequence is signaled by the target. There's no such
+ * signal for the queue, so in that case we back off exponentially.
+ *==========================================================================*/
+
+static
+void
+nfc_tag_t2_prefetch_next(
+    NfcTagType2* self);
+
+static
+gboolean
+nfc_tag_t2_prefetch_timer(
+    gpointer user_data)
+{
+    NfcTagType2* self = THIS(user_data);
+
+    self->priv->prefetch_timer = 0;
+    nfc_tag_t2_prefetch_next(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+nfc_tag_t2_prefetch_schedule(
+    NfcTagType2* self,
+    guint ms)
+{
+    NfcTagType2Priv* priv = self->priv;
+
+    if (!priv->prefetch_timer) {
+        priv->prefetch_timer = ms ?
+            g_timeout_add(ms, nfc_tag_t2_prefetch_timer, self) :
+            g_idle_add(nfc_tag_t2_prefetch_timer, self);
+    }
 }
 
 static
 void
-nfc_tag_t2_write_resp(
-    NfcTagType2* t2,
-    NFC_TRANSMIT_STATUS status,
-    const void* resp,
-    guint len,
+nfc_tag_t2_prefetch_sequence_changed(
+    NfcTarget* target,
     void* user_data)
 {
-    NfcTag* tag = &t2->tag;
-    NfcTagType2WriteData* write = user_data;
-    NfcTagType2Priv* priv = t2->priv;
-    gsize total_size = 0;
-    const guint block_size = t2->block_size;
-    const guint8* data = g_bytes_get_data(write->bytes, &total_size);
-
-    write->cmd_id = 0;
+    NfcTagType2* self = THIS(user_data);
+    NfcTagType2Priv* priv = self->priv;
 
-    /* Round total size down to the nearest block boundary.
-     * Offset is rounded too (see nfc_tag_t2_write) */
-    total_size -= total_size % block_size;
+    if (!target->sequence) {
+        nfc_target_remove_handler(target, priv->prefetch_seq_id);
+        priv->prefetch_seq_id = 0;
 
-    nfc_tag_ref(tag);
-    if (status != NFC_TRANSMIT_STATUS_OK) {
-        NfcTagType2WriteFunc complete = write->complete.write_cb;
+        /* Don't submit anything from the signal handler */
+        nfc_tag_t2_prefetch_schedule(self, 0);
+    }
+}
 
-        GDEBUG("Oops, write failed!");
-        if (complete) {
-            write->complete.write_cb = NULL;
-            complete(write->t2, status, write->written, write->user_data);
-        }
-        g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
-    } else if ((write->written + block_size) >= total_size) {
-        /* Last write succeeded */
-        guint written = write->written;
-        NfcTagType2WriteFunc complete = write->complete.write_cb;
+static
+void
+nfc_tag_t2_prefetch_reactivated(
+    NfcTarget* target,
+    NFC_REACTIVATE_STATUS status,
+    void* user_data)
+{
+    NfcTagType2* self = THIS(user_data);
 
-        written += block_size;
-        GDEBUG("Wrote %u byte(s)", written);
-        GASSERT(written == total_size);
-        if (complete) {
-            write->complete.write_cb = NULL;
-            complete(write->t2, status, written, write->user_data);
-        }
-        g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+    if (status == NFC_REACTIVATE_STATUS_SUCCESS) {
+        /* Freshly activated tag always starts in sector 0 */
+        self->priv->sector = 0;
     } else {
-        /* Write the next block */
-        NfcTagType2Sector* sector = priv->sectors + write->sector_number;
-        guint next_block;
-
-        write->written += block_size;
-        next_block = (write->offset + write->written)/block_size;
-        nfc_tag_t2_sector_invalidate(sector, block_size, next_block, 1);
-        write->cmd_id = nfc_tag_t2_cmd_write(t2, next_block,
-            data + write->written, write->seq, nfc_tag_t2_write_resp,
-            NULL, write);
+        GDEBUG("Failed to reactivate Type 2 tag");
     }
-    nfc_tag_unref(tag);
 }
 
 static
 void
-nfc_tag_t2_write_data_fetch_resp(
-    NfcTagType2* t2,
-    NFC_TRANSMIT_STATUS status,
-    const void* data,
-    guint len,
-    void* user_data)
+nfc_tag_t2_prefetch_reactivate(
+    NfcTagType2* self)
 {
-    NfcTagType2WriteData* write = user_data;
-    NfcTag* tag = &t2->tag;
+    NfcTag* tag = &self->tag;
 
-    write->cmd_id = 0;
+    /* The prefetch sequence is still holding the target */
     nfc_tag_ref(tag);
-
-    if (status == NFC_TRANSMIT_STATUS_OK && len > 0) {
-        const guint block_size = t2->block_size;
-        const guint8* bytes = data;
-        const guint nb = len / block_size;
-        guint8 b[NFC_TAG_T2_MAX_BLOCK_SIZE];
-        guint next_block;
-        gsize write_size;
-        const guint8* write_data = g_bytes_get_data(write->bytes, &write_size);
-        NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
-            (write->offset + write->written) / block_size, &next_block, NULL);
-        /* Sector must be there, the initiator of fetch has checked that. */
-
-        nfc_tag_t2_sector_set_data(sector, block_size, bytes, next_block, nb);
-
-        /* Mix the contents */
-        if (!write->written) {
-            const guint block_offset = write->offset % block_size;
-
-            /* First block (and possibly the last one) */
-            GASSERT(block_offset);
-            GASSERT(!write->written);
-            memcpy(b, sector->data.bytes + (write->offset - block_offset),
-                block_size);
-            memcpy(b + block_offset, write_data, MIN(block_size - block_offset,
-                write_size));
-            write->cmd_id = nfc_tag_t2_cmd_write(t2, next_block, b,
-                write->seq, nfc_tag_t2_write_data_resp, NULL, write);
-        } else {
-            const guint remaining = write_size - write->written;
-
-            /* Last block */
-            GASSERT(remaining < block_size);
-            memcpy(b, write_data + write->written, remaining);
-            memcpy(b + remaining, sector->bytes + (next_block * block_size +
-                remaining), block_size - remaining);
-            write->cmd_id = nfc_tag_t2_cmd_write(t2, next_block, b,
-                write->seq, nfc_tag_t2_write_data_resp, NULL, write);
-        }
-    } else {
-        GDEBUG("Oops, fetch failed!");
-        nfc_tag_t2_write_data_error(write);
+    if (!nfc_target_reactivate(tag->target, self->priv->prefetch_seq,
+        nfc_tag_t2_prefetch_reactivated,
+        (GDestroyNotify)nfc_tag_unref, self)) {
+        GDEBUG("Oops. Failed to reactivate, leaving the tag as is");
+        nfc_tag_unref(tag);
     }
-    nfc_tag_unref(tag);
 }
 
 static
 void
-nfc_tag_t2_write_data_resp(
-    NfcTagType2* t2,
+nfc_tag_t2_prefetch_resp(
+    NfcTagType2* self,
     NFC_TRANSMIT_STATUS status,
-    const void* resp,
+    const void* data,
     guint len,
     void* user_data)
 {
-    NfcTagType2WriteData* write = user_data;
-    NfcTagType2Priv* priv = t2->priv;
-    NfcTag* tag = &t2->tag;
-    gsize total_size = 0;
-    const guint8* data = g_bytes_get_data(write->bytes, &total_size);
-    const guint block_size = t2->block_size;
-    const guint written = block_size - /* Adjust for first unaligned block */
-        (write->written + write->offset) % block_size;
+    NfcTagType2Priv* priv = self->priv;
+    NfcTag* tag = &self->tag;
+    const guint block_size = self->block_size;
+    const guint block = GPOINTER_TO_UINT(user_data); /* Data block */
+    guint bno;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self, block,
+        &bno, NULL);
 
-    write->cmd_id = 0;
+    priv->prefetch_id = 0;
     nfc_tag_ref(tag);
-    if (status != NFC_TRANSMIT_STATUS_OK) {
-        GDEBUG("Oops, write failed!");
-        nfc_tag_t2_write_data_error(write);
-    } else if ((write->written + written) >= total_size) {
-        /* Last write succeeded */
-        guint total = write->written + written;
-        NfcTagType2WriteDataFunc complete = write->complete.write_data_cb;
-
-        if (total > total_size) {
-            /* Don't report more bytes written than requested (even
-             * though we could have actually written more due to
-             * unaligned offset and/or size) */
-            total = total_size;
-        }
-
-        GDEBUG("Wrote %u byte(s)", total);
-        if (complete) {
-            write->complete.write_cb = NULL;
-            complete(write->t2, NFC_TAG_T2_IO_STATUS_OK, total,
-                write->user_data);
-        }
-        g_hash_table_remove(priv->writes, GUINT_TO_POINTER(write->seq_id));
+    nfc_tag_t2_fetch_stop(self, &priv->prefetch);
+    if (status == NFC_TRANSMIT_STATUS_OK && len >= block_size) {
+        const GUtilData* sd = &sector->data;
+        const guint data_end = (sd->bytes - sector->bytes + sd->size) /
+            block_size;
+        const guint nb = MIN(len / block_size, data_end - bno);
+
+        nfc_target_sequence_unref(priv->prefetch_seq);
+        priv->prefetch_seq = NULL;
+        nfc_tag_t2_sector_set_data(sector, block_size, data, bno, nb);
+        priv->prefetch_block = block + nb;
+        nfc_tag_t2_prefetch_next(self);
     } else {
-        /* Write the next block */
-        guint remaining;
-        guint next_block;
-        gboolean next_block_cached;
-        NfcTagType2Sector* sector;
-
-        write->written += written;
-        remaining = total_size - write->written;
-        sector = nfc_tag_t2_data_block_to_sector(t2, (write->offset +
-            write->written) / block_size, &next_block, &next_block_cached);
-
-        nfc_tag_t2_sector_invalidate(sector, block_size, next_block, 1);
-        if (remaining < block_size) {
-            if (next_block_cached) {
-                guint8 b[NFC_TAG_T2_MAX_BLOCK_SIZE];
-
-                /* Mix the contents */
-                memcpy(b, data + write->written, remaining);
-                memcpy(b + remaining, sector->bytes +
-                    (next_block * block_size + remaining),
-                    block_size - remaining);
-                write->cmd_id = nfc_tag_t2_cmd_write(t2, next_block, b,
-                    write->seq, nfc_tag_t2_write_data_resp, NULL, write);
-            } else {
-                /* Have to fetch it first */
-                write->cmd_id = nfc_tag_t2_cmd_read(t2, next_block,
-                   write->seq, nfc_tag_t2_write_data_fetch_resp, NULL, write);
-            }
-        } else{
-            write->cmd_id = nfc_tag_t2_cmd_write(t2, next_block,
-                data + write->written, write->seq, nfc_tag_t2_write_data_resp,
-                NULL, write);
+        /* Not worth retrying, it's only an optimization */
+        GDEBUG("Prefetch failed at block %u", block);
+        if (status == NFC_TRANSMIT_STATUS_NACK ||
+            status == NFC_TRANSMIT_STATUS_OK /* 4-bit NACK */) {
+            /*
+             * Most likely, the rest of the memory is read protected
+             * (e.g. by AUTH0 on NTAG21x and Ultralight EV1). NACK sends
+             * the tag back to IDLE state, reactivate it before anyone
+             * else gets a chance to talk to it.
+             */
+            nfc_tag_t2_prefetch_reactivate(self);
         }
+        nfc_target_sequence_unref(priv->prefetch_seq);
+        priv->prefetch_seq = NULL;
     }
+    nfc_tag_t2_fetch_done(self);
     nfc_tag_unref(tag);
 }
 
 static
 void
-nfc_tag_t2_write_data_unaligned_start(
-    NfcTagType2WriteData* write)
+nfc_tag_t2_prefetch_next(
+    NfcTagType2* self)
 {
-    NfcTagType2* t2 = write->t2;
-    const guint block_size = t2->block_size;
-    const guint block_offset = write->offset % block_size;
-    gsize write_size;
-    const guint8* write_data = g_bytes_get_data(write->bytes, &write_size);
-    guint start_block;
-    gboolean start_block_cached;
-    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(t2,
-        write->offset / block_size, &start_block, &start_block_cached);
+    NfcTagType2Priv* priv = self->priv;
+    NfcTarget* target = self->tag.target;
+    guint block = priv->prefetch_block;
 
-    GASSERT(block_offset);
-    GASSERT(!write->cmd_id);
+    if (!target->present || priv->prefetch_id) {
+        return;
+    }
 
-    /* For unaligned writes we have to first read the block that
-     * we are going to (partially) overwrite. */
-    nfc_tag_t2_sector_invalidate(sector, block_size, start_block, 1);
-    if (start_block_cached) {
-        guint8 b[NFC_TAG_T2_MAX_BLOCK_SIZE];
-
-        /* Mix the contents */
-        memcpy(b, sector->data.bytes + (write->offset - block_offset),
-            block_size);
-        memcpy(b + block_offset, write_data, MIN(block_size - block_offset,
-            write_size));
-        write->cmd_id = nfc_tag_t2_cmd_write(t2, start_block, b, write->seq,
-            nfc_tag_t2_write_data_resp, NULL, write);
-    } else {
-        /* Have to fetch it first */
-        write->cmd_id = nfc_tag_t2_cmd_read(t2, start_block, write->seq,
-            nfc_tag_t2_write_data_fetch_resp, NULL, write);
+    /* Yield to everyone else */
+    if (target->sequence) {
+        if (!priv->prefetch_seq_id) {
+            priv->prefetch_seq_id = nfc_target_add_sequence_handler(target,
+                nfc_tag_t2_prefetch_sequence_changed, self);
+        }
+        return;
+    } else if (nfc_target_queue_depth(target, NFC_TARGET_PRIORITY_HIGH) ||
+        nfc_target_queue_depth(target, NFC_TARGET_PRIORITY_NORMAL)) {
+        nfc_tag_t2_prefetch_schedule(self, priv->prefetch_delay);
+        priv->prefetch_delay = MIN(priv->prefetch_delay * 2,
+            NFC_TAG_T2_PREFETCH_MAX_DELAY_MS);
+        return;
     }
-}
+    priv->prefetch_delay = NFC_TAG_T2_PREFETCH_DELAY_MS;
 
-static
-void
-nfc_tag_t2_write_data_unaligned_wait(
-    NfcTarget* target,
-    void* user_data)
-{
-    NfcTagType2WriteData* write = user_data;
+    /* Skip the blocks which are already cached or being read */
+    while (block < priv->data_blocks &&
+        (nfc_tag_t2_data_block_cached(self, block) ||
+        nfc_tag_t2_fetch_find(self, block))) {
+        block++;
+    }
 
-    if (target->sequence == write->seq) {
-        GDEBUG("Starting write #%u", write->seq_id);
-        nfc_target_remove_handler(target, write->start_id);
-        write->start_id = 0;
-        nfc_tag_t2_write_data_unaligned_start(write);
+    if (block < priv->data_blocks) {
+        guint bno, count = 1;
+        NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self,
+            block, &bno, NULL);
+        const GUtilData* sd = &sector->data;
+        const guint data_end = (sd->bytes - sector->bytes + sd->size) /
+            self->block_size;
+
+        /* Read the whole uncached range within the sector */
+        while ((bno + count) < data_end &&
+            !nfc_tag_t2_data_block_cached(self, block + count) &&
+            !nfc_tag_t2_fetch_find(self, block + count)) {
+            count++;
+        }
+        /*
+         * The command runs in its own sequence. The target is idle, so
+         * the sequence starts right away, SECTOR_SELECT is only sent if
+         * the sector has to be switched and the reads may wait for the
+         * prefetch (see nfc_tag_t2_fetch_can_wait) rather than fetching
+         * the same blocks again.
+         */
+        priv->prefetch_seq = nfc_target_sequence_new(target);
+        priv->prefetch_block = block;
+        priv->prefetch_id = nfc_tag_t2_cmd_read_blocks_full(self,
+            sector - priv->sectors, bno, count, priv->prefetch_seq,
+            NFC_TARGET_PRIORITY_LOW, nfc_tag_t2_prefetch_resp, NULL,
+            GUINT_TO_POINTER(block));
+        if (priv->prefetch_id) {
+            nfc_tag_t2_fetch_start(self, &priv->prefetch,
+                priv->prefetch_seq, block, count);
+        } else {
+            nfc_target_sequence_unref(priv->prefetch_seq);
+            priv->prefetch_seq = NULL;
+        }
+    } else {
+        GDEBUG("Prefetch done");
     }
 }
 
@@ -842,7 +2430,13 @@ nfc_tag_t2_initialized(
         nfc_target_sequence_unref(priv->init_seq);
         priv->init_seq = NULL;
     }
+    nfc_tag_cache_entry_free(priv->cache);
+    priv->cache = NULL;
     nfc_tag_set_initialized(tag);
+    if (priv->sectors && nfc_tag_t2_prefetch_enabled) {
+        /* Read the rest of the data while the tag sits in the field */
+        nfc_tag_t2_prefetch_schedule(self, NFC_TAG_T2_PREFETCH_DELAY_MS);
+    }
 }
 
 static
@@ -855,47 +2449,76 @@ nfc_tag_t2_init_read_resp(
     void* user_data)
 {
     NfcTagType2Priv* priv = self->priv;
-    guint block = GPOINTER_TO_UINT(user_data);
+    guint block = GPOINTER_TO_UINT(user_data); /* Data block */
+    guint rel_block, from_cache = 0;
+    NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self,
+        block, &rel_block, NULL);
 
     priv->init_id = 0;
-    if (status == NFC_TRANSMIT_STATUS_OK) {
-        NfcTagType2Sector* sector = priv->sectors; /* sector 0 */
+    if (status == NFC_TRANSMIT_STATUS_OK && sector) {
         const guint block_size = self->block_size;
         const guint total_blocks = sector->size / block_size;
         guint nb = len / block_size;
         GUtilData data;
 
-        /* Handle reads beyond the end of data */
+        /* Handle reads beyond the end of data (or sector) */
         GASSERT(!(len % block_size));
-        if ((block + nb) > total_blocks) {
-            nb = total_blocks - block;
+        if ((rel_block + nb) > total_blocks) {
+            nb = total_blocks - rel_block;
         }
-        nfc_tag_t2_sector_set_data(sector, block_size, bytes, block, nb);
+        nfc_tag_t2_sector_set_data(sector, block_size, bytes, rel_block, nb);
         block += nb;
-        data.bytes = sector->data.bytes;
-        data.size = (block - NFC_TAG_T2_DATA_BLOCK0) * block_size;
+
+        /* Data area is contiguous, even if it spans several sectors */
+        data.bytes = priv->sectors->data.bytes;
+        data.size = block * block_size;
+
+        if (priv->cache) {
+            /* Validate the cache against the first blocks */
+            from_cache = nfc_tag_t2_cache_load(self, &data);
+            if (from_cache > block) {
+                block = from_cache;
+                data.size = block * block_size;
+            }
+        }
 
         /* Stop reading when we have fetched the entire TLV sequence.
          * That should be enough to parse the NDEF (if there's any)
          * which all we really need in most cases. */
-        if ((block * block_size) < sector->size &&
+        if (block < priv->data_blocks &&
             len >= block_size && !ndef_tlv_check(&data)) {
-            /* Continue reading the data */
-            priv->init_id = nfc_tag_t2_cmd_read(self, block, priv->init_seq,
+            const GUtilData* sd;
+
+            /*
+             * Continue reading the data, possibly in the next sector.
+             * If FAST_READ is supported, read the rest of the sector
+             * in one go.
+             */
+            sector = nfc_tag_t2_data_block_to_sector(self, block,
+                &rel_block, NULL);
+            sd = &sector->data;
+            priv->init_id = nfc_tag_t2_cmd_read_blocks(self, sector -
+                priv->sectors, rel_block, (sd->bytes - sector->bytes +
+                sd->size) / block_size - rel_block, priv->init_seq,
                 nfc_tag_t2_init_read_resp, NULL, GUINT_TO_POINTER(block));
         } else {
             NfcTag* tag = &self->tag;
 
             GDEBUG("Tag data:");
             nfc_hexdump_data(&data);
-            if ((block * block_size) < sector->size) {
+            if (block < priv->data_blocks) {
                 /* Inficate that data wasn't fully read */
                 gutil_log(&nfc_dump_log, GLOG_LEVEL_DEBUG, "  %04X: ...",
                     block * block_size);
             }
 
             /* Find NDEF */
-            tag->ndef = ndef_rec_new_from_tlv(&sector->data);
+            priv->ndef_end = nfc_tag_t2_tlv_end(self, &data);
+            if (!from_cache) {
+                nfc_tag_t2_cache_put(self, data.size);
+            }
+            data.size = self->data_size;
+            tag->ndef = ndef_rec_new_from_tlv(&data);
             nfc_tag_t2_initialized(self);
         }
     } else {
@@ -932,26 +2555,30 @@ nfc_tag_t2_control_area_read_resp(
 
         if (cc[0] == NFC_TAG_T2_CC_NFC_FORUM_MAGIC &&
             cc[1] >= NFC_TAG_T2_CC_MIN_VERSION) {
-            NfcTagType2Sector* sector0;
-
             self->data_size = cc[2] * 8;
             GDEBUG("Data size: %u bytes", self->data_size);
-            /* Allocate sector descriptors (only one sector for now) */
-            priv->sector_count = 1;
-            priv->sectors = g_new0(NfcTagType2Sector, priv->sector_count);
 
-            sector0 = priv->sectors;
-            nfc_tag_t2_sector_init(sector0, self->block_size,
-                NFC_TAG_T2_DATA_BLOCK0, self->data_size / self->block_size, 0);
-            nfc_tag_t2_sector_set_data(sector0, self->block_size, data, 0,
-                len / self->block_size);
+            /* Allocate sector descriptors */
+            nfc_tag_t2_alloc_sectors(self);
+            nfc_tag_t2_sector_set_data(priv->sectors, self->block_size, data,
+                0, len / self->block_size);
+
+            /* Check the persistent cache */
+            priv->cache = nfc_tag_cache_get(NFC_TAG_T2_CACHE_TYPE,
+                &self->serial);
+            if (priv->cache && (priv->cache->key.size != len ||
+                memcmp(priv->cache->key.bytes, data, len))) {
+                GDEBUG("Cache key mismatch");
+                nfc_tag_cache_entry_free(priv->cache);
+                priv->cache = NULL;
+            }
 
             /* We can already mark it as NFC Forum compatible */
             self->t2flags |= NFC_TAG_T2_FLAG_NFC_FORUM_COMPATIBLE;
             /* Start reading the data */
-            priv->init_id = nfc_tag_t2_cmd_read(self, NFC_TAG_T2_DATA_BLOCK0,
-                priv->init_seq, nfc_tag_t2_init_read_resp, NULL,
-                GUINT_TO_POINTER(NFC_TAG_T2_DATA_BLOCK0));
+            priv->init_id = nfc_tag_t2_cmd_read(self, 0,
+                NFC_TAG_T2_DATA_BLOCK0, priv->init_seq,
+                nfc_tag_t2_init_read_resp, NULL, GUINT_TO_POINTER(0));
         } else {
             GDEBUG("Tag is not NFC Forum compatible");
             nfc_tag_t2_initialized(self);
@@ -962,6 +2589,95 @@ nfc_tag_t2_control_area_read_resp(
     }
 }
 
+static
+void
+nfc_tag_t2_read_control_area(
+    NfcTagType2* self)
+{
+    NfcTagType2Priv* priv = self->priv;
+
+    /* Start initialization by reading first blocks of sector 0 */
+    priv->init_id = nfc_tag_t2_cmd_read(self, 0, 0, priv->init_seq,
+        nfc_tag_t2_control_area_read_resp, NULL, NULL);
+    if (!priv->init_id) {
+        nfc_tag_t2_initialized(self);
+    }
+}
+
+static
+void
+nfc_tag_t2_get_version_reactivated(
+    NfcTarget* target,
+    NFC_REACTIVATE_STATUS status,
+    void* user_data)
+{
+    NfcTagType2* self = THIS(user_data);
+
+    if (status == NFC_REACTIVATE_STATUS_SUCCESS) {
+        /* Freshly activated tag always starts in sector 0 */
+        self->priv->sector = 0;
+        nfc_tag_t2_read_control_area(self);
+    } else {
+        GDEBUG("Failed to reactivate Type 2 tag");
+        nfc_tag_t2_initialized(self);
+    }
+    nfc_tag_unref(&self->tag);
+}
+
+static
+void
+nfc_tag_t2_get_version_resp(
+    NfcTagType2* self,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType2Priv* priv = self->priv;
+    NfcTag* tag = &self->tag;
+
+    priv->init_id = 0;
+    if (status == NFC_TRANSMIT_STATUS_OK &&
+        len == NFC_TAG_T2_VERSION_SIZE) {
+        const guint8* version = data;
+
+        /*
+         * GET_VERSION response:
+         *
+         * Byte 0 - Fixed header (0x00)
+         * Byte 1 - Vendor ID
+         * Byte 2 - Product type
+         * Byte 3 - Product subtype
+         * Byte 4 - Major product version
+         * Byte 5 - Minor product version
+         * Byte 6 - Storage size
+         * Byte 7 - Protocol type
+         */
+        GDEBUG("Version:");
+        nfc_hexdump(data, len);
+        if (version[1] == NXP_MANUFACTURER_ID &&
+            (version[2] == NXP_PRODUCT_TYPE_ULTRALIGHT ||
+             version[2] == NXP_PRODUCT_TYPE_NTAG)) {
+            GDEBUG("FAST_READ is supported");
+            priv->fast_read = TRUE;
+        }
+        nfc_tag_t2_read_control_area(self);
+    } else {
+        /*
+         * Tags which don't support GET_VERSION respond with NACK
+         * and go back to IDLE state. They need to be reactivated.
+         */
+        GDEBUG("GET_VERSION is not supported");
+        nfc_tag_ref(tag);
+        if (!nfc_target_reactivate(tag->target, priv->init_seq,
+            nfc_tag_t2_get_version_reactivated, NULL, self)) {
+            GDEBUG("Oops. Failed to reactivate, leaving the tag as is");
+            nfc_tag_t2_read_control_area(self);
+            nfc_tag_unref(tag);
+        }
+    }
+}
+
 static
 void
 nfc_tag_t2_init2(
@@ -1055,14 +2771,42 @@ nfc_tag_t2_new(
         GDEBUG("Type 2 tag%s", desc);
         nfc_tag_t2_init2(self, target, param);
 
-        /* Start initialization by reading first blocks of sector 0 */
-        priv->init_id = nfc_tag_t2_cmd_read(self, 0, priv->init_seq,
-            nfc_tag_t2_control_area_read_resp, NULL, NULL);
+        /*
+         * Ultralight EV1 and NTAG21x support FAST_READ, which allows
+         * to read many blocks with a single command. GET_VERSION tells
+         * us whether it's supported. But older tags respond to it with
+         * NACK and have to be reactivated after that. Don't ask if we
+         * can't reactivate the tag.
+         */
+        if (tag->type == NFC_TAG_TYPE_MIFARE_ULTRALIGHT &&
+            nfc_target_can_reactivate(target)) {
+            static const guint8 cmd[] = { NFC_TAG_T2_CMD_GET_VERSION };
+
+            priv->init_id = nfc_tag_t2_cmd(self, 0, cmd, sizeof(cmd),
+                priv->init_seq, nfc_tag_t2_get_version_resp, NULL, NULL);
+        }
+        if (!priv->init_id) {
+            nfc_tag_t2_read_control_area(self);
+        }
         return self;
     }
     return NULL;
 }
 
+guint
+nfc_tag_t2_alloc_count(
+    void)
+{
+    return nfc_tag_t2_cmd_allocs;
+}
+
+void
+nfc_tag_t2_configure_prefetch(
+    gboolean enable)
+{
+    nfc_tag_t2_prefetch_enabled = enable;
+}
+
 /*==========================================================================*
  * Interface
  *==========================================================================*/
@@ -1076,9 +2820,55 @@ nfc_tag_t2_read(
     GDestroyNotify done,
     void* user_data)
 {
-#pragma message("TODO: Support more than one sector")
-    if (G_LIKELY(self) && sector == 0) {
-        return nfc_tag_t2_cmd_read(self, block, NULL, resp, done, user_data);
+    if (G_LIKELY(self) && (!sector || sector < self->priv->sector_count)) {
+        return nfc_tag_t2_cmd_read(self, sector, block, NULL, resp, done,
+            user_data);
+    }
+    return 0;
+}
+
+guint
+nfc_tag_t2_read_blocks(
+    NfcTagType2* self,
+    guint sector,
+    guint block,
+    guint count,
+    NfcTargetSequence* seq,
+    NfcTagType2ReadFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self) && count > 0 &&
+        (block + count) <= NFC_TAG_T2_SECTOR_BLOCKS &&
+        (!sector || sector < self->priv->sector_count)) {
+        NfcTagType2Priv* priv = self->priv;
+        NfcTagType2ReadData* read = g_slice_new0(NfcTagType2ReadData);
+        const guint block_size = self->block_size;
+
+        read->t2 = self;
+        read->size = count * block_size;
+        read->buffer = g_malloc(read->size);
+        read->sector = sector;
+        read->offset = block * block_size;
+        read->complete.read_cb = complete;
+        read->destroy = destroy;
+        read->user_data = user_data;
+        read->seq_id = nfc_tag_t2_generate_id(self);
+        read->seq = seq ? nfc_target_sequence_ref(seq) :
+            nfc_target_sequence_new(self->tag.target);
+
+        if (!priv->reads) {
+            priv->reads = g_hash_table_new_full(g_direct_hash,
+                g_direct_equal, NULL, nfc_tag_t2_read_data_free);
+        }
+        g_hash_table_insert(priv->reads, GUINT_TO_POINTER(read->seq_id), read);
+        read->cmd_id = nfc_tag_t2_read_blocks_next(read);
+        if (read->cmd_id) {
+            return read->seq_id;
+        }
+        /* Read failed */
+        read->destroy = NULL;
+        g_hash_table_remove(priv->reads, GUINT_TO_POINTER(read->seq_id));
     }
     return 0;
 }
@@ -1106,29 +2896,21 @@ nfc_tag_t2_read_data_seq(
     GDestroyNotify destroy,
     void* user_data) /* Since 1.0.17 */
 {
-#pragma message("TODO: Support more than one sector and cross-sector reads")
     if (G_LIKELY(self) && (self->tag.flags & NFC_TAG_FLAG_INITIALIZED)) {
         NfcTagType2Priv* priv = self->priv;
-        NfcTagType2Sector* sector = priv->sectors;
-        const GUtilData* data = &sector->data;
 
-        if (offset < data->size) {
+        if (offset < self->data_size) {
             NfcTagType2ReadData* read = g_slice_new0(NfcTagType2ReadData);
-            const guint block_size = self->block_size;
-            const guint header_bytes = data->bytes - sector->bytes;
-            const guint header_blocks = header_bytes / block_size;
-            guint end_block, start_block = offset / block_size;
-            gboolean valid;
-
-            if (maxbytes > (data->size - offset)) {
-                maxbytes = (data->size - offset);
+
+            if (maxbytes > (self->data_size - offset)) {
+                maxbytes = (self->data_size - offset);
             }
 
             read->t2 = self;
             read->buffer = g_malloc0(maxbytes);
             read->offset = offset;
             read->size = maxbytes;
-            read->complete = complete;
+            read->complete.read_data_cb = complete;
             read->destroy = destroy;
             read->user_data = user_data;
             read->seq_id = nfc_tag_t2_generate_id(self);
@@ -1140,40 +2922,25 @@ nfc_tag_t2_read_data_seq(
             g_hash_table_insert(priv->reads,
                 GUINT_TO_POINTER(read->seq_id), read);
 
-            end_block = (offset + read->size + block_size - 1) / block_size;
-            nfc_tag_t2_data_block_to_sector(self, start_block, NULL, &valid);
-            if (valid) {
-                guint i, cached_bytes = block_size - (offset % block_size);
-
-                for (i = start_block + 1; i < end_block; i++) {
-                    nfc_tag_t2_data_block_to_sector(self, i, NULL, &valid);
-                    if (valid) {
-                        cached_bytes += block_size;
-                    } else {
-                        break;
-                    }
-                }
-
-                /* Copy cached data */
-                if (cached_bytes > maxbytes) {
-                    cached_bytes = maxbytes;
-                }
-                memcpy(read->buffer, data->bytes + offset, cached_bytes);
-                read->read = cached_bytes;
-                start_block = i;
-            }
+            /* Copy cached data */
+            read->read = nfc_tag_t2_read_cached(self, offset, maxbytes,
+                read->buffer);
 
-            if (start_block == end_block) {
+            if (read->read == read->size) {
                 /* Everything was cached - call completion on a fresh stack */
                 read->complete_id = g_idle_add(nfc_tag_t2_read_complete, read);
                 return read->seq_id;
             } else {
-                /* We actually need to read something */
+                /*
+                 * We actually need to read something. Reads without
+                 * a sequence get a private one, so that SECTOR_SELECT
+                 * is only needed when the read crosses the sector
+                 * boundary and no one else can switch the sector
+                 * in the middle of it.
+                 */
                 read->seq = seq ? nfc_target_sequence_ref(seq) :
                     nfc_target_sequence_new(self->tag.target);
-                read->cmd_id = nfc_tag_t2_cmd_read(self, header_blocks +
-                    start_block, read->seq, nfc_tag_t2_read_resp, NULL, read);
-                if (read->cmd_id) {
+                if (nfc_tag_t2_read_next(read)) {
                     return read->seq_id;
                 }
                 /* Read failed */
@@ -1206,40 +2973,12 @@ nfc_tag_t2_read_data_sync(
         } else if (!nfc_tag_t2_data_block_to_sector(self, end_block - 1,
             NULL, NULL)) {
             return NFC_TAG_T2_IO_STATUS_BAD_SIZE;
-        } else if (!valid) {
-            /* The very first block is invalid, we are done */
+        } else if (!valid ||
+            nfc_tag_t2_read_cached(self, offset, size, NULL) < size) {
             return NFC_TAG_T2_IO_STATUS_NOT_CACHED;
         } else {
-            guint i;
-            guint sect_offset = offset;
-            guint sect_bytes = block_size - (offset % block_size);
-            const GUtilData* data = &sector->data;
-
-            /* Check the remaining blocks */
-            for (i = start_block + 1; i < end_block; i++) {
-                /* Since we have checked the range, sector must be found */
-                NfcTagType2Sector* next = nfc_tag_t2_data_block_to_sector
-                    (self, i, NULL, &valid);
-                if (!valid) {
-                    return NFC_TAG_T2_IO_STATUS_NOT_CACHED;
-                } else if (sector == next) {
-                    /* Count bytes in this sector */
-                    sect_bytes += block_size;
-                } else {
-                    /* Copy bytes from this sector and switch to the next */
-                    if (buffer) {
-                        memcpy(buffer, data->bytes + sect_offset, sect_bytes);
-                        buffer += sect_bytes;
-                    }
-                    sect_offset = 0;
-                    sect_bytes = 0;
-                    sector = next;
-                    data = &sector->data;
-                }
-            }
-
             if (buffer) {
-                memcpy(buffer, data->bytes + sect_offset, sect_bytes);
+                nfc_tag_t2_read_cached(self, offset, size, buffer);
             }
             return NFC_TAG_T2_IO_STATUS_OK;
         }
@@ -1247,6 +2986,21 @@ nfc_tag_t2_read_data_sync(
     return NFC_TAG_T2_IO_STATUS_FAILURE;
 }
 
+gboolean
+nfc_tag_t2_cancel_read(
+    NfcTagType2* self,
+    guint id) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self) && G_LIKELY(id)) {
+        NfcTagType2Priv* priv = self->priv;
+
+        /* Completion callback is not invoked, destroy notification is */
+        return priv->reads && g_hash_table_remove(priv->reads,
+            GUINT_TO_POINTER(id));
+    }
+    return FALSE;
+}
+
 /* Primitive write, absolute block number withint a sector, only writes
  * entire blocks, can be used to write special areas, i.e. lock bytes. */
 guint
@@ -1274,9 +3028,9 @@ nfc_tag_t2_write_seq(
     GDestroyNotify destroy,
     void* user_data) /* Since 1.0.17 */
 {
-#pragma message("TODO: Support more than one sector and cross-sector writes")
-    if (G_LIKELY(self) && bytes && sector_number == 0 &&
-        (self->tag.flags & NFC_TAG_FLAG_INITIALIZED)) {
+    if (G_LIKELY(self) && bytes &&
+        (self->tag.flags & NFC_TAG_FLAG_INITIALIZED) &&
+        sector_number < self->priv->sector_count) {
         gsize size;
         const guint block_size = self->block_size;
         gsize offset = block * block_size;
@@ -1286,7 +3040,7 @@ nfc_tag_t2_write_seq(
 
         /* Round total size down to the nearest block boundary */
         size -= size % block_size;
-        if (sector && size > 0 && (offset + size) <= sector->size) {
+        if (size > 0 && (offset + size) <= sector->size) {
             NfcTagType2WriteData* write = nfc_tag_t2_write_data_new(self,
                 sector_number, offset, bytes, seq, G_CALLBACK(complete),
                 destroy, user_data);
@@ -1294,8 +3048,8 @@ nfc_tag_t2_write_seq(
             GDEBUG("Writing %u block(s) starting at %u", (guint)
                 (size / block_size), block);
             nfc_tag_t2_sector_invalidate(sector, block_size, block, 1);
-            write->cmd_id = nfc_tag_t2_cmd_write(self, block, data,
-                write->seq, nfc_tag_t2_write_resp, NULL, write);
+            write->cmd_id = nfc_tag_t2_cmd_write(self, sector_number, block,
+                data, write->seq, nfc_tag_t2_write_resp, NULL, write);
             if (write->cmd_id) {
                 return write->seq_id;
             }
@@ -1333,18 +3087,14 @@ nfc_tag_t2_write_data_seq(
 {
     if (G_LIKELY(self) && bytes &&
        (self->tag.flags & NFC_TAG_FLAG_INITIALIZED)) {
-        gsize size;
+        const gsize size = g_bytes_get_size(bytes);
         const guint block_size = self->block_size;
-        const guint8* data = g_bytes_get_data(bytes, &size);
         NfcTagType2Priv* priv = self->priv;
-        guint start_block;
-        gboolean start_block_cached;
         NfcTagType2Sector* sector = nfc_tag_t2_data_block_to_sector(self,
-            offset / block_size, &start_block, &start_block_cached);
+            offset / block_size, NULL, NULL);
 
-#pragma message("TODO: Support more than one sector and cross-sector writes")
-        if (sector && size > 0 && (offset + size) <= sector->size) {
-            const guint block_offset = offset % block_size;
+        if (sector && size > 0 && (offset + size) <= self->data_size) {
+            NfcTarget* target = self->tag.target;
             NfcTagType2WriteData* write = nfc_tag_t2_write_data_new(self,
                 sector - priv->sectors, offset, bytes, seq,
                 G_CALLBACK(complete), destroy, user_data);
@@ -1352,33 +3102,20 @@ nfc_tag_t2_write_data_seq(
             GDEBUG("Writing %u data byte(s) starting at offset %u",
                 (guint)size, offset);
 
-            if (block_offset) {
-                NfcTarget* target = self->tag.target;
-
-                if (target->sequence == write->seq) {
-                    /* Our sequence has started right away */
-                    nfc_tag_t2_write_data_unaligned_start(write);
-                    if (write->cmd_id) {
-                        return write->seq_id;
-                    }
-                } else {
-                    /* Even if the block is cached, we can't really do
-                     * anything until our sequence starts, because the
-                     * block can be overwritten, invalidated or whatever
-                     * between now and then. */
-                    GDEBUG("Write #%u is pending", write->seq_id);
-                    write->start_id = nfc_target_add_sequence_handler(target,
-                        nfc_tag_t2_write_data_unaligned_wait, write);
+            if (target->sequence == write->seq) {
+                /* Our sequence has started right away */
+                if (nfc_tag_t2_write_data_start(write)) {
                     return write->seq_id;
                 }
             } else {
-                nfc_tag_t2_sector_invalidate(sector, block_size,
-                    start_block, 1);
-                write->cmd_id = nfc_tag_t2_cmd_write(self, start_block,
-                    data, write->seq, nfc_tag_t2_write_data_resp, NULL, write);
-                if (write->cmd_id) {
-                    return write->seq_id;
-                }
+                /* Even if the blocks are cached, we can't really compare
+                 * anything until our sequence starts, because the blocks
+                 * can be overwritten, invalidated or whatever between now
+                 * and then. */
+                GDEBUG("Write #%u is pending", write->seq_id);
+                write->start_id = nfc_target_add_sequence_handler(target,
+                    nfc_tag_t2_write_data_wait, write);
+                return write->seq_id;
             }
 
             /* Write failed */
@@ -1398,8 +3135,12 @@ void
 nfc_tag_t2_init(
     NfcTagType2* self)
 {
+    NfcTagType2Priv* priv = G_TYPE_INSTANCE_GET_PRIVATE(self, THIS_TYPE,
+        NfcTagType2Priv);
+
     self->block_size = NFC_TAG_T2_BLOCK_SIZE;
-    self->priv = G_TYPE_INSTANCE_GET_PRIVATE(self, THIS_TYPE, NfcTagType2Priv);
+    self->priv = priv;
+    priv->prefetch_delay = NFC_TAG_T2_PREFETCH_DELAY_MS;
 }
 
 static
@@ -1416,6 +3157,18 @@ nfc_tag_t2_finalize(
     if (priv->writes) {
         g_hash_table_destroy(priv->writes);
     }
+    if (priv->wake_id) {
+        g_source_remove(priv->wake_id);
+    }
+    while (priv->selects) {
+        NfcTagType2SectorSelect* select = priv->selects->data;
+
+        /* Cancelling the second packet deallocates the structure */
+        nfc_target_cancel_transmit(self->tag.target, select->select_id);
+        if (!nfc_target_cancel_transmit(self->tag.target, select->ack_id)) {
+            nfc_tag_t2_sector_select_free(select);
+        }
+    }
     if (priv->sectors) {
         guint i;
 
@@ -1424,7 +3177,22 @@ nfc_tag_t2_finalize(
         }
         g_free(priv->sectors);
     }
+    if (priv->select_cmd) {
+        g_bytes_unref(priv->select_cmd);
+    }
+    g_free(priv->block_map);
+    g_free(priv->mem);
+    nfc_tag_cache_entry_free(priv->cache);
+    if (priv->prefetch_timer) {
+        g_source_remove(priv->prefetch_timer);
+    }
+    nfc_target_cancel_transmit(self->tag.target, priv->prefetch_id);
+    nfc_target_sequence_unref(priv->prefetch_seq);
+    nfc_target_remove_handler(self->tag.target, priv->prefetch_seq_id);
     nfc_target_cancel_transmit(self->tag.target, priv->init_id);
+    g_slist_free(priv->waiters);
+    g_slist_free(priv->waking);
+    g_slist_free(priv->fetches);
     nfc_target_sequence_unref(priv->init_seq);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
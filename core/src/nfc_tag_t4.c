@@ -40,6 +40,7 @@
 
 #include "nfc_tag_p.h"
 #include "nfc_tag_t4_p.h"
+#include "nfc_tag_cache.h"
 #include "nfc_target_p.h"
 #include "nfc_util.h"
 #include "nfc_log.h"
@@ -48,28 +49,82 @@
 
 #include <gutil_macros.h>
 
-typedef struct nfc_isodep_tx {
+#define NDEF_CC_LEN (15)
+#define NDEF_DATA_OFFSET (2)
+#define NFC_TAG_T4_CACHE_TYPE "t4"
+#define NFC_TAG_T4_TX_POOL_SIZE (4)
+
+typedef struct nfc_isodep_tx NfcIsoDepTx;
+struct nfc_isodep_tx {
+    NfcIsoDepTx* next;      /* Only used by the pool */
     NfcTagType4* t4;
     NfcTagType4ResponseFunc resp;
     GDestroyNotify destroy;
     void* user_data;
-} NfcIsoDepTx;
+    guint pending;          /* Number of NfcTarget requests */
+    guint timeout_ms;       /* Timeout hint, zero if none */
+    NFC_ISODEP_TX_FLAGS flags;
+    /* The rest is only used for response chaining */
+    guint id;               /* Returned to the caller, zero if none */
+    guint cmd_id;           /* The command currently being sent */
+    NfcTargetSequence* seq;
+    NfcApdu apdu;           /* Last command */
+    GBytes* data;           /* Command data */
+    GByteArray* resp_data;  /* Response data collected so far */
+};
 
 typedef struct nfc_iso_dep_ndef_read {
     NfcTagType4* t4;
     guint8 fid[2];
     guint data_len;
-    guint max_read;
+    guint max_read;         /* Le limit, MLe or less */
+    guint max_write;        /* Lc limit, MLc or less */
+    guint max_size;         /* Maximum NDEF file size */
+    guint head_le;          /* Le of the first READ BINARY */
+    gboolean writable;
+    gboolean complete;      /* The whole NDEF has been read */
+    guint8 cc[NDEF_CC_LEN];
     GByteArray* data;
 } NfcIsoDepNdefRead;
 
+/* What we know about the NDEF file after reading it */
+typedef struct nfc_iso_dep_ndef_file {
+    guint8 cc[NDEF_CC_LEN];
+    guint8 fid[2];
+    guint max_write;        /* Lc limit, MLc or less */
+    guint max_size;         /* Maximum NDEF file size, zero if unknown */
+    gboolean writable;
+} NfcIsoDepNdefFile;
+
+typedef struct nfc_iso_dep_ndef_write {
+    NfcTargetSequence* seq;
+    guint8* image;          /* NLEN (zero if written separately) + NDEF */
+    guint size;             /* Size of the image */
+    guint offset;           /* Offset of the next chunk */
+    guint chunk;            /* Size of the chunk being written */
+    guint8 nlen[2];         /* NLEN to write at the end */
+    gboolean nlen_pending;  /* NLEN has to be written separately */
+    gboolean reselect;      /* Selection has been skipped */
+    guint cmd_id;
+    NfcTagType4WriteNdefFunc complete;
+    GDestroyNotify destroy;
+    void* user_data;
+} NfcIsoDepNdefWrite;
+
 struct nfc_tag_t4_priv {
     guint mtu;  /* FSC (Type 4A) or FSD (Type 4B) */
     GByteArray* buf;
     NfcTargetSequence* init_seq;
     NfcIsoDepNdefRead* init_read;
+    NfcTagCacheEntry* init_cache;
     guint init_id;
+    gint64 init_start;
+    gboolean reset_pending;
+    gboolean ndef_selected;  /* Only valid if reset_pending is TRUE */
+    NfcIsoDepNdefFile ndef_file;
+    NfcIsoDepNdefWrite* ndef_write;
     NfcParamIsoDep* iso_dep; /* Since 1.0.39 */
+    GSList* chains;          /* NfcIsoDepTx with response chaining */
 };
 
 typedef struct nfc_isodep_reset_data {
@@ -86,6 +141,14 @@ typedef struct nfc_isodep_reset_data {
 
 G_DEFINE_ABSTRACT_TYPE(NfcTagType4, nfc_tag_t4, PARENT_TYPE)
 
+/*
+ * Transmission contexts are recycled. The pool is shared by all tags
+ * because a transmission may complete after its tag is gone.
+ */
+static NfcIsoDepTx* nfc_tag_t4_tx_pool = NULL;
+static guint nfc_tag_t4_tx_pool_size = 0;
+static guint nfc_tag_t4_tx_allocs = 0;
+
 /*
  * NFCForum-TS-Type-4-Tag_2.0
  * Section 5.4.2. NDEF Tag Application Select Procedure
@@ -97,13 +160,37 @@ static const GUtilData ndef_aid_data = { ndef_aid, sizeof(ndef_aid) };
 static const GUtilData ndef_cc_ef_data = { ndef_cc_ef, sizeof(ndef_cc_ef) };
 
 #define ISO_SW_NDEF_NOT_FOUND (0x6a82)
-#define NDEF_CC_LEN (15)
-#define NDEF_DATA_OFFSET (2)
+#define ISO_SW_END_OF_FILE (0x6282) /* End of file reached before Le */
+#define ISO_SW1_MORE_DATA (0x61)    /* SW2 more bytes are available */
+#define ISO_SW1_WRONG_LE (0x6c)     /* SW2 is the exact length */
+#define ISO_SHORT_LE_MAX (0x100)
+#define ISO_EXTENDED_LE_MAX (0xffff) /* Plus SW must fit into 64K */
+#define ISO_SHORT_LC_MAX (0xff)
+#define ISO_EXTENDED_LC_MAX (0xffff)
+#define ISO_OFFSET_MAX (0x7fff) /* Larger offsets require ODO */
 
 /*==========================================================================*
  * Implementation
  *==========================================================================*/
 
+static
+NfcIsoDepTx*
+nfc_tag_t4_tx_new(
+    void)
+{
+    NfcIsoDepTx* tx = nfc_tag_t4_tx_pool;
+
+    if (tx) {
+        nfc_tag_t4_tx_pool = tx->next;
+        nfc_tag_t4_tx_pool_size--;
+        memset(tx, 0, sizeof(*tx));
+    } else {
+        tx = g_slice_new0(NfcIsoDepTx);
+        nfc_tag_t4_tx_allocs++;
+    }
+    return tx;
+}
+
 static
 void
 nfc_tag_t4_tx_free(
@@ -111,11 +198,29 @@ nfc_tag_t4_tx_free(
 {
     GDestroyNotify destroy = tx->destroy;
 
+    if (tx->id) {
+        NfcTagType4Priv* priv = tx->t4->priv;
+
+        priv->chains = g_slist_remove(priv->chains, tx);
+    }
     if (destroy) {
         tx->destroy = NULL;
         destroy(tx->user_data);
     }
-    g_slice_free1(sizeof(*tx), tx);
+    nfc_target_sequence_unref(tx->seq);
+    if (tx->data) {
+        g_bytes_unref(tx->data);
+    }
+    if (tx->resp_data) {
+        g_byte_array_free(tx->resp_data, TRUE);
+    }
+    if (nfc_tag_t4_tx_pool_size < NFC_TAG_T4_TX_POOL_SIZE) {
+        tx->next = nfc_tag_t4_tx_pool;
+        nfc_tag_t4_tx_pool = tx;
+        nfc_tag_t4_tx_pool_size++;
+    } else {
+        g_slice_free1(sizeof(*tx), tx);
+    }
 }
 
 static
@@ -123,7 +228,128 @@ void
 nfc_tag_t4_tx_free1(
     void* data)
 {
-    nfc_tag_t4_tx_free((NfcIsoDepTx*)data);
+    NfcIsoDepTx* tx = data;
+
+    /* Chained responses keep using the same context */
+    if (!--tx->pending) {
+        nfc_tag_t4_tx_free(tx);
+    }
+}
+
+static
+void
+nfc_tag_t4_tx_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data);
+
+static
+guint
+nfc_tag_t4_tx_submit(
+    NfcIsoDepTx* tx,
+    const NfcApdu* apdu,
+    NfcTargetSequence* seq)
+{
+    NfcTagType4* t4 = tx->t4;
+    GByteArray* buf = t4->priv->buf;
+
+    if (nfc_apdu_encode(buf, apdu)) {
+        /* NfcTarget only copies the APDU if it has to be queued */
+        const guint id = nfc_target_transmit2(t4->tag.target, buf->data,
+            buf->len, seq, tx->timeout_ms, tx->resp ? nfc_tag_t4_tx_resp :
+            NULL, nfc_tag_t4_tx_free1, tx);
+
+        if (id) {
+            tx->pending++;
+            tx->cmd_id = id;
+        }
+        return id;
+    }
+    return 0;
+}
+
+static
+void
+nfc_tag_t4_tx_done(
+    NfcIsoDepTx* tx,
+    guint sw,
+    const void* data,
+    guint len)
+{
+    GByteArray* buf = tx->resp_data;
+
+    if (buf && buf->len) {
+        /* Deliver the whole thing */
+        if ((buf->len + len) > 0x10000) {
+            GWARN("Type 4 response too long, %u bytes(s)", buf->len + len);
+            tx->resp(tx->t4, ISO_SW_IO_ERR, NULL, 0, tx->user_data);
+        } else {
+            g_byte_array_append(buf, data, len);
+            tx->resp(tx->t4, sw, buf->data, buf->len, tx->user_data);
+        }
+    } else {
+        tx->resp(tx->t4, sw, data, len, tx->user_data);
+    }
+}
+
+/*
+ * ISO/IEC 7816-4
+ * Section 5.3.4 Command-response pairs
+ *
+ * 61xx means that SW2 more bytes are available with GET RESPONSE,
+ * 6Cxx means that the command should be repeated with Le = SW2.
+ * Returns TRUE if the next command has been submitted.
+ */
+static
+gboolean
+nfc_tag_t4_tx_chain(
+    NfcIsoDepTx* tx,
+    guint sw,
+    const void* data,
+    guint len)
+{
+    const guint le = (sw & 0xff) ? (sw & 0xff) : 0x100;
+    const guint collected = tx->resp_data ? tx->resp_data->len : 0;
+
+    switch (sw >> 8) {
+    case ISO_SW1_MORE_DATA:
+        if ((collected + len + le) <= 0x10000) {
+            NfcApdu* apdu = &tx->apdu;
+            const guint8 cla = apdu->cla;
+
+            /* Interindustry class without the command chaining bit */
+            apdu->cla = (cla & ISO_CLA_PROPRIETARY) ? ISO_CLA :
+                (cla & ~ISO_CLA_CHAINING);
+            apdu->ins = ISO_INS_GET_RESPONSE;
+            apdu->p1 = apdu->p2 = 0;
+            apdu->le = le;
+            memset(&apdu->data, 0, sizeof(apdu->data));
+            if (nfc_tag_t4_tx_submit(tx, apdu, tx->seq)) {
+                if (len) {
+                    if (!tx->resp_data) {
+                        tx->resp_data = g_byte_array_sized_new(len + le);
+                    }
+                    g_byte_array_append(tx->resp_data, data, len);
+                }
+                GVERBOSE("GET RESPONSE %u", le);
+                return TRUE;
+            }
+        }
+        break;
+    case ISO_SW1_WRONG_LE:
+        /* Don't loop forever if the card keeps asking for the same Le */
+        if (tx->apdu.le != le) {
+            tx->apdu.le = le;
+            if (nfc_tag_t4_tx_submit(tx, &tx->apdu, tx->seq)) {
+                GVERBOSE("Retrying with Le %u", le);
+                return TRUE;
+            }
+        }
+        break;
+    }
+    return FALSE;
 }
 
 static
@@ -146,9 +372,12 @@ nfc_tag_t4_tx_resp(
             tx->resp(tx->t4, ISO_SW_IO_ERR, NULL, 0, tx->user_data);
         } else {
             const guint8* sw = ((guint8*)data) + len - 2;
+            const guint code = (((guint)sw[0]) << 8) | sw[1];
 
-            tx->resp(tx->t4, (((guint)sw[0]) << 8) | sw[1],  data, len - 2,
-                tx->user_data);
+            if (!(tx->flags & NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE) ||
+                !nfc_tag_t4_tx_chain(tx, code, data, len - 2)) {
+                nfc_tag_t4_tx_done(tx, code, data, len - 2);
+            }
         }
     } else {
         tx->resp(tx->t4, ISO_SW_IO_ERR, NULL, 0, tx->user_data);
@@ -157,7 +386,7 @@ nfc_tag_t4_tx_resp(
 
 static
 guint
-nfc_isodep_submit(
+nfc_isodep_submit_full(
     NfcTagType4* self,
     guint8 cla,             /* Class byte */
     guint8 ins,             /* Instruction byte */
@@ -165,45 +394,126 @@ nfc_isodep_submit(
     guint8 p2,              /* Parameter byte 2 */
     const GUtilData* data,  /* Command data */
     guint le,               /* Expected length */
+    NFC_ISODEP_TX_FLAGS flags,
+    guint timeout_ms,
     NfcTargetSequence* seq,
     NfcTagType4ResponseFunc resp,
     GDestroyNotify destroy,
     void* user_data)
 {
-    NfcTagType4Priv* priv = self->priv;
-    GByteArray* buf = priv->buf;
-    NfcApdu apdu;
-
-    apdu.cla = cla;
-    apdu.ins = ins;
-    apdu.p1 = p1;
-    apdu.p2 = p2;
-    apdu.le = le;
+    NfcIsoDepTx* tx = nfc_tag_t4_tx_new();
+    NfcApdu* apdu = &tx->apdu;
+    guint id;
+
+    tx->t4 = self;
+    tx->resp = resp;
+    tx->destroy = destroy;
+    tx->user_data = user_data;
+    tx->flags = flags;
+    tx->timeout_ms = timeout_ms;
+
+    apdu->cla = cla;
+    apdu->ins = ins;
+    apdu->p1 = p1;
+    apdu->p2 = p2;
+    apdu->le = le;
     if (data) {
-        apdu.data = *data;
-    } else {
-        memset(&apdu.data, 0, sizeof(apdu.data));
+        apdu->data = *data;
     }
 
-    if (nfc_apdu_encode(buf, &apdu)) {
-        NfcTag* tag = &self->tag;
-        NfcIsoDepTx* tx = g_slice_new0(NfcIsoDepTx);
-        guint id;
+    if ((flags & NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE) && resp) {
+        /*
+         * The command may have to be repeated, keep a copy of the data.
+         * Nothing else may get in between, hence the sequence.
+         */
+        tx->seq = seq ? nfc_target_sequence_ref(seq) :
+            nfc_target_sequence_new(self->tag.target);
+        if (apdu->data.size) {
+            tx->data = g_bytes_new(apdu->data.bytes, apdu->data.size);
+            apdu->data.bytes = g_bytes_get_data(tx->data, NULL);
+        }
+        seq = tx->seq;
+    }
 
-        tx->t4 = self;
-        tx->resp = resp;
-        tx->destroy = destroy;
-        tx->user_data = user_data;
-        id = nfc_target_transmit(tag->target, buf->data, buf->len, seq,
-            resp ? nfc_tag_t4_tx_resp : NULL, nfc_tag_t4_tx_free1, tx);
-        if (id) {
-            return id;
-        } else {
-            tx->destroy = NULL;
-            nfc_tag_t4_tx_free(tx);
+    id = nfc_tag_t4_tx_submit(tx, apdu, seq);
+    if (!id) {
+        tx->destroy = NULL;
+        nfc_tag_t4_tx_free(tx);
+    } else if (tx->seq) {
+        /* The first id stays valid for nfc_isodep_cancel() */
+        NfcTagType4Priv* priv = self->priv;
+
+        tx->id = id;
+        priv->chains = g_slist_prepend(priv->chains, tx);
+    }
+    return id;
+}
+
+static
+guint
+nfc_isodep_submit(
+    NfcTagType4* self,
+    guint8 cla,             /* Class byte */
+    guint8 ins,             /* Instruction byte */
+    guint8 p1,              /* Parameter byte 1 */
+    guint8 p2,              /* Parameter byte 2 */
+    const GUtilData* data,  /* Command data */
+    guint le,               /* Expected length */
+    NfcTargetSequence* seq,
+    NfcTagType4ResponseFunc resp,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    return nfc_isodep_submit_full(self, cla, ins, p1, p2, data, le,
+        NFC_ISODEP_TX_FLAGS_NONE, 0, seq, resp, destroy, user_data);
+}
+
+/*
+ * ISO/IEC 7816-4
+ * Section 8.1.1.2.7 Card capabilities
+ *
+ * The third software function table (if present) tells whether
+ * the card supports extended Lc and Le fields. For Type 4A tags
+ * it comes in historical bytes. Type 4B tags have no standard way
+ * of telling that.
+ */
+static
+gboolean
+nfc_tag_t4_extended_length(
+    NfcTagType4* self)
+{
+    const NfcParamIsoDep* iso_dep = self->priv->iso_dep;
+
+    if (iso_dep && self->tag.target->technology == NFC_TECHNOLOGY_A) {
+        const GUtilData* hb = &iso_dep->a.t1;
+
+        /*
+         * Category indicator 80h means that the rest of historical
+         * bytes are COMPACT-TLV data objects, 00h means the same but
+         * followed by 3 bytes of status indicator.
+         */
+        if (hb->size > 1 && (hb->bytes[0] == 0x80 ||
+            (hb->bytes[0] == 0x00 && hb->size > 4))) {
+            const guint8* ptr = hb->bytes + 1;
+            const guint8* end = hb->bytes + hb->size -
+                (hb->bytes[0] ? 0 : 3);
+
+            while (ptr < end) {
+                const guint tag = ptr[0] >> 4;
+                const guint len = ptr[0] & 0x0f;
+
+                ptr++;
+                if ((ptr + len) > end) {
+                    break;
+                } else if (tag == 7 && len >= 3) {
+                    /* Card capabilities, third software function table */
+                    return (ptr[2] & 0x40) != 0;
+                }
+                ptr += len;
+            }
         }
     }
-    return 0;
+    return FALSE;
 }
 
 static
@@ -237,17 +547,32 @@ nfc_iso_dep_ndef_read_new(
                 (fid >= 0x3F01 && fid <= 0x3FFE) ||
                 (fid >= 0x4000 && fid <= 0xFFFE)) {
                 const guint max_read = ((((guint)(cc[3])) << 8) | cc[4]);
+                const guint max_write = ((((guint)(cc[5])) << 8) | cc[6]);
 
                 /* The valid values for MLe are 000Fh-FFFFh */
                 if (max_read >= 0x000f) {
                     NfcIsoDepNdefRead* read = g_slice_new0(NfcIsoDepNdefRead);
-
-                    read->max_read = max_read;
+                    const gboolean ext = nfc_tag_t4_extended_length(self);
+
+                    /* Larger Le and Lc require extended length APDUs */
+                    read->max_read = MIN(max_read, ext ?
+                        ISO_EXTENDED_LE_MAX : ISO_SHORT_LE_MAX);
+                    read->max_write = MIN(max_write, ext ?
+                        ISO_EXTENDED_LC_MAX : ISO_SHORT_LC_MAX);
+                    read->max_size = MAX((((guint)(v[2])) << 8) | v[3],
+                        NDEF_DATA_OFFSET);
+
+                    /* The valid values for MLc are 0001h-FFFFh */
+                    read->writable = (v[5] == 0 /* write access granted */ &&
+                        max_write > 0);
                     read->fid[0] = v[0];
                     read->fid[1] = v[1];
                     read->t4 = self;
+                    memcpy(read->cc, cc, NDEF_CC_LEN);
                     GDEBUG("NDEF file: %04X", fid);
                     GVERBOSE("Max read: %u bytes", read->max_read);
+                    GVERBOSE("Max write: %u bytes%s", read->max_write,
+                        read->writable ? "" : " (read-only)");
                     return read;
                 } else {
                     GDEBUG("MLe too small (%u)", max_read);
@@ -277,6 +602,166 @@ nfc_iso_dep_ndef_read_free(
     }
 }
 
+/*
+ * NDEF cache entries are keyed by NFCID1 (Type 4A) or NFCID0 (Type 4B).
+ * The key part of the entry is the NDEF Tag Application AID followed
+ * by the CC, the data part is NLEN followed by NDEF.
+ *
+ * The most recently seen tags are also kept in memory, in front of the
+ * files. The memory entries are keyed by the UID followed by the AID.
+ * Both layers are only there if the tag cache has been configured.
+ */
+
+static
+GByteArray*
+nfc_tag_t4_cache_id(
+    const GUtilData* uid,
+    GUtilData* id)
+{
+    GByteArray* buf = g_byte_array_sized_new(uid->size + sizeof(ndef_aid));
+
+    g_byte_array_append(buf, uid->bytes, uid->size);
+    g_byte_array_append(buf, ndef_aid, sizeof(ndef_aid));
+    id->bytes = buf->data;
+    id->size = buf->len;
+    return buf;
+}
+static
+gboolean
+nfc_tag_t4_cache_uid(
+    NfcTagType4* self,
+    GUtilData* uid)
+{
+    NfcTag* tag = &self->tag;
+    const NfcParamPoll* poll = nfc_tag_param(tag);
+
+    if (poll) {
+        switch (tag->target->technology) {
+        case NFC_TECHNOLOGY_A:
+            *uid = poll->a.nfcid1;
+            /*
+             * NFCForum-TS-DigitalProtocol-1.0
+             * 4.7.2 NFCID1 Format
+             *
+             * Single size NFCID1 starting with 08h is dynamically
+             * generated. There's no point in caching those.
+             */
+            if (uid->size == 4 && uid->bytes[0] == 0x08) {
+                GDEBUG("Random NFCID1, not using the cache");
+                return FALSE;
+            }
+            return uid->size > 0;
+        case NFC_TECHNOLOGY_B:
+            *uid = poll->b.nfcid0;
+            return uid->size > 0;
+        case NFC_TECHNOLOGY_F:
+        case NFC_TECHNOLOGY_UNKNOWN:
+            break;
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+nfc_tag_t4_cache_entry_valid(
+    const NfcTagCacheEntry* entry)
+{
+    const GUtilData* key = &entry->key;
+    const GUtilData* data = &entry->data;
+
+    return key->size == sizeof(ndef_aid) + NDEF_CC_LEN &&
+        !memcmp(key->bytes, ndef_aid, sizeof(ndef_aid)) &&
+        data->size >= NDEF_DATA_OFFSET && (data->size -
+        NDEF_DATA_OFFSET) == ((((guint)(data->bytes[0])) << 8) |
+        data->bytes[1]);
+}
+
+static
+NfcTagCacheEntry*
+nfc_tag_t4_cache_get(
+    NfcTagType4* self)
+{
+    GUtilData uid;
+    NfcTagCacheEntry* entry = NULL;
+
+    if (nfc_tag_t4_cache_uid(self, &uid)) {
+        GUtilData id;
+        GByteArray* buf = nfc_tag_t4_cache_id(&uid, &id);
+
+        entry = nfc_tag_cache_mem_get(NFC_TAG_T4_CACHE_TYPE, &id);
+        if (entry) {
+            GDEBUG("Found the tag in memory");
+        } else if ((entry = nfc_tag_cache_get(NFC_TAG_T4_CACHE_TYPE,
+            &uid)) != NULL) {
+            if (nfc_tag_t4_cache_entry_valid(entry)) {
+                nfc_tag_cache_mem_put(NFC_TAG_T4_CACHE_TYPE, &id,
+                    &entry->key, &entry->data);
+            } else {
+                GDEBUG("Ignoring invalid cache entry");
+                nfc_tag_cache_entry_free(entry);
+                entry = NULL;
+            }
+        }
+        g_byte_array_free(buf, TRUE);
+    }
+    return entry;
+}
+
+static
+void
+nfc_tag_t4_cache_put(
+    NfcTagType4* self,
+    const guint8* cc,
+    const void* ndef,
+    guint len)
+{
+    GUtilData uid;
+
+    if (nfc_tag_t4_cache_uid(self, &uid)) {
+        GByteArray* buf = g_byte_array_sized_new(NDEF_DATA_OFFSET + len);
+        guint8 key_bytes[sizeof(ndef_aid) + NDEF_CC_LEN];
+        guint8 nlen[NDEF_DATA_OFFSET];
+        GUtilData key, data, id;
+        GByteArray* id_buf;
+
+        memcpy(key_bytes, ndef_aid, sizeof(ndef_aid));
+        memcpy(key_bytes + sizeof(ndef_aid), cc, NDEF_CC_LEN);
+        key.bytes = key_bytes;
+        key.size = sizeof(key_bytes);
+
+        nlen[0] = (guint8)(len >> 8);
+        nlen[1] = (guint8)len;
+        g_byte_array_append(buf, nlen, sizeof(nlen));
+        g_byte_array_append(buf, ndef, len);
+        data.bytes = buf->data;
+        data.size = buf->len;
+
+        id_buf = nfc_tag_t4_cache_id(&uid, &id);
+        nfc_tag_cache_mem_put(NFC_TAG_T4_CACHE_TYPE, &id, &key, &data);
+        nfc_tag_cache_put(NFC_TAG_T4_CACHE_TYPE, &uid, &key, &data);
+        g_byte_array_free(id_buf, TRUE);
+        g_byte_array_free(buf, TRUE);
+    }
+}
+
+static
+void
+nfc_tag_t4_cache_drop(
+    NfcTagType4* self)
+{
+    GUtilData uid;
+
+    if (nfc_tag_t4_cache_uid(self, &uid)) {
+        GUtilData id;
+        GByteArray* buf = nfc_tag_t4_cache_id(&uid, &id);
+
+        nfc_tag_cache_mem_drop(NFC_TAG_T4_CACHE_TYPE, &id);
+        nfc_tag_cache_drop(NFC_TAG_T4_CACHE_TYPE, &uid);
+        g_byte_array_free(buf, TRUE);
+    }
+}
+
 static
 void
 nfc_tag_t4_initialized(
@@ -289,49 +774,57 @@ nfc_tag_t4_initialized(
     g_object_ref(self);
     nfc_target_sequence_unref(priv->init_seq);
     nfc_iso_dep_ndef_read_free(priv->init_read);
+    nfc_tag_cache_entry_free(priv->init_cache);
     priv->init_seq = NULL;
     priv->init_read = NULL;
+    priv->init_cache = NULL;
+    GDEBUG("Type 4 tag initialized in %u ms", (guint)
+        ((g_get_monotonic_time() - priv->init_start) / 1000));
     nfc_tag_set_initialized(tag);
     g_object_unref(self);
 }
 
 static
 void
-nfc_tag_t4_init_done(
-    NfcTarget* target,
-    NFC_REACTIVATE_STATUS status,
-    void* tag)
+nfc_tag_t4_ndef_read_done(
+    NfcTagType4* self)
 {
-    NfcTagType4* self = THIS(tag);
-
     /*
-     * Still mark the tag as initialized even if reactivation times out,
-     * to give the dbus_handlers plugin a chance to run its NDEF handlers.
+     * Reading NDEF has left the NDEF application selected, the tag
+     * has to be reactivated before anyone else talks to it. That may
+     * take a while (or even time out) and nobody may need it at all,
+     * so it's deferred until the first APDU from the outside.
      */
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefRead* read = priv->init_read;
+
+    if (read && read->complete) {
+        nfc_tag_t4_cache_put(self, read->cc, read->data ? read->data->data :
+            NULL, read->data_len);
+    }
+    priv->reset_pending = TRUE;
     nfc_tag_t4_initialized(self);
-    nfc_tag_unref(&self->tag);
 }
 
 static
-void
-nfc_tag_t4_ndef_read_done(
-    NfcTagType4* self)
+gboolean
+nfc_tag_t4_submit_pending_reset(
+    NfcTagType4* self,
+    NfcTargetSequence* seq)
 {
     NfcTagType4Priv* priv = self->priv;
 
-    /*
-     * The initialization sequence has completed, release it. It must be
-     * done now, to avoid blocking presence checks in case if reactivation
-     * times out.
-     */
-    GDEBUG("Reactivating Type 4 tag");
-    nfc_tag_ref(&self->tag);
-    if (!nfc_target_reactivate(self->tag.target, priv->init_seq,
-        nfc_tag_t4_init_done, NULL, self)) {
+    if (priv->reset_pending) {
+        priv->reset_pending = FALSE;
+        GDEBUG("Reactivating Type 4 tag");
+
+        /* The request is queued, nothing gets sent before it completes */
+        if (nfc_target_reactivate(self->tag.target, seq, NULL, NULL, NULL)) {
+            return TRUE;
+        }
         GDEBUG("Oops. Failed to reactivate, leaving the tag as is");
-        nfc_tag_t4_initialized(self);
-        nfc_tag_unref(&self->tag);
     }
+    return FALSE;
 }
 
 static
@@ -347,6 +840,46 @@ nfc_isodep_init_read_binary(
         self->priv->init_seq, resp, NULL, NULL);
 }
 
+static
+void
+nfc_tag_t4_init_read_ndef_data_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data);
+
+/* Returns TRUE if the next chunk has been requested */
+static
+gboolean
+nfc_tag_t4_init_ndef_data(
+    NfcTagType4* self,
+    const void* data,
+    guint len)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefRead* read = priv->init_read;
+    GByteArray* buf = read->data;
+
+    g_byte_array_append(buf, data, MIN(len, read->data_len - buf->len));
+    if (buf->len < read->data_len) {
+        const guint remaining = read->data_len - buf->len;
+
+        return (priv->init_id = nfc_isodep_init_read_binary(self,
+            buf->len + NDEF_DATA_OFFSET, MIN(remaining, read->max_read),
+            nfc_tag_t4_init_read_ndef_data_resp)) != 0;
+    } else {
+        GUtilData ndef;
+
+        /* Parse the NDEF */
+        ndef.bytes = buf->data;
+        ndef.size = buf->len;
+        self->tag.ndef = ndef_rec_new(&ndef);
+        read->complete = TRUE;
+        return FALSE;
+    }
+}
+
 static
 void
 nfc_tag_t4_init_read_ndef_data_resp(
@@ -360,29 +893,52 @@ nfc_tag_t4_init_read_ndef_data_resp(
 
     if (sw == ISO_SW_OK) {
         if (len > 0) {
-            NfcIsoDepNdefRead* read = priv->init_read;
-            GByteArray* buf = read->data;
+            if (nfc_tag_t4_init_ndef_data(self, data, len)) {
+                return;
+            }
+        } else {
+            GDEBUG("Empty NDEF read");
+        }
+    } else if (sw != ISO_SW_IO_ERR) {
+        GDEBUG("NDEF read error %04X", sw);
+    } else {
+        GDEBUG("NDEF read I/O error");
+    }
+    priv->init_id = 0;
+    nfc_tag_t4_ndef_read_done(self);
+}
 
-            g_byte_array_append(buf, data, len);
-            if (buf->len < read->data_len) {
-                const guint remaining = read->data_len - buf->len;
+static
+void
+nfc_tag_t4_init_read_ndef_len_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType4Priv* priv = self->priv;
+
+    if (sw == ISO_SW_OK) {
+        if (len == NDEF_DATA_OFFSET) {
+            NfcIsoDepNdefRead* read = priv->init_read;
+            const guint8* bytes = data;
 
+            read->data_len = ((((guint)(bytes[0])) << 8) | bytes[1]);
+            if (read->data_len > 0) {
+                GDEBUG("Reading %u bytes of NDEF data", read->data_len);
+                read->data = g_byte_array_sized_new(read->data_len);
                 if ((priv->init_id = nfc_isodep_init_read_binary(self,
-                    buf->len + NDEF_DATA_OFFSET,
-                    MIN(remaining, read->max_read),
+                    NDEF_DATA_OFFSET, MIN(read->data_len, read->max_read),
                     nfc_tag_t4_init_read_ndef_data_resp)) != 0) {
                     return;
                 }
             } else {
-                GUtilData ndef;
-
-                /* Parse the NDEF */
-                ndef.bytes = buf->data;
-                ndef.size = buf->len;
-                self->tag.ndef = ndef_rec_new(&ndef);
+                GDEBUG("NDEF is empty");
+                read->complete = TRUE;
             }
         } else {
-            GDEBUG("Empty NDEF read");
+            GDEBUG("Unexpected number of bytes from NDEF file (%u)", len);
         }
     } else if (sw != ISO_SW_IO_ERR) {
         GDEBUG("NDEF read error %04X", sw);
@@ -395,7 +951,115 @@ nfc_tag_t4_init_read_ndef_data_resp(
 
 static
 void
-nfc_tag_t4_init_read_ndef_len_resp(
+nfc_tag_t4_init_read_ndef_head_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data);
+
+static
+guint
+nfc_tag_t4_init_read_ndef_head(
+    NfcTagType4* self,
+    guint le)
+{
+    self->priv->init_read->head_le = le;
+    return nfc_isodep_init_read_binary(self, 0, le,
+        nfc_tag_t4_init_read_ndef_head_resp);
+}
+
+/*
+ * NLEN and (at least) the beginning of NDEF data come in one response.
+ * If the card doesn't like our Le, fall back to reading NLEN alone.
+ */
+static
+void
+nfc_tag_t4_init_read_ndef_head_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefRead* read = priv->init_read;
+
+    if (sw == ISO_SW_OK || sw == ISO_SW_END_OF_FILE) {
+        if (len >= NDEF_DATA_OFFSET) {
+            const guint8* bytes = data;
+
+            read->data_len = ((((guint)(bytes[0])) << 8) | bytes[1]);
+            if (read->data_len > 0) {
+                GDEBUG("Reading %u bytes of NDEF data", read->data_len);
+                read->data = g_byte_array_sized_new(read->data_len);
+                if (nfc_tag_t4_init_ndef_data(self, bytes + NDEF_DATA_OFFSET,
+                    len - NDEF_DATA_OFFSET)) {
+                    return;
+                }
+            } else {
+                GDEBUG("NDEF is empty");
+                read->complete = TRUE;
+            }
+        } else {
+            GDEBUG("Unexpected number of bytes from NDEF file (%u)", len);
+        }
+    } else if (sw == ISO_SW_IO_ERR) {
+        GDEBUG("NDEF read I/O error");
+    } else if ((sw >> 8) == ISO_SW1_WRONG_LE &&
+        (sw & 0xff) >= NDEF_DATA_OFFSET && (sw & 0xff) != read->head_le) {
+        /* The card has told us the exact length, try again */
+        GDEBUG("Retrying NDEF read with Le %u", sw & 0xff);
+        if ((priv->init_id = nfc_tag_t4_init_read_ndef_head(self,
+            sw & 0xff)) != 0) {
+            return;
+        }
+    } else if (read->head_le != NDEF_DATA_OFFSET) {
+        GDEBUG("NDEF read error %04X, reading NLEN only", sw);
+        /* Read first 2 bytes of the NDEF file (record size) */
+        if ((priv->init_id = nfc_isodep_init_read_binary(self, 0,
+            NDEF_DATA_OFFSET, nfc_tag_t4_init_read_ndef_len_resp)) != 0) {
+            return;
+        }
+    } else {
+        GDEBUG("NDEF read error %04X", sw);
+    }
+    priv->init_id = 0;
+    nfc_tag_t4_ndef_read_done(self);
+}
+
+static
+guint
+nfc_tag_t4_init_select_cc(
+    NfcTagType4* self);
+
+/* Remembers what we know about the selected NDEF file */
+static
+void
+nfc_tag_t4_init_ndef_file(
+    NfcTagType4* self)
+{
+    NfcTagType4Priv* priv = self->priv;
+    const NfcIsoDepNdefRead* read = priv->init_read;
+    NfcIsoDepNdefFile* file = &priv->ndef_file;
+
+    memcpy(file->cc, read->cc, NDEF_CC_LEN);
+    file->fid[0] = read->fid[0];
+    file->fid[1] = read->fid[1];
+    file->max_write = read->max_write;
+    file->max_size = read->max_size;
+    file->writable = read->writable;
+    priv->ndef_selected = TRUE;
+}
+
+/*
+ * The CC and NDEF come from the cache. If NLEN matches, the cached
+ * NDEF is assumed to be valid. Otherwise, NDEF is read from the tag
+ * as usual.
+ */
+static
+void
+nfc_tag_t4_init_check_cache_resp(
     NfcTagType4* self,
     guint sw,
     const void* data,
@@ -403,34 +1067,28 @@ nfc_tag_t4_init_read_ndef_len_resp(
     void* user_data)
 {
     NfcTagType4Priv* priv = self->priv;
-
-    if (sw == ISO_SW_OK) {
-        if (len == NDEF_DATA_OFFSET) {
-            NfcIsoDepNdefRead* read = priv->init_read;
-            const guint8* bytes = data;
-
-            read->data_len = ((((guint)(bytes[0])) << 8) | bytes[1]);
-            if (read->data_len > 0) {
-                GDEBUG("Reading %u bytes of NDEF data", read->data_len);
-                read->data = g_byte_array_sized_new(read->data_len);
-                if ((priv->init_id = nfc_isodep_init_read_binary(self,
-                    NDEF_DATA_OFFSET, MIN(read->data_len, read->max_read),
-                    nfc_tag_t4_init_read_ndef_data_resp)) != 0) {
-                    return;
-                }
-            } else {
-                GDEBUG("NDEF is empty");
-            }
-        } else {
-            GDEBUG("Unexpected number of bytes from NDEF file (%u)", len);
+    NfcTagCacheEntry* cache = priv->init_cache;
+
+    priv->init_cache = NULL;
+    if (sw == ISO_SW_OK && len == NDEF_DATA_OFFSET &&
+        !memcmp(data, cache->data.bytes, NDEF_DATA_OFFSET)) {
+        GDEBUG("NDEF matches the cache");
+        if (cache->data.size > NDEF_DATA_OFFSET) {
+            GUtilData ndef;
+
+            ndef.bytes = cache->data.bytes + NDEF_DATA_OFFSET;
+            ndef.size = cache->data.size - NDEF_DATA_OFFSET;
+            self->tag.ndef = ndef_rec_new(&ndef);
         }
-    } else if (sw != ISO_SW_IO_ERR) {
-        GDEBUG("NDEF read error %04X", sw);
+        nfc_tag_cache_entry_free(cache);
+        priv->init_id = 0;
+        nfc_tag_t4_ndef_read_done(self);
     } else {
-        GDEBUG("NDEF read I/O error");
+        GDEBUG("Cached NDEF is out of date");
+        nfc_tag_cache_entry_free(cache);
+        nfc_tag_t4_cache_drop(self);
+        nfc_tag_t4_init_read_ndef_len_resp(self, sw, data, len, user_data);
     }
-    priv->init_id = 0;
-    nfc_tag_t4_ndef_read_done(self);
 }
 
 static
@@ -444,13 +1102,35 @@ nfc_tag_t4_init_select_ndef_resp(
 {
     NfcTagType4Priv* priv = self->priv;
 
-    if (sw == ISO_SW_OK) {
+    if (sw == ISO_SW_OK && priv->init_cache) {
         NfcIsoDepNdefRead* read = priv->init_read;
 
-        GDEBUG("Selected %02X%02X", read->fid[0], read->fid[1]);
-        /* Read first 2 bytes of the NDEF file (record size) */
+        GDEBUG("Selected %02X%02X (cached)", read->fid[0], read->fid[1]);
+        nfc_tag_t4_init_ndef_file(self);
+        /* Read NLEN to validate the cached data */
         if ((priv->init_id = nfc_isodep_init_read_binary(self, 0,
-            NDEF_DATA_OFFSET, nfc_tag_t4_init_read_ndef_len_resp)) != 0) {
+            NDEF_DATA_OFFSET, nfc_tag_t4_init_check_cache_resp)) != 0) {
+            return;
+        }
+    } else if (sw != ISO_SW_IO_ERR && priv->init_cache) {
+        /* Cached CC must be out of date, start from scratch */
+        GDEBUG("Cached NDEF file selection error %04X", sw);
+        nfc_tag_cache_entry_free(priv->init_cache);
+        nfc_iso_dep_ndef_read_free(priv->init_read);
+        priv->init_cache = NULL;
+        priv->init_read = NULL;
+        nfc_tag_t4_cache_drop(self);
+        if ((priv->init_id = nfc_tag_t4_init_select_cc(self)) != 0) {
+            return;
+        }
+    } else if (sw == ISO_SW_OK) {
+        NfcIsoDepNdefRead* read = priv->init_read;
+
+        GDEBUG("Selected %02X%02X", read->fid[0], read->fid[1]);
+        nfc_tag_t4_init_ndef_file(self);
+        /* Read NLEN together with as much data as we can */
+        if ((priv->init_id = nfc_tag_t4_init_read_ndef_head(self,
+            MIN(read->max_read, read->max_size))) != 0) {
             return;
         }
     } else if (sw != ISO_SW_IO_ERR) {
@@ -462,6 +1142,26 @@ nfc_tag_t4_init_select_ndef_resp(
     nfc_tag_t4_ndef_read_done(self);
 }
 
+static
+guint
+nfc_tag_t4_init_select_ndef(
+    NfcTagType4* self)
+{
+    NfcTagType4Priv* priv = self->priv;
+    GUtilData fid;
+
+    /*
+     * Table 18: NDEF Select Command C-APDU
+     * 00A4000C02xxxx
+     */
+    fid.bytes = priv->init_read->fid;
+    fid.size = 2;
+    return nfc_isodep_submit(self, ISO_CLA, ISO_INS_SELECT,
+        ISO_P1_SELECT_BY_ID, ISO_P2_SELECT_FILE_FIRST | ISO_P2_RESPONSE_NONE,
+        &fid, 0, priv->init_seq, nfc_tag_t4_init_select_ndef_resp,
+        NULL, NULL);
+}
+
 static
 void
 nfc_tag_t4_init_read_ndef_cc_resp(
@@ -480,22 +1180,9 @@ nfc_tag_t4_init_read_ndef_cc_resp(
             GDEBUG("NDEF Capability Container");
             nfc_hexdump(data, len);
             priv->init_read = nfc_iso_dep_ndef_read_new(self, data);
-            if (priv->init_read) {
-                GUtilData fid;
-
-                /*
-                 * Table 18: NDEF Select Command C-APDU
-                 * 00A4000C02xxxx
-                 */
-                fid.bytes = priv->init_read->fid;
-                fid.size = 2;
-                if ((priv->init_id = nfc_isodep_submit(self, ISO_CLA,
-                    ISO_INS_SELECT, ISO_P1_SELECT_BY_ID,
-                    ISO_P2_SELECT_FILE_FIRST | ISO_P2_RESPONSE_NONE,
-                    &fid, 0, priv->init_seq,
-                    nfc_tag_t4_init_select_ndef_resp, NULL, NULL)) != 0) {
-                    return;
-                }
+            if (priv->init_read &&
+                (priv->init_id = nfc_tag_t4_init_select_ndef(self)) != 0) {
+                return;
             }
         }
     } else if (sw != ISO_SW_IO_ERR) {
@@ -544,6 +1231,21 @@ nfc_tag_t4_init_select_ndef_cc_resp(
     nfc_tag_t4_ndef_read_done(self);
 }
 
+static
+guint
+nfc_tag_t4_init_select_cc(
+    NfcTagType4* self)
+{
+    /*
+     * Table 12: Capability Container Select Command C-APDU
+     * 00A4000C02E103
+     */
+    return nfc_isodep_submit(self, ISO_CLA, ISO_INS_SELECT,
+        ISO_P1_SELECT_BY_ID, ISO_P2_SELECT_FILE_FIRST | ISO_P2_RESPONSE_NONE,
+        &ndef_cc_ef_data, 0, self->priv->init_seq,
+        nfc_tag_t4_init_select_ndef_cc_resp, NULL, NULL);
+}
+
 static
 void
 nfc_tag_t4_init_select_ndef_app_resp(
@@ -565,15 +1267,22 @@ nfc_tag_t4_init_select_ndef_app_resp(
      */
     if (sw == ISO_SW_OK) {
         GDEBUG("Found NDEF Tag Application");
-        /*
-         * Table 12: Capability Container Select Command C-APDU
-         * 00A4000C02E103
-         */
-        if ((priv->init_id = nfc_isodep_submit(self, ISO_CLA,
-            ISO_INS_SELECT, ISO_P1_SELECT_BY_ID,
-            ISO_P2_SELECT_FILE_FIRST | ISO_P2_RESPONSE_NONE,
-            &ndef_cc_ef_data, 0, priv->init_seq,
-            nfc_tag_t4_init_select_ndef_cc_resp, NULL, NULL)) != 0) {
+        /* If we have seen this tag before, skip reading the CC */
+        priv->init_cache = nfc_tag_t4_cache_get(self);
+        if (priv->init_cache) {
+            priv->init_read = nfc_iso_dep_ndef_read_new(self,
+                priv->init_cache->key.bytes + sizeof(ndef_aid));
+            if (priv->init_read) {
+                if ((priv->init_id = nfc_tag_t4_init_select_ndef(self)) != 0) {
+                    return;
+                }
+                nfc_iso_dep_ndef_read_free(priv->init_read);
+                priv->init_read = NULL;
+            }
+            nfc_tag_cache_entry_free(priv->init_cache);
+            priv->init_cache = NULL;
+        }
+        if ((priv->init_id = nfc_tag_t4_init_select_cc(self)) != 0) {
             return;
         }
     } else if (sw == ISO_SW_NDEF_NOT_FOUND) {
@@ -627,6 +1336,215 @@ nfc_tag_t4_reset_data_resp(
     }
 }
 
+static
+void
+nfc_tag_t4_ndef_write_free(
+    NfcIsoDepNdefWrite* write)
+{
+    GDestroyNotify destroy = write->destroy;
+
+    if (destroy) {
+        write->destroy = NULL;
+        destroy(write->user_data);
+    }
+    nfc_target_sequence_unref(write->seq);
+    g_free(write->image);
+    g_slice_free1(sizeof(*write), write);
+}
+
+static
+void
+nfc_tag_t4_ndef_write_done(
+    NfcTagType4* self,
+    guint sw)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefWrite* write = priv->ndef_write;
+
+    priv->ndef_write = NULL;
+    g_object_ref(self);
+    if (sw == ISO_SW_OK) {
+        NfcTag* tag = &self->tag;
+        const guint len = write->size - NDEF_DATA_OFFSET;
+
+        GDEBUG("NDEF written (%u bytes)", len);
+        if (len) {
+            GUtilData ndef;
+
+            ndef.bytes = write->image + NDEF_DATA_OFFSET;
+            ndef.size = len;
+            nfc_tag_set_ndef(tag, ndef_rec_new(&ndef));
+        } else {
+            nfc_tag_set_ndef(tag, NULL);
+        }
+        nfc_tag_t4_cache_put(self, priv->ndef_file.cc, write->image +
+            NDEF_DATA_OFFSET, len);
+    } else {
+        if (sw != ISO_SW_IO_ERR) {
+            GDEBUG("NDEF write error %04X", sw);
+        } else {
+            GDEBUG("NDEF write I/O error");
+        }
+        if (write->offset) {
+            /* Something has been written, NLEN is most likely zero */
+            nfc_tag_set_ndef(&self->tag, NULL);
+            nfc_tag_t4_cache_drop(self);
+        }
+    }
+    if (write->complete) {
+        write->complete(self, sw, write->user_data);
+    }
+    nfc_tag_t4_ndef_write_free(write);
+    g_object_unref(self);
+}
+
+static
+gboolean
+nfc_tag_t4_ndef_write_select_app(
+    NfcTagType4* self);
+
+static
+void
+nfc_tag_t4_ndef_write_update_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data);
+
+/* Submits the next UPDATE BINARY, there must be something to write */
+static
+gboolean
+nfc_tag_t4_ndef_write_next(
+    NfcTagType4* self)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefWrite* write = priv->ndef_write;
+    GUtilData chunk;
+    guint offset;
+
+    if (write->offset < write->size) {
+        offset = write->offset;
+        write->chunk = MIN(write->size - offset, priv->ndef_file.max_write);
+        chunk.bytes = write->image + offset;
+        chunk.size = write->chunk;
+    } else {
+        /* The data are there, NLEN makes them valid */
+        GASSERT(write->nlen_pending);
+        offset = 0;
+        write->chunk = 0;
+        write->nlen_pending = FALSE;
+        chunk.bytes = write->nlen;
+        chunk.size = sizeof(write->nlen);
+    }
+
+    /* Table 21: NDEF Update Binary Command C-APDU */
+    return (write->cmd_id = nfc_isodep_submit(self, ISO_CLA,
+        ISO_INS_UPDATE_BINARY, (guint8)(offset >> 8), (guint8)offset,
+        &chunk, 0, write->seq, nfc_tag_t4_ndef_write_update_resp,
+        NULL, NULL)) != 0;
+}
+
+static
+void
+nfc_tag_t4_ndef_write_update_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcIsoDepNdefWrite* write = self->priv->ndef_write;
+
+    write->cmd_id = 0;
+    if (sw == ISO_SW_OK) {
+        write->offset += write->chunk;
+        if (write->offset < write->size || write->nlen_pending) {
+            if (nfc_tag_t4_ndef_write_next(self)) {
+                return;
+            }
+            sw = ISO_SW_IO_ERR;
+        }
+    } else if (write->reselect && !write->offset && sw != ISO_SW_IO_ERR) {
+        /* Perhaps the NDEF file is no longer selected */
+        GDEBUG("NDEF update error %04X, selecting the file", sw);
+        write->reselect = FALSE;
+        write->chunk = 0;
+        if (nfc_tag_t4_ndef_write_select_app(self)) {
+            return;
+        }
+        sw = ISO_SW_IO_ERR;
+    }
+    nfc_tag_t4_ndef_write_done(self, sw);
+}
+
+static
+void
+nfc_tag_t4_ndef_write_select_file_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType4Priv* priv = self->priv;
+
+    priv->ndef_write->cmd_id = 0;
+    if (sw == ISO_SW_OK) {
+        priv->ndef_selected = TRUE;
+        if (nfc_tag_t4_ndef_write_next(self)) {
+            return;
+        }
+        sw = ISO_SW_IO_ERR;
+    }
+    nfc_tag_t4_ndef_write_done(self, sw);
+}
+
+static
+void
+nfc_tag_t4_ndef_write_select_app_resp(
+    NfcTagType4* self,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefWrite* write = priv->ndef_write;
+
+    write->cmd_id = 0;
+    if (sw == ISO_SW_OK) {
+        GUtilData fid;
+
+        fid.bytes = priv->ndef_file.fid;
+        fid.size = sizeof(priv->ndef_file.fid);
+        if ((write->cmd_id = nfc_isodep_submit(self, ISO_CLA,
+            ISO_INS_SELECT, ISO_P1_SELECT_BY_ID,
+            ISO_P2_SELECT_FILE_FIRST | ISO_P2_RESPONSE_NONE,
+            &fid, 0, write->seq, nfc_tag_t4_ndef_write_select_file_resp,
+            NULL, NULL)) != 0) {
+            return;
+        }
+        sw = ISO_SW_IO_ERR;
+    }
+    nfc_tag_t4_ndef_write_done(self, sw);
+}
+
+static
+gboolean
+nfc_tag_t4_ndef_write_select_app(
+    NfcTagType4* self)
+{
+    NfcTagType4Priv* priv = self->priv;
+    NfcIsoDepNdefWrite* write = priv->ndef_write;
+
+    priv->ndef_selected = FALSE;
+    return (write->cmd_id = nfc_isodep_submit(self, ISO_CLA, ISO_INS_SELECT,
+        ISO_P1_SELECT_DF_BY_NAME, ISO_P2_SELECT_FILE_FIRST, &ndef_aid_data,
+        0x100, write->seq, nfc_tag_t4_ndef_write_select_app_resp,
+        NULL, NULL)) != 0;
+}
+
 /*==========================================================================*
  * Internal interface
  *==========================================================================*/
@@ -644,6 +1562,7 @@ nfc_tag_t4_init_base(
 
     nfc_tag_init_base(tag, target, poll);
     priv->mtu = mtu;
+    priv->init_start = g_get_monotonic_time();
 
     if (iso_dep) {
         const gsize aligned_size = G_ALIGN8(sizeof(*iso_dep));
@@ -718,6 +1637,13 @@ nfc_tag_t4_init_base(
     nfc_tag_t4_initialized(self);
 }
 
+guint
+nfc_tag_t4_alloc_count(
+    void)
+{
+    return nfc_tag_t4_tx_allocs;
+}
+
 /*==========================================================================*
  * Interface
  *==========================================================================*/
@@ -736,8 +1662,63 @@ nfc_isodep_transmit(
     GDestroyNotify destroy,
     void* user_data)
 {
-    return G_LIKELY(self) ? nfc_isodep_submit(self, cla, ins, p1, p2,
-        data, le, seq, resp, destroy, user_data) : 0;
+    return nfc_isodep_transmit2(self, cla, ins, p1, p2, data, le,
+        NFC_ISODEP_TX_FLAGS_NONE, 0, seq, resp, destroy, user_data);
+}
+
+guint
+nfc_isodep_transmit2(
+    NfcTagType4* self,
+    guint8 cla,             /* Class byte */
+    guint8 ins,             /* Instruction byte */
+    guint8 p1,              /* Parameter byte 1 */
+    guint8 p2,              /* Parameter byte 2 */
+    const GUtilData* data,  /* Command data */
+    guint le,               /* Expected length, zero if none */
+    NFC_ISODEP_TX_FLAGS flags,
+    guint timeout_ms,       /* Timeout hint, zero if none */
+    NfcTargetSequence* seq,
+    NfcTagType4ResponseFunc resp,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self)) {
+        NfcTargetSequence* tmp_seq = NULL;
+        guint id;
+
+        if ((flags & NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE) && !seq) {
+            /* Reactivation (if any) must be part of the sequence too */
+            seq = tmp_seq = nfc_target_sequence_new(self->tag.target);
+        }
+        nfc_tag_t4_submit_pending_reset(self, seq);
+        id = nfc_isodep_submit_full(self, cla, ins, p1, p2, data, le,
+            flags, timeout_ms, seq, resp, destroy, user_data);
+        nfc_target_sequence_unref(tmp_seq);
+        return id;
+    }
+    return 0;
+}
+
+gboolean
+nfc_isodep_cancel(
+    NfcTagType4* self,
+    guint id) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self) && G_LIKELY(id)) {
+        NfcTarget* target = self->tag.target;
+        GSList* l;
+
+        for (l = self->priv->chains; l; l = l->next) {
+            NfcIsoDepTx* tx = l->data;
+
+            if (tx->id == id) {
+                /* Cancel whatever is being sent on behalf of this call */
+                return nfc_target_cancel_transmit(target, tx->cmd_id);
+            }
+        }
+        return nfc_target_cancel_transmit(target, id);
+    }
+    return FALSE;
 }
 
 gboolean
@@ -754,6 +1735,8 @@ nfc_isodep_reset(
         if (G_LIKELY(tag) && nfc_target_can_reactivate(tag->target)) {
             NfcIsoDepResetData* rst = g_slice_new0(NfcIsoDepResetData);
 
+            /* This one will do the job */
+            self->priv->reset_pending = FALSE;
             rst->t4 = self;
             rst->resp = resp;
             rst->destroy = destroy;
@@ -777,6 +1760,95 @@ nfc_isodep_reset(
     return FALSE;
 }
 
+gboolean
+nfc_isodep_deferred_reset(
+    NfcTagType4* self,
+    NfcTargetSequence* seq) /* Since 1.2.1 */
+{
+    return G_LIKELY(self) && nfc_tag_t4_submit_pending_reset(self, seq);
+}
+
+/*
+ * NFCForum-TS-Type-4-Tag_2.0
+ * Section 5.4.5 NDEF Update Procedure
+ *
+ * NLEN is zeroed first, then the data are written in MLc sized chunks
+ * and finally NLEN is set to the actual length. Zeroing NLEN is combined
+ * with writing the first chunk of data. If the whole thing fits into a
+ * single UPDATE BINARY, it's written in one go.
+ */
+gboolean
+nfc_tag_t4_write_ndef(
+    NfcTagType4* self,
+    GBytes* ndef,
+    NfcTargetSequence* seq,
+    NfcTagType4WriteNdefFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self) && G_LIKELY(ndef)) {
+        NfcTagType4Priv* priv = self->priv;
+        const NfcIsoDepNdefFile* file = &priv->ndef_file;
+        gsize len = 0;
+        const guint8* data = g_bytes_get_data(ndef, &len);
+        const gsize size = len + NDEF_DATA_OFFSET;
+
+        if (!(self->tag.flags & NFC_TAG_FLAG_INITIALIZED) || !file->max_size) {
+            GDEBUG("No NDEF file to write to");
+        } else if (!file->writable) {
+            GDEBUG("NDEF file is read-only");
+        } else if (priv->ndef_write) {
+            GDEBUG("NDEF write is already in progress");
+        } else if (size > file->max_size || size > (ISO_OFFSET_MAX + 1)) {
+            GDEBUG("NDEF is too large (%u bytes)", (guint) len);
+        } else {
+            NfcIsoDepNdefWrite* write = g_slice_new0(NfcIsoDepNdefWrite);
+
+            write->seq = seq ? nfc_target_sequence_ref(seq) :
+                nfc_target_sequence_new(self->tag.target);
+            write->size = (guint) size;
+            write->image = g_malloc(size);
+            write->nlen[0] = (guint8)(len >> 8);
+            write->nlen[1] = (guint8)len;
+            write->nlen_pending = (size > file->max_write);
+            if (write->nlen_pending) {
+                write->image[0] = write->image[1] = 0;
+            } else {
+                write->image[0] = write->nlen[0];
+                write->image[1] = write->nlen[1];
+            }
+            memcpy(write->image + NDEF_DATA_OFFSET, data, len);
+            write->complete = complete;
+            write->destroy = destroy;
+            write->user_data = user_data;
+            priv->ndef_write = write;
+            GDEBUG("Writing %u bytes of NDEF", (guint) len);
+
+            /*
+             * If the tag hasn't been touched since NDEF was read, the
+             * NDEF file is still selected. Otherwise, we are going to
+             * select it and the tag will have to be reactivated before
+             * anyone else gets to talk to it.
+             */
+            if (priv->reset_pending && priv->ndef_selected) {
+                write->reselect = TRUE;
+                if (nfc_tag_t4_ndef_write_next(self)) {
+                    return TRUE;
+                }
+            } else {
+                priv->reset_pending = TRUE;
+                if (nfc_tag_t4_ndef_write_select_app(self)) {
+                    return TRUE;
+                }
+            }
+            priv->ndef_write = NULL;
+            write->destroy = NULL;
+            nfc_tag_t4_ndef_write_free(write);
+        }
+    }
+    return FALSE;
+}
+
 /*==========================================================================*
  * Internals
  *==========================================================================*/
@@ -801,9 +1873,22 @@ nfc_tag_t4_finalize(
     NfcTagType4* self = THIS(object);
     NfcTagType4Priv* priv = self->priv;
 
+    while (priv->chains) {
+        NfcIsoDepTx* tx = priv->chains->data;
+
+        /* The chain can't continue without the tag */
+        priv->chains = g_slist_delete_link(priv->chains, priv->chains);
+        tx->id = 0;
+        nfc_target_cancel_transmit(self->tag.target, tx->cmd_id);
+    }
     nfc_target_cancel_transmit(self->tag.target, priv->init_id);
     nfc_target_sequence_unref(priv->init_seq);
     nfc_iso_dep_ndef_read_free(priv->init_read);
+    nfc_tag_cache_entry_free(priv->init_cache);
+    if (priv->ndef_write) {
+        nfc_target_cancel_transmit(self->tag.target, priv->ndef_write->cmd_id);
+        nfc_tag_t4_ndef_write_free(priv->ndef_write);
+    }
     g_byte_array_free(priv->buf, TRUE);
     g_free(priv->iso_dep);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
@@ -71,6 +71,15 @@ nfc_tag_t4_init_base(
     const NfcParamIsoDep* iso_dep)
     NFCD_INTERNAL;
 
+/*
+ * Number of transmission contexts allocated by Type 4 tags. The contexts
+ * are recycled, in a steady transmit/complete loop it doesn't grow.
+ */
+guint
+nfc_tag_t4_alloc_count(
+    void)
+    NFCD_INTERNAL;
+
 #endif /* NFC_TAG_T4_PRIVATE_H */
 
 /*
@@ -36,6 +36,7 @@
 
 #include "nfc_target_p.h"
 #include "nfc_target_impl.h"
+#include "nfc_capture_p.h"
 #include "nfc_log.h"
 
 #include <gutil_macros.h>
@@ -43,16 +44,27 @@
 
 #define DEFAULT_TRANSMIT_TIMEOUT_MS (500)
 #define DEFAULT_REACTIVATION_TIMEOUT_MS (1500)
+#define ADAPTIVE_TIMEOUT_MIN_MS (100)
+#define ADAPTIVE_TIMEOUT_MAX_MS (2500)
+#define ADAPTIVE_TIMEOUT_MAX_BACKOFF (4)
+#define PRIORITY_COUNT (NFC_TARGET_PRIORITY_LOW + 1)
+#define PRIORITY_STARVATION_LIMIT (4)
+#define TRANSMIT_REQUEST_POOL_SIZE (4)
+#define TRANSMIT_BUFFER_POOL_SIZE (4)
+#define TRANSMIT_BUFFER_SIZE (272) /* Enough for a short APDU + framing */
 
 typedef struct nfc_target_request NfcTargetRequest;
 typedef struct nfc_target_request_type {
     const char* name;
+    gsize stats_offset; /* NfcTargetOpStats within NfcTargetStats */
     gboolean (*submit)(NfcTargetRequest* req);
     void (*cancel)(NfcTargetRequest* req);
     void (*abandon)(NfcTargetRequest* req);
     guint (*timeout_ms)(NfcTargetRequest* req);
     void (*transmit_done)(NfcTargetRequest* req, NFC_TRANSMIT_STATUS status,
         const void* data, guint len);
+    gboolean (*transmit_partial)(NfcTargetRequest* req,
+        NFC_TRANSMIT_STATUS status, const void* data, guint len);
     void (*reactivated)(NfcTargetRequest* req);
     void (*timed_out)(NfcTargetRequest* req);
     void (*failed)(NfcTargetRequest* req);
@@ -60,12 +72,16 @@ typedef struct nfc_target_request_type {
 } NfcTargetRequestType;
 
 struct nfc_target_request {
-    NfcTargetRequest* next;
+    NfcTargetRequest* next;     /* Requests of the same priority */
+    NfcTargetRequest* prev;
+    NfcTargetRequest* seq_next; /* Requests queued for the same sequence */
+    NfcTargetRequest* seq_prev;
     NfcTargetSequence* seq;
     const NfcTargetRequestType* type;
     NfcTarget* target;
     guint id;
-    guint timeout;
+    NFC_TARGET_PRIORITY priority;
+    gint64 submitted; /* Monotonic time, microseconds */
     GDestroyNotify destroy;
     void* user_data;
 };
@@ -73,8 +89,9 @@ struct nfc_target_request {
 typedef struct nfc_target_transmit_request {
     NfcTargetRequest request;
     const void* data;
-    void* copied_data;
     guint len;
+    GBytes* bytes; /* Owns the data if not NULL */
+    guint timeout_hint_ms;
     NfcTargetTransmitFunc complete;
 } NfcTargetTransmitRequest;
 
@@ -83,9 +100,24 @@ typedef struct nfc_target_reactivate_request {
     NfcTargetReactivateFunc callback;
 } NfcTargetReactivateRequest;
 
+typedef struct nfc_target_batch_request_frame {
+    NfcTargetTransmitFunc complete;
+    void* user_data;
+} NfcTargetBatchRequestFrame;
+
+typedef struct nfc_target_batch_request {
+    NfcTargetRequest request;
+    GBytes** bytes;
+    NfcTargetBatchRequestFrame* frames;
+    guint count;
+    guint next; /* Index of the next frame to complete */
+    gboolean batched; /* Submitted with transmit_batch */
+} NfcTargetBatchRequest;
+
 typedef struct nfc_target_request_queue {
     NfcTargetRequest* first;
     NfcTargetRequest* last;
+    guint count;
 } NfcTargetRequestQueue;
 
 struct nfc_target_sequence {
@@ -93,22 +125,79 @@ struct nfc_target_sequence {
     gint refcount;
     NfcTarget* target;
     NFC_SEQUENCE_FLAGS flags;
+    NfcTargetRequestQueue req_queue; /* Linked via seq_next */
 };
 
+/*
+ * Round-trip time estimator, same as the one used by TCP (RFC 6298).
+ * Times are in microseconds.
+ */
+typedef struct nfc_target_rtt {
+    gint64 srtt;    /* Smoothed round-trip time */
+    gint64 rttvar;  /* Round-trip time variation */
+    gint64 start;   /* When the active transmission was submitted */
+    guint samples;
+    guint backoff;  /* Consecutive timeouts */
+} NfcTargetRtt;
+
 typedef struct nfc_target_sequence_queue {
     NfcTargetSequence* first;
     NfcTargetSequence* last;
 } NfcTargetSequenceQueue;
 
+/*
+ * Re-armable timer. Unlike g_timeout_add() and g_idle_add() sources,
+ * it's created once and then reused for every request.
+ */
+/*
+ * Buffers for the copies of outgoing frames. The implementation may hold
+ * on to the GBytes after the request is gone, maybe even after the target
+ * is gone, hence the reference count.
+ */
+typedef struct nfc_target_buf NfcTargetBuf;
+typedef struct nfc_target_buf_pool {
+    gint refcount;
+    gboolean closed;
+    NfcTargetBuf* first;
+    guint count;
+} NfcTargetBufPool;
+
+struct nfc_target_buf {
+    NfcTargetBuf* next;
+    NfcTargetBufPool* pool;
+    guint8 data[TRANSMIT_BUFFER_SIZE];
+};
+
+typedef struct nfc_target_timer {
+    GSource source;
+    gboolean armed;
+    gint64 deadline; /* Monotonic time, microseconds */
+} NfcTargetTimer;
+
 struct nfc_target_priv {
     guint last_req_id;
-    guint continue_id;
+    NfcTargetTimer* continue_timer;
+    NfcTargetTimer* timeout_timer;
+    NfcTargetRequest* timeout_req;
     NfcTargetRequest* req_active;
+    NfcTargetRequest* req_completing;
+    NfcTargetRequest* tx_pool;
+    guint tx_pool_size;
+    NfcTargetBufPool* buf_pool;
+    guint allocs;
     NfcTargetSequenceQueue seq_queue;
-    NfcTargetRequestQueue req_queue;
+    NfcTargetRequestQueue req_queue[PRIORITY_COUNT];
+    guint req_skipped[PRIORITY_COUNT];
+    guint req_count;
+    GHashTable* req_index; /* Queued requests by id */
     guint tx_timeout_ms;
+    gboolean tx_timeout_adaptive;
+    NfcTargetRtt rtt;
     guint ra_timeout_ms;
+    guint submitting;
+    gboolean direct_continuation;
     gboolean reactivating;
+    NfcTargetStats stats;
 };
 
 #define THIS(obj) NFC_TARGET(obj)
@@ -136,12 +225,374 @@ void
 nfc_target_schedule_next_request(
     NfcTarget* self);
 
+static
+void
+nfc_target_continue(
+    NfcTarget* self);
+
+static
+NfcTargetRequest*
+nfc_target_peek_next_req(
+    NfcTargetPriv* priv);
+
 static
 void
 nfc_target_set_sequence(
     NfcTarget* self,
     NfcTargetSequence* seq);
 
+/*==========================================================================*
+ * Timer
+ *==========================================================================*/
+
+static
+gboolean
+nfc_target_timer_prepare(
+    GSource* source,
+    gint* timeout)
+{
+    NfcTargetTimer* timer = (NfcTargetTimer*)source;
+
+    if (timer->armed) {
+        const gint64 now = g_source_get_time(source);
+
+        if (now >= timer->deadline) {
+            *timeout = 0;
+            return TRUE;
+        } else {
+            /* Round up to the next millisecond */
+            *timeout = (gint)((timer->deadline - now + 999) / 1000);
+        }
+    } else {
+        *timeout = -1;
+    }
+    return FALSE;
+}
+
+static
+gboolean
+nfc_target_timer_check(
+    GSource* source)
+{
+    NfcTargetTimer* timer = (NfcTargetTimer*)source;
+
+    return timer->armed && g_source_get_time(source) >= timer->deadline;
+}
+
+static
+gboolean
+nfc_target_timer_dispatch(
+    GSource* source,
+    GSourceFunc callback,
+    gpointer user_data)
+{
+    NfcTargetTimer* timer = (NfcTargetTimer*)source;
+
+    /* The timer is single-shot, the callback may re-arm it */
+    timer->armed = FALSE;
+    callback(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+static
+NfcTargetTimer*
+nfc_target_timer_new(
+    NfcTarget* target,
+    gint priority,
+    GSourceFunc callback)
+{
+    static GSourceFuncs nfc_target_timer_funcs = {
+        nfc_target_timer_prepare,
+        nfc_target_timer_check,
+        nfc_target_timer_dispatch,
+        NULL
+    };
+
+    GSource* source = g_source_new(&nfc_target_timer_funcs,
+        sizeof(NfcTargetTimer));
+
+    /* The timer doesn't hold a reference to the target */
+    g_source_set_priority(source, priority);
+    g_source_set_callback(source, callback, target, NULL);
+    g_source_attach(source, NULL);
+    target->priv->allocs++;
+    return (NfcTargetTimer*)source;
+}
+
+static
+void
+nfc_target_timer_free(
+    NfcTargetTimer* timer)
+{
+    if (timer) {
+        GSource* source = &timer->source;
+
+        g_source_destroy(source);
+        g_source_unref(source);
+    }
+}
+
+static
+void
+nfc_target_timer_start(
+    NfcTargetTimer* timer,
+    guint ms)
+{
+    GSource* source = &timer->source;
+
+    timer->armed = TRUE;
+    timer->deadline = g_source_get_time(source) + ((gint64)ms) * 1000;
+}
+
+static inline
+void
+nfc_target_timer_stop(
+    NfcTargetTimer* timer)
+{
+    if (timer) {
+        timer->armed = FALSE;
+    }
+}
+
+static inline
+gboolean
+nfc_target_timer_armed(
+    NfcTargetTimer* timer)
+{
+    return timer && timer->armed;
+}
+
+/*==========================================================================*
+ * Round-trip time
+ *==========================================================================*/
+
+static
+void
+nfc_target_rtt_sample(
+    NfcTargetRtt* rtt)
+{
+    const gint64 r = g_get_monotonic_time() - rtt->start;
+
+    if (rtt->samples++) {
+        const gint64 delta = rtt->srtt - r;
+
+        /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+        rtt->rttvar += ((delta < 0 ? -delta : delta) - rtt->rttvar) / 4;
+        rtt->srtt += (r - rtt->srtt) / 8;
+    } else {
+        rtt->srtt = r;
+        rtt->rttvar = r / 2;
+    }
+    rtt->backoff = 0;
+}
+
+static
+void
+nfc_target_rtt_timed_out(
+    NfcTargetRtt* rtt)
+{
+    /* Back off exponentially until we get a valid sample */
+    if (rtt->backoff < ADAPTIVE_TIMEOUT_MAX_BACKOFF) {
+        rtt->backoff++;
+    }
+}
+
+static
+void
+nfc_target_rtt_response(
+    NfcTargetRtt* rtt,
+    NFC_TRANSMIT_STATUS status)
+{
+    switch (status) {
+    case NFC_TRANSMIT_STATUS_OK:
+    case NFC_TRANSMIT_STATUS_NACK:
+    case NFC_TRANSMIT_STATUS_CORRUPTED:
+        /* Something has come back from the target */
+        nfc_target_rtt_sample(rtt);
+        break;
+    case NFC_TRANSMIT_STATUS_ERROR:
+    case NFC_TRANSMIT_STATUS_TIMEOUT:
+        break;
+    }
+}
+
+static
+guint
+nfc_target_rtt_timeout_ms(
+    const NfcTargetRtt* rtt)
+{
+    if (rtt->samples) {
+        /* RTO = SRTT + max(G, 4 * RTTVAR) with 1 ms granularity */
+        gint64 us = rtt->srtt + MAX(1000, 4 * rtt->rttvar);
+        guint ms = (guint)((us + 999) / 1000);
+
+        ms = MAX(ms, ADAPTIVE_TIMEOUT_MIN_MS) << rtt->backoff;
+        return MIN(ms, ADAPTIVE_TIMEOUT_MAX_MS);
+    } else {
+        /* No measurements yet */
+        return MIN(DEFAULT_TRANSMIT_TIMEOUT_MS << rtt->backoff,
+            ADAPTIVE_TIMEOUT_MAX_MS);
+    }
+}
+
+static
+guint
+nfc_target_transmit_timeout_ms(
+    NfcTargetPriv* priv)
+{
+    return priv->tx_timeout_adaptive ?
+        nfc_target_rtt_timeout_ms(&priv->rtt) :
+        priv->tx_timeout_ms;
+}
+
+/*==========================================================================*
+ * Statistics
+ *==========================================================================*/
+
+static inline
+NfcTargetOpStats*
+nfc_target_op_stats(
+    NfcTargetRequest* req)
+{
+    return G_STRUCT_MEMBER_P(&req->target->priv->stats,
+        req->type->stats_offset);
+}
+
+static
+void
+nfc_target_stats_latency(
+    NfcTargetOpStats* stats,
+    NfcTargetRequest* req)
+{
+    const gint64 ms = (g_get_monotonic_time() - req->submitted) / 1000;
+
+    /* Bucket N counts [2^(N-1), 2^N) ms, i.e. N is the bit length */
+    stats->latency[(ms > 0) ? MIN(g_bit_storage((gulong)ms),
+        NFC_TARGET_LATENCY_BUCKETS - 1) : 0]++;
+}
+
+static
+void
+nfc_target_stats_done(
+    NfcTargetRequest* req,
+    NFC_TRANSMIT_STATUS status)
+{
+    NfcTargetOpStats* stats = nfc_target_op_stats(req);
+
+    switch (status) {
+    case NFC_TRANSMIT_STATUS_OK:
+        stats->ok++;
+        break;
+    case NFC_TRANSMIT_STATUS_TIMEOUT:
+        stats->timeouts++;
+        break;
+    case NFC_TRANSMIT_STATUS_ERROR:
+    case NFC_TRANSMIT_STATUS_NACK:
+    case NFC_TRANSMIT_STATUS_CORRUPTED:
+        stats->errors++;
+        break;
+    }
+    nfc_target_stats_latency(stats, req);
+}
+
+static
+void
+nfc_target_stats_failed(
+    NfcTargetRequest* req)
+{
+    NfcTargetOpStats* stats = nfc_target_op_stats(req);
+
+    stats->errors++;
+    if (req->submitted) {
+        /* Requests which never made it to the hardware have no latency */
+        nfc_target_stats_latency(stats, req);
+    }
+}
+
+/*==========================================================================*
+ * Frame buffers
+ *==========================================================================*/
+
+static
+void
+nfc_target_buf_pool_unref(
+    NfcTargetBufPool* pool)
+{
+    if (g_atomic_int_dec_and_test(&pool->refcount)) {
+        g_slice_free(NfcTargetBufPool, pool);
+    }
+}
+
+static
+void
+nfc_target_buf_pool_close(
+    NfcTargetBufPool* pool)
+{
+    pool->closed = TRUE;
+    while (pool->first) {
+        NfcTargetBuf* buf = pool->first;
+
+        pool->first = buf->next;
+        g_slice_free(NfcTargetBuf, buf);
+    }
+    pool->count = 0;
+    nfc_target_buf_pool_unref(pool);
+}
+
+static
+void
+nfc_target_buf_free(
+    gpointer data)
+{
+    NfcTargetBuf* buf = data;
+    NfcTargetBufPool* pool = buf->pool;
+
+    if (!pool->closed && pool->count < TRANSMIT_BUFFER_POOL_SIZE) {
+        /* Keep it for reuse */
+        buf->next = pool->first;
+        pool->first = buf;
+        pool->count++;
+    } else {
+        g_slice_free(NfcTargetBuf, buf);
+    }
+    nfc_target_buf_pool_unref(pool);
+}
+
+/* Makes a copy of the frame, reusing a previously allocated buffer */
+static
+GBytes*
+nfc_target_copy_frame(
+    NfcTargetPriv* priv,
+    const void* data,
+    guint len)
+{
+    if (len <= TRANSMIT_BUFFER_SIZE) {
+        NfcTargetBufPool* pool = priv->buf_pool;
+        NfcTargetBuf* buf;
+
+        if (!pool) {
+            pool = priv->buf_pool = g_slice_new0(NfcTargetBufPool);
+            pool->refcount = 1;
+        }
+        if (pool->first) {
+            buf = pool->first;
+            pool->first = buf->next;
+            pool->count--;
+        } else {
+            buf = g_slice_new(NfcTargetBuf);
+            buf->pool = pool;
+            priv->allocs++;
+        }
+        g_atomic_int_inc(&pool->refcount);
+        memcpy(buf->data, data, len);
+        return g_bytes_new_with_free_func(buf->data, len,
+            nfc_target_buf_free, buf);
+    } else {
+        priv->allocs++;
+        return g_bytes_new(data, len);
+    }
+}
+
 /*==========================================================================*
  * Transmit request
  *==========================================================================*/
@@ -160,9 +611,26 @@ nfc_target_transmit_request_submit(
     NfcTargetRequest* req)
 {
     NfcTarget* target = req->target;
+    NfcTargetClass* klass = GET_THIS_CLASS(target);
     NfcTargetTransmitRequest* tx = nfc_target_transmit_request_cast(req);
 
-    return GET_THIS_CLASS(target)->transmit(target, tx->data, tx->len);
+    target->priv->rtt.start = g_get_monotonic_time();
+    nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, tx->data,
+        tx->len);
+    if (klass->transmit_bytes) {
+        if (!tx->bytes) {
+            /*
+             * The caller's buffer is only valid during this call but
+             * the implementation may want to hold on to the GBytes.
+             */
+            tx->bytes = nfc_target_copy_frame(target->priv, tx->data,
+                tx->len);
+            tx->data = g_bytes_get_data(tx->bytes, NULL);
+        }
+        return klass->transmit_bytes(target, tx->bytes);
+    } else {
+        return klass->transmit(target, tx->data, tx->len);
+    }
 }
 
 static
@@ -186,7 +654,11 @@ guint
 nfc_target_transmit_request_timeout_ms(
     NfcTargetRequest* req)
 {
-    return req->target->priv->tx_timeout_ms;
+    NfcTargetTransmitRequest* tx = nfc_target_transmit_request_cast(req);
+    const guint ms = nfc_target_transmit_timeout_ms(req->target->priv);
+
+    /* The hint extends the timeout for slow commands, never shortens it */
+    return (ms && tx->timeout_hint_ms > ms) ? tx->timeout_hint_ms : ms;
 }
 
 static
@@ -206,6 +678,18 @@ nfc_target_transmit_request_done(
     }
 }
 
+static
+void
+nfc_target_transmit_request_response(
+    NfcTargetRequest* req,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len)
+{
+    nfc_target_rtt_response(&req->target->priv->rtt, status);
+    nfc_target_transmit_request_done(req, status, data, len);
+}
+
 static
 void
 nfc_target_transmit_request_failed(
@@ -219,6 +703,7 @@ void
 nfc_target_transmit_request_timed_out(
     NfcTargetRequest* req)
 {
+    nfc_target_rtt_timed_out(&req->target->priv->rtt);
     nfc_target_transmit_request_done(req, NFC_TRANSMIT_STATUS_TIMEOUT, NULL, 0);
 }
 
@@ -228,9 +713,19 @@ nfc_target_transmit_request_free(
     NfcTargetRequest* req)
 {
     NfcTargetTransmitRequest* tx = nfc_target_transmit_request_cast(req);
+    NfcTargetPriv* priv = req->target->priv;
 
-    g_free(tx->copied_data);
-    g_slice_free1(sizeof(*tx), tx);
+    if (tx->bytes) {
+        g_bytes_unref(tx->bytes);
+    }
+    if (priv->tx_pool_size < TRANSMIT_REQUEST_POOL_SIZE) {
+        /* Keep it for reuse */
+        req->next = priv->tx_pool;
+        priv->tx_pool = req;
+        priv->tx_pool_size++;
+    } else {
+        g_slice_free1(sizeof(*tx), tx);
+    }
 }
 
 static
@@ -239,26 +734,45 @@ nfc_target_transmit_request_new(
     NfcTarget* target,
     const void* data,
     guint len,
+    GBytes* bytes,
     NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    guint timeout_hint_ms,
     NfcTargetTransmitFunc complete,
     GDestroyNotify destroy,
     void* user_data)
 {
     static const NfcTargetRequestType transmit_request_type = {
         "Transmit",
+        G_STRUCT_OFFSET(NfcTargetStats, transmit),
         nfc_target_transmit_request_submit,
         nfc_target_transmit_request_cancel,
         nfc_target_transmit_request_abandon,
         nfc_target_transmit_request_timeout_ms,
-        nfc_target_transmit_request_done,
+        nfc_target_transmit_request_response,
+        NULL,
         nfc_target_transmit_request_failed, /* Not expected to be called */
         nfc_target_transmit_request_timed_out,
         nfc_target_transmit_request_failed,
         nfc_target_transmit_request_free
     };
 
-    NfcTargetTransmitRequest* tx = g_slice_new0(NfcTargetTransmitRequest);
-    NfcTargetRequest* req = &tx->request;
+    NfcTargetPriv* priv = target->priv;
+    NfcTargetTransmitRequest* tx;
+    NfcTargetRequest* req;
+
+    if (priv->tx_pool) {
+        /* Recycle the previously allocated request */
+        req = priv->tx_pool;
+        priv->tx_pool = req->next;
+        priv->tx_pool_size--;
+        tx = nfc_target_transmit_request_cast(req);
+        memset(tx, 0, sizeof(*tx));
+    } else {
+        tx = g_slice_new0(NfcTargetTransmitRequest);
+        req = &tx->request;
+        priv->allocs++;
+    }
 
     GASSERT(!seq || seq->target == target);
     if (seq && seq->target == target) {
@@ -270,8 +784,18 @@ nfc_target_transmit_request_new(
     req->target = target;
     req->destroy = destroy;
     req->user_data = user_data;
-    tx->data = data;
-    tx->len = len;
+    if (bytes) {
+        gsize size;
+
+        tx->bytes = g_bytes_ref(bytes);
+        tx->data = g_bytes_get_data(bytes, &size);
+        tx->len = (guint)size;
+    } else {
+        tx->data = data;
+        tx->len = len;
+    }
+    req->priority = priority;
+    tx->timeout_hint_ms = timeout_hint_ms;
     tx->complete = complete;
     return tx;
 };
@@ -375,67 +899,311 @@ void
 nfc_target_reactivate_request_timed_out(
     NfcTargetRequest* req)
 {
-    nfc_target_reactivate_request_done(req, NFC_REACTIVATE_STATUS_TIMEOUT);
-    GET_THIS_CLASS(req->target)->deactivate(req->target);
+    nfc_target_reactivate_request_done(req, NFC_REACTIVATE_STATUS_TIMEOUT);
+    GET_THIS_CLASS(req->target)->deactivate(req->target);
+}
+
+static
+void
+nfc_target_reactivate_request_failed(
+    NfcTargetRequest* req)
+{
+    nfc_target_reactivate_request_done(req, NFC_REACTIVATE_STATUS_GONE);
+}
+
+static
+void
+nfc_target_reactivate_request_free(
+    NfcTargetRequest* req)
+{
+    NfcTargetReactivateRequest* re = nfc_target_reactivate_request_cast(req);
+
+    GASSERT(!req->target->priv->reactivating);
+    g_slice_free1(sizeof(*re), re);
+}
+
+static
+NfcTargetRequest*
+nfc_target_reactivate_request_new(
+    NfcTarget* target,
+    NfcTargetSequence* seq,
+    NfcTargetReactivateFunc cb,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    static const NfcTargetRequestType reactivate_request_type = {
+        "Reactivate",
+        G_STRUCT_OFFSET(NfcTargetStats, reactivate),
+        nfc_target_reactivate_request_submit,
+        nfc_target_request_nop,
+        nfc_target_reactivate_request_abandon,
+        nfc_target_reactivate_request_timeout_ms,
+        nfc_target_reactivate_request_unexpected_call,
+        NULL,
+        nfc_target_reactivate_request_ok,
+        nfc_target_reactivate_request_timed_out,
+        nfc_target_reactivate_request_failed,
+        nfc_target_reactivate_request_free
+    };
+
+    NfcTargetReactivateRequest* re = g_slice_new0(NfcTargetReactivateRequest);
+    NfcTargetRequest* req = &re->request;
+
+    target->priv->allocs++;
+    GASSERT(!seq || seq->target == target);
+    if (seq && seq->target == target) {
+        req->seq = nfc_target_sequence_ref(seq);
+    }
+
+    req->id = nfc_target_generate_id(target);
+    req->priority = NFC_TARGET_PRIORITY_NORMAL;
+    req->type = &reactivate_request_type;
+    req->target = target;
+    req->destroy = destroy;
+    req->user_data = user_data;
+    re->callback = cb;
+    return req;
+};
+
+/*==========================================================================*
+ * Batch request
+ *==========================================================================*/
+
+static inline
+NfcTargetBatchRequest*
+nfc_target_batch_request_cast(
+    NfcTargetRequest* req)
+{
+    return G_CAST(req, NfcTargetBatchRequest, request);
+}
+
+static
+gboolean
+nfc_target_batch_request_submit(
+    NfcTargetRequest* req)
+{
+    NfcTarget* target = req->target;
+    NfcTargetClass* klass = GET_THIS_CLASS(target);
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+
+    target->priv->rtt.start = g_get_monotonic_time();
+    if (batch->batched) {
+        /* The whole thing has already been handed over */
+        return TRUE;
+    } else if (!batch->next && klass->transmit_batch) {
+        guint i;
+
+        for (i = 0; i < batch->count; i++) {
+            nfc_capture_bytes(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT,
+                batch->bytes[i]);
+        }
+        batch->batched = TRUE;
+        return klass->transmit_batch(target, batch->bytes, batch->count);
+    } else {
+        /* Sequential fallback */
+        GBytes* bytes = batch->bytes[batch->next];
+
+        nfc_capture_bytes(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, bytes);
+        if (klass->transmit_bytes) {
+            return klass->transmit_bytes(target, bytes);
+        } else {
+            gsize size;
+            const void* data = g_bytes_get_data(bytes, &size);
+
+            return klass->transmit(target, data, (guint)size);
+        }
+    }
+}
+
+static
+void
+nfc_target_batch_request_abandon(
+    NfcTargetRequest* req)
+{
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+    guint i;
+
+    for (i = batch->next; i < batch->count; i++) {
+        batch->frames[i].complete = NULL;
+    }
+}
+
+static
+void
+nfc_target_batch_request_complete_frame(
+    NfcTargetBatchRequest* batch,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len)
+{
+    NfcTargetRequest* req = &batch->request;
+    NfcTargetBatchRequestFrame* frame = batch->frames + (batch->next++);
+    NfcTargetTransmitFunc complete = frame->complete;
+
+    if (complete) {
+        frame->complete = NULL;
+        complete(req->target, status, data, len, frame->user_data);
+    }
+}
+
+static
+void
+nfc_target_batch_request_done(
+    NfcTargetRequest* req,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len)
+{
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+
+    /* This frame and whatever is left of the batch */
+    if (batch->next < batch->count) {
+        nfc_target_batch_request_complete_frame(batch, status, data, len);
+    }
+    while (batch->next < batch->count) {
+        nfc_target_batch_request_complete_frame(batch,
+            NFC_TRANSMIT_STATUS_ERROR, NULL, 0);
+    }
+}
+
+static
+void
+nfc_target_batch_request_response(
+    NfcTargetRequest* req,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len)
+{
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+
+    nfc_target_rtt_response(&req->target->priv->rtt, status);
+    if (batch->batched && (batch->next + 1) < batch->count) {
+        /* The implementation may still be busy with the rest */
+        GET_THIS_CLASS(req->target)->cancel_transmit(req->target);
+    }
+    nfc_target_batch_request_done(req, status, data, len);
+}
+
+static
+gboolean
+nfc_target_batch_request_partial(
+    NfcTargetRequest* req,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len)
+{
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+
+    /*
+     * Returns TRUE if the frame has been consumed and more frames are
+     * expected. The last frame and a failed frame complete the request
+     * and are handled by nfc_target_batch_request_response()
+     */
+    if (status == NFC_TRANSMIT_STATUS_OK &&
+        (batch->next + 1) < batch->count) {
+        nfc_target_rtt_response(&req->target->priv->rtt, status);
+        nfc_target_batch_request_complete_frame(batch, status, data, len);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static
+void
+nfc_target_batch_request_failed(
+    NfcTargetRequest* req)
+{
+    nfc_target_batch_request_done(req, NFC_TRANSMIT_STATUS_ERROR, NULL, 0);
+}
+
+static
+void
+nfc_target_batch_request_timed_out(
+    NfcTargetRequest* req)
+{
+    nfc_target_rtt_timed_out(&req->target->priv->rtt);
+    nfc_target_batch_request_done(req, NFC_TRANSMIT_STATUS_TIMEOUT, NULL, 0);
 }
 
 static
-void
-nfc_target_reactivate_request_failed(
+guint
+nfc_target_batch_request_timeout_ms(
     NfcTargetRequest* req)
 {
-    nfc_target_reactivate_request_done(req, NFC_REACTIVATE_STATUS_GONE);
+    /* Applies to each frame */
+    return nfc_target_transmit_timeout_ms(req->target->priv);
 }
 
 static
 void
-nfc_target_reactivate_request_free(
+nfc_target_batch_request_free(
     NfcTargetRequest* req)
 {
-    NfcTargetReactivateRequest* re = nfc_target_reactivate_request_cast(req);
+    NfcTargetBatchRequest* batch = nfc_target_batch_request_cast(req);
+    guint i;
 
-    GASSERT(!req->target->priv->reactivating);
-    g_slice_free1(sizeof(*re), re);
+    for (i = 0; i < batch->count; i++) {
+        g_bytes_unref(batch->bytes[i]);
+    }
+    g_free(batch->bytes);
+    g_free(batch->frames);
+    g_slice_free1(sizeof(*batch), batch);
 }
 
 static
 NfcTargetRequest*
-nfc_target_reactivate_request_new(
+nfc_target_batch_request_new(
     NfcTarget* target,
+    const NfcTargetBatchFrame* frames,
+    guint count,
     NfcTargetSequence* seq,
-    NfcTargetReactivateFunc cb,
     GDestroyNotify destroy,
     void* user_data)
 {
-    static const NfcTargetRequestType reactivate_request_type = {
-        "Reactivate",
-        nfc_target_reactivate_request_submit,
-        nfc_target_request_nop,
-        nfc_target_reactivate_request_abandon,
-        nfc_target_reactivate_request_timeout_ms,
-        nfc_target_reactivate_request_unexpected_call,
-        nfc_target_reactivate_request_ok,
-        nfc_target_reactivate_request_timed_out,
-        nfc_target_reactivate_request_failed,
-        nfc_target_reactivate_request_free
+    static const NfcTargetRequestType batch_request_type = {
+        "Batch",
+        G_STRUCT_OFFSET(NfcTargetStats, transmit),
+        nfc_target_batch_request_submit,
+        nfc_target_transmit_request_cancel,
+        nfc_target_batch_request_abandon,
+        nfc_target_batch_request_timeout_ms,
+        nfc_target_batch_request_response,
+        nfc_target_batch_request_partial,
+        nfc_target_batch_request_failed, /* Not expected to be called */
+        nfc_target_batch_request_timed_out,
+        nfc_target_batch_request_failed,
+        nfc_target_batch_request_free
     };
 
-    NfcTargetReactivateRequest* re = g_slice_new0(NfcTargetReactivateRequest);
-    NfcTargetRequest* req = &re->request;
+    NfcTargetBatchRequest* batch = g_slice_new0(NfcTargetBatchRequest);
+    NfcTargetRequest* req = &batch->request;
+    guint i;
 
+    target->priv->allocs++;
     GASSERT(!seq || seq->target == target);
     if (seq && seq->target == target) {
         req->seq = nfc_target_sequence_ref(seq);
     }
 
     req->id = nfc_target_generate_id(target);
-    req->type = &reactivate_request_type;
+    req->priority = NFC_TARGET_PRIORITY_NORMAL;
+    req->type = &batch_request_type;
     req->target = target;
     req->destroy = destroy;
     req->user_data = user_data;
-    re->callback = cb;
+    batch->count = count;
+    batch->bytes = g_new(GBytes*, count);
+    batch->frames = g_new(NfcTargetBatchRequestFrame, count);
+    for (i = 0; i < count; i++) {
+        const NfcTargetBatchFrame* src = frames + i;
+        NfcTargetBatchRequestFrame* dest = batch->frames + i;
+
+        batch->bytes[i] = g_bytes_new(src->data, src->len);
+        dest->complete = src->complete;
+        dest->user_data = src->user_data;
+    }
     return req;
-};
+}
 
 /*==========================================================================*
  * Sequence
@@ -472,7 +1240,7 @@ nfc_target_sequence_dealloc(
             }
         }
         if (target->sequence == self) {
-            NfcTargetRequest* req = priv->req_queue.first;
+            NfcTargetRequest* req = nfc_target_peek_next_req(priv);
 
             /*
              * The last reference to the current sequence is gone.
@@ -595,15 +1363,25 @@ nfc_target_free_request(
     NfcTargetRequest* req)
 {
     const NfcTargetRequestType* rt = req->type;
+    NfcTargetPriv* priv = req->target->priv;
+    GDestroyNotify destroy = req->destroy;
+    void* user_data = req->user_data;
 
-    nfc_target_sequence_unref(req->seq);
-    if (req->timeout) {
-        g_source_remove(req->timeout);
-    }
-    if (req->destroy) {
-        req->destroy(req->user_data);
+    if (priv->timeout_req == req) {
+        priv->timeout_req = NULL;
+        nfc_target_timer_stop(priv->timeout_timer);
     }
+    nfc_target_sequence_unref(req->seq);
+
+    /*
+     * The request may go back to the pool, so it has to be freed before
+     * the destroy callback which might release the last reference to the
+     * target.
+     */
     rt->free(req);
+    if (destroy) {
+        destroy(user_data);
+    }
 }
 
 static
@@ -613,6 +1391,7 @@ nfc_target_fail_request(
 {
     const NfcTargetRequestType* rt = req->type;
 
+    nfc_target_stats_failed(req);
     rt->failed(req);
     nfc_target_free_request(req);
 }
@@ -622,38 +1401,153 @@ gboolean
 nfc_target_request_timeout(
     gpointer user_data)
 {
-    NfcTargetRequest* req = user_data;
-    const NfcTargetRequestType* rt = req->type;
-    NfcTarget* self = nfc_target_ref(req->target);
+    NfcTarget* self = nfc_target_ref(THIS(user_data));
     NfcTargetPriv* priv = self->priv;
+    NfcTargetRequest* req = priv->timeout_req;
 
-    GDEBUG("%s request timed out", rt->name);
-    GASSERT(req->timeout);
-    req->timeout = 0;
+    GASSERT(req);
+    if (req) {
+        const NfcTargetRequestType* rt = req->type;
 
-    GASSERT(req == priv->req_active);
-    priv->req_active = NULL;
-    rt->cancel(req);
-    rt->timed_out(req);
-    nfc_target_free_request(req);
-    nfc_target_schedule_next_request(self);
+        NfcTargetOpStats* stats = nfc_target_op_stats(req);
+
+        GDEBUG("%s request timed out", rt->name);
+        priv->timeout_req = NULL;
+        stats->timeouts++;
+        nfc_target_stats_latency(stats, req);
+
+        GASSERT(req == priv->req_active);
+        priv->req_active = NULL;
+        rt->cancel(req);
+        rt->timed_out(req);
+        nfc_target_free_request(req);
+        nfc_target_continue(self);
+    }
     nfc_target_unref(self);
-    return G_SOURCE_REMOVE;
+    return G_SOURCE_CONTINUE;
 }
 
 static
 void
 nfc_target_transmit_queue_req(
-    NfcTargetRequestQueue* queue,
+    NfcTarget* self,
     NfcTargetRequest* req)
 {
-    if (queue->last) {
+    NfcTargetPriv* priv = self->priv;
+    NfcTargetRequestQueue* queue = priv->req_queue + req->priority;
+    NfcTargetSequence* seq = req->seq;
+
+    /* Per-priority FIFO */
+    GASSERT(!req->next && !req->prev);
+    if ((req->prev = queue->last) != NULL) {
         queue->last->next = req;
     } else {
         GASSERT(!queue->first);
         queue->first = req;
     }
     queue->last = req;
+    queue->count++;
+    if (++(priv->req_count) > priv->stats.max_queue_depth) {
+        priv->stats.max_queue_depth = priv->req_count;
+    }
+
+    /* Per-sequence FIFO */
+    if (seq) {
+        NfcTargetRequestQueue* seq_queue = &seq->req_queue;
+
+        GASSERT(!req->seq_next && !req->seq_prev);
+        if ((req->seq_prev = seq_queue->last) != NULL) {
+            seq_queue->last->seq_next = req;
+        } else {
+            GASSERT(!seq_queue->first);
+            seq_queue->first = req;
+        }
+        seq_queue->last = req;
+        seq_queue->count++;
+    }
+
+    g_hash_table_insert(priv->req_index, GUINT_TO_POINTER(req->id), req);
+}
+
+static
+void
+nfc_target_transmit_unqueue_req(
+    NfcTarget* self,
+    NfcTargetRequest* req)
+{
+    NfcTargetPriv* priv = self->priv;
+    NfcTargetRequestQueue* queue = priv->req_queue + req->priority;
+    NfcTargetSequence* seq = req->seq;
+
+    if (req->prev) {
+        req->prev->next = req->next;
+    } else {
+        GASSERT(queue->first == req);
+        queue->first = req->next;
+    }
+    if (req->next) {
+        req->next->prev = req->prev;
+    } else {
+        GASSERT(queue->last == req);
+        queue->last = req->prev;
+    }
+    req->next = req->prev = NULL;
+    queue->count--;
+    priv->req_count--;
+
+    if (seq) {
+        NfcTargetRequestQueue* seq_queue = &seq->req_queue;
+
+        if (req->seq_prev) {
+            req->seq_prev->seq_next = req->seq_next;
+        } else {
+            GASSERT(seq_queue->first == req);
+            seq_queue->first = req->seq_next;
+        }
+        if (req->seq_next) {
+            req->seq_next->seq_prev = req->seq_prev;
+        } else {
+            GASSERT(seq_queue->last == req);
+            seq_queue->last = req->seq_prev;
+        }
+        req->seq_next = req->seq_prev = NULL;
+        seq_queue->count--;
+    }
+
+    g_hash_table_remove(priv->req_index, GUINT_TO_POINTER(req->id));
+}
+
+static
+int
+nfc_target_next_priority(
+    NfcTargetPriv* priv)
+{
+    int i, next = -1;
+
+    /*
+     * The highest non-empty priority class wins unless a lower one
+     * has been skipped too many times in a row.
+     */
+    for (i = 0; i < PRIORITY_COUNT; i++) {
+        if (priv->req_queue[i].first) {
+            if (priv->req_skipped[i] >= PRIORITY_STARVATION_LIMIT) {
+                return i;
+            } else if (next < 0) {
+                next = i;
+            }
+        }
+    }
+    return next;
+}
+
+static
+NfcTargetRequest*
+nfc_target_peek_next_req(
+    NfcTargetPriv* priv)
+{
+    const int p = nfc_target_next_priority(priv);
+
+    return (p >= 0) ? priv->req_queue[p].first : NULL;
 }
 
 static
@@ -662,34 +1556,37 @@ nfc_target_transmit_dequeue_req(
     NfcTarget* self)
 {
     NfcTargetPriv* priv = self->priv;
-    NfcTargetRequestQueue* queue = &priv->req_queue;
-    NfcTargetRequest* req = queue->first;
     NfcTargetSequence* seq = self->sequence;
+    NfcTargetRequest* req;
 
-    if (req) {
-        if (!seq || req->seq == seq) {
-            if (!(queue->first = req->next)) {
-                queue->last = NULL;
-            }
-            req->next = NULL;
-        } else {
-            NfcTargetRequest* prev = req;
-
-            /* Scan the queue */
-            req = req->next;
-            while (req) {
-                if (!seq || req->seq == seq) {
-                    if (!(prev->next = req->next)) {
-                        queue->last = prev;
-                    }
-                    req->next = NULL;
-                    break;
+    if (seq) {
+        /*
+         * If there's an active sequence, only its requests are eligible,
+         * in the order they were queued regardless of their priority.
+         */
+        req = seq->req_queue.first;
+    } else {
+        const int p = nfc_target_next_priority(priv);
+
+        if (p >= 0) {
+            int i;
+
+            /* Everyone else who is waiting gets a bit closer */
+            for (i = 0; i < PRIORITY_COUNT; i++) {
+                if (i != p && priv->req_queue[i].first) {
+                    priv->req_skipped[i]++;
                 }
-                prev = req;
-                req = req->next;
             }
+            priv->req_skipped[p] = 0;
+            req = priv->req_queue[p].first;
+        } else {
+            req = NULL;
         }
     }
+
+    if (req) {
+        nfc_target_transmit_unqueue_req(self, req);
+    }
     return req;
 }
 
@@ -702,11 +1599,19 @@ nfc_target_submit_request(
     NfcTargetPriv* priv = self->priv;
     const NfcTargetRequestType* rt = req->type;
 
+    gboolean submitted;
+
     priv->req_active = req;
+    req->submitted = g_get_monotonic_time();
     if (!self->sequence && req->seq) {
         nfc_target_set_sequence(self, req->seq);
     }
-    if (rt->submit(req)) {
+
+    /* Requests completed synchronously must not recurse into submit */
+    priv->submitting++;
+    submitted = rt->submit(req);
+    priv->submitting--;
+    if (submitted) {
         /*
          * If the target goes away during submission of the request, the
          * request is already completed and freed by now (but we still
@@ -716,14 +1621,24 @@ nfc_target_submit_request(
             const guint ms = rt->timeout_ms(req);
 
             if (ms) {
-                GASSERT(!req->timeout);
-                req->timeout = g_timeout_add(ms,
-                    nfc_target_request_timeout, req);
+                /*
+                 * If the request is being submitted from the completion
+                 * callback, timeout_req may still point to the previous
+                 * request which is about to be freed. It's not active
+                 * anymore and can't time out.
+                 */
+                if (!priv->timeout_timer) {
+                    priv->timeout_timer = nfc_target_timer_new(self,
+                        G_PRIORITY_DEFAULT, nfc_target_request_timeout);
+                }
+                priv->timeout_req = req;
+                nfc_target_timer_start(priv->timeout_timer, ms);
             }
         }
         return TRUE;
     } else {
         priv->req_active = NULL;
+        req->submitted = 0;
         return FALSE;
     }
 }
@@ -757,23 +1672,47 @@ gboolean
 nfc_target_next_transmit(
     gpointer user_data)
 {
-    NfcTarget* self = THIS(user_data);
+    nfc_target_submit_next_request(THIS(user_data));
+    return G_SOURCE_CONTINUE;
+}
+
+static
+void
+nfc_target_schedule_next_request(
+    NfcTarget* self)
+{
     NfcTargetPriv* priv = self->priv;
 
-    priv->continue_id = 0;
-    nfc_target_submit_next_request(self);
-    return G_SOURCE_REMOVE;
+    if (priv->req_count && !nfc_target_timer_armed(priv->continue_timer)) {
+        if (!priv->continue_timer) {
+            priv->continue_timer = nfc_target_timer_new(self,
+                G_PRIORITY_DEFAULT_IDLE, nfc_target_next_transmit);
+        }
+        nfc_target_timer_start(priv->continue_timer, 0);
+    }
 }
 
 static
 void
-nfc_target_schedule_next_request(
+nfc_target_continue(
     NfcTarget* self)
 {
     NfcTargetPriv* priv = self->priv;
 
-    if (priv->req_queue.first && !priv->continue_id) {
-        priv->continue_id = g_idle_add(nfc_target_next_transmit, self);
+    /*
+     * The previous request has been completed and freed and nothing
+     * is on the stack except for the code which has completed it.
+     * Unless that happened inside the submit call, it's safe to submit
+     * the next request right away, without a trip to the main loop.
+     * Only the next step of the active sequence is submitted this way,
+     * anything else still waits for the main loop as it always did.
+     */
+    if (priv->direct_continuation && !priv->submitting &&
+        self->sequence && self->sequence->req_queue.first) {
+        nfc_target_timer_stop(priv->continue_timer);
+        nfc_target_submit_next_request(self);
+    } else {
+        nfc_target_schedule_next_request(self);
     }
 }
 
@@ -783,7 +1722,7 @@ nfc_target_fail_requests(
     NfcTarget* self)
 {
     NfcTargetPriv* priv = self->priv;
-    NfcTargetRequestQueue* queue = &priv->req_queue;
+    int i;
 
     if (priv->req_active) {
         NfcTargetRequest* req = priv->req_active;
@@ -791,15 +1730,23 @@ nfc_target_fail_requests(
 
         priv->req_active = NULL;
         rt->cancel(req);
-        nfc_target_fail_request(req);
+        if (req == priv->req_completing) {
+            /* nfc_target_transmit_done() will free it */
+            nfc_target_stats_failed(req);
+            rt->failed(req);
+        } else {
+            nfc_target_fail_request(req);
+        }
     }
-    while (queue->first) {
-        NfcTargetRequest* req = queue->first;
+    for (i = 0; i < PRIORITY_COUNT; i++) {
+        NfcTargetRequestQueue* queue = priv->req_queue + i;
 
-        if (!(queue->first = req->next)) {
-            queue->last = NULL;
+        while (queue->first) {
+            NfcTargetRequest* req = queue->first;
+
+            nfc_target_transmit_unqueue_req(self, req);
+            nfc_target_fail_request(req);
         }
-        nfc_target_fail_request(req);
     }
 }
 
@@ -850,6 +1797,46 @@ nfc_target_generate_id(
     return id;
 }
 
+static
+guint
+nfc_target_transmit_request_start(
+    NfcTarget* self,
+    NfcTargetTransmitRequest* tx)
+{
+    NfcTargetPriv* priv = self->priv;
+    NfcTargetRequest* req = &tx->request;
+
+    /* Request id to return */
+    guint id = req->id;
+
+    /* Check if the request can be submitted right away */
+    if (!priv->req_active && (req->seq == self->sequence)) {
+        /*
+         * The data will be copied by the transmit method (or referenced
+         * by the transmit_bytes one), no need to make another copy and
+         * attach it to the request.
+         */
+        if (!nfc_target_submit_request(self, req)) {
+            nfc_target_op_stats(req)->errors++;
+            nfc_target_set_sequence(self, NULL);
+            id = 0;
+            req->destroy = NULL;
+            nfc_target_free_request(req);
+        }
+    } else {
+        if (!tx->bytes) {
+            /*
+             * Can't pass the data pointer to the transmit implementation
+             * right away, make a copy.
+             */
+            tx->bytes = nfc_target_copy_frame(priv, tx->data, tx->len);
+            tx->data = g_bytes_get_data(tx->bytes, NULL);
+        }
+        nfc_target_transmit_queue_req(self, req);
+    }
+    return id;
+}
+
 guint
 nfc_target_transmit(
     NfcTarget* self,
@@ -860,39 +1847,110 @@ nfc_target_transmit(
     GDestroyNotify destroy,
     void* user_data)
 {
-    guint id = 0;
+    return nfc_target_transmit2(self, data, len, seq, 0, complete,
+        destroy, user_data);
+}
 
-    if (G_LIKELY(self)) {
-        NfcTargetPriv* priv = self->priv;
-        NfcTargetTransmitRequest* tx = nfc_target_transmit_request_new(self,
-            data, len, seq, complete, destroy, user_data);
-        NfcTargetRequest* req = &tx->request;
+guint
+nfc_target_transmit2(
+    NfcTarget* self,
+    const void* data,
+    guint len,
+    NfcTargetSequence* seq,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    return nfc_target_transmit_full(self, data, len, seq,
+        NFC_TARGET_PRIORITY_NORMAL, timeout_ms, complete, destroy,
+        user_data);
+}
+
+guint
+nfc_target_transmit_full(
+    NfcTarget* self,
+    const void* data,
+    guint len,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    return (G_LIKELY(self) && (guint)priority < PRIORITY_COUNT) ?
+        nfc_target_transmit_request_start(self,
+        nfc_target_transmit_request_new(self, data, len, NULL, seq,
+        priority, timeout_ms, complete, destroy, user_data)) : 0;
+}
+
+guint
+nfc_target_transmit_bytes(
+    NfcTarget* self,
+    GBytes* bytes,
+    NfcTargetSequence* seq,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    return nfc_target_transmit_bytes_full(self, bytes, seq,
+        NFC_TARGET_PRIORITY_NORMAL, 0, complete, destroy, user_data);
+}
+
+guint
+nfc_target_transmit_bytes_full(
+    NfcTarget* self,
+    GBytes* bytes,
+    NfcTargetSequence* seq,
+    NFC_TARGET_PRIORITY priority,
+    guint timeout_ms,
+    NfcTargetTransmitFunc complete,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    /*
+     * The request holds a reference to the bytes until it's completed,
+     * the data never get copied by NfcTarget itself.
+     */
+    return (G_LIKELY(self) && G_LIKELY(bytes) &&
+        (guint)priority < PRIORITY_COUNT) ?
+        nfc_target_transmit_request_start(self,
+        nfc_target_transmit_request_new(self, NULL, 0, bytes, seq,
+        priority, timeout_ms, complete, destroy, user_data)) : 0;
+}
 
-        /* Request id to return */
-        id = req->id;
+guint
+nfc_target_transmit_batch(
+    NfcTarget* self,
+    const NfcTargetBatchFrame* frames,
+    guint count,
+    NfcTargetSequence* seq,
+    GDestroyNotify destroy,
+    void* user_data) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self) && G_LIKELY(frames) && G_LIKELY(count)) {
+        NfcTargetPriv* priv = self->priv;
+        NfcTargetRequest* req = nfc_target_batch_request_new(self,
+            frames, count, seq, destroy, user_data);
+        guint id = req->id;
 
-        /* Check if the request can be submitted right away */
+        /* Same as nfc_target_transmit_request_start() */
         if (!priv->req_active && (req->seq == self->sequence)) {
-            /*
-             * The data will be copied by the transmit method, no need
-             * to make another copy and attach it to the request.
-             */
             if (!nfc_target_submit_request(self, req)) {
+                nfc_target_op_stats(req)->errors++;
                 nfc_target_set_sequence(self, NULL);
                 id = 0;
                 req->destroy = NULL;
+                nfc_target_batch_request_abandon(req);
                 nfc_target_free_request(req);
             }
         } else {
-            /*
-             * Can't pass the data pointer to the transmit implementation
-             * right away, make a copy.
-             */
-            tx->data = tx->copied_data = gutil_memdup(data, len);
-            nfc_target_transmit_queue_req(&priv->req_queue, req);
+            nfc_target_transmit_queue_req(self, req);
         }
+        return id;
     }
-    return id;
+    return 0;
 }
 
 gboolean
@@ -908,46 +1966,25 @@ nfc_target_cancel_transmit(
             const NfcTargetRequestType* rt = req->type;
 
             priv->req_active = NULL;
+            nfc_target_op_stats(req)->cancelled++;
             rt->abandon(req);
             rt->cancel(req);
-            nfc_target_free_request(req);
+            if (req != priv->req_completing) {
+                nfc_target_free_request(req);
+            }
+            /* Otherwise nfc_target_transmit_done() will free it */
             nfc_target_schedule_next_request(self);
             return TRUE;
         } else {
-            NfcTargetRequestQueue* queue = &priv->req_queue;
-
-            req = queue->first;
+            req = g_hash_table_lookup(priv->req_index, GUINT_TO_POINTER(id));
             if (req) {
-                if (req->id == id) {
-                    const NfcTargetRequestType* rt = req->type;
-
-                    /* The first queued request is cancelled */
-                    rt->abandon(req);
-                    if (!(queue->first = req->next)) {
-                        queue->last = NULL;
-                    }
-                    nfc_target_free_request(req);
-                    return TRUE;
-                } else {
-                    NfcTargetRequest* prev = req;
-
-                    /* Scan the queue */
-                    req = req->next;
-                    while (req) {
-                        if (req->id == id) {
-                            const NfcTargetRequestType* rt = req->type;
-
-                            rt->abandon(req);
-                            if (!(prev->next = req->next)) {
-                                queue->last = prev;
-                            }
-                            nfc_target_free_request(req);
-                            return TRUE;
-                        }
-                        prev = req;
-                        req = req->next;
-                    }
-                }
+                const NfcTargetRequestType* rt = req->type;
+
+                nfc_target_op_stats(req)->cancelled++;
+                rt->abandon(req);
+                nfc_target_transmit_unqueue_req(self, req);
+                nfc_target_free_request(req);
+                return TRUE;
             }
         }
     }
@@ -964,8 +2001,11 @@ nfc_target_set_transmit_timeout(
 
         if (ms < 0) {
             priv->tx_timeout_ms = DEFAULT_TRANSMIT_TIMEOUT_MS;
+            priv->tx_timeout_adaptive = TRUE;
+            GDEBUG("Adaptive transmission timeout");
         } else {
             priv->tx_timeout_ms = ms;
+            priv->tx_timeout_adaptive = FALSE;
             if (priv->tx_timeout_ms) {
                 GDEBUG("Transmission timeout %u ms", priv->tx_timeout_ms);
             } else {
@@ -1008,7 +2048,7 @@ nfc_target_reactivate(
             NfcTargetRequest* req = nfc_target_reactivate_request_new(self,
                 seq, func, destroy, user_data);
 
-            nfc_target_transmit_queue_req(&priv->req_queue, req);
+            nfc_target_transmit_queue_req(self, req);
             nfc_target_submit_next_request(self);
             return TRUE;
         }
@@ -1016,6 +2056,36 @@ nfc_target_reactivate(
     return FALSE;
 }
 
+guint
+nfc_target_queue_depth(
+    NfcTarget* self,
+    NFC_TARGET_PRIORITY priority) /* Since 1.2.1 */
+{
+    return (G_LIKELY(self) && (guint)priority < PRIORITY_COUNT) ?
+        self->priv->req_queue[priority].count : 0;
+}
+
+const NfcTargetStats*
+nfc_target_stats(
+    NfcTarget* self) /* Since 1.2.1 */
+{
+    return G_LIKELY(self) ? &self->priv->stats : NULL;
+}
+
+guint
+nfc_target_transmit_timeout(
+    NfcTarget* self)
+{
+    return G_LIKELY(self) ? nfc_target_transmit_timeout_ms(self->priv) : 0;
+}
+
+guint
+nfc_target_alloc_count(
+    NfcTarget* self)
+{
+    return G_LIKELY(self) ? self->priv->allocs : 0;
+}
+
 void
 nfc_target_set_reactivate_timeout(
     NfcTarget* self,
@@ -1083,9 +2153,10 @@ nfc_target_reactivated(
 
             nfc_target_ref(self);
             priv->req_active = NULL;
+            nfc_target_stats_done(req, NFC_TRANSMIT_STATUS_OK);
             rt->reactivated(req);
             nfc_target_free_request(req);
-            nfc_target_schedule_next_request(self);
+            nfc_target_continue(self);
             nfc_target_unref(self);
         }
     }
@@ -1105,17 +2176,61 @@ nfc_target_transmit_done(
         GASSERT(req);
         if (req) {
             const NfcTargetRequestType* rt = req->type;
+            gboolean more = FALSE;
 
+            if (status == NFC_TRANSMIT_STATUS_OK) {
+                nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_IN,
+                    data, len);
+            }
             nfc_target_ref(self);
-            priv->req_active = NULL;
-            rt->transmit_done(req, status, data, len);
-            nfc_target_free_request(req);
-            nfc_target_schedule_next_request(self);
+            if (rt->transmit_partial) {
+                /* The request stays active while the frame is completed */
+                GASSERT(!priv->req_completing);
+                priv->req_completing = req;
+                more = rt->transmit_partial(req, status, data, len);
+                priv->req_completing = NULL;
+            }
+
+            if (priv->req_active != req) {
+                /* Cancelled by the completion callback */
+                nfc_target_free_request(req);
+                nfc_target_continue(self);
+            } else if (more) {
+                /* Re-arm the timer for the next frame */
+                if (priv->timeout_req == req) {
+                    nfc_target_timer_start(priv->timeout_timer,
+                        rt->timeout_ms(req));
+                }
+                priv->submitting++;
+                more = rt->submit(req);
+                priv->submitting--;
+                if (!more && priv->req_active == req) {
+                    priv->req_active = NULL;
+                    nfc_target_fail_request(req);
+                    nfc_target_continue(self);
+                }
+            } else {
+                priv->req_active = NULL;
+                nfc_target_stats_done(req, status);
+                rt->transmit_done(req, status, data, len);
+                nfc_target_free_request(req);
+                nfc_target_continue(self);
+            }
             nfc_target_unref(self);
         }
     }
 }
 
+void
+nfc_target_set_direct_continuation(
+    NfcTarget* self,
+    gboolean enabled) /* Since 1.2.1 */
+{
+    if (G_LIKELY(self)) {
+        self->priv->direct_continuation = enabled;
+    }
+}
+
 void
 nfc_target_gone(
     NfcTarget* self)
@@ -1175,8 +2290,10 @@ nfc_target_init(
     /* When target is created, it must be present, right? */
     self->present = TRUE;
     self->priv = priv;
+    priv->req_index = g_hash_table_new(g_direct_hash, g_direct_equal);
     priv->ra_timeout_ms = DEFAULT_REACTIVATION_TIMEOUT_MS;
     priv->tx_timeout_ms = DEFAULT_TRANSMIT_TIMEOUT_MS;
+    priv->tx_timeout_adaptive = TRUE;
 }
 
 static
@@ -1187,10 +2304,7 @@ nfc_target_dispose(
     NfcTarget* self = THIS(object);
     NfcTargetPriv* priv = self->priv;
 
-    if (priv->continue_id) {
-        g_source_remove(priv->continue_id);
-        priv->continue_id = 0;
-    }
+    nfc_target_timer_stop(priv->continue_timer);
     nfc_target_fail_requests(self);
     G_OBJECT_CLASS(PARENT_CLASS)->dispose(object);
 }
@@ -1205,6 +2319,20 @@ nfc_target_finalize(
     NfcTargetSequenceQueue* queue = &priv->seq_queue;
     NfcTargetSequence* seq = queue->first;
 
+    while (priv->tx_pool) {
+        NfcTargetRequest* req = priv->tx_pool;
+
+        priv->tx_pool = req->next;
+        g_slice_free1(sizeof(NfcTargetTransmitRequest),
+            nfc_target_transmit_request_cast(req));
+    }
+    if (priv->buf_pool) {
+        nfc_target_buf_pool_close(priv->buf_pool);
+    }
+    nfc_target_timer_free(priv->continue_timer);
+    nfc_target_timer_free(priv->timeout_timer);
+    g_hash_table_destroy(priv->req_index);
+
     /*
      * NfcTargetSequence can (theoretically) survive longer than
      * the associated NfcTarget, clear stale pointers.
@@ -81,6 +81,25 @@ nfc_target_generate_id(
     NfcTarget* target)
     NFCD_INTERNAL;
 
+/*
+ * Transmit timeout (in milliseconds) which would be applied to the next
+ * request without a timeout hint. Zero means no timeout.
+ */
+guint
+nfc_target_transmit_timeout(
+    NfcTarget* target)
+    NFCD_INTERNAL;
+
+/*
+ * Number of heap allocations (requests, timers and data copies) made
+ * by the target's request queue since the target has been created.
+ * In a steady transmit/complete loop it's not supposed to grow.
+ */
+guint
+nfc_target_alloc_count(
+    NfcTarget* target)
+    NFCD_INTERNAL;
+
 gulong
 nfc_target_add_gone_handler(
     NfcTarget* target,
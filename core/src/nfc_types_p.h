@@ -75,12 +75,16 @@ typedef struct nfc_peer_services NfcPeerServices;
 #define ISO_MF (0x3F00)
 
 #define ISO_CLA (0x00) /* Basic channel */
+#define ISO_CLA_CHAINING (0x10) /* Command chaining */
+#define ISO_CLA_PROPRIETARY (0x80) /* Proprietary class */
 
 #define ISO_SHORT_FID_MASK (0x1f) /* Short File ID mask */
 
 /* Instruction byte */
 #define ISO_INS_SELECT (0xA4)
 #define ISO_INS_READ_BINARY (0xB0)
+#define ISO_INS_GET_RESPONSE (0xC0)
+#define ISO_INS_UPDATE_BINARY (0xD6)
 
 /* Selection by file identifier */
 #define ISO_P1_SELECT_BY_ID (0x00)      /* Select MF, DF or EF */
@@ -61,6 +61,7 @@ typedef struct dbus_service_tag_t2 DBusServiceTagType2;
 typedef struct dbus_service_isodep DBusServiceIsoDep;
 typedef struct dbus_service_peer DBusServicePeer;
 typedef struct dbus_service_host DBusServiceHost;
+typedef struct dbus_service_stats DBusServiceStats;
 
 #define DBUS_SERVICE_ERROR (dbus_service_error_quark())
 GQuark dbus_service_error_quark(void);
@@ -82,6 +83,7 @@ typedef enum dbus_service_error {
 
 #define NFC_DBUS_TAG_T2_INTERFACE "org.sailfishos.nfc.TagType2"
 #define NFC_DBUS_ISODEP_INTERFACE "org.sailfishos.nfc.IsoDep"
+#define NFC_DBUS_STATS_INTERFACE "org.sailfishos.nfc.Stats"
 
 DBusServicePeer*
 dbus_service_plugin_find_peer(
@@ -229,6 +231,18 @@ void
 dbus_service_isodep_free(
     DBusServiceIsoDep* isodep);
 
+/* org.sailfishos.nfc.Stats */
+
+DBusServiceStats*
+dbus_service_stats_new(
+    const NfcTargetStats* stats,
+    GDBusConnection* connection,
+    const char* path);
+
+void
+dbus_service_stats_free(
+    DBusServiceStats* stats);
+
 /* org.sailfishos.nfc.Peer */
 
 struct dbus_service_peer {
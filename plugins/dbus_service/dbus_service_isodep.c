@@ -47,6 +47,9 @@ enum {
     CALL_GET_ALL2,
     CALL_GET_ACTIVATION_PARAMETERS,
     CALL_RESET,
+    CALL_TRANSMIT2,
+    CALL_TRANSMIT_BATCH,
+    CALL_WRITE_NDEF,
     CALL_COUNT
 };
 
@@ -57,13 +60,33 @@ struct dbus_service_isodep {
     gulong call_id[CALL_COUNT];
 };
 
-#define NFC_DBUS_ISODEP_INTERFACE_VERSION  (3)
+#define NFC_DBUS_ISODEP_INTERFACE_VERSION  (6)
+
+/* Transmit2 and TransmitBatch flags */
+#define NFC_DBUS_ISODEP_TRANSMIT_CHAIN_RESPONSE (0x01)
 
 typedef struct dbus_service_isodep_async_call {
     OrgSailfishosNfcIsoDep* iface;
     GDBusMethodInvocation* call;
 } DBusServiceIsoDepAsyncCall;
 
+typedef struct dbus_service_isodep_batch {
+    gint refcount;
+    OrgSailfishosNfcIsoDep* iface;
+    GDBusMethodInvocation* call;  /* NULL once completed */
+    NfcTagType4* t4;
+    NfcTargetSequence* seq;       /* Private sequence, if we have one */
+    NfcTargetSequence* client_seq;
+    NFC_ISODEP_TX_FLAGS flags;
+    guint timeout_ms;
+    GVariant* apdus;
+    guint count;
+    guint next;
+    guint expect_sw;
+    guint sw_mask;
+    GVariantBuilder results;
+} DBusServiceIsoDepBatch;
+
 static
 NfcTargetSequence*
 dbus_service_isodep_sequence(
@@ -167,8 +190,9 @@ dbus_service_isodep_handle_transmit_done(
 }
 
 static
-gboolean
-dbus_service_isodep_handle_transmit(
+void
+dbus_service_isodep_transmit(
+    DBusServiceIsoDep* self,
     OrgSailfishosNfcIsoDep* iface,
     GDBusMethodInvocation* call,
     guchar cla,
@@ -177,7 +201,9 @@ dbus_service_isodep_handle_transmit(
     guchar p2,
     GVariant* data_var,
     guint le,
-    DBusServiceIsoDep* self)
+    NFC_ISODEP_TX_FLAGS flags,
+    guint timeout_ms,
+    NfcTagType4ResponseFunc done)
 {
     GUtilData data;
     DBusServiceIsoDepAsyncCall* async =
@@ -187,15 +213,32 @@ dbus_service_isodep_handle_transmit(
     data.bytes = g_variant_get_data(data_var);
     GDEBUG("%02X %02X %02X %02X (%u bytes) %02X", cla, ins, p1, p2, (guint)
         data.size, le);
-    if (!nfc_isodep_transmit(self->t4, cla, ins, p1, p2, &data, le,
-        dbus_service_isodep_sequence(self, call),
-        dbus_service_isodep_handle_transmit_done,
+    if (!nfc_isodep_transmit2(self->t4, cla, ins, p1, p2, &data, le, flags,
+        timeout_ms, dbus_service_isodep_sequence(self, call), done,
         dbus_service_isodep_async_call_free1, async)) {
         dbus_service_isodep_async_call_free(async);
         g_dbus_method_invocation_return_error_literal(call,
             DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
             "Failed to submit APDU");
     }
+}
+
+static
+gboolean
+dbus_service_isodep_handle_transmit(
+    OrgSailfishosNfcIsoDep* iface,
+    GDBusMethodInvocation* call,
+    guchar cla,
+    guchar ins,
+    guchar p1,
+    guchar p2,
+    GVariant* data_var,
+    guint le,
+    DBusServiceIsoDep* self)
+{
+    dbus_service_isodep_transmit(self, iface, call, cla, ins, p1, p2,
+        data_var, le, NFC_ISODEP_TX_FLAGS_NONE, 0,
+        dbus_service_isodep_handle_transmit_done);
     return TRUE;
 }
 
@@ -320,6 +363,285 @@ dbus_service_isodep_handle_reset(
     return TRUE;
 }
 
+/* Interface version 4 */
+
+/* Transmit2 */
+
+static
+void
+dbus_service_isodep_handle_transmit2_done(
+    NfcTagType4* tag,
+    guint sw,  /* 16 bits (SW1 << 8)|SW2 */
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    DBusServiceIsoDepAsyncCall* async = user_data;
+
+    if (sw) {
+        GDEBUG("%04X", sw);
+        org_sailfishos_nfc_iso_dep_complete_transmit2(async->iface,
+            async->call, dbus_service_dup_byte_array_as_variant(data, len),
+            sw >> 8, sw & 0xff);
+    } else {
+        GDEBUG("oops");
+        g_dbus_method_invocation_return_error_literal(async->call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "APDU command failed");
+    }
+}
+
+static
+gboolean
+dbus_service_isodep_handle_transmit2(
+    OrgSailfishosNfcIsoDep* iface,
+    GDBusMethodInvocation* call,
+    guchar cla,
+    guchar ins,
+    guchar p1,
+    guchar p2,
+    GVariant* data_var,
+    guint le,
+    guint flags,
+    guint timeout,
+    DBusServiceIsoDep* self)
+{
+    dbus_service_isodep_transmit(self, iface, call, cla, ins, p1, p2,
+        data_var, le, (flags & NFC_DBUS_ISODEP_TRANSMIT_CHAIN_RESPONSE) ?
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE : NFC_ISODEP_TX_FLAGS_NONE,
+        timeout, dbus_service_isodep_handle_transmit2_done);
+    return TRUE;
+}
+
+/* Interface version 5 */
+
+/* TransmitBatch */
+
+static
+void
+dbus_service_isodep_batch_unref(
+    void* user_data)
+{
+    DBusServiceIsoDepBatch* batch = user_data;
+
+    if (g_atomic_int_dec_and_test(&batch->refcount)) {
+        if (batch->call) {
+            /* The last APDU has been dropped without completion */
+            GDEBUG("Batch cancelled at %u", batch->next);
+            g_dbus_method_invocation_return_error_literal(batch->call,
+                DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+                "APDU command failed");
+            g_object_unref(batch->call);
+        }
+        g_variant_builder_clear(&batch->results);
+        g_variant_unref(batch->apdus);
+        if (batch->seq) {
+            nfc_target_sequence_free(batch->seq);
+        }
+        nfc_tag_unref(&batch->t4->tag);
+        g_object_unref(batch->iface);
+        g_slice_free1(sizeof(*batch), batch);
+    }
+}
+
+static
+void
+dbus_service_isodep_batch_error(
+    DBusServiceIsoDepBatch* batch,
+    const char* message)
+{
+    g_dbus_method_invocation_return_error_literal(batch->call,
+        DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED, message);
+    g_object_unref(batch->call);
+    batch->call = NULL;
+}
+
+static
+void
+dbus_service_isodep_batch_complete(
+    DBusServiceIsoDepBatch* batch)
+{
+    GDEBUG("Batch done, %u APDU(s)", batch->next);
+    org_sailfishos_nfc_iso_dep_complete_transmit_batch(batch->iface,
+        batch->call, g_variant_builder_end(&batch->results));
+    g_object_unref(batch->call);
+    batch->call = NULL;
+}
+
+static
+void
+dbus_service_isodep_batch_resp(
+    NfcTagType4* tag,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data);
+
+static
+gboolean
+dbus_service_isodep_batch_submit_next(
+    DBusServiceIsoDepBatch* batch)
+{
+    GVariant* data_var = NULL;
+    GUtilData data;
+    guchar cla, ins, p1, p2;
+    guint16 sw, mask;
+    guint le;
+    gboolean ok;
+
+    g_variant_get_child(batch->apdus, batch->next, "(yyyy@ayuqq)",
+        &cla, &ins, &p1, &p2, &data_var, &le, &sw, &mask);
+    batch->expect_sw = sw;
+    batch->sw_mask = mask;
+    data.size = g_variant_get_size(data_var);
+    data.bytes = g_variant_get_data(data_var);
+    GDEBUG("[%u] %02X %02X %02X %02X (%u bytes) %02X", batch->next,
+        cla, ins, p1, p2, (guint) data.size, le);
+    g_atomic_int_inc(&batch->refcount);
+    ok = nfc_isodep_transmit2(batch->t4, cla, ins, p1, p2, &data, le,
+        batch->flags, batch->timeout_ms, batch->seq ? batch->seq :
+        batch->client_seq,
+        dbus_service_isodep_batch_resp, dbus_service_isodep_batch_unref,
+        batch) != 0;
+    g_variant_unref(data_var);
+    if (ok) {
+        batch->next++;
+        return TRUE;
+    } else {
+        g_atomic_int_add(&batch->refcount, -1); /* Can't drop to zero */
+        return FALSE;
+    }
+}
+
+static
+void
+dbus_service_isodep_batch_resp(
+    NfcTagType4* tag,
+    guint sw,  /* 16 bits (SW1 << 8)|SW2 */
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    DBusServiceIsoDepBatch* batch = user_data;
+
+    if (!sw) {
+        GDEBUG("[%u] oops", batch->next - 1);
+        dbus_service_isodep_batch_error(batch, "APDU command failed");
+    } else {
+        GDEBUG("[%u] %04X", batch->next - 1, sw);
+        g_variant_builder_add(&batch->results, "(@ayyy)",
+            dbus_service_dup_byte_array_as_variant(data, len),
+            sw >> 8, sw & 0xff);
+        if ((sw & batch->sw_mask) != (batch->expect_sw & batch->sw_mask)) {
+            GDEBUG("Unexpected status %04X, stopping", sw);
+            dbus_service_isodep_batch_complete(batch);
+        } else if (batch->next >= batch->count) {
+            dbus_service_isodep_batch_complete(batch);
+        } else if (!dbus_service_isodep_batch_submit_next(batch)) {
+            dbus_service_isodep_batch_error(batch, "Failed to submit APDU");
+        }
+    }
+}
+
+static
+gboolean
+dbus_service_isodep_handle_transmit_batch(
+    OrgSailfishosNfcIsoDep* iface,
+    GDBusMethodInvocation* call,
+    GVariant* apdus,
+    guint flags,
+    guint timeout,
+    DBusServiceIsoDep* self)
+{
+    const guint count = g_variant_n_children(apdus);
+
+    GDEBUG("Batch of %u APDU(s)", count);
+    if (count) {
+        DBusServiceIsoDepBatch* batch = g_slice_new0(DBusServiceIsoDepBatch);
+        NfcTag* tag = &self->t4->tag;
+
+        g_atomic_int_set(&batch->refcount, 1);
+        g_object_ref(batch->iface = iface);
+        g_object_ref(batch->call = call);
+        nfc_tag_ref(&(batch->t4 = self->t4)->tag);
+        batch->apdus = g_variant_ref(apdus);
+        batch->count = count;
+        batch->flags = (flags & NFC_DBUS_ISODEP_TRANSMIT_CHAIN_RESPONSE) ?
+            NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE : NFC_ISODEP_TX_FLAGS_NONE;
+        batch->timeout_ms = timeout;
+        g_variant_builder_init(&batch->results, G_VARIANT_TYPE("a(ayyy)"));
+
+        /*
+         * Keep the whole batch in one sequence. If the client doesn't
+         * hold a lock, allocate a private sequence for the duration of
+         * the batch.
+         */
+        batch->client_seq = dbus_service_isodep_sequence(self, call);
+        if (!batch->client_seq) {
+            batch->seq = nfc_target_sequence_new(tag->target);
+        }
+        if (!dbus_service_isodep_batch_submit_next(batch)) {
+            dbus_service_isodep_batch_error(batch, "Failed to submit APDU");
+        }
+        dbus_service_isodep_batch_unref(batch);
+    } else {
+        org_sailfishos_nfc_iso_dep_complete_transmit_batch(iface, call,
+            g_variant_new_array(G_VARIANT_TYPE("(ayyy)"), NULL, 0));
+    }
+    return TRUE;
+}
+
+/* Interface version 6 */
+
+/* WriteNdef */
+
+static
+void
+dbus_service_isodep_handle_write_ndef_done(
+    NfcTagType4* tag,
+    guint sw,
+    void* user_data)
+{
+    DBusServiceIsoDepAsyncCall* async = user_data;
+
+    if (sw == ISO_SW_OK) {
+        org_sailfishos_nfc_iso_dep_complete_write_ndef(async->iface,
+            async->call);
+    } else {
+        GDEBUG("NDEF write failed (%04X)", sw);
+        g_dbus_method_invocation_return_error_literal(async->call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "NDEF write failed");
+    }
+}
+
+static
+gboolean
+dbus_service_isodep_handle_write_ndef(
+    OrgSailfishosNfcIsoDep* iface,
+    GDBusMethodInvocation* call,
+    GVariant* data,
+    DBusServiceIsoDep* self)
+{
+    GBytes* bytes = g_bytes_new(g_variant_get_data(data),
+        g_variant_get_size(data));
+    DBusServiceIsoDepAsyncCall* async =
+        dbus_service_isodep_async_call_new(iface, call);
+
+    GDEBUG("Writing %u bytes of NDEF", (guint) g_bytes_get_size(bytes));
+    if (!nfc_tag_t4_write_ndef(self->t4, bytes,
+        dbus_service_isodep_sequence(self, call),
+        dbus_service_isodep_handle_write_ndef_done,
+        dbus_service_isodep_async_call_free1, async)) {
+        dbus_service_isodep_async_call_free(async);
+        g_dbus_method_invocation_return_error_literal(call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "Failed to write NDEF");
+    }
+    g_bytes_unref(bytes);
+    return TRUE;
+}
+
 /*==========================================================================*
  * Interface
  *==========================================================================*/
@@ -367,6 +689,15 @@ dbus_service_isodep_new(
     self->call_id[CALL_RESET] =
         g_signal_connect(self->iface, "handle-reset",
         G_CALLBACK(dbus_service_isodep_handle_reset), self);
+    self->call_id[CALL_TRANSMIT2] =
+        g_signal_connect(self->iface, "handle-transmit2",
+        G_CALLBACK(dbus_service_isodep_handle_transmit2), self);
+    self->call_id[CALL_TRANSMIT_BATCH] =
+        g_signal_connect(self->iface, "handle-transmit-batch",
+        G_CALLBACK(dbus_service_isodep_handle_transmit_batch), self);
+    self->call_id[CALL_WRITE_NDEF] =
+        g_signal_connect(self->iface, "handle-write-ndef",
+        G_CALLBACK(dbus_service_isodep_handle_write_ndef), self);
 
     if (g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON
         (self->iface), owner->connection, owner->path, &error)) {
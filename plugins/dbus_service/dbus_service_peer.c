@@ -107,6 +107,7 @@ struct dbus_service_peer_priv {
     gulong call_id[CALL_COUNT];
     gulong peer_event_id[PEER_EVENT_COUNT];
     NfcPeerService* peer_client;
+    DBusServiceStats* stats;
 };
 
 #define NFC_DBUS_PEER_INTERFACE "org.sailfishos.nfc.Peer"
@@ -116,9 +117,22 @@ static const char* const dbus_service_peer_default_interfaces[] = {
     NFC_DBUS_PEER_INTERFACE, NULL
 };
 
+static const char* const dbus_service_peer_stats_interfaces[] = {
+    NFC_DBUS_PEER_INTERFACE, NFC_DBUS_STATS_INTERFACE, NULL
+};
+
 static inline DBusServicePeerPriv* dbus_service_peer_cast(DBusServicePeer* pub)
     { return G_LIKELY(pub) ? G_CAST(pub, DBusServicePeerPriv, pub) : NULL; }
 
+static
+const char* const*
+dbus_service_peer_interfaces(
+    DBusServicePeerPriv* self)
+{
+    return self->stats ? dbus_service_peer_stats_interfaces :
+        dbus_service_peer_default_interfaces;
+}
+
 /*==========================================================================*
  * Peer client
  *==========================================================================*/
@@ -364,7 +378,7 @@ dbus_service_peer_complete_get_all(
 
     org_sailfishos_nfc_peer_complete_get_all(self->iface, call,
         NFC_DBUS_PEER_INTERFACE_VERSION, peer->present, peer->technology,
-        dbus_service_peer_default_interfaces, peer->wks);
+        dbus_service_peer_interfaces(self), peer->wks);
 }
 
 static
@@ -431,7 +445,7 @@ dbus_service_peer_handle_get_interfaces(
     DBusServicePeerPriv* self)
 {
     org_sailfishos_nfc_peer_complete_get_interfaces(self->iface, call,
-        dbus_service_peer_default_interfaces);
+        dbus_service_peer_interfaces(self));
     return TRUE;
 }
 
@@ -588,6 +602,7 @@ dbus_service_peer_free_unexported(
 
     nfc_peer_remove_all_handlers(pub->peer, self->peer_event_id);
     gutil_disconnect_handlers(self->iface, self->call_id, CALL_COUNT);
+    dbus_service_stats_free(self->stats);
 
     /* Cancel pending calls if there are any */
     while ((call = dbus_service_peer_dequeue_call(&self->queue)) != NULL) {
@@ -656,7 +671,13 @@ dbus_service_peer_new(
     }
     if (g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON
         (self->iface), connection, self->path, &error)) {
+        const NfcTargetStats* stats = nfc_peer_stats(peer);
+
         GDEBUG("Created D-Bus object %s (Peer)", self->path);
+        if (stats) {
+            self->stats = dbus_service_stats_new(stats, connection,
+                self->path);
+        }
         return pub;
     } else {
         GERR("%s: %s", self->path, GERRMSG(error));
@@ -43,6 +43,7 @@
 
 #include <nfc_core.h>
 #include <nfc_adapter.h>
+#include <nfc_capture.h>
 #include <nfc_manager.h>
 #include <nfc_peer_service.h>
 #include <nfc_plugin_impl.h>
@@ -81,7 +82,10 @@ GLOG_MODULE_DEFINE("dbus-service");
     x(REGISTER_LOCAL_HOST_APP, register_local_host_app, \
       register-local-host-app) \
     x(UNREGISTER_LOCAL_HOST_APP, unregister_local_host_app, \
-      unregister-local-host-app)
+      unregister-local-host-app) \
+    x(START_CAPTURE, start_capture, start-capture) \
+    x(STOP_CAPTURE, stop_capture, stop-capture) \
+    x(GET_CAPTURE, get_capture, get-capture)
 
 enum {
     EVENT_ADAPTER_ADDED,
@@ -122,6 +126,7 @@ struct dbus_service_plugin {
     OrgSailfishosNfcDaemon* iface;
     gulong event_id[EVENT_COUNT];
     gulong call_id[CALL_COUNT];
+    gboolean capturing;
 };
 
 #define PARENT_TYPE NFC_TYPE_PLUGIN
@@ -135,7 +140,7 @@ G_DEFINE_TYPE(DBusServicePlugin, dbus_service_plugin, PARENT_TYPE)
 #define NFC_SERVICE     "org.sailfishos.nfc.daemon"
 #define NFC_DAEMON_PATH "/"
 
-#define NFC_DBUS_PLUGIN_INTERFACE_VERSION  (4)
+#define NFC_DBUS_PLUGIN_INTERFACE_VERSION  (5)
 
 static
 gboolean
@@ -962,6 +967,62 @@ dbus_service_plugin_handle_unregister_local_host_app(
     return TRUE;
 }
 
+static
+gboolean
+dbus_service_plugin_handle_start_capture(
+    OrgSailfishosNfcDaemon* iface,
+    GDBusMethodInvocation* call,
+    guint max_frames,
+    DBusServicePlugin* self)
+{
+    if (nfc_capture_start(max_frames)) {
+        GDEBUG("Capture started by %s",
+            g_dbus_method_invocation_get_sender(call));
+        self->capturing = TRUE;
+        org_sailfishos_nfc_daemon_complete_start_capture(iface, call);
+    } else {
+        g_dbus_method_invocation_return_error(call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_INVALID_ARGS,
+                "Invalid frame count %u", max_frames);
+    }
+    return TRUE;
+}
+
+static
+gboolean
+dbus_service_plugin_handle_stop_capture(
+    OrgSailfishosNfcDaemon* iface,
+    GDBusMethodInvocation* call,
+    DBusServicePlugin* self)
+{
+    nfc_capture_stop();
+    self->capturing = FALSE;
+    org_sailfishos_nfc_daemon_complete_stop_capture(iface, call);
+    return TRUE;
+}
+
+static
+gboolean
+dbus_service_plugin_handle_get_capture(
+    OrgSailfishosNfcDaemon* iface,
+    GDBusMethodInvocation* call,
+    DBusServicePlugin* self)
+{
+    GBytes* pcapng = nfc_capture_pcapng();
+
+    if (pcapng) {
+        org_sailfishos_nfc_daemon_complete_get_capture(iface, call,
+            g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, pcapng,
+                TRUE));
+        g_bytes_unref(pcapng);
+    } else {
+        g_dbus_method_invocation_return_error(call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+                "Capture is not active");
+    }
+    return TRUE;
+}
+
 /*==========================================================================*
  * Name watching
  *==========================================================================*/
@@ -1070,6 +1131,10 @@ dbus_service_plugin_stop(
 
     GVERBOSE("Stopping");
     gutil_disconnect_handlers(self->iface, self->call_id, CALL_COUNT);
+    if (self->capturing) {
+        nfc_capture_stop();
+        self->capturing = FALSE;
+    }
     g_hash_table_remove_all(self->adapters);
     g_bus_unown_name(self->own_name_id);
     if (self->connection) {
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "dbus_service.h"
+
+#include "dbus_service/org.sailfishos.nfc.Stats.h"
+
+#include <nfc_target.h>
+
+#include <gutil_misc.h>
+
+enum {
+    CALL_GET_ALL,
+    CALL_GET_INTERFACE_VERSION,
+    CALL_COUNT
+};
+
+struct dbus_service_stats {
+    OrgSailfishosNfcStats* iface;
+    const NfcTargetStats* stats;
+    char* path;
+    gulong call_id[CALL_COUNT];
+};
+
+#define NFC_DBUS_STATS_INTERFACE_VERSION  (1)
+
+static
+GVariant*
+dbus_service_stats_op(
+    const NfcTargetOpStats* op)
+{
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("(uuuuau)"));
+    g_variant_builder_add(&builder, "u", op->ok);
+    g_variant_builder_add(&builder, "u", op->errors);
+    g_variant_builder_add(&builder, "u", op->timeouts);
+    g_variant_builder_add(&builder, "u", op->cancelled);
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("au"));
+    for (i = 0; i < G_N_ELEMENTS(op->latency); i++) {
+        g_variant_builder_add(&builder, "u", op->latency[i]);
+    }
+    g_variant_builder_close(&builder);
+    return g_variant_builder_end(&builder);
+}
+
+/*==========================================================================*
+ * D-Bus calls
+ *==========================================================================*/
+
+/* GetAll */
+
+static
+gboolean
+dbus_service_stats_handle_get_all(
+    OrgSailfishosNfcStats* iface,
+    GDBusMethodInvocation* call,
+    DBusServiceStats* self)
+{
+    const NfcTargetStats* stats = self->stats;
+
+    org_sailfishos_nfc_stats_complete_get_all(iface, call,
+        NFC_DBUS_STATS_INTERFACE_VERSION,
+        dbus_service_stats_op(&stats->transmit),
+        dbus_service_stats_op(&stats->reactivate),
+        stats->max_queue_depth);
+    return TRUE;
+}
+
+/* GetInterfaceVersion */
+
+static
+gboolean
+dbus_service_stats_handle_get_interface_version(
+    OrgSailfishosNfcStats* iface,
+    GDBusMethodInvocation* call,
+    DBusServiceStats* self)
+{
+    org_sailfishos_nfc_stats_complete_get_interface_version(iface, call,
+        NFC_DBUS_STATS_INTERFACE_VERSION);
+    return TRUE;
+}
+
+/*==========================================================================*
+ * Interface
+ *==========================================================================*/
+
+static
+void
+dbus_service_stats_free_unexported(
+    DBusServiceStats* self)
+{
+    gutil_disconnect_handlers(self->iface, self->call_id, CALL_COUNT);
+    g_object_unref(self->iface);
+    g_free(self->path);
+    g_free(self);
+}
+
+DBusServiceStats*
+dbus_service_stats_new(
+    const NfcTargetStats* stats,
+    GDBusConnection* connection,
+    const char* path)
+{
+    DBusServiceStats* self = g_new0(DBusServiceStats, 1);
+    GError* error = NULL;
+
+    self->stats = stats;
+    self->path = g_strdup(path);
+    self->iface = org_sailfishos_nfc_stats_skeleton_new();
+
+    /* D-Bus calls */
+    self->call_id[CALL_GET_ALL] =
+        g_signal_connect(self->iface, "handle-get-all",
+        G_CALLBACK(dbus_service_stats_handle_get_all), self);
+    self->call_id[CALL_GET_INTERFACE_VERSION] =
+        g_signal_connect(self->iface, "handle-get-interface-version",
+        G_CALLBACK(dbus_service_stats_handle_get_interface_version), self);
+
+    if (g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON
+        (self->iface), connection, path, &error)) {
+        GDEBUG("Created D-Bus object %s (Stats)", path);
+        return self;
+    } else {
+        GERR("%s: %s", path, GERRMSG(error));
+        g_error_free(error);
+        dbus_service_stats_free_unexported(self);
+        return NULL;
+    }
+}
+
+void
+dbus_service_stats_free(
+    DBusServiceStats* self)
+{
+    if (self) {
+        GDEBUG("Removing D-Bus object %s (Stats)", self->path);
+        g_dbus_interface_skeleton_unexport(G_DBUS_INTERFACE_SKELETON
+            (self->iface));
+        dbus_service_stats_free_unexported(self);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -52,6 +52,7 @@ enum {
 
 enum {
     TAG_INITIALIZED,
+    TAG_NDEF_CHANGED,
     TAG_EVENT_COUNT
 };
 
@@ -135,10 +136,11 @@ struct dbus_service_tag_priv {
     const char** interfaces;
     DBusServiceTagType2* t2;
     DBusServiceIsoDep* isodep;
+    DBusServiceStats* stats;
 };
 
 #define NFC_DBUS_TAG_INTERFACE "org.sailfishos.nfc.Tag"
-#define NFC_DBUS_TAG_INTERFACE_VERSION  (5)
+#define NFC_DBUS_TAG_INTERFACE_VERSION  (6)
 
 static const char* const dbus_service_tag_default_interfaces[] = {
     NFC_DBUS_TAG_INTERFACE, NULL
@@ -380,15 +382,12 @@ dbus_service_tag_lock_peer_vanished(
 
 static
 void
-dbus_service_tag_export_all(
+dbus_service_tag_export_ndefs(
     DBusServiceTagPriv* self)
 {
     DBusServiceTag* pub = &self->pub;
-    NfcTag* tag = pub->tag;
-    NfcNdefRec* rec = tag->ndef;
-    GPtrArray* interfaces = g_ptr_array_new();
+    NfcNdefRec* rec = pub->tag->ndef;
 
-    /* Export NDEF records */
     if (rec) {
         GString* buf = g_string_new(self->path);
         guint base_len, i;
@@ -409,6 +408,19 @@ dbus_service_tag_export_all(
         }
         g_string_free(buf, TRUE);
     }
+}
+
+static
+void
+dbus_service_tag_export_all(
+    DBusServiceTagPriv* self)
+{
+    DBusServiceTag* pub = &self->pub;
+    NfcTag* tag = pub->tag;
+    GPtrArray* interfaces = g_ptr_array_new();
+
+    /* Export NDEF records */
+    dbus_service_tag_export_ndefs(self);
 
     /* Export sub-interfaces */
     g_ptr_array_add(interfaces, (gpointer)NFC_DBUS_TAG_INTERFACE);
@@ -430,6 +442,14 @@ dbus_service_tag_export_all(
         }
     }
 
+    self->stats = dbus_service_stats_new(nfc_target_stats(tag->target),
+        pub->connection, self->path);
+    if (self->stats) {
+        const char* iface = NFC_DBUS_STATS_INTERFACE;
+        GDEBUG("Adding %s", iface);
+        g_ptr_array_add(interfaces, (gpointer)iface);
+    }
+
     GASSERT(!self->interfaces);
     g_ptr_array_add(interfaces, NULL);
     self->interfaces = (const char**)g_ptr_array_free(interfaces, FALSE);
@@ -668,6 +688,25 @@ dbus_service_tag_initialized(
     dbus_service_tag_complete_pending_calls(self);
 }
 
+static
+void
+dbus_service_tag_ndef_changed(
+    NfcTag* tag,
+    void* user_data)
+{
+    DBusServiceTagPriv* self = user_data;
+
+    /* Nothing has been exported before the tag gets initialized */
+    if (self->interfaces) {
+        GDEBUG("NDEF records changed");
+        g_slist_free_full(self->ndefs, dbus_service_tag_free_ndef_rec);
+        self->ndefs = NULL;
+        dbus_service_tag_export_ndefs(self);
+        org_sailfishos_nfc_tag_emit_ndef_records_changed(self->iface,
+            dbus_service_tag_get_ndef_rec_paths(self));
+    }
+}
+
 /*==========================================================================*
  * D-Bus calls
  *==========================================================================*/
@@ -969,13 +1008,17 @@ dbus_service_tag_handle_transceive(
     DBusServiceTag* self)
 {
     NfcTag* tag = self->tag;
+    NfcTargetSequence* seq = dbus_service_tag_sequence(self, call);
     DBusServiceTagAsyncCall* async = g_slice_new(DBusServiceTagAsyncCall);
 
+    if (NFC_IS_TAG_T4(tag)) {
+        /* Raw frames bypass nfc_isodep_transmit() */
+        nfc_isodep_deferred_reset(NFC_TAG_T4(tag), seq);
+    }
     g_object_ref(async->iface = iface);
     g_object_ref(async->call = call);
     if (!nfc_target_transmit(tag->target,
-        g_variant_get_data(data), g_variant_get_size(data),
-        dbus_service_tag_sequence(self, call),
+        g_variant_get_data(data), g_variant_get_size(data), seq,
         dbus_service_tag_handle_transmit_complete,
         dbus_service_tag_async_destroy, async)) {
         dbus_service_tag_async_free(async);
@@ -1037,6 +1080,7 @@ dbus_service_tag_free_unexported(
 
     g_slist_free_full(self->ndefs, dbus_service_tag_free_ndef_rec);
     g_slist_free_full(self->lock_waiters, dbus_service_tag_lock_waiter_free1);
+    dbus_service_stats_free(self->stats);
     dbus_service_isodep_free(self->isodep);
     dbus_service_tag_t2_free(self->t2);
     dbus_service_tag_lock_free(self->lock);
@@ -1141,6 +1185,9 @@ dbus_service_tag_new(
             nfc_tag_add_initialized_handler(tag,
                 dbus_service_tag_initialized, self);
     }
+    self->tag_event_id[TAG_NDEF_CHANGED] =
+        nfc_tag_add_ndef_changed_handler(tag,
+            dbus_service_tag_ndef_changed, self);
     if (g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON
         (self->iface), connection, self->path, &error)) {
         GDEBUG("Created D-Bus object %s", self->path);
@@ -50,6 +50,7 @@ enum {
     CALL_READ_DATA,
     CALL_READ_ALL_DATA,
     CALL_WRITE_DATA,
+    CALL_READ_BLOCKS,
     CALL_COUNT
 };
 
@@ -68,7 +69,7 @@ struct dbus_service_tag_t2 {
     GVariant* serial;
 };
 
-#define NFC_DBUS_TAG_T2_INTERFACE_VERSION  (1)
+#define NFC_DBUS_TAG_T2_INTERFACE_VERSION  (2)
 
 typedef struct dbus_service_tag_t2_async_call {
     OrgSailfishosNfcTagType2* iface;
@@ -265,22 +266,64 @@ dbus_service_tag_t2_handle_read(
     guint block,
     DBusServiceTagType2* self)
 {
-    if (sector != 0) {
+    DBusServiceTagType2AsyncCall* read =
+        dbus_service_tag_t2_async_call_new(iface, call);
+
+    if (!nfc_tag_t2_read(self->t2, sector, block,
+        dbus_service_tag_t2_handle_read_done,
+        dbus_service_tag_t2_async_call_free, read)) {
+        dbus_service_tag_t2_async_call_free1(read);
         g_dbus_method_invocation_return_error_literal(call,
-            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_NOT_SUPPORTED,
-            "Only sector 0 is supported");
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "Read failed");
+    }
+    return TRUE;
+}
+
+/* ReadBlocks */
+
+static
+void
+dbus_service_tag_t2_handle_read_blocks_done(
+    NfcTagType2* tag,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    DBusServiceTagType2AsyncCall* read = user_data;
+
+    if (status == NFC_TRANSMIT_STATUS_OK) {
+        org_sailfishos_nfc_tag_type2_complete_read_blocks(read->iface,
+            read->call, dbus_service_dup_byte_array_as_variant(data, len));
     } else {
-        DBusServiceTagType2AsyncCall* read =
-            dbus_service_tag_t2_async_call_new(iface, call);
-
-        if (!nfc_tag_t2_read(self->t2, sector, block,
-            dbus_service_tag_t2_handle_read_done,
-            dbus_service_tag_t2_async_call_free, read)) {
-            dbus_service_tag_t2_async_call_free1(read);
-            g_dbus_method_invocation_return_error_literal(call,
-                DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
-                "Read failed");
-        }
+        g_dbus_method_invocation_return_error_literal(read->call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "Read failed");
+    }
+}
+
+static
+gboolean
+dbus_service_tag_t2_handle_read_blocks(
+    OrgSailfishosNfcTagType2* iface,
+    GDBusMethodInvocation* call,
+    guint sector,
+    guint block,
+    guint count,
+    DBusServiceTagType2* self)
+{
+    DBusServiceTagType2AsyncCall* read =
+        dbus_service_tag_t2_async_call_new(iface, call);
+
+    if (!nfc_tag_t2_read_blocks(self->t2, sector, block, count,
+        dbus_service_tag_t2_sequence(self, call),
+        dbus_service_tag_t2_handle_read_blocks_done,
+        dbus_service_tag_t2_async_call_free, read)) {
+        dbus_service_tag_t2_async_call_free1(read);
+        g_dbus_method_invocation_return_error_literal(call,
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "Read failed");
     }
     return TRUE;
 }
@@ -317,26 +360,20 @@ dbus_service_tag_t2_handle_write(
     GVariant* data,
     DBusServiceTagType2* self)
 {
-    if (sector != 0) {
+    GBytes* bytes = g_variant_get_data_as_bytes(data);
+    DBusServiceTagType2AsyncCall* write =
+        dbus_service_tag_t2_async_call_new(iface, call);
+
+    if (!nfc_tag_t2_write_seq(self->t2, sector, block, bytes,
+        dbus_service_tag_t2_sequence(self, call),
+        dbus_service_tag_t2_handle_write_done,
+        dbus_service_tag_t2_async_call_free, write)) {
+        dbus_service_tag_t2_async_call_free1(write);
         g_dbus_method_invocation_return_error_literal(call,
-            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_NOT_SUPPORTED,
-            "Only sector 0 is supported");
-    } else {
-        GBytes* bytes = g_variant_get_data_as_bytes(data);
-        DBusServiceTagType2AsyncCall* write =
-            dbus_service_tag_t2_async_call_new(iface, call);
-
-        if (!nfc_tag_t2_write_seq(self->t2, sector, block, bytes,
-            dbus_service_tag_t2_sequence(self, call),
-            dbus_service_tag_t2_handle_write_done,
-            dbus_service_tag_t2_async_call_free, write)) {
-            dbus_service_tag_t2_async_call_free1(write);
-            g_dbus_method_invocation_return_error_literal(call,
-                DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
-                "Write failed");
-        }
-        g_bytes_unref(bytes);
+            DBUS_SERVICE_ERROR, DBUS_SERVICE_ERROR_FAILED,
+            "Write failed");
     }
+    g_bytes_unref(bytes);
     return TRUE;
 }
 
@@ -555,6 +592,9 @@ dbus_service_tag_t2_new(
     self->call_id[CALL_WRITE_DATA] =
         g_signal_connect(self->iface, "handle-write-data",
         G_CALLBACK(dbus_service_tag_t2_handle_write_data), self);
+    self->call_id[CALL_READ_BLOCKS] =
+        g_signal_connect(self->iface, "handle-read-blocks",
+        G_CALLBACK(dbus_service_tag_t2_handle_read_blocks), self);
 
     if (g_dbus_interface_skeleton_export(G_DBUS_INTERFACE_SKELETON
         (self->iface), owner->connection, owner->path, &error)) {
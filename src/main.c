@@ -31,6 +31,8 @@
  */
 
 #include "internal/nfc_manager_i.h"
+#include "internal/nfc_tag_cache_i.h"
+#include "internal/nfc_tag_t2_i.h"
 
 #include "dbus_handlers/plugin.h"
 #include "dbus_neard/plugin.h"
@@ -61,12 +63,17 @@ static FILE* nfcd_log_file = NULL;
 typedef struct nfcd_opt {
     char* plugin_dir;
     gboolean dont_unload;
+    char* tag_cache_dir;
+    int tag_cache_size;
+    gboolean tag_prefetch;
 } NfcdOpt;
 
 #ifndef DEFAULT_PLUGIN_DIR
 #define DEFAULT_PLUGIN_DIR "/usr/lib/nfcd/plugins"
 #endif
 
+#define DEFAULT_TAG_CACHE_SIZE (1024) /* KiB */
+
 #define RET_OK      (0)
 #define RET_CMDLINE (1)
 #define RET_ERR     (2)
@@ -106,8 +113,15 @@ nfcd_run(
         .disable = (const char**)nfcd_disable_plugins,
         .flags = opts->dont_unload ? NFC_PLUGINS_DONT_UNLOAD : 0
     };
-    NfcManager* nfc = nfc_manager_new(&plugins_info);
+    NfcManager* nfc;
+
+    if (opts->tag_cache_dir) {
+        nfc_tag_cache_configure(opts->tag_cache_dir,
+            (gsize)MAX(opts->tag_cache_size, 0) * 1024);
+    }
+    nfc_tag_t2_configure_prefetch(opts->tag_prefetch);
 
+    nfc = nfc_manager_new(&plugins_info);
     if (nfc_manager_start(nfc)) {
         if (!nfc->stopped) {
             GMainLoop* loop = g_main_loop_new(NULL, FALSE);
@@ -128,6 +142,7 @@ nfcd_run(
         ret = RET_OK;
     }
     nfc_manager_unref(nfc);
+    nfc_tag_cache_configure(NULL, 0);
     return ret;
 }
 
@@ -292,6 +307,12 @@ nfcd_opt_parse(
           "Disable plugins (repeatable)", "PLUGINS"},
         { "dont-unload", 'U', 0, G_OPTION_ARG_NONE, &opt->dont_unload,
           "Don't unload external plugins on exit", NULL },
+        { "tag-cache", 'c', 0, G_OPTION_ARG_FILENAME, &opt->tag_cache_dir,
+          "Cache tag contents in DIR", "DIR" },
+        { "tag-cache-size", 's', 0, G_OPTION_ARG_INT, &opt->tag_cache_size,
+          "Tag cache size limit in KiB, 0 for none [1024]", "SIZE" },
+        { "tag-prefetch", 'P', 0, G_OPTION_ARG_NONE, &opt->tag_prefetch,
+          "Read the rest of Type 2 tag memory in the background", NULL },
         { NULL }
     };
     GOptionContext* options = g_option_context_new("- NFC daemon");
@@ -314,6 +335,7 @@ nfcd_opt_init(
     NfcdOpt* opts)
 {
     memset(opts, 0, sizeof(*opts));
+    opts->tag_cache_size = DEFAULT_TAG_CACHE_SIZE;
 }
 
 static
@@ -325,6 +347,7 @@ nfcd_opt_cleanup(
         fclose(nfcd_log_file);
     }
     g_free(opts->plugin_dir);
+    g_free(opts->tag_cache_dir);
     g_strfreev(nfcd_enable_plugins);
     g_strfreev(nfcd_disable_plugins);
 }
@@ -0,0 +1,648 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_replay_target.h"
+
+#include <gutil_log.h>
+#include <gutil_misc.h>
+
+#include <string.h>
+
+#define THIS_TYPE TEST_TYPE_REPLAY_TARGET
+#define THIS(obj) TEST_REPLAY_TARGET(obj)
+#define PARENT_CLASS test_replay_target_parent_class
+G_DEFINE_TYPE(TestReplayTarget, test_replay_target, NFC_TYPE_TARGET)
+
+typedef enum test_replay_result {
+    TEST_REPLAY_RESPONSE,
+    TEST_REPLAY_DROPOUT,
+    TEST_REPLAY_TIMEOUT
+} TEST_REPLAY_RESULT;
+
+struct test_replay_entry {
+    GBytes* cmd;    /* NULL matches anything */
+    GBytes* resp;
+    TEST_REPLAY_RESULT result;
+    guint delay_us;
+};
+
+/* pcapng */
+#define PCAPNG_BLOCK_SHB (0x0a0d0d0a)
+#define PCAPNG_BLOCK_IDB (0x00000001)
+#define PCAPNG_BLOCK_EPB (0x00000006)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1a2b3c4d)
+#define PCAPNG_OPT_IF_TSRESOL (9)
+#define LINKTYPE_ISO_14443 (264)
+#define ISO_14443_EVENT_PICC_TO_PCD_CRC (0xfe)
+#define ISO_14443_EVENT_PCD_TO_PICC_CRC (0xff)
+#define ISO_14443_EVENT_PCD_TO_PICC (0xfa)
+#define ISO_14443_EVENT_PICC_TO_PCD (0xfb)
+
+/*==========================================================================*
+ * Parsing
+ *==========================================================================*/
+
+static
+void
+test_replay_entry_clear(
+    gpointer data)
+{
+    TestReplayEntry* entry = data;
+
+    if (entry->cmd) {
+        g_bytes_unref(entry->cmd);
+    }
+    if (entry->resp) {
+        g_bytes_unref(entry->resp);
+    }
+}
+
+static
+GBytes*
+test_replay_parse_hex(
+    const char* str)
+{
+    GString* hex = g_string_new(NULL);
+    GBytes* bytes = NULL;
+
+    while (*str) {
+        if (!g_ascii_isspace(*str)) {
+            g_string_append_c(hex, *str);
+        }
+        str++;
+    }
+    if (hex->len) {
+        bytes = gutil_hex2bytes(hex->str, hex->len);
+    }
+    g_string_free(hex, TRUE);
+    return bytes;
+}
+
+static
+gboolean
+test_replay_parse_response(
+    TestReplayEntry* entry,
+    char* str)
+{
+    char* delay = strchr(str, '@');
+
+    if (delay) {
+        char* end = NULL;
+        const double ms = g_ascii_strtod(g_strstrip(delay + 1), &end);
+
+        if (end == delay + 1 || *end || ms < 0) {
+            return FALSE;
+        }
+        entry->delay_us = (guint)(ms * 1000);
+        *delay = 0;
+    }
+    g_strstrip(str);
+    if (!strcmp(str, "!")) {
+        entry->result = TEST_REPLAY_DROPOUT;
+    } else if (!strcmp(str, "~")) {
+        entry->result = TEST_REPLAY_TIMEOUT;
+    } else if ((entry->resp = test_replay_parse_hex(str)) != NULL) {
+        entry->result = TEST_REPLAY_RESPONSE;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static
+gboolean
+test_replay_parse_text(
+    GArray* entries,
+    const char* text,
+    gsize size)
+{
+    char* buf = g_strndup(text, size);
+    char** lines = g_strsplit(buf, "\n", -1);
+    char** ptr;
+    TestReplayEntry* entry = NULL;
+    gboolean ok = TRUE;
+
+    for (ptr = lines; *ptr && ok; ptr++) {
+        char* line = *ptr;
+        char* comment = strchr(line, '#');
+
+        if (comment) {
+            *comment = 0;
+        }
+        g_strstrip(line);
+        if (line[0] == '>') {
+            TestReplayEntry next;
+            char* cmd = g_strstrip(line + 1);
+
+            memset(&next, 0, sizeof(next));
+            next.result = TEST_REPLAY_TIMEOUT;
+            if (strcmp(cmd, "*")) {
+                ok = ((next.cmd = test_replay_parse_hex(cmd)) != NULL);
+            }
+            g_array_append_val(entries, next);
+            entry = &g_array_index(entries, TestReplayEntry, entries->len - 1);
+        } else if (line[0] == '<') {
+            /* Only one response per command */
+            ok = (entry && !entry->resp && entry->result ==
+                TEST_REPLAY_TIMEOUT && !entry->delay_us &&
+                test_replay_parse_response(entry, line + 1));
+        } else {
+            ok = !line[0];
+        }
+    }
+    if (!ok) {
+        GWARN("Invalid trace line: %s", ptr[-1]);
+    }
+    g_strfreev(lines);
+    g_free(buf);
+    return ok;
+}
+
+static
+guint32
+test_replay_u32(
+    const guint8* ptr)
+{
+    guint32 value;
+
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static
+guint16
+test_replay_u16(
+    const guint8* ptr)
+{
+    guint16 value;
+
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+/* Returns the number of timestamp units per microsecond */
+static
+gdouble
+test_replay_pcapng_tsresol(
+    const guint8* opt,
+    const guint8* end)
+{
+    while (opt + 4 <= end) {
+        const guint16 code = test_replay_u16(opt);
+        const guint16 len = test_replay_u16(opt + 2);
+
+        if (!code) {
+            break;
+        } else if (code == PCAPNG_OPT_IF_TSRESOL && len == 1) {
+            const guint8 resol = opt[4];
+            const guint8 exp = resol & 0x7f;
+            gdouble units_per_sec = 1;
+            guint i;
+
+            for (i = 0; i < exp; i++) {
+                units_per_sec *= (resol & 0x80) ? 2 : 10;
+            }
+            return units_per_sec / G_USEC_PER_SEC;
+        }
+        opt += 4 + ((len + 3) & ~3);
+    }
+    return 1; /* Microseconds by default */
+}
+
+static
+gboolean
+test_replay_parse_pcapng(
+    GArray* entries,
+    const guint8* data,
+    gsize size)
+{
+    const guint8* ptr = data;
+    const guint8* end = data + size;
+    gdouble tsresol = 1;
+    guint iface = 0, rf_iface = G_MAXUINT;
+    gboolean have_cmd = FALSE;
+    guint64 cmd_time = 0;
+
+    while (ptr + 12 <= end) {
+        const guint32 type = test_replay_u32(ptr);
+        const guint32 len = test_replay_u32(ptr + 4);
+
+        if (len < 12 || (len & 3) || ptr + len > end) {
+            GWARN("Broken pcapng block");
+            return FALSE;
+        }
+        if (type == PCAPNG_BLOCK_SHB) {
+            if (test_replay_u32(ptr + 8) != PCAPNG_BYTE_ORDER_MAGIC) {
+                GWARN("Unsupported pcapng byte order");
+                return FALSE;
+            }
+            iface = 0;
+        } else if (type == PCAPNG_BLOCK_IDB && len >= 20) {
+            if (rf_iface == G_MAXUINT &&
+                test_replay_u16(ptr + 8) == LINKTYPE_ISO_14443) {
+                rf_iface = iface;
+                tsresol = test_replay_pcapng_tsresol(ptr + 16,
+                    ptr + len - 4);
+            }
+            iface++;
+        } else if (type == PCAPNG_BLOCK_EPB && len >= 32 &&
+            test_replay_u32(ptr + 8) == rf_iface) {
+            const guint64 ts = ((guint64)test_replay_u32(ptr + 12) << 32) |
+                test_replay_u32(ptr + 16);
+            const guint32 caplen = test_replay_u32(ptr + 20);
+            const guint8* pkt = ptr + 28;
+
+            if (caplen >= 4 && pkt + caplen <= ptr + len - 4) {
+                const guint8 event = pkt[1];
+                guint n = MIN((guint)((pkt[2] << 8) | pkt[3]), caplen - 4);
+                TestReplayEntry* entry;
+
+                /* Drop CRC */
+                if ((event == ISO_14443_EVENT_PCD_TO_PICC_CRC ||
+                     event == ISO_14443_EVENT_PICC_TO_PCD_CRC) && n >= 2) {
+                    n -= 2;
+                }
+                switch (event) {
+                case ISO_14443_EVENT_PCD_TO_PICC:
+                case ISO_14443_EVENT_PCD_TO_PICC_CRC:
+                    g_array_set_size(entries, entries->len + 1);
+                    entry = &g_array_index(entries, TestReplayEntry,
+                        entries->len - 1);
+                    entry->cmd = g_bytes_new(pkt + 4, n);
+                    entry->result = TEST_REPLAY_TIMEOUT;
+                    cmd_time = ts;
+                    have_cmd = TRUE;
+                    break;
+                case ISO_14443_EVENT_PICC_TO_PCD:
+                case ISO_14443_EVENT_PICC_TO_PCD_CRC:
+                    if (have_cmd) {
+                        entry = &g_array_index(entries, TestReplayEntry,
+                            entries->len - 1);
+                        entry->resp = g_bytes_new(pkt + 4, n);
+                        entry->result = TEST_REPLAY_RESPONSE;
+                        entry->delay_us = (guint)((ts - cmd_time) / tsresol);
+                        have_cmd = FALSE;
+                    }
+                    break;
+                }
+            }
+        }
+        ptr += len;
+    }
+    return TRUE;
+}
+
+static
+gboolean
+test_replay_parse(
+    GArray* entries,
+    const void* trace,
+    gsize size)
+{
+    if (size >= 4 && test_replay_u32(trace) == PCAPNG_BLOCK_SHB) {
+        return test_replay_parse_pcapng(entries, trace, size);
+    } else {
+        return test_replay_parse_text(entries, trace, size);
+    }
+}
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gboolean
+test_replay_target_transmit_done(
+    gpointer user_data)
+{
+    TestReplayTarget* self = THIS(user_data);
+    const TestReplayEntry* entry = &g_array_index(self->entries,
+        TestReplayEntry, self->pos - 1);
+    gsize len;
+    const void* data = g_bytes_get_data(entry->resp, &len);
+
+    g_assert(self->transmit_id);
+    self->transmit_id = 0;
+    self->stats.responses++;
+    nfc_target_transmit_done(&self->target, NFC_TRANSMIT_STATUS_OK,
+        data, (guint)len);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+test_replay_target_transmit_error(
+    gpointer user_data)
+{
+    TestReplayTarget* self = THIS(user_data);
+
+    g_assert(self->transmit_id);
+    self->transmit_id = 0;
+    nfc_target_transmit_done(&self->target, NFC_TRANSMIT_STATUS_ERROR,
+        NULL, 0);
+    return G_SOURCE_REMOVE;
+}
+
+static
+guint
+test_replay_target_schedule(
+    TestReplayTarget* self,
+    guint delay_us,
+    GSourceFunc fn)
+{
+    const guint ms = (guint)(delay_us * self->time_scale / 1000);
+
+    self->stats.delay_us += delay_us;
+    return ms ? g_timeout_add(ms, fn, self) : g_idle_add(fn, self);
+}
+
+static
+gboolean
+test_replay_target_transmit(
+    NfcTarget* target,
+    const void* data,
+    guint len)
+{
+    TestReplayTarget* self = THIS(target);
+    const TestReplayEntry* entry = NULL;
+
+    self->stats.transmits++;
+    if (self->pos < self->entries->len) {
+        entry = &g_array_index(self->entries, TestReplayEntry, self->pos++);
+        if (entry->cmd) {
+            gsize size;
+            const void* cmd = g_bytes_get_data(entry->cmd, &size);
+
+            if (size != len || memcmp(cmd, data, len)) {
+                GWARN("Replay mismatch at frame %u", self->pos);
+                self->stats.mismatches++;
+                entry = NULL;
+            }
+        }
+    }
+
+    if (!entry) {
+        /* Off the script */
+        self->transmit_id = g_idle_add(test_replay_target_transmit_error,
+            self);
+    } else if (self->dropout_rate &&
+        (guint)g_rand_int_range(self->rand, 0, 1000) < self->dropout_rate) {
+        GDEBUG("Simulating dropout at frame %u", self->pos);
+        self->stats.dropouts++;
+        self->transmit_id = g_idle_add(test_replay_target_transmit_error,
+            self);
+    } else {
+        switch (entry->result) {
+        case TEST_REPLAY_RESPONSE:
+            self->transmit_id = test_replay_target_schedule(self,
+                entry->delay_us, test_replay_target_transmit_done);
+            break;
+        case TEST_REPLAY_DROPOUT:
+            self->stats.dropouts++;
+            self->transmit_id = test_replay_target_schedule(self,
+                entry->delay_us, test_replay_target_transmit_error);
+            break;
+        case TEST_REPLAY_TIMEOUT:
+            /* Leave it hanging until NfcTarget gives up */
+            self->stats.timeouts++;
+            break;
+        }
+    }
+    return TRUE;
+}
+
+static
+void
+test_replay_target_cancel_transmit(
+    NfcTarget* target)
+{
+    TestReplayTarget* self = THIS(target);
+
+    if (self->transmit_id) {
+        g_source_remove(self->transmit_id);
+        self->transmit_id = 0;
+    }
+}
+
+static
+gboolean
+test_replay_target_reactivated(
+    gpointer user_data)
+{
+    TestReplayTarget* self = THIS(user_data);
+
+    g_assert(self->reactivate_id);
+    self->reactivate_id = 0;
+    nfc_target_reactivated(&self->target);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+test_replay_target_reactivate(
+    NfcTarget* target)
+{
+    TestReplayTarget* self = THIS(target);
+
+    g_assert(!self->reactivate_id);
+    self->stats.reactivations++;
+    self->reactivate_id = test_replay_target_schedule(self,
+        self->reactivate_us, test_replay_target_reactivated);
+    return TRUE;
+}
+
+static
+void
+test_replay_target_deactivate(
+    NfcTarget* target)
+{
+    TestReplayTarget* self = THIS(target);
+
+    if (self->reactivate_id) {
+        g_source_remove(self->reactivate_id);
+        self->reactivate_id = 0;
+    }
+    nfc_target_gone(target);
+}
+
+/*==========================================================================*
+ * Interface
+ *==========================================================================*/
+
+NfcTarget*
+test_replay_target_new(
+    NFC_TECHNOLOGY tech,
+    const void* trace,
+    gsize size)
+{
+    TestReplayTarget* self = g_object_new(THIS_TYPE, NULL);
+
+    self->target.technology = tech;
+    if (test_replay_parse(self->entries, trace, size)) {
+        GDEBUG("%u frame(s) to replay", self->entries->len);
+        return &self->target;
+    }
+    nfc_target_unref(&self->target);
+    return NULL;
+}
+
+NfcTarget*
+test_replay_target_new_from_file(
+    NFC_TECHNOLOGY tech,
+    const char* path)
+{
+    NfcTarget* target = NULL;
+    GError* error = NULL;
+    gchar* contents = NULL;
+    gsize size = 0;
+
+    if (g_file_get_contents(path, &contents, &size, &error)) {
+        target = test_replay_target_new(tech, contents, size);
+        g_free(contents);
+    } else {
+        GWARN("%s", GERRMSG(error));
+        g_error_free(error);
+    }
+    return target;
+}
+
+void
+test_replay_target_set_time_scale(
+    NfcTarget* target,
+    gdouble scale)
+{
+    THIS(target)->time_scale = MAX(scale, 0);
+}
+
+void
+test_replay_target_set_reactivate_time(
+    NfcTarget* target,
+    gdouble ms)
+{
+    THIS(target)->reactivate_us = (guint)(MAX(ms, 0) * 1000);
+}
+
+void
+test_replay_target_set_dropout(
+    NfcTarget* target,
+    guint per_mille,
+    guint32 seed)
+{
+    TestReplayTarget* self = THIS(target);
+
+    self->dropout_rate = MIN(per_mille, 1000);
+    g_rand_set_seed(self->rand, seed);
+}
+
+void
+test_replay_target_rewind(
+    NfcTarget* target)
+{
+    TestReplayTarget* self = THIS(target);
+
+    self->pos = 0;
+    memset(&self->stats, 0, sizeof(self->stats));
+}
+
+guint
+test_replay_target_remaining(
+    NfcTarget* target)
+{
+    TestReplayTarget* self = THIS(target);
+
+    return self->entries->len - self->pos;
+}
+
+const TestReplayStats*
+test_replay_target_stats(
+    NfcTarget* target)
+{
+    return &THIS(target)->stats;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+test_replay_target_init(
+    TestReplayTarget* self)
+{
+    self->entries = g_array_new(FALSE, TRUE, sizeof(TestReplayEntry));
+    g_array_set_clear_func(self->entries, test_replay_entry_clear);
+    self->rand = g_rand_new_with_seed(0);
+}
+
+static
+void
+test_replay_target_finalize(
+    GObject* object)
+{
+    TestReplayTarget* self = THIS(object);
+
+    if (self->transmit_id) {
+        g_source_remove(self->transmit_id);
+    }
+    if (self->reactivate_id) {
+        g_source_remove(self->reactivate_id);
+    }
+    g_array_free(self->entries, TRUE);
+    g_rand_free(self->rand);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+test_replay_target_class_init(
+    NfcTargetClass* klass)
+{
+    klass->transmit = test_replay_target_transmit;
+    klass->cancel_transmit = test_replay_target_cancel_transmit;
+    klass->reactivate = test_replay_target_reactivate;
+    klass->deactivate = test_replay_target_deactivate;
+    G_OBJECT_CLASS(klass)->finalize = test_replay_target_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
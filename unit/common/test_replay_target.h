@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef TEST_REPLAY_TARGET_H
+#define TEST_REPLAY_TARGET_H
+
+#include "test_types.h"
+
+#include "nfc_target_impl.h"
+
+/*
+ * Replay target answers transmissions from a recorded trace. Commands
+ * are expected in the order they were recorded, each one gets the
+ * recorded response after the recorded delay (multiplied by the time
+ * scale, zero by default i.e. no delay). A mismatching command or
+ * running out of the recorded frames fails the transmission.
+ *
+ * Two trace formats are supported. Text traces look like this:
+ *
+ *   # Comment
+ *   > 30 00                    Command (hex)
+ *   < 04 d4 fb a3 ... @1.5     Response, optionally delayed (ms)
+ *   > *                        Matches any command
+ *   < !                        Transmission fails (dropout)
+ *   > 30 04
+ *   < ~                        No response at all (timeout)
+ *
+ * Command without a response is the same as "< ~". The other format
+ * is pcapng produced by nfc_capture_pcapng() or any other tool using
+ * LINKTYPE_ISO_14443. Only the first ISO 14443 interface is replayed.
+ * There, the delay is the time between a command and its response.
+ *
+ * Dropouts can also be injected randomly, with a fixed seed to make
+ * runs reproducible.
+ *
+ * Reactivation isn't a part of the trace. It always succeeds after the
+ * configured delay (zero by default), scaled the same way as responses.
+ */
+
+typedef struct test_replay_stats {
+    guint transmits;
+    guint responses;
+    guint mismatches;
+    guint dropouts;
+    guint timeouts;
+    guint reactivations;
+    gint64 delay_us;    /* Total simulated delay */
+} TestReplayStats;
+
+typedef struct test_replay_entry TestReplayEntry;
+typedef NfcTargetClass TestReplayTargetClass;
+typedef struct test_replay_target {
+    NfcTarget target;
+    GArray* entries;
+    guint pos;
+    guint transmit_id;
+    guint reactivate_id;
+    guint reactivate_us;
+    gdouble time_scale;
+    guint dropout_rate; /* Per mille */
+    GRand* rand;
+    TestReplayStats stats;
+} TestReplayTarget;
+
+GType test_replay_target_get_type(void);
+#define TEST_TYPE_REPLAY_TARGET (test_replay_target_get_type())
+#define TEST_REPLAY_TARGET(obj) (G_TYPE_CHECK_INSTANCE_CAST(obj, \
+        TEST_TYPE_REPLAY_TARGET, TestReplayTarget))
+
+/* Returns NULL if the trace can't be parsed */
+NfcTarget*
+test_replay_target_new(
+    NFC_TECHNOLOGY tech,
+    const void* trace,
+    gsize size);
+
+NfcTarget*
+test_replay_target_new_from_file(
+    NFC_TECHNOLOGY tech,
+    const char* path);
+
+void
+test_replay_target_set_time_scale(
+    NfcTarget* target,
+    gdouble scale);
+
+void
+test_replay_target_set_reactivate_time(
+    NfcTarget* target,
+    gdouble ms);
+
+void
+test_replay_target_set_dropout(
+    NfcTarget* target,
+    guint per_mille,
+    guint32 seed);
+
+/* Starts over and resets the statistics */
+void
+test_replay_target_rewind(
+    NfcTarget* target);
+
+guint
+test_replay_target_remaining(
+    NfcTarget* target);
+
+const TestReplayStats*
+test_replay_target_stats(
+    NfcTarget* target);
+
+#endif /* TEST_REPLAY_TARGET_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -142,6 +142,7 @@ test_target_init(
 {
     self->fail_transmit = TEST_TARGET_FAIL_ALL;
     self->cmd_resp = g_ptr_array_new_with_free_func(g_free);
+    nfc_target_set_direct_continuation(&self->target, TRUE);
 }
 
 static
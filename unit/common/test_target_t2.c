@@ -53,20 +53,18 @@ test_target_t2_read_done(
     NfcTarget* target = &self->target;
     const GUtilData* data = &self->data;
     NFC_TRANSMIT_STATUS status = NFC_TRANSMIT_STATUS_OK;
-    guint offset = (read->block * TEST_TARGET_T2_BLOCK_SIZE) % data->size;
-    guint8 buf[TEST_TARGET_T2_READ_SIZE];
-    guint len = sizeof(buf);
+    const guint offset = self->sector * TEST_TARGET_T2_SECTOR_SIZE +
+        read->block * TEST_TARGET_T2_BLOCK_SIZE;
+    guint8 buf[256];
+    guint i, len = read->count * TEST_TARGET_T2_BLOCK_SIZE;
 
     g_assert(self->transmit_id);
+    g_assert(len <= sizeof(buf));
     self->transmit_id = 0;
 
-    if ((offset + TEST_TARGET_T2_READ_SIZE) <= data->size) {
-        memcpy(buf, data->bytes + offset, TEST_TARGET_T2_READ_SIZE);
-    } else {
-        const guint remain = (offset + TEST_TARGET_T2_READ_SIZE) - data->size;
-
-        memcpy(buf, data->bytes + offset, TEST_TARGET_T2_READ_SIZE - remain);
-        memcpy(buf + (TEST_TARGET_T2_READ_SIZE - remain), data->bytes, remain);
+    /* Roll over at the end of memory */
+    for (i = 0; i < len; i++) {
+        buf[i] = data->bytes[(offset + i) % data->size];
     }
 
     if (self->read_error && self->read_error->block == read->block) {
@@ -144,7 +142,8 @@ test_target_t2_write_done(
         self->write_error = NULL;
     } else {
         const guint data_size = self->data.size;
-        guint offset = (write->block * TEST_TARGET_T2_BLOCK_SIZE) % data_size;
+        guint offset = (self->sector * TEST_TARGET_T2_SECTOR_SIZE +
+            write->block * TEST_TARGET_T2_BLOCK_SIZE) % data_size;
         guint size = write->size;
         const guint8* src = write->data;
 
@@ -167,6 +166,70 @@ test_target_t2_write_done(
     return G_SOURCE_REMOVE;
 }
 
+static
+gboolean
+test_target_t2_ack_done(
+    gpointer user_data)
+{
+    TestTargetT2Ack* ack = user_data;
+    TestTargetT2* self = ack->target;
+    static const guint8 ack_byte = 0x0a;
+
+    g_assert(self->transmit_id);
+    self->transmit_id = 0;
+    if (ack->status == NFC_TRANSMIT_STATUS_OK) {
+        nfc_target_transmit_done(&self->target, ack->status, &ack_byte, 1);
+    } else {
+        nfc_target_transmit_done(&self->target, ack->status, NULL, 0);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+test_target_t2_ack(
+    TestTargetT2* self,
+    NFC_TRANSMIT_STATUS status)
+{
+    TestTargetT2Ack* ack = g_new(TestTargetT2Ack, 1);
+
+    ack->target = self;
+    ack->status = status;
+    self->transmit_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+        test_target_t2_ack_done, ack, g_free);
+}
+
+static
+void
+test_target_t2_read(
+    TestTargetT2* self,
+    guint block,
+    guint count)
+{
+    TestTargetT2Read* read = g_new(TestTargetT2Read, 1);
+
+    read->target = self;
+    read->block = block;
+    read->count = count;
+    self->reads++;
+    self->transmit_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+        test_target_t2_read_done, read, g_free);
+}
+
+static
+gboolean
+test_target_t2_version_done(
+    gpointer user_data)
+{
+    TestTargetT2* self = TEST_TARGET_T2(user_data);
+
+    g_assert(self->transmit_id);
+    self->transmit_id = 0;
+    nfc_target_transmit_done(&self->target, NFC_TRANSMIT_STATUS_OK,
+        self->version, TEST_TARGET_T2_VERSION_SIZE);
+    return G_SOURCE_REMOVE;
+}
+
 static
 void
 test_target_t2_write_free(
@@ -191,19 +254,40 @@ test_target_t2_transmit(
     if (self->transmit_error > 0) {
         self->transmit_error--;
         GDEBUG("Simulating transmission failure");
+    } else if (self->sector_select) {
+        const guint8* cmd = data;
+
+        /* SECTOR_SELECT packet 2 is acknowledged passively */
+        self->sector_select = FALSE;
+        if (len == 4) {
+            self->sector = cmd[0];
+            GDEBUG("Sector %u", self->sector);
+            test_target_t2_ack(self, NFC_TRANSMIT_STATUS_TIMEOUT);
+            return TRUE;
+        }
     } else if (len > 0) {
         const guint8* cmd = data;
 
         switch (cmd[0]) {
         case 0x30: /* READ */
             if (len == 2) {
-                TestTargetT2Read* read = g_new(TestTargetT2Read, 1);
-
-                read->target = self;
-                read->block = cmd[1];
-                GDEBUG("Read block #%u", read->block);
-                self->transmit_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-                    test_target_t2_read_done, read, g_free);
+                GDEBUG("Read block #%u", cmd[1]);
+                test_target_t2_read(self, cmd[1],
+                    TEST_TARGET_T2_READ_SIZE / TEST_TARGET_T2_BLOCK_SIZE);
+                return TRUE;
+            }
+            break;
+        case 0x3a: /* FAST_READ */
+            if (self->version && len == 3 && cmd[2] >= cmd[1]) {
+                GDEBUG("Fast read blocks #%u..%u", cmd[1], cmd[2]);
+                test_target_t2_read(self, cmd[1], cmd[2] - cmd[1] + 1);
+                return TRUE;
+            }
+            break;
+        case 0x60: /* GET_VERSION */
+            if (self->version && len == 1) {
+                self->transmit_id = g_idle_add(test_target_t2_version_done,
+                    self);
                 return TRUE;
             }
             break;
@@ -216,12 +300,26 @@ test_target_t2_transmit(
                 write->size = len - 2;
                 write->data = gutil_memdup(cmd + 2, write->size);
                 GDEBUG("Write block #%u, %u bytes", write->block, write->size);
+                if (!self->writes++) {
+                    self->first_write = write->block;
+                    memcpy(self->first_write_data, write->data,
+                        MIN(write->size, TEST_TARGET_T2_BLOCK_SIZE));
+                }
+                self->last_write = write->block;
                 self->transmit_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
                     test_target_t2_write_done, write,
                     test_target_t2_write_free);
                 return TRUE;
             }
             break;
+        case 0xc2: /* SECTOR_SELECT */
+            if (len == 2 && cmd[1] == 0xff) {
+                self->sector_select = TRUE;
+                self->sector_selects++;
+                test_target_t2_ack(self, NFC_TRANSMIT_STATUS_OK);
+                return TRUE;
+            }
+            break;
         }
     }
     return FALSE;
@@ -244,6 +342,7 @@ void
 test_target_t2_init(
     TestTargetT2* self)
 {
+    nfc_target_set_direct_continuation(&self->target, TRUE);
 }
 
 static
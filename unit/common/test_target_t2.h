@@ -38,6 +38,8 @@
 #define TEST_TARGET_T2_READ_SIZE (16)
 #define TEST_TARGET_T2_BLOCK_SIZE (4)
 #define TEST_TARGET_T2_FIRST_DATA_BLOCK (4)
+#define TEST_TARGET_T2_SECTOR_SIZE (1024)
+#define TEST_TARGET_T2_VERSION_SIZE (8)
 #define TEST_TARGET_T2_DATA_OFFSET \
     (TEST_TARGET_T2_FIRST_DATA_BLOCK * TEST_TARGET_T2_BLOCK_SIZE)
 
@@ -50,6 +52,15 @@ typedef struct test_target_t2 {
     const TestTargetT2Error* read_error;
     const TestTargetT2Error* write_error;
     gboolean transmit_error;
+    guint sector;
+    gboolean sector_select;
+    guint sector_selects;
+    const guint8* version; /* GET_VERSION and FAST_READ are supported */
+    guint reads;
+    guint writes;
+    guint first_write; /* Since writes was last zero */
+    guint8 first_write_data[TEST_TARGET_T2_BLOCK_SIZE];
+    guint last_write;
 } TestTargetT2;
 
 typedef enum test_target_t2_error_type {
@@ -68,8 +79,14 @@ struct test_target_t2_error {
 typedef struct test_target_t2_read {
     TestTargetT2* target;
     guint block;
+    guint count;
 } TestTargetT2Read;
 
+typedef struct test_target_t2_ack {
+    TestTargetT2* target;
+    NFC_TRANSMIT_STATUS status;
+} TestTargetT2Ack;
+
 typedef struct test_target_t2_write {
     TestTargetT2* target;
     guint block;
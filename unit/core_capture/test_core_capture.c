@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nfc_types_p.h"
+#include "nfc_capture_p.h"
+
+#include "test_common.h"
+
+static TestOpt test_opt;
+
+#define PCAPNG_BLOCK_SHB (0x0a0d0d0a)
+#define PCAPNG_BLOCK_IDB (0x00000001)
+#define PCAPNG_BLOCK_EPB (0x00000006)
+#define LINKTYPE_NFC_LLCP (245)
+#define LINKTYPE_ISO_14443 (264)
+
+typedef struct test_packet {
+    guint32 ifid;
+    guint32 caplen;
+    guint32 origlen;
+    const guint8* data;
+    guint32 flags;
+} TestPacket;
+
+static
+guint32
+test_u32(
+    const guint8* ptr)
+{
+    guint32 value;
+
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static
+guint16
+test_u16(
+    const guint8* ptr)
+{
+    guint16 value;
+
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+/* Returns the number of packets, fills in up to max packets */
+static
+guint
+test_parse(
+    GBytes* pcapng,
+    TestPacket* packets,
+    guint max)
+{
+    gsize size;
+    const guint8* data = g_bytes_get_data(pcapng, &size);
+    const guint8* ptr = data;
+    const guint8* end = data + size;
+    guint n = 0, ifcount = 0;
+
+    g_assert_cmpuint(size % 4, == ,0);
+    while (ptr < end) {
+        const guint32 type = test_u32(ptr);
+        const guint32 len = test_u32(ptr + 4);
+
+        g_assert_cmpuint(len % 4, == ,0);
+        g_assert(ptr + len <= end);
+        g_assert_cmpuint(test_u32(ptr + len - 4), == ,len);
+        if (ptr == data) {
+            g_assert_cmpuint(type, == ,PCAPNG_BLOCK_SHB);
+            g_assert_cmpuint(test_u32(ptr + 8), == ,0x1a2b3c4d);
+            g_assert_cmpuint(test_u16(ptr + 12), == ,1);
+            g_assert_cmpuint(test_u16(ptr + 14), == ,0);
+        } else if (type == PCAPNG_BLOCK_IDB) {
+            const guint16 linktype = test_u16(ptr + 8);
+
+            switch (ifcount++) {
+            case NFC_CAPTURE_LINK_POLL:
+            case NFC_CAPTURE_LINK_LISTEN:
+                g_assert_cmpuint(linktype, == ,LINKTYPE_ISO_14443);
+                break;
+            case NFC_CAPTURE_LINK_LLCP:
+                g_assert_cmpuint(linktype, == ,LINKTYPE_NFC_LLCP);
+                break;
+            default:
+                g_assert_not_reached();
+            }
+        } else {
+            g_assert_cmpuint(type, == ,PCAPNG_BLOCK_EPB);
+            g_assert_cmpuint(ifcount, == ,3);
+            if (n < max) {
+                TestPacket* p = packets + n;
+                const guint8* opt;
+
+                p->ifid = test_u32(ptr + 8);
+                p->caplen = test_u32(ptr + 20);
+                p->origlen = test_u32(ptr + 24);
+                p->data = ptr + 28;
+
+                /* The first option is epb_flags */
+                opt = p->data + ((p->caplen + 3) & ~3);
+                g_assert_cmpuint(test_u16(opt), == ,2);
+                g_assert_cmpuint(test_u16(opt + 2), == ,4);
+                p->flags = test_u32(opt + 4);
+            }
+            n++;
+        }
+        ptr += len;
+    }
+    g_assert(ptr == end);
+    return n;
+}
+
+/*==========================================================================*
+ * inactive
+ *==========================================================================*/
+
+static
+void
+test_inactive(
+    void)
+{
+    static const guint8 frame[] = { 0x30, 0x00 };
+
+    nfc_capture_stop();
+    g_assert(!nfc_capture_active());
+    g_assert(!nfc_capture_pcapng());
+
+    /* These do nothing */
+    nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, frame,
+        sizeof(frame));
+    nfc_capture_bytes(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, NULL);
+    nfc_capture_stop();
+    g_assert(!nfc_capture_active());
+
+    /* Too many frames */
+    g_assert(!nfc_capture_start(G_MAXUINT));
+    g_assert(!nfc_capture_active());
+}
+
+/*==========================================================================*
+ * basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    static const guint8 read_cmd[] = { 0x30, 0x00 };
+    static const guint8 select_cmd[] = { 0x00, 0xa4, 0x04, 0x00 };
+    static const guint8 ok_resp[] = { 0x90, 0x00 };
+    static const guint8 symm[] = { 0x00, 0x00 };
+    static const guint8 data[16] = { 0x01, 0x02, 0x03 };
+    TestPacket p[6];
+    GBytes* bytes = g_bytes_new_static(symm, sizeof(symm));
+    GBytes* pcapng;
+
+    g_assert(nfc_capture_start(0));
+    g_assert(nfc_capture_active());
+
+    /* Empty capture is still a valid file */
+    pcapng = nfc_capture_pcapng();
+    g_assert(pcapng);
+    g_assert_cmpuint(test_parse(pcapng, p, G_N_ELEMENTS(p)), == ,0);
+    g_bytes_unref(pcapng);
+
+    nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, read_cmd,
+        sizeof(read_cmd));
+    nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_IN, data,
+        sizeof(data));
+    nfc_capture_frame(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_IN, select_cmd,
+        sizeof(select_cmd));
+    nfc_capture_frame(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_OUT, ok_resp,
+        sizeof(ok_resp));
+    nfc_capture_bytes(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_OUT, bytes);
+    nfc_capture_frame(NFC_CAPTURE_LINK_LLCP, NFC_CAPTURE_IN, NULL, 0);
+    g_bytes_unref(bytes);
+
+    pcapng = nfc_capture_pcapng();
+    g_assert(pcapng);
+    g_assert_cmpuint(test_parse(pcapng, p, G_N_ELEMENTS(p)), == ,6);
+
+    /* Reader to card */
+    g_assert_cmpuint(p[0].ifid, == ,NFC_CAPTURE_LINK_POLL);
+    g_assert_cmpuint(p[0].caplen, == ,4 + sizeof(read_cmd));
+    g_assert_cmpuint(p[0].origlen, == ,4 + sizeof(read_cmd));
+    g_assert_cmpuint(p[0].flags, == ,2);
+    g_assert_cmpuint(p[0].data[1], == ,0xfa);
+    g_assert_cmpuint(p[0].data[2], == ,0);
+    g_assert_cmpuint(p[0].data[3], == ,sizeof(read_cmd));
+    g_assert(!memcmp(p[0].data + 4, read_cmd, sizeof(read_cmd)));
+
+    /* Card to reader */
+    g_assert_cmpuint(p[1].ifid, == ,NFC_CAPTURE_LINK_POLL);
+    g_assert_cmpuint(p[1].caplen, == ,4 + sizeof(data));
+    g_assert_cmpuint(p[1].flags, == ,1);
+    g_assert_cmpuint(p[1].data[1], == ,0xfb);
+    g_assert(!memcmp(p[1].data + 4, data, sizeof(data)));
+
+    /* Reader to card, we are the card */
+    g_assert_cmpuint(p[2].ifid, == ,NFC_CAPTURE_LINK_LISTEN);
+    g_assert_cmpuint(p[2].flags, == ,1);
+    g_assert_cmpuint(p[2].data[1], == ,0xfa);
+    g_assert(!memcmp(p[2].data + 4, select_cmd, sizeof(select_cmd)));
+
+    /* Card to reader, we are the card */
+    g_assert_cmpuint(p[3].ifid, == ,NFC_CAPTURE_LINK_LISTEN);
+    g_assert_cmpuint(p[3].flags, == ,2);
+    g_assert_cmpuint(p[3].data[1], == ,0xfb);
+    g_assert(!memcmp(p[3].data + 4, ok_resp, sizeof(ok_resp)));
+
+    /* LLCP */
+    g_assert_cmpuint(p[4].ifid, == ,NFC_CAPTURE_LINK_LLCP);
+    g_assert_cmpuint(p[4].caplen, == ,2 + sizeof(symm));
+    g_assert_cmpuint(p[4].flags, == ,2);
+    g_assert_cmpuint(p[4].data[1], == ,0x01);
+    g_assert(!memcmp(p[4].data + 2, symm, sizeof(symm)));
+    g_assert_cmpuint(p[5].ifid, == ,NFC_CAPTURE_LINK_LLCP);
+    g_assert_cmpuint(p[5].caplen, == ,2);
+    g_assert_cmpuint(p[5].flags, == ,1);
+    g_assert_cmpuint(p[5].data[1], == ,0);
+    g_bytes_unref(pcapng);
+
+    /* Restarting discards what's been captured */
+    g_assert(nfc_capture_start(2));
+    pcapng = nfc_capture_pcapng();
+    g_assert_cmpuint(test_parse(pcapng, p, G_N_ELEMENTS(p)), == ,0);
+    g_bytes_unref(pcapng);
+
+    nfc_capture_stop();
+    g_assert(!nfc_capture_active());
+    g_assert(!nfc_capture_pcapng());
+}
+
+/*==========================================================================*
+ * wrap
+ *==========================================================================*/
+
+static
+void
+test_wrap(
+    void)
+{
+    TestPacket p[3];
+    GBytes* pcapng;
+    guint8 i;
+
+    g_assert(nfc_capture_start(3));
+    for (i = 0; i < 10; i++) {
+        nfc_capture_frame(NFC_CAPTURE_LINK_POLL, NFC_CAPTURE_OUT, &i, 1);
+    }
+
+    /* Only the last 3 frames are there, oldest first */
+    pcapng = nfc_capture_pcapng();
+    g_assert_cmpuint(test_parse(pcapng, p, G_N_ELEMENTS(p)), == ,3);
+    g_assert_cmpuint(p[0].data[4], == ,7);
+    g_assert_cmpuint(p[1].data[4], == ,8);
+    g_assert_cmpuint(p[2].data[4], == ,9);
+    g_bytes_unref(pcapng);
+    nfc_capture_stop();
+}
+
+/*==========================================================================*
+ * snaplen
+ *==========================================================================*/
+
+static
+void
+test_snaplen(
+    void)
+{
+    guint8 frame[300];
+    TestPacket p;
+    GBytes* pcapng;
+    guint i;
+
+    for (i = 0; i < sizeof(frame); i++) {
+        frame[i] = (guint8)i;
+    }
+
+    /* Long frames are truncated */
+    g_assert(nfc_capture_start(1));
+    nfc_capture_frame(NFC_CAPTURE_LINK_LISTEN, NFC_CAPTURE_IN, frame,
+        sizeof(frame));
+    pcapng = nfc_capture_pcapng();
+    g_assert_cmpuint(test_parse(pcapng, &p, 1), == ,1);
+    g_assert_cmpuint(p.caplen, == ,4 + 256);
+    g_assert_cmpuint(p.origlen, == ,4 + sizeof(frame));
+    g_assert_cmpuint(p.data[2], == ,1);
+    g_assert_cmpuint(p.data[3], == ,0);
+    g_assert(!memcmp(p.data + 4, frame, 256));
+    g_bytes_unref(pcapng);
+    nfc_capture_stop();
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/core/capture/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("inactive"), test_inactive);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("wrap"), test_wrap);
+    g_test_add_func(TEST_("snaplen"), test_snaplen);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -198,6 +198,7 @@ test_null(
     g_assert(!nfc_peer_add_gone_handler(NULL, NULL, NULL));
     g_assert(!nfc_peer_register_service(NULL, NULL));
     nfc_peer_deactivate(NULL);
+    g_assert(!nfc_peer_stats(NULL));
     nfc_peer_unregister_service(NULL, NULL);
     nfc_peer_remove_handler(NULL, 0);
     nfc_peer_unref(NULL);
@@ -230,6 +231,7 @@ test_name(
     g_assert(!peer->name);
     nfc_peer_set_name(peer, name);
     g_assert_cmpstr(peer->name, == ,name);
+    g_assert(nfc_peer_stats(peer) == nfc_target_stats(target));
 
     nfc_peer_unref(peer);
     nfc_target_unref(target);
@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "nfc_tag_p.h"
+#include "nfc_tag_t2.h"
+#include "nfc_tag_t4_p.h"
+#include "nfc_target_p.h"
+#include "nfc_target_impl.h"
+#include "nfc_capture.h"
+
+#include "test_common.h"
+#include "test_replay_target.h"
+#include "test_target_t2.h"
+
+#include <gutil_log.h>
+
+#include <stdlib.h>
+
+static TestOpt test_opt;
+
+typedef struct test_transmit {
+    GMainLoop* loop;
+    NFC_TRANSMIT_STATUS status;
+    GByteArray* resp;
+} TestTransmit;
+
+static
+void
+test_transmit_done(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestTransmit* tx = user_data;
+
+    tx->status = status;
+    g_byte_array_set_size(tx->resp, 0);
+    g_byte_array_append(tx->resp, data, len);
+    g_main_loop_quit(tx->loop);
+}
+
+/* Returns the completion status */
+static
+NFC_TRANSMIT_STATUS
+test_transmit(
+    NfcTarget* target,
+    const void* data,
+    guint len,
+    GByteArray* resp)
+{
+    TestTransmit tx;
+
+    tx.loop = g_main_loop_new(NULL, TRUE);
+    tx.resp = resp;
+    tx.status = NFC_TRANSMIT_STATUS_ERROR;
+    g_assert(nfc_target_transmit(target, data, len, NULL,
+        test_transmit_done, NULL, &tx));
+    test_run(&test_opt, tx.loop);
+    g_main_loop_unref(tx.loop);
+    return tx.status;
+}
+
+static
+void
+test_tag_initialized(
+    NfcTag* tag,
+    void* loop)
+{
+    g_main_loop_quit((GMainLoop*)loop);
+}
+
+static
+void
+test_tag_wait_initialized(
+    NfcTag* tag)
+{
+    if (!(tag->flags & NFC_TAG_FLAG_INITIALIZED)) {
+        GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+        gulong id = nfc_tag_add_initialized_handler(tag,
+            test_tag_initialized, loop);
+
+        test_run(&test_opt, loop);
+        nfc_tag_remove_handler(tag, id);
+        g_main_loop_unref(loop);
+    }
+}
+
+static
+void
+test_target_reactivated(
+    NfcTarget* target,
+    NFC_REACTIVATE_STATUS status,
+    void* loop)
+{
+    g_assert_cmpint(status, == ,NFC_REACTIVATE_STATUS_SUCCESS);
+    g_main_loop_quit((GMainLoop*)loop);
+}
+
+/*
+ * This is what nfc_tag_t4_ndef_read_done() used to do before marking
+ * the tag as initialized, now it happens before the first APDU.
+ */
+static
+void
+test_target_reactivate(
+    NfcTarget* target)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+
+    g_assert(nfc_target_reactivate(target, NULL, test_target_reactivated,
+        NULL, loop));
+    test_run(&test_opt, loop);
+    g_main_loop_unref(loop);
+}
+
+static
+NfcTag*
+test_tag_t2_new(
+    NfcTarget* target)
+{
+    static const guint8 nfcid1[] = {0x04, 0x9b, 0xfb, 0x4a, 0xeb, 0x2b, 0x80};
+    NfcParamPollA param;
+    NfcTagType2* t2;
+
+    memset(&param, 0, sizeof(param));
+    param.nfcid1.bytes = nfcid1;
+    param.nfcid1.size = sizeof(nfcid1);
+    t2 = nfc_tag_t2_new(target, &param);
+    g_assert(t2);
+    return &t2->tag;
+}
+
+static
+NfcTag*
+test_tag_t4a_new(
+    NfcTarget* target)
+{
+    NfcParamPollA poll_a;
+    NfcParamIsoDepPollA iso_dep;
+    NfcTagType4a* t4a;
+
+    memset(&poll_a, 0, sizeof(poll_a));
+    memset(&iso_dep, 0, sizeof(iso_dep));
+    t4a = nfc_tag_t4a_new(target, &poll_a, &iso_dep);
+    g_assert(t4a);
+    return NFC_TAG(t4a);
+}
+
+/*==========================================================================*
+ * invalid
+ *==========================================================================*/
+
+static
+void
+test_invalid(
+    void)
+{
+    static const char* bad[] = {
+        "< 00 00\n",                /* Response without a command */
+        "> 30 0\n",                 /* Odd number of hex digits */
+        "> 30 00\n< xx\n",          /* Not a hex */
+        "> 30 00\n< 00 @\n",        /* Missing delay */
+        "> 30 00\n< 00 @-1\n",      /* Negative delay */
+        "> 30 00\n< 00\n< 00\n",    /* Two responses */
+        "30 00\n"                   /* Neither command nor response */
+    };
+    static const guint8 broken_pcapng[] = {
+        0x0a, 0x0d, 0x0d, 0x0a, 0x0d, 0x00, 0x00, 0x00,
+        0x4d, 0x3c, 0x2b, 0x1a, 0x01, 0x00, 0x00, 0x00
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(bad); i++) {
+        GDEBUG("%s", bad[i]);
+        g_assert(!test_replay_target_new(NFC_TECHNOLOGY_A, bad[i],
+            strlen(bad[i])));
+    }
+    g_assert(!test_replay_target_new(NFC_TECHNOLOGY_A,
+        TEST_ARRAY_AND_SIZE(broken_pcapng)));
+    g_assert(!test_replay_target_new_from_file(NFC_TECHNOLOGY_A,
+        "/no/such/file"));
+}
+
+/*==========================================================================*
+ * text
+ *==========================================================================*/
+
+static
+void
+test_text(
+    void)
+{
+    static const char trace[] =
+        "# Test trace\n"
+        "> 30 00\n"
+        "< 01 02 03 04 @0.5  # Response\n"
+        "\n"
+        "> *\n"
+        "< 05\n"
+        "> 30 04\n"
+        "< !\n"
+        "> 30 08\n"
+        "< ~\n"
+        "> 30 0c\n";
+    static const guint8 read0[] = { 0x30, 0x00 };
+    static const guint8 read4[] = { 0x30, 0x04 };
+    static const guint8 read8[] = { 0x30, 0x08 };
+    static const guint8 read12[] = { 0x30, 0x0c };
+    static const guint8 resp0[] = { 0x01, 0x02, 0x03, 0x04 };
+    static const guint8 resp1[] = { 0x05 };
+    static const guint8 any[] = { 0xaa, 0xbb };
+    GByteArray* resp = g_byte_array_new();
+    NfcTarget* target = test_replay_target_new(NFC_TECHNOLOGY_A,
+        trace, strlen(trace));
+    const TestReplayStats* stats = test_replay_target_stats(target);
+
+    g_assert(target);
+    g_assert_cmpuint(test_replay_target_remaining(target), == ,5);
+    nfc_target_set_transmit_timeout(target, 10);
+
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read0), resp),
+        == ,NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpuint(resp->len, == ,sizeof(resp0));
+    g_assert(!memcmp(resp->data, resp0, sizeof(resp0)));
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(any), resp),
+        == ,NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpuint(resp->len, == ,sizeof(resp1));
+    g_assert(!memcmp(resp->data, resp1, sizeof(resp1)));
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read4), resp),
+        == ,NFC_TRANSMIT_STATUS_ERROR);
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read8), resp),
+        == ,NFC_TRANSMIT_STATUS_TIMEOUT);
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read12), resp),
+        == ,NFC_TRANSMIT_STATUS_TIMEOUT);
+    g_assert_cmpuint(test_replay_target_remaining(target), == ,0);
+
+    /* Off the script */
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read0), resp),
+        == ,NFC_TRANSMIT_STATUS_ERROR);
+
+    g_assert_cmpuint(stats->transmits, == ,6);
+    g_assert_cmpuint(stats->responses, == ,2);
+    g_assert_cmpuint(stats->mismatches, == ,0);
+    g_assert_cmpuint(stats->dropouts, == ,1);
+    g_assert_cmpuint(stats->timeouts, == ,2);
+    g_assert_cmpint(stats->delay_us, == ,500);
+
+    /* Start over, this time with a wrong command */
+    test_replay_target_rewind(target);
+    g_assert_cmpuint(stats->transmits, == ,0);
+    g_assert_cmpuint(test_replay_target_remaining(target), == ,5);
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read4), resp),
+        == ,NFC_TRANSMIT_STATUS_ERROR);
+    g_assert_cmpuint(stats->mismatches, == ,1);
+
+    nfc_target_unref(target);
+    g_byte_array_free(resp, TRUE);
+}
+
+/*==========================================================================*
+ * delay
+ *==========================================================================*/
+
+static
+void
+test_delay(
+    void)
+{
+    static const char trace[] = "> 30 00\n< 00 @20\n";
+    static const guint8 read0[] = { 0x30, 0x00 };
+    GByteArray* resp = g_byte_array_new();
+    NfcTarget* target = test_replay_target_new(NFC_TECHNOLOGY_A,
+        trace, strlen(trace));
+    gint64 start;
+
+    /* No delay by default */
+    g_assert(target);
+    start = g_get_monotonic_time();
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read0), resp),
+        == ,NFC_TRANSMIT_STATUS_OK);
+    GDEBUG("%d us", (int)(g_get_monotonic_time() - start));
+
+    /* Real time */
+    test_replay_target_rewind(target);
+    test_replay_target_set_time_scale(target, 1);
+    start = g_get_monotonic_time();
+    g_assert_cmpint(test_transmit(target, TEST_ARRAY_AND_SIZE(read0), resp),
+        == ,NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpint(g_get_monotonic_time() - start, >= ,20000);
+    g_assert_cmpint(test_replay_target_stats(target)->delay_us, == ,20000);
+
+    nfc_target_unref(target);
+    g_byte_array_free(resp, TRUE);
+}
+
+/*==========================================================================*
+ * dropout
+ *==========================================================================*/
+
+static
+guint
+test_dropout_run(
+    NfcTarget* target,
+    guint count)
+{
+    static const guint8 cmd[] = { 0x30, 0x00 };
+    GByteArray* resp = g_byte_array_new();
+    guint i;
+
+    test_replay_target_rewind(target);
+    for (i = 0; i < count; i++) {
+        test_transmit(target, TEST_ARRAY_AND_SIZE(cmd), resp);
+    }
+    g_byte_array_free(resp, TRUE);
+    g_assert_cmpuint(test_replay_target_stats(target)->transmits, == ,count);
+    return test_replay_target_stats(target)->dropouts;
+}
+
+static
+void
+test_dropout(
+    void)
+{
+    GString* trace = g_string_new(NULL);
+    NfcTarget* target;
+    guint i, n;
+
+    for (i = 0; i < 100; i++) {
+        g_string_append(trace, "> 30 00\n< 00\n");
+    }
+    target = test_replay_target_new(NFC_TECHNOLOGY_A, trace->str,
+        trace->len);
+    g_assert(target);
+
+    /* Same seed, same dropouts */
+    test_replay_target_set_dropout(target, 200, 1234);
+    n = test_dropout_run(target, 100);
+    GDEBUG("%u dropouts", n);
+    g_assert_cmpuint(n, > ,0);
+    g_assert_cmpuint(n, < ,100);
+    test_replay_target_set_dropout(target, 200, 1234);
+    g_assert_cmpuint(test_dropout_run(target, 100), == ,n);
+
+    /* Everything is dropped */
+    test_replay_target_set_dropout(target, 1000, 0);
+    g_assert_cmpuint(test_dropout_run(target, 10), == ,10);
+
+    /* Nothing is dropped */
+    test_replay_target_set_dropout(target, 0, 0);
+    g_assert_cmpuint(test_dropout_run(target, 10), == ,0);
+
+    nfc_target_unref(target);
+    g_string_free(trace, TRUE);
+}
+
+/*==========================================================================*
+ * t2
+ *==========================================================================*/
+
+static
+void
+test_t2(
+    void)
+{
+    static const guint8 header[] = {
+        0x04, 0xd4, 0xfb, 0xa3, 0x4a, 0xeb, 0x2b, 0x80,
+        0x0a, 0x48, 0x00, 0x00, 0xe1, 0x10, 0x12, 0x00,
+        0x03, 0x00, 0xfe
+    };
+    guint8 data[16 + 0x12 * 8];
+    TestTargetT2* t2_target;
+    NfcTarget* replay;
+    NfcTag* tag;
+    GBytes* pcapng;
+    gsize size;
+    const TestReplayStats* stats;
+    guint data_size;
+
+    memset(data, 0, sizeof(data));
+    memcpy(data, header, sizeof(header));
+
+    /* Record the initialization sequence */
+    g_assert(nfc_capture_start(0));
+    t2_target = test_target_t2_new(data, sizeof(data));
+    tag = test_tag_t2_new(&t2_target->target);
+    test_tag_wait_initialized(tag);
+    data_size = NFC_TAG_T2(tag)->data_size;
+    g_assert_cmpuint(data_size, == ,0x12 * 8);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&t2_target->target);
+    pcapng = nfc_capture_pcapng();
+    nfc_capture_stop();
+
+    /* And play it back */
+    replay = test_replay_target_new(NFC_TECHNOLOGY_A,
+        g_bytes_get_data(pcapng, &size), size);
+    g_assert(replay);
+    g_assert_cmpuint(test_replay_target_remaining(replay), > ,0);
+    stats = test_replay_target_stats(replay);
+    tag = test_tag_t2_new(replay);
+    test_tag_wait_initialized(tag);
+    g_assert_cmpuint(NFC_TAG_T2(tag)->data_size, == ,data_size);
+    g_assert_cmpuint(test_replay_target_remaining(replay), == ,0);
+    g_assert_cmpuint(stats->mismatches, == ,0);
+    g_assert_cmpuint(stats->responses, == ,stats->transmits);
+
+    nfc_tag_unref(tag);
+    nfc_target_unref(replay);
+    g_bytes_unref(pcapng);
+}
+
+/*==========================================================================*
+ * t4
+ *
+ * Tap-to-initialized time of a Type 4 tag, with reactivation deferred
+ * until the first APDU (the way it's done now) and with reactivation
+ * preceding the initialization (the way it used to be done).
+ *==========================================================================*/
+
+static
+void
+test_t4(
+    void)
+{
+    static const char trace[] =
+        "# SELECT NDEF application\n"
+        "> 00 a4 04 00 07 d2 76 00 00 85 01 01 00\n"
+        "< 90 00 @2\n"
+        "# SELECT CC\n"
+        "> 00 a4 00 0c 02 e1 03\n"
+        "< 90 00 @2\n"
+        "# READ CC\n"
+        "> 00 b0 00 00 0f\n"
+        "< 00 0f 20 00 3b 00 34 04 06 e1 04 0f ff 00 ff 90 00 @3\n"
+        "# SELECT NDEF\n"
+        "> 00 a4 00 0c 02 e1 04\n"
+        "< 90 00 @2\n"
+        "# READ NLEN and NDEF\n"
+        "> 00 b0 00 00 3b\n"
+        "< 00 03 d0 00 00 90 00 @4\n";
+    static const gint64 init_us = 13000;
+    static const gint64 reactivate_us = 50000;
+    NfcTarget* target = test_replay_target_new(NFC_TECHNOLOGY_A,
+        trace, strlen(trace));
+    const TestReplayStats* stats;
+    NfcTag* tag;
+    gint64 deferred_us, immediate_us;
+
+    g_assert(target);
+    stats = test_replay_target_stats(target);
+    test_replay_target_set_reactivate_time(target, reactivate_us / 1000);
+
+    /* Deferred reactivation */
+    tag = test_tag_t4a_new(target);
+    test_tag_wait_initialized(tag);
+    deferred_us = stats->delay_us;
+    g_assert(tag->ndef);
+    g_assert_cmpuint(test_replay_target_remaining(target), == ,0);
+    g_assert_cmpuint(stats->mismatches, == ,0);
+    g_assert_cmpuint(stats->reactivations, == ,0);
+    nfc_tag_unref(tag);
+
+    /* Immediate reactivation */
+    test_replay_target_rewind(target);
+    tag = test_tag_t4a_new(target);
+    test_tag_wait_initialized(tag);
+    test_target_reactivate(target);
+    immediate_us = stats->delay_us;
+    g_assert_cmpuint(stats->mismatches, == ,0);
+    g_assert_cmpuint(stats->reactivations, == ,1);
+    nfc_tag_unref(tag);
+
+    GDEBUG("Tap-to-initialized %d us deferred, %d us immediate",
+        (int)deferred_us, (int)immediate_us);
+    g_assert_cmpint(deferred_us, == ,init_us);
+    g_assert_cmpint(immediate_us, == ,init_us + reactivate_us);
+    nfc_target_unref(target);
+}
+
+/*==========================================================================*
+ * bench
+ *
+ * Runs only if TEST_REPLAY_TRACE environment variable points to a trace.
+ * TEST_REPLAY_TAG selects the tag type (t2 or t4a, default is t2),
+ * TEST_REPLAY_COUNT the number of iterations and TEST_REPLAY_SCALE
+ * the time scale (0 by default, i.e. no simulated delays). For Type 4
+ * tags, TEST_REPLAY_REACTIVATE sets the reactivation time (ms) and the
+ * time it would take if reactivation preceded initialization is shown
+ * too.
+ *==========================================================================*/
+
+static
+void
+test_bench(
+    void)
+{
+    const char* path = getenv("TEST_REPLAY_TRACE");
+    const char* type = getenv("TEST_REPLAY_TAG");
+    const char* count_str = getenv("TEST_REPLAY_COUNT");
+    const char* scale_str = getenv("TEST_REPLAY_SCALE");
+    const char* reactivate_str = getenv("TEST_REPLAY_REACTIVATE");
+    const int count = count_str ? atoi(count_str) : 10;
+    const gboolean t4 = type && !strcmp(type, "t4a");
+    NfcTarget* target = test_replay_target_new_from_file(NFC_TECHNOLOGY_A,
+        path);
+    const TestReplayStats* stats;
+    gint64 total = 0, best = G_MAXINT64;
+    gint64 ra_total = 0, ra_best = G_MAXINT64;
+    int i;
+
+    g_assert(target);
+    g_assert_cmpint(count, > ,0);
+    stats = test_replay_target_stats(target);
+    if (scale_str) {
+        test_replay_target_set_time_scale(target, g_ascii_strtod(scale_str,
+            NULL));
+    }
+    if (reactivate_str) {
+        test_replay_target_set_reactivate_time(target,
+            g_ascii_strtod(reactivate_str, NULL));
+    }
+    for (i = 0; i < count; i++) {
+        const gint64 start = g_get_monotonic_time();
+        NfcTag* tag;
+        gint64 elapsed;
+
+        test_replay_target_rewind(target);
+        tag = t4 ? test_tag_t4a_new(target) : test_tag_t2_new(target);
+        test_tag_wait_initialized(tag);
+        elapsed = g_get_monotonic_time() - start;
+        total += elapsed;
+        best = MIN(best, elapsed);
+        if (t4) {
+            /* As if the tag was reactivated before being initialized */
+            test_target_reactivate(target);
+            elapsed = g_get_monotonic_time() - start;
+            ra_total += elapsed;
+            ra_best = MIN(ra_best, elapsed);
+        }
+        nfc_tag_unref(tag);
+    }
+    g_print("%s: %d run(s), %u transmit(s), %u mismatch(es), "
+        "simulated delay %d us, best %d us, average %d us\n", path,
+        count, stats->transmits, stats->mismatches, (int)stats->delay_us,
+        (int)best, (int)(total / count));
+    if (t4) {
+        g_print("%s: with reactivation best %d us, average %d us\n", path,
+            (int)ra_best, (int)(ra_total / count));
+    }
+    nfc_target_unref(target);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/core/replay/" name
+
+int main(int argc, char* argv[])
+{
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+    g_type_init();
+    G_GNUC_END_IGNORE_DEPRECATIONS;
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("invalid"), test_invalid);
+    g_test_add_func(TEST_("text"), test_text);
+    g_test_add_func(TEST_("delay"), test_delay);
+    g_test_add_func(TEST_("dropout"), test_dropout);
+    g_test_add_func(TEST_("t2"), test_t2);
+    g_test_add_func(TEST_("t4"), test_t4);
+    if (getenv("TEST_REPLAY_TRACE")) {
+        g_test_add_func(TEST_("bench"), test_bench);
+    }
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2026 Slava Monich <slava@monich.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ *  3. Neither the names of the copyright holders nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+#include "nfc_tag_cache.h"
+
+#include <glib/gstdio.h>
+
+#include <utime.h>
+
+static TestOpt test_opt;
+
+static const guint8 test_uid1[] = { 0x04, 0x9b, 0xfb, 0x4a, 0xeb, 0x2b, 0x80 };
+static const guint8 test_uid2[] = { 0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+static const guint8 test_uid3[] = { 0x01, 0x02, 0x03, 0x04 };
+static const guint8 test_key[] = { 0x12, 0x00, 0x00, 0xe1, 0x10, 0x12, 0x00 };
+static const guint8 test_data[] = {
+    0x03, 0x0e, 0xd1, 0x01, 0x0a,  'U', 0x02,  'j',
+     'o',  'l',  'l',  'a',  '.',  'c',  'o',  'm',
+    0xfe, 0x00, 0x00, 0x00
+};
+
+/* Header + key + data */
+#define TEST_FILE_SIZE (12 + sizeof(test_key) + sizeof(test_data))
+
+static
+char*
+test_cache_dir(
+    void)
+{
+    char* dir = g_dir_make_tmp("test_tag_cache_XXXXXX", NULL);
+
+    g_assert(dir);
+    GDEBUG("Cache directory %s", dir);
+    return dir;
+}
+
+static
+void
+test_cache_cleanup(
+    char* dir)
+{
+    nfc_tag_cache_configure(NULL, 0);
+    test_rmdir(dir);
+    g_free(dir);
+}
+
+static
+char*
+test_cache_path(
+    const char* dir,
+    const char* name)
+{
+    return g_build_filename(dir, NFC_TAG_CACHE_SUBDIR, name, NULL);
+}
+
+static
+void
+test_cache_write(
+    const char* path,
+    gsize size)
+{
+    char* dir = g_path_get_dirname(path);
+    char* buf = g_malloc0(size);
+
+    g_assert(!g_mkdir_with_parents(dir, 0700));
+    g_assert(g_file_set_contents(path, buf, size, NULL));
+    g_free(buf);
+    g_free(dir);
+}
+
+static
+void
+test_cache_set_mtime(
+    const char* dir,
+    const char* name,
+    time_t t)
+{
+    char* path = test_cache_path(dir, name);
+    struct utimbuf times;
+
+    times.actime = times.modtime = t;
+    g_assert(!g_utime(path, &times));
+    g_free(path);
+}
+
+static
+gboolean
+test_cache_file_exists(
+    const char* dir,
+    const char* name)
+{
+    char* path = test_cache_path(dir, name);
+    gboolean exists = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+
+    g_free(path);
+    return exists;
+}
+
+/*==========================================================================*
+ * disabled
+ *==========================================================================*/
+
+static
+void
+test_disabled(
+    void)
+{
+    GUtilData uid, key, data;
+
+    TEST_BYTES_SET(uid, test_uid1);
+    TEST_BYTES_SET(key, test_key);
+    TEST_BYTES_SET(data, test_data);
+
+    /* Everything is a noop */
+    nfc_tag_cache_configure(NULL, 0);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    nfc_tag_cache_drop("t2", &uid);
+    nfc_tag_cache_entry_free(NULL);
+}
+
+/*==========================================================================*
+ * basic
+ *==========================================================================*/
+
+static
+void
+test_basic(
+    void)
+{
+    char* dir = test_cache_dir();
+    NfcTagCacheEntry* entry;
+    GUtilData uid, key, data;
+
+    TEST_BYTES_SET(uid, test_uid1);
+    TEST_BYTES_SET(key, test_key);
+    TEST_BYTES_SET(data, test_data);
+
+    nfc_tag_cache_configure(dir, 0);
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+
+    /* Empty UID is ignored */
+    uid.size = 0;
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    TEST_BYTES_SET(uid, test_uid1);
+
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(test_cache_file_exists(dir, "t2-049BFB4AEB2B80"));
+    g_assert(!nfc_tag_cache_get("t4", &uid));
+
+    entry = nfc_tag_cache_get("t2", &uid);
+    g_assert(entry);
+    g_assert(gutil_data_equal(&entry->key, &key));
+    g_assert(gutil_data_equal(&entry->data, &data));
+    nfc_tag_cache_entry_free(entry);
+
+    /* Replace the data */
+    data.size = 4;
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    entry = nfc_tag_cache_get("t2", &uid);
+    g_assert(entry);
+    g_assert(gutil_data_equal(&entry->key, &key));
+    g_assert(gutil_data_equal(&entry->data, &data));
+    nfc_tag_cache_entry_free(entry);
+
+    nfc_tag_cache_drop("t2", &uid);
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    nfc_tag_cache_drop("t2", &uid);
+
+    test_cache_cleanup(dir);
+}
+
+/*==========================================================================*
+ * invalid
+ *==========================================================================*/
+
+static
+void
+test_invalid(
+    void)
+{
+    static const guint8 garbage[] = {
+        'N', 'F', 'C', 'T', 0x01, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x02, 0x00 /* One byte is missing */
+    };
+    static const guint8 version[] = {
+        'N', 'F', 'C', 'T', 0x02, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00
+    };
+    char* dir = test_cache_dir();
+    char* path = test_cache_path(dir, "t2-01020304");
+    GUtilData uid;
+
+    TEST_BYTES_SET(uid, test_uid3);
+    nfc_tag_cache_configure(dir, 0);
+    test_cache_write(path, 0);
+
+    /* Invalid files get deleted */
+    g_assert(g_file_set_contents(path, (char*)garbage, sizeof(garbage),
+        NULL));
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+
+    g_assert(g_file_set_contents(path, (char*)version, sizeof(version),
+        NULL));
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+
+    g_assert(g_file_set_contents(path, "NFC", 3, NULL));
+    g_assert(!nfc_tag_cache_get("t2", &uid));
+    g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+
+    g_free(path);
+    test_cache_cleanup(dir);
+}
+
+/*==========================================================================*
+ * evict
+ *==========================================================================*/
+
+static
+void
+test_evict(
+    void)
+{
+    char* dir = test_cache_dir();
+    NfcTagCacheEntry* entry;
+    GUtilData uid, key, data;
+    const time_t now = time(NULL);
+
+    TEST_BYTES_SET(key, test_key);
+    TEST_BYTES_SET(data, test_data);
+
+    /* Enough room for two entries */
+    nfc_tag_cache_configure(dir, 2 * TEST_FILE_SIZE);
+    TEST_BYTES_SET(uid, test_uid1);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    test_cache_set_mtime(dir, "t2-049BFB4AEB2B80", now - 20);
+    TEST_BYTES_SET(uid, test_uid2);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    test_cache_set_mtime(dir, "t2-04010203040506", now - 10);
+
+    /* Cache hit makes the first one most recently used */
+    TEST_BYTES_SET(uid, test_uid1);
+    entry = nfc_tag_cache_get("t2", &uid);
+    g_assert(entry);
+    nfc_tag_cache_entry_free(entry);
+
+    /* Which means that the second one gets evicted */
+    TEST_BYTES_SET(uid, test_uid3);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(test_cache_file_exists(dir, "t2-049BFB4AEB2B80"));
+    g_assert(!test_cache_file_exists(dir, "t2-04010203040506"));
+    g_assert(test_cache_file_exists(dir, "t2-01020304"));
+
+    /* Reducing the limit evicts the rest of the old stuff */
+    test_cache_set_mtime(dir, "t2-049BFB4AEB2B80", now - 20);
+    nfc_tag_cache_configure(dir, TEST_FILE_SIZE);
+    g_assert(!test_cache_file_exists(dir, "t2-049BFB4AEB2B80"));
+    g_assert(test_cache_file_exists(dir, "t2-01020304"));
+
+    test_cache_cleanup(dir);
+}
+
+/*==========================================================================*
+ * foreign
+ *==========================================================================*/
+
+static
+void
+test_foreign(
+    void)
+{
+    static const char* foreign[] = {
+        "README", "t2-", "-01020304", "t2-0102030", "t2-01020a0b",
+        "t2_01020304", "t2-0102030X"
+    };
+    char* dir = test_cache_dir();
+    char* top = g_build_filename(dir, "t2-04010203040506", NULL);
+    GUtilData uid, key, data;
+    guint i;
+
+    TEST_BYTES_SET(key, test_key);
+    TEST_BYTES_SET(data, test_data);
+
+    /* None of these is a cache file */
+    test_cache_write(top, 4 * TEST_FILE_SIZE);
+    for (i = 0; i < G_N_ELEMENTS(foreign); i++) {
+        char* path = test_cache_path(dir, foreign[i]);
+
+        test_cache_write(path, 4 * TEST_FILE_SIZE);
+        g_free(path);
+    }
+
+    /* And none of them counts against the limit */
+    nfc_tag_cache_configure(dir, 2 * TEST_FILE_SIZE);
+    TEST_BYTES_SET(uid, test_uid1);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    TEST_BYTES_SET(uid, test_uid2);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(test_cache_file_exists(dir, "t2-049BFB4AEB2B80"));
+    g_assert(test_cache_file_exists(dir, "t2-04010203040506"));
+
+    /* Eviction leaves them alone too */
+    TEST_BYTES_SET(uid, test_uid3);
+    nfc_tag_cache_put("t2", &uid, &key, &data);
+    g_assert(!test_cache_file_exists(dir, "t2-049BFB4AEB2B80"));
+    g_assert(test_cache_file_exists(dir, "t2-01020304"));
+    nfc_tag_cache_configure(dir, 1);
+    g_assert(!test_cache_file_exists(dir, "t2-01020304"));
+
+    g_assert(g_file_test(top, G_FILE_TEST_IS_REGULAR));
+    for (i = 0; i < G_N_ELEMENTS(foreign); i++) {
+        g_assert(test_cache_file_exists(dir, foreign[i]));
+    }
+
+    g_free(top);
+    test_cache_cleanup(dir);
+}
+
+/*==========================================================================*
+ * mem
+ *==========================================================================*/
+
+static
+void
+test_mem(
+    void)
+{
+    char* dir = test_cache_dir();
+    NfcTagCacheEntry* entry;
+    GUtilData id, key, data;
+    guint8 buf[4];
+    guint i;
+
+    TEST_BYTES_SET(id, test_uid1);
+    TEST_BYTES_SET(key, test_key);
+    TEST_BYTES_SET(data, test_data);
+
+    /* Noop if the cache isn't configured */
+    nfc_tag_cache_configure(NULL, 0);
+    nfc_tag_cache_mem_put("t4", &id, &key, &data);
+    g_assert(!nfc_tag_cache_mem_get("t4", &id));
+    nfc_tag_cache_mem_drop("t4", &id);
+
+    nfc_tag_cache_configure(dir, 0);
+    nfc_tag_cache_mem_put("t4", &id, &key, &data);
+    g_assert(!nfc_tag_cache_mem_get("t2", &id));
+    entry = nfc_tag_cache_mem_get("t4", &id);
+    g_assert(entry);
+    g_assert(gutil_data_equal(&entry->key, &key));
+    g_assert(gutil_data_equal(&entry->data, &data));
+    nfc_tag_cache_entry_free(entry);
+
+    /* Nothing is written to disk */
+    g_assert(!test_cache_file_exists(dir, "t4-049BFB4AEB2B80"));
+
+    /* Replace the data */
+    data.size = 4;
+    nfc_tag_cache_mem_put("t4", &id, &key, &data);
+    entry = nfc_tag_cache_mem_get("t4", &id);
+    g_assert(entry);
+    g_assert(gutil_data_equal(&entry->data, &data));
+    nfc_tag_cache_entry_free(entry);
+
+    /* Least recently used entries get evicted */
+    id.bytes = buf;
+    id.size = sizeof(buf);
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < 16; i++) {
+        buf[3] = (guint8)i;
+        nfc_tag_cache_mem_put("t4", &id, &key, &data);
+    }
+    TEST_BYTES_SET(id, test_uid1);
+    g_assert(!nfc_tag_cache_mem_get("t4", &id));
+    id.bytes = buf;
+    id.size = sizeof(buf);
+    buf[3] = 0;
+    entry = nfc_tag_cache_mem_get("t4", &id);
+    g_assert(entry);
+    nfc_tag_cache_entry_free(entry);
+    nfc_tag_cache_mem_drop("t4", &id);
+    g_assert(!nfc_tag_cache_mem_get("t4", &id));
+
+    /* Reconfiguring the cache clears the memory */
+    buf[3] = 1;
+    nfc_tag_cache_configure(dir, 0);
+    g_assert(!nfc_tag_cache_mem_get("t4", &id));
+
+    test_cache_cleanup(dir);
+}
+
+/*==========================================================================*
+ * Common
+ *==========================================================================*/
+
+#define TEST_(name) "/core/tag_cache/" name
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func(TEST_("disabled"), test_disabled);
+    g_test_add_func(TEST_("basic"), test_basic);
+    g_test_add_func(TEST_("invalid"), test_invalid);
+    g_test_add_func(TEST_("evict"), test_evict);
+    g_test_add_func(TEST_("foreign"), test_foreign);
+    g_test_add_func(TEST_("mem"), test_mem);
+    test_init(&test_opt, argc, argv);
+    return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
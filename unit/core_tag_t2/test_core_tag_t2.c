@@ -33,15 +33,21 @@
 
 #include "nfc_tag_p.h"
 #include "nfc_tag_t2.h"
+#include "nfc_tag_cache.h"
+#include "nfc_target_p.h"
 #include "nfc_target_impl.h"
 #include "nfc_ndef.h"
 
+#include "internal/nfc_tag_t2_i.h"
+
 #include "test_common.h"
 #include "test_target_t2.h"
 
 #include <gutil_log.h>
 #include <gutil_misc.h>
 
+#include <glib/gstdio.h>
+
 static TestOpt test_opt;
 
 #define SUPER_LONG_TIMEOUT (24*60*60) /* seconds */
@@ -96,6 +102,15 @@ test_destroy_quit_loop(
     g_main_loop_quit((GMainLoop*)user_data);
 }
 
+static
+gboolean
+test_timeout_quit_loop(
+    gpointer user_data)
+{
+    g_main_loop_quit((GMainLoop*)user_data);
+    return G_SOURCE_REMOVE;
+}
+
 /*==========================================================================*
  * Test target
  *==========================================================================*/
@@ -370,6 +385,94 @@ test_tag_new(
     return tag;
 }
 
+/*==========================================================================*
+ * Test target with reactivate
+ *==========================================================================*/
+
+typedef NfcTargetClass TestTargetT2ReactClass;
+typedef struct test_target_t2_react {
+    TestTargetT2 parent;
+    guint reactivate_id;
+    guint reactivations;
+} TestTargetT2React;
+
+G_DEFINE_TYPE(TestTargetT2React, test_target_t2_react, TEST_TYPE_TARGET_T2)
+#define TEST_TYPE_TARGET_T2_REACT (test_target_t2_react_get_type())
+#define TEST_TARGET_T2_REACT(obj) (G_TYPE_CHECK_INSTANCE_CAST(obj, \
+        TEST_TYPE_TARGET_T2_REACT, TestTargetT2React))
+
+static
+gboolean
+test_target_t2_react_reactivated(
+    gpointer user_data)
+{
+    TestTargetT2React* test = TEST_TARGET_T2_REACT(user_data);
+
+    test->reactivate_id = 0;
+    nfc_target_reactivated(NFC_TARGET(test));
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+test_target_t2_react_reactivate(
+    NfcTarget* target)
+{
+    TestTargetT2React* test = TEST_TARGET_T2_REACT(target);
+
+    g_assert(!test->reactivate_id);
+    test->reactivations++;
+    test->parent.sector = 0;
+    test->reactivate_id = g_idle_add(test_target_t2_react_reactivated, test);
+    return TRUE;
+}
+
+static
+void
+test_target_t2_react_init(
+    TestTargetT2React* self)
+{
+}
+
+static
+void
+test_target_t2_react_finalize(
+    GObject* object)
+{
+    TestTargetT2React* test = TEST_TARGET_T2_REACT(object);
+
+    if (test->reactivate_id) {
+        g_source_remove(test->reactivate_id);
+    }
+    G_OBJECT_CLASS(test_target_t2_react_parent_class)->finalize(object);
+}
+
+static
+void
+test_target_t2_react_class_init(
+    NfcTargetClass* klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = test_target_t2_react_finalize;
+    klass->reactivate = test_target_t2_react_reactivate;
+}
+
+static
+TestTargetT2React*
+test_target_t2_react_new(
+    const guint8* bytes,
+    guint size,
+    const guint8* version)
+{
+    TestTargetT2React* test = g_object_new(TEST_TYPE_TARGET_T2_REACT, NULL);
+    TestTargetT2* t2 = &test->parent;
+
+    t2->target.technology = NFC_TECHNOLOGY_A;
+    t2->data.bytes = t2->storage = gutil_memdup(bytes, size);
+    t2->data.size = size;
+    t2->version = version;
+    return test;
+}
+
 /*==========================================================================*
  * null
  *==========================================================================*/
@@ -385,6 +488,7 @@ test_null(
     g_assert(!nfc_tag_t2_new(NULL, NULL));
     g_assert(!nfc_tag_t2_new(target, NULL));
     g_assert(!nfc_tag_t2_read(NULL, 0, 0, NULL, NULL, NULL));
+    g_assert(!nfc_tag_t2_read_blocks(NULL, 0, 0, 1, NULL, NULL, NULL, NULL));
     g_assert(!nfc_tag_t2_read_data(NULL, 0, 0, NULL, NULL, NULL));
     g_assert(nfc_tag_t2_read_data_sync(NULL, 0, 0, NULL) ==
         NFC_TAG_T2_IO_STATUS_FAILURE);
@@ -677,67 +781,938 @@ test_read_data(
         t2->data_size));
     g_free(buf);
 
-    /* This one will still complete asynchronously */
-    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size, test_read_data_done,
-        test_destroy_quit_loop, loop));
+    /* This one will still complete asynchronously */
+    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size, test_read_data_done,
+        test_destroy_quit_loop, loop));
+
+    test_run(&test_opt, loop);
+
+    /* And this one will be canceled when we delete the tag */
+    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size, test_read_data_done,
+        test_destroy_quit_loop, loop));
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * read_data_872
+ *==========================================================================*/
+
+static
+void
+test_read_data_872_start(
+    NfcTag* tag,
+    void* user_data)
+{
+    NfcTagType2* t2 = NFC_TAG_T2(tag);
+    NfcNdefRec* rec = tag->ndef;
+
+    g_assert(t2->data_size == 872);
+
+    g_assert(rec);
+    g_assert(!rec->next);
+    g_assert(NFC_IS_NDEF_REC_U(rec));
+    g_assert(!g_strcmp0(NFC_NDEF_REC_U(rec)->uri,
+        "https://www.merproject.org"));
+
+    /* Note: reusing test_read_data_done callback */
+    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_read_data_done, test_destroy_quit_loop, user_data /* loop */));
+}
+
+static
+void
+test_read_data_872(
+    void)
+{
+    TestTargetT2* test = test_target_t2_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216));
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id = nfc_tag_add_initialized_handler(tag,
+        test_read_data_872_start, loop);
+    const guint8* data = test->data.bytes + TEST_TARGET_T2_DATA_OFFSET;
+    guint8 buf[300];
+    guint i;
+
+    test_run(&test_opt, loop);
+
+    /* Unaligned reads, some of them crossing the 64 block boundary */
+    for (i = 0; i < t2->data_size - sizeof(buf); i += 37) {
+        g_assert(nfc_tag_t2_read_data_sync(t2, i, sizeof(buf), buf) ==
+            NFC_TAG_T2_IO_STATUS_OK);
+        g_assert(!memcmp(buf, data + i, sizeof(buf)));
+    }
+    g_assert(nfc_tag_t2_read_data_sync(t2, t2->data_size - 1, 1, buf) ==
+        NFC_TAG_T2_IO_STATUS_OK);
+    g_assert(buf[0] == data[t2->data_size - 1]);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * read_data_2k
+ *==========================================================================*/
+
+#define TEST_2K_DATA_SIZE (0xea * 8)
+#define TEST_2K_SIZE (TEST_TARGET_T2_DATA_OFFSET + TEST_2K_DATA_SIZE)
+
+static
+void
+test_read_data_2k_sector0_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestTargetT2* test = TEST_TARGET_T2(t2->tag.target);
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpuint(len, == ,TEST_TARGET_T2_READ_SIZE);
+    g_assert(!memcmp(data, test->data.bytes, len));
+}
+
+static
+void
+test_read_data_2k_start(
+    NfcTag* tag,
+    void* loop)
+{
+    NfcTagType2* t2 = NFC_TAG_T2(tag);
+    TestTargetT2* test = TEST_TARGET_T2(tag->target);
+
+    g_assert_cmpuint(t2->data_size, == ,TEST_2K_DATA_SIZE);
+
+    /* Initialization didn't have to leave the first sector */
+    g_assert_cmpuint(test->sector_selects, == ,0);
+
+    /* Note: reusing test_read_data_done callback */
+    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_read_data_done, test_destroy_quit_loop, loop));
+}
+
+static
+void
+test_read_data_2k(
+    void)
+{
+    guint8* bytes = g_malloc(TEST_2K_SIZE);
+    TestTargetT2* test;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id;
+    guint i;
+
+    /* Empty NDEF followed by some pattern */
+    for (i = 0; i < TEST_2K_SIZE; i++) {
+        bytes[i] = (guint8)i;
+    }
+    memcpy(bytes, test_data_empty, 2 * TEST_TARGET_T2_DATA_OFFSET);
+    bytes[14] = TEST_2K_DATA_SIZE / 8;
+    test = test_target_t2_new(bytes, TEST_2K_SIZE);
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_read_data_2k_start,
+        loop);
+
+    test_run(&test_opt, loop);
+
+    /* The whole thing has been read with one sector switch */
+    g_assert_cmpuint(test->sector_selects, == ,1);
+    g_assert_cmpuint(test->sector, == ,1);
+    g_assert(nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, NULL) ==
+        NFC_TAG_T2_IO_STATUS_OK);
+
+    /* There are only two sectors */
+    g_assert(!nfc_tag_t2_read(t2, 2, 0, test_read_data_2k_sector0_resp,
+        NULL, NULL));
+
+    /* Raw read from the first sector switches back */
+    g_assert(nfc_tag_t2_read(t2, 0, 0, test_read_data_2k_sector0_resp,
+        test_destroy_quit_loop, loop));
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->sector_selects, == ,2);
+    g_assert_cmpuint(test->sector, == ,0);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+    g_free(bytes);
+}
+
+/*==========================================================================*
+ * read_data_coalesce
+ *==========================================================================*/
+
+typedef struct test_read_data_coalesce {
+    GMainLoop* loop;
+    guint requests;
+} TestReadDataCoalesce;
+
+static
+void
+test_read_data_coalesce_done(
+    NfcTagType2* t2,
+    NFC_TAG_T2_IO_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReadDataCoalesce* coalesce = user_data;
+
+    g_assert_cmpint(status, == ,NFC_TAG_T2_IO_STATUS_OK);
+    test_read_data_done(t2, status, data, len, NULL);
+    g_assert(coalesce->requests > 0);
+    if (!--coalesce->requests) {
+        g_main_loop_quit(coalesce->loop);
+    }
+}
+
+static
+void
+test_read_data_coalesce_start(
+    NfcTag* tag,
+    void* user_data)
+{
+    TestReadDataCoalesce* coalesce = user_data;
+    NfcTagType2* t2 = NFC_TAG_T2(tag);
+    TestTargetT2* test = TEST_TARGET_T2(tag->target);
+    guint i;
+
+    test->reads = 0;
+    for (i = 0; i < coalesce->requests; i++) {
+        g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size,
+            test_read_data_coalesce_done, NULL, coalesce));
+    }
+}
+
+static
+guint
+test_read_data_coalesce_run(
+    guint requests,
+    guint* selects)
+{
+    guint8* bytes = g_malloc(TEST_2K_SIZE);
+    TestTargetT2* test;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    TestReadDataCoalesce coalesce;
+    gulong init_id;
+    guint i, reads;
+
+    for (i = 0; i < TEST_2K_SIZE; i++) {
+        bytes[i] = (guint8)i;
+    }
+    memcpy(bytes, test_data_empty, 2 * TEST_TARGET_T2_DATA_OFFSET);
+    bytes[14] = TEST_2K_DATA_SIZE / 8;
+    test = test_target_t2_new(bytes, TEST_2K_SIZE);
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+
+    memset(&coalesce, 0, sizeof(coalesce));
+    coalesce.loop = g_main_loop_new(NULL, TRUE);
+    coalesce.requests = requests;
+    init_id = nfc_tag_add_initialized_handler(tag,
+        test_read_data_coalesce_start, &coalesce);
+
+    test_run(&test_opt, coalesce.loop);
+    g_assert(!coalesce.requests);
+    reads = test->reads;
+    *selects = test->sector_selects;
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(coalesce.loop);
+    g_free(bytes);
+    return reads;
+}
+
+static
+void
+test_read_data_coalesce(
+    void)
+{
+    guint selects;
+    const guint reads = test_read_data_coalesce_run(1, &selects);
+
+    /* The whole thing has been read with one sector switch */
+    g_assert_cmpuint(reads, > ,0);
+    g_assert_cmpuint(selects, == ,1);
+
+    /* Concurrent requests for the same data don't read it twice */
+    g_assert_cmpuint(test_read_data_coalesce_run(2, &selects), == ,reads);
+    g_assert_cmpuint(selects, == ,1);
+    g_assert_cmpuint(test_read_data_coalesce_run(3, &selects), == ,reads);
+    g_assert_cmpuint(selects, == ,1);
+}
+
+/*==========================================================================*
+ * read_data_cancel
+ *==========================================================================*/
+
+typedef struct test_read_data_cancel {
+    GMainLoop* loop;
+    guint id[3];
+    guint completed;
+    gboolean destroyed;
+} TestReadDataCancel;
+
+static
+void
+test_read_data_cancel_check(
+    TestReadDataCancel* cancel)
+{
+    if (cancel->completed == 2 && cancel->destroyed) {
+        g_main_loop_quit(cancel->loop);
+    }
+}
+
+static
+void
+test_read_data_cancel_done(
+    NfcTagType2* t2,
+    NFC_TAG_T2_IO_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReadDataCancel* cancel = user_data;
+
+    g_assert_cmpint(status, == ,NFC_TAG_T2_IO_STATUS_OK);
+    test_read_data_done(t2, status, data, len, NULL);
+    cancel->completed++;
+    test_read_data_cancel_check(cancel);
+}
+
+static
+void
+test_read_data_cancel_done2(
+    NfcTagType2* t2,
+    NFC_TAG_T2_IO_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReadDataCancel* cancel = user_data;
+
+    /* The third read is still waiting for the same fetch */
+    g_assert(!cancel->destroyed);
+    g_assert(nfc_tag_t2_cancel_read(t2, cancel->id[2]));
+    g_assert(cancel->destroyed);
+    g_assert(!nfc_tag_t2_cancel_read(t2, cancel->id[2]));
+    test_read_data_cancel_done(t2, status, data, len, user_data);
+}
+
+static
+void
+test_read_data_cancel_destroy(
+    void* user_data)
+{
+    TestReadDataCancel* cancel = user_data;
+
+    g_assert(!cancel->destroyed);
+    cancel->destroyed = TRUE;
+    test_read_data_cancel_check(cancel);
+}
+
+static
+void
+test_read_data_cancel_start(
+    NfcTag* tag,
+    void* user_data)
+{
+    TestReadDataCancel* cancel = user_data;
+    NfcTagType2* t2 = NFC_TAG_T2(tag);
+
+    /* The last two wait for the fetches made by the first one */
+    cancel->id[0] = nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_read_data_cancel_done, NULL, cancel);
+    cancel->id[1] = nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_read_data_cancel_done2, NULL, cancel);
+    cancel->id[2] = nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_unexpected_read_completion, test_read_data_cancel_destroy,
+        cancel);
+    g_assert(cancel->id[0]);
+    g_assert(cancel->id[1]);
+    g_assert(cancel->id[2]);
+}
+
+static
+void
+test_read_data_cancel(
+    void)
+{
+    guint8* bytes = g_malloc(TEST_2K_SIZE);
+    TestTargetT2* test;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    TestReadDataCancel cancel;
+    gulong init_id;
+    guint i;
+
+    for (i = 0; i < TEST_2K_SIZE; i++) {
+        bytes[i] = (guint8)i;
+    }
+    memcpy(bytes, test_data_empty, 2 * TEST_TARGET_T2_DATA_OFFSET);
+    bytes[14] = TEST_2K_DATA_SIZE / 8;
+    test = test_target_t2_new(bytes, TEST_2K_SIZE);
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+
+    g_assert(!nfc_tag_t2_cancel_read(NULL, 1));
+    g_assert(!nfc_tag_t2_cancel_read(t2, 0));
+    g_assert(!nfc_tag_t2_cancel_read(t2, 1));
+
+    memset(&cancel, 0, sizeof(cancel));
+    cancel.loop = g_main_loop_new(NULL, TRUE);
+    init_id = nfc_tag_add_initialized_handler(tag,
+        test_read_data_cancel_start, &cancel);
+
+    test_run(&test_opt, cancel.loop);
+    g_assert_cmpuint(cancel.completed, == ,2);
+    g_assert(cancel.destroyed);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(cancel.loop);
+    g_free(bytes);
+}
+
+/*==========================================================================*
+ * fast_read
+ *==========================================================================*/
+
+static const guint8 test_version_ntag216[] = {
+    0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x13, 0x03
+};
+
+#define TEST_FAST_READ_BLOCK (10)
+#define TEST_FAST_READ_COUNT (70) /* More than fits into one frame */
+
+static
+void
+test_fast_read_blocks_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestTargetT2* test = TEST_TARGET_T2(t2->tag.target);
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpuint(len, == ,TEST_FAST_READ_COUNT *
+        TEST_TARGET_T2_BLOCK_SIZE);
+    g_assert(!memcmp(data, test->data.bytes + TEST_FAST_READ_BLOCK *
+        TEST_TARGET_T2_BLOCK_SIZE, len));
+}
+
+static
+void
+test_fast_read(
+    void)
+{
+    TestTargetT2React* react = test_target_t2_react_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216), test_version_ntag216);
+    TestTargetT2* test = &react->parent;
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id = nfc_tag_add_initialized_handler(tag,
+        test_read_data_872_start, loop);
+
+    test_run(&test_opt, loop);
+
+    /*
+     * GET_VERSION doesn't need reactivation. Initialization reads the
+     * control area, then 4 data blocks with READ and then 63 blocks
+     * with FAST_READ. The remaining 151 blocks take 3 more FAST_READs.
+     */
+    g_assert_cmpuint(react->reactivations, == ,0);
+    g_assert_cmpuint(test->reads, == ,6);
+    g_assert(nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, NULL) ==
+        NFC_TAG_T2_IO_STATUS_OK);
+
+    /* Invalid ranges */
+    g_assert(!nfc_tag_t2_read_blocks(t2, 0, 0, 0, NULL,
+        test_fast_read_blocks_resp, NULL, NULL));
+    g_assert(!nfc_tag_t2_read_blocks(t2, 0, 200, 57, NULL,
+        test_fast_read_blocks_resp, NULL, NULL));
+    g_assert(!nfc_tag_t2_read_blocks(t2, 1, 0, 1, NULL,
+        test_fast_read_blocks_resp, NULL, NULL));
+
+    /* Raw block read, which doesn't fit into one FAST_READ */
+    test->reads = 0;
+    g_assert(nfc_tag_t2_read_blocks(t2, 0, TEST_FAST_READ_BLOCK,
+        TEST_FAST_READ_COUNT, NULL, test_fast_read_blocks_resp,
+        test_destroy_quit_loop, loop));
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,2);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * fast_read_unsup
+ *==========================================================================*/
+
+static
+void
+test_fast_read_unsup_start(
+    NfcTag* tag,
+    void* loop)
+{
+    TestTargetT2React* react = TEST_TARGET_T2_REACT(tag->target);
+
+    /* GET_VERSION has failed and the tag had to be reactivated */
+    g_assert_cmpuint(react->reactivations, == ,1);
+    g_assert(tag->ndef);
+    g_main_loop_quit((GMainLoop*)loop);
+}
+
+static
+void
+test_fast_read_unsup(
+    void)
+{
+    TestTargetT2React* react = test_target_t2_react_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216), NULL);
+    TestTargetT2* test = &react->parent;
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id = nfc_tag_add_initialized_handler(tag,
+        test_fast_read_unsup_start, loop);
+
+    test_run(&test_opt, loop);
+
+    /* Still reading 4 blocks at a time */
+    test->reads = 0;
+    g_assert(nfc_tag_t2_read_blocks(t2, 0, TEST_FAST_READ_BLOCK,
+        TEST_FAST_READ_COUNT, NULL, test_fast_read_blocks_resp,
+        test_destroy_quit_loop, loop));
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,(TEST_FAST_READ_COUNT + 3) / 4);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * prefetch
+ *==========================================================================*/
+
+typedef struct test_prefetch {
+    NfcTagType2* t2;
+    GMainLoop* loop;
+} TestPrefetch;
+
+static
+gboolean
+test_prefetch_check(
+    gpointer user_data)
+{
+    TestPrefetch* prefetch = user_data;
+    NfcTagType2* t2 = prefetch->t2;
+    TestTargetT2* test = TEST_TARGET_T2(t2->tag.target);
+    guint8* buf = g_malloc(t2->data_size);
+
+    if (nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, buf) ==
+        NFC_TAG_T2_IO_STATUS_OK) {
+        g_assert(!memcmp(buf, test->data.bytes + TEST_TARGET_T2_DATA_OFFSET,
+            t2->data_size));
+        g_main_loop_quit(prefetch->loop);
+        g_free(buf);
+        return G_SOURCE_REMOVE;
+    }
+    g_free(buf);
+    return G_SOURCE_CONTINUE;
+}
+
+static
+void
+test_prefetch(
+    void)
+{
+    TestTargetT2React* react;
+    TestTargetT2* test;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id;
+    TestPrefetch prefetch;
+
+    nfc_tag_t2_configure_prefetch(TRUE);
+    react = test_target_t2_react_new(TEST_ARRAY_AND_SIZE(test_data_ntag216),
+        test_version_ntag216);
+    test = &react->parent;
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_basic_exit, loop);
+    test_run(&test_opt, loop);
+
+    /* Initialization doesn't read the whole thing */
+    g_assert_cmpuint(test->reads, == ,3);
+    g_assert(nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, NULL) ==
+        NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+
+    /* But then the rest gets fetched in the background */
+    prefetch.t2 = t2;
+    prefetch.loop = loop;
+    g_timeout_add(10, test_prefetch_check, &prefetch);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,6);
+    g_assert_cmpuint(react->reactivations, == ,0);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+    nfc_tag_t2_configure_prefetch(FALSE);
+}
+
+/*==========================================================================*
+ * prefetch_off
+ *==========================================================================*/
+
+static
+void
+test_prefetch_off(
+    void)
+{
+    TestTargetT2React* react = test_target_t2_react_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216), test_version_ntag216);
+    TestTargetT2* test = &react->parent;
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id = nfc_tag_add_initialized_handler(tag,
+        test_basic_exit, loop);
+
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
+
+    /* Prefetch is disabled by default */
+    g_timeout_add(300, test_timeout_quit_loop, loop);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
+    g_assert(nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, NULL) ==
+        NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * prefetch_nack
+ *==========================================================================*/
+
+static
+void
+test_prefetch_nack(
+    void)
+{
+    TestTargetT2React* react;
+    TestTargetT2* test;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    TestTargetT2Error nack;
+    gulong init_id;
+    guint reads;
+
+    nfc_tag_t2_configure_prefetch(TRUE);
+    react = test_target_t2_react_new(TEST_ARRAY_AND_SIZE(test_data_ntag216),
+        test_version_ntag216);
+    test = &react->parent;
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_basic_exit, loop);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
+    g_assert_cmpuint(react->reactivations, == ,0);
+
+    /* The first uncached block is read protected */
+    memset(&nack, 0, sizeof(nack));
+    nack.type = TEST_TARGET_T2_ERROR_NACK;
+    while (nfc_tag_t2_read_data_sync(t2, nack.block * t2->block_size,
+        t2->block_size, NULL) == NFC_TAG_T2_IO_STATUS_OK) {
+        nack.block++;
+    }
+    nack.block += TEST_TARGET_T2_FIRST_DATA_BLOCK;
+    test->read_error = &nack;
+
+    /* Prefetch gets NACK, reactivates the tag and gives up */
+    g_timeout_add(500, test_timeout_quit_loop, loop);
+    test_run(&test_opt, loop);
+    g_assert(!test->read_error);
+    g_assert_cmpuint(test->reads, == ,4);
+    g_assert_cmpuint(react->reactivations, == ,1);
+    g_assert(nfc_tag_t2_read_data_sync(t2, 0, t2->data_size, NULL) ==
+        NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+
+    /* The tag is still usable */
+    reads = test->reads;
+    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_read_data_done, test_destroy_quit_loop, loop));
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, > ,reads);
+    g_assert_cmpuint(react->reactivations, == ,1);
+
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+    nfc_tag_t2_configure_prefetch(FALSE);
+}
+
+/*==========================================================================*
+ * prefetch_seq
+ *==========================================================================*/
+
+static
+void
+test_prefetch_seq(
+    void)
+{
+    TestTargetT2React* react;
+    TestTargetT2* test;
+    NfcTarget* target;
+    NfcTagType2* t2;
+    NfcTag* tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    gulong init_id;
+    NfcTargetSequence* seq;
+    TestPrefetch prefetch;
+
+    nfc_tag_t2_configure_prefetch(TRUE);
+    react = test_target_t2_react_new(TEST_ARRAY_AND_SIZE(test_data_ntag216),
+        test_version_ntag216);
+    test = &react->parent;
+    target = &test->target;
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_basic_exit, loop);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
 
+    /* Nothing gets prefetched while someone is running a sequence */
+    seq = nfc_target_sequence_new(target);
+    g_assert(target->sequence == seq);
+    g_timeout_add(300, test_timeout_quit_loop, loop);
     test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
 
-    /* And this one will be canceled when we delete the tag */
-    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size, test_read_data_done,
-        test_destroy_quit_loop, loop));
+    /* Prefetch resumes when the sequence is finished */
+    nfc_target_sequence_unref(seq);
+    prefetch.t2 = t2;
+    prefetch.loop = loop;
+    g_timeout_add(10, test_prefetch_check, &prefetch);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,6);
 
     nfc_tag_remove_handler(tag, init_id);
     nfc_tag_unref(tag);
-    nfc_target_unref(&test->target);
+    nfc_target_unref(target);
     g_main_loop_unref(loop);
+    nfc_tag_t2_configure_prefetch(FALSE);
 }
 
 /*==========================================================================*
- * read_data_872
+ * prefetch_wait
  *==========================================================================*/
 
+typedef struct test_prefetch_wait {
+    NfcTagType2* t2;
+    GMainLoop* loop;
+    guint read_id;
+    guint idle_id;
+} TestPrefetchWait;
+
 static
 void
-test_read_data_872_start(
-    NfcTag* tag,
+test_prefetch_wait_done(
+    NfcTagType2* t2,
+    NFC_TAG_T2_IO_STATUS status,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    NfcTagType2* t2 = NFC_TAG_T2(tag);
-    NfcNdefRec* rec = tag->ndef;
+    TestPrefetchWait* wait = user_data;
 
-    g_assert(t2->data_size == 872);
+    g_assert_cmpint(status, == ,NFC_TAG_T2_IO_STATUS_OK);
+    test_read_data_done(t2, status, data, len, NULL);
+    g_main_loop_quit(wait->loop);
+}
 
-    g_assert(rec);
-    g_assert(!rec->next);
-    g_assert(NFC_IS_NDEF_REC_U(rec));
-    g_assert(!g_strcmp0(NFC_NDEF_REC_U(rec)->uri,
-        "https://www.merproject.org"));
+static
+gboolean
+test_prefetch_wait_read(
+    gpointer user_data)
+{
+    TestPrefetchWait* wait = user_data;
+    NfcTagType2* t2 = wait->t2;
 
-    /* Note: reusing test_read_data_done callback */
-    g_assert(nfc_tag_t2_read_data(t2, 0, t2->data_size,
-        test_read_data_done, test_destroy_quit_loop, user_data /* loop */));
+    /* Prefetch has been submitted but hasn't completed yet */
+    g_assert(t2->tag.target->sequence);
+    wait->idle_id = 0;
+    wait->read_id = nfc_tag_t2_read_data(t2, 0, t2->data_size,
+        test_prefetch_wait_done, NULL, wait);
+    g_assert(wait->read_id);
+    return G_SOURCE_REMOVE;
 }
 
 static
 void
-test_read_data_872(
+test_prefetch_wait_sequence(
+    NfcTarget* target,
+    void* user_data)
+{
+    TestPrefetchWait* wait = user_data;
+
+    /* Outrun the completion of the read command */
+    if (target->sequence && !wait->read_id && !wait->idle_id) {
+        wait->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT,
+            test_prefetch_wait_read, wait, NULL);
+    }
+}
+
+static
+void
+test_prefetch_wait(
     void)
 {
-    TestTargetT2* test = test_target_t2_new
-        (TEST_ARRAY_AND_SIZE(test_data_ntag216));
-    NfcTagType2* t2 = test_tag_new(test, 0);
-    NfcTag* tag = &t2->tag;
+    TestTargetT2React* react;
+    TestTargetT2* test;
+    NfcTarget* target;
+    NfcTagType2* t2;
+    NfcTag* tag;
     GMainLoop* loop = g_main_loop_new(NULL, TRUE);
-    gulong init_id = nfc_tag_add_initialized_handler(tag,
-        test_read_data_872_start, loop);
+    gulong init_id, seq_id;
+    TestPrefetchWait wait;
+
+    nfc_tag_t2_configure_prefetch(TRUE);
+    react = test_target_t2_react_new(TEST_ARRAY_AND_SIZE(test_data_ntag216),
+        test_version_ntag216);
+    test = &react->parent;
+    target = &test->target;
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_basic_exit, loop);
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->reads, == ,3);
+
+    /* The read waits for the prefetch instead of reading the same data */
+    memset(&wait, 0, sizeof(wait));
+    wait.t2 = t2;
+    wait.loop = loop;
+    seq_id = nfc_target_add_sequence_handler(target,
+        test_prefetch_wait_sequence, &wait);
+    test_run(&test_opt, loop);
+    g_assert(wait.read_id);
+    g_assert_cmpuint(test->reads, == ,6);
+
+    nfc_target_remove_handler(target, seq_id);
+    nfc_tag_remove_handler(tag, init_id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+    nfc_tag_t2_configure_prefetch(FALSE);
+}
+
+/*==========================================================================*
+ * persistent_cache
+ *==========================================================================*/
 
+#define TEST_PERSISTENT_CACHE_FILE "t2-049BFB4AEB2B80"
+
+static
+guint
+test_persistent_cache_run(
+    guint pos,
+    guint8 byte,
+    const char* uri)
+{
+    TestTargetT2* test = test_target_t2_new
+        (TEST_ARRAY_AND_SIZE(test_data_google));
+    NfcTagType2* t2;
+    NfcTag* tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcNdefRec* rec;
+    gulong init_id;
+    guint reads;
+
+    test->storage[pos] = byte;
+    t2 = test_tag_new(test, 0);
+    tag = &t2->tag;
+    init_id = nfc_tag_add_initialized_handler(tag, test_basic_exit, loop);
     test_run(&test_opt, loop);
 
+    rec = tag->ndef;
+    g_assert(rec);
+    g_assert(NFC_IS_NDEF_REC_U(rec));
+    g_assert_cmpstr(NFC_NDEF_REC_U(rec)->uri, == ,uri);
+    reads = test->reads;
+
     nfc_tag_remove_handler(tag, init_id);
     nfc_tag_unref(tag);
     nfc_target_unref(&test->target);
     g_main_loop_unref(loop);
+    return reads;
+}
+
+static
+void
+test_persistent_cache(
+    void)
+{
+    const guint pos = TEST_TARGET_T2_DATA_OFFSET + 7;
+    char* dir = g_dir_make_tmp("test_tag_t2_cache_XXXXXX", NULL);
+    char* file = g_build_filename(dir, NFC_TAG_CACHE_SUBDIR,
+        TEST_PERSISTENT_CACHE_FILE, NULL);
+
+    nfc_tag_cache_configure(dir, 0);
+
+    /* Control area and two 4-block reads */
+    g_assert_cmpuint(test_persistent_cache_run(pos, 'g',
+        "http://google.com"), == ,3);
+    g_assert(g_file_test(file, G_FILE_TEST_IS_REGULAR));
+
+    /* The second block comes from the cache */
+    g_assert_cmpuint(test_persistent_cache_run(pos, 'g',
+        "http://google.com"), == ,2);
+
+    /* The first data block doesn't match, the cache is ignored */
+    g_assert_cmpuint(test_persistent_cache_run(pos, 'G',
+        "http://Google.com"), == ,3);
+
+    /* And gets updated */
+    g_assert_cmpuint(test_persistent_cache_run(pos, 'G',
+        "http://Google.com"), == ,2);
+
+    nfc_tag_cache_configure(NULL, 0);
+    test_rmdir(dir);
+    g_free(file);
+    g_free(dir);
 }
 
 /*==========================================================================*
@@ -1165,6 +2140,28 @@ test_write(
  * write_data1
  *==========================================================================*/
 
+static
+void
+test_write_data_ndef_changed(
+    NfcTag* tag,
+    void* user_data)
+{
+    (*((int*)user_data))++;
+}
+
+static
+void
+test_write_data_check_jolla(
+    NfcTag* tag)
+{
+    NfcNdefRec* rec = tag->ndef;
+
+    g_assert(rec);
+    g_assert(!rec->next);
+    g_assert(NFC_IS_NDEF_REC_U(rec));
+    g_assert(!g_strcmp0(NFC_NDEF_REC_U(rec)->uri, "https://www.jolla.com"));
+}
+
 static
 void
 test_write_data1_done(
@@ -1202,8 +2199,12 @@ test_write_data1(
     NfcTag* tag = &t2->tag;
     GMainLoop* loop = g_main_loop_new(NULL, TRUE);
     GBytes* rec = g_bytes_new_static(TEST_ARRAY_AND_SIZE(jolla_rec));
-    gulong id = nfc_tag_add_initialized_handler(tag,
-        test_write_data1_start, loop);
+    int ndef_changed = 0;
+    gulong id[2];
+
+    id[0] = nfc_tag_add_initialized_handler(tag, test_write_data1_start, loop);
+    id[1] = nfc_tag_add_ndef_changed_handler(tag,
+        test_write_data_ndef_changed, &ndef_changed);
 
     /* Data is required */
     g_assert(!nfc_tag_t2_write_data(t2, 0, NULL,
@@ -1221,11 +2222,13 @@ test_write_data1(
     g_assert(!memcmp(test->data.bytes + TEST_TARGET_T2_DATA_OFFSET,
         TEST_ARRAY_AND_SIZE(jolla_rec)));
 
-    /* It's not considered cached anymore */
+    /* What we have written is cached, and NDEF has been updated */
     g_assert(nfc_tag_t2_read_data_sync(t2, 0, sizeof(jolla_rec), NULL) ==
-        NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+        NFC_TAG_T2_IO_STATUS_OK);
+    g_assert_cmpint(ndef_changed, == ,1);
+    test_write_data_check_jolla(tag);
 
-    nfc_tag_remove_handler(tag, id);
+    nfc_tag_remove_all_handlers(tag, id);
     nfc_tag_unref(tag);
     nfc_target_unref(&test->target);
     g_bytes_unref(rec);
@@ -1300,8 +2303,12 @@ test_write_data2(
     NfcTagType2* t2 = test_tag_new(test, 0);
     NfcTag* tag = &t2->tag;
     GMainLoop* loop = g_main_loop_new(NULL, TRUE);
-    gulong id = nfc_tag_add_initialized_handler(tag,
-        test_write_data2_start, loop);
+    int ndef_changed = 0;
+    gulong id[2];
+
+    id[0] = nfc_tag_add_initialized_handler(tag, test_write_data2_start, loop);
+    id[1] = nfc_tag_add_ndef_changed_handler(tag,
+        test_write_data_ndef_changed, &ndef_changed);
 
     test_run(&test_opt, loop);
 
@@ -1309,11 +2316,13 @@ test_write_data2(
     g_assert(!memcmp(test->data.bytes + TEST_TARGET_T2_DATA_OFFSET, jolla_rec,
         NDEF_JOLLA_COM_SIZE_EXACT));
 
-    /* It's not considered cached anymore */
+    /* What we have written is cached, and NDEF has been updated */
     g_assert(nfc_tag_t2_read_data_sync(t2, 0, sizeof(jolla_rec), NULL) ==
-        NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+        NFC_TAG_T2_IO_STATUS_OK);
+    g_assert_cmpint(ndef_changed, == ,1);
+    test_write_data_check_jolla(tag);
 
-    nfc_tag_remove_handler(tag, id);
+    nfc_tag_remove_all_handlers(tag, id);
     nfc_tag_unref(tag);
     nfc_target_unref(&test->target);
     g_main_loop_unref(loop);
@@ -1401,9 +2410,10 @@ test_write_data3(
         g_assert(!test->data.bytes[TEST_TARGET_T2_DATA_OFFSET + i]);
     }
 
-    /* It's not considered cached anymore */
+    /* Zeros are cached, there's no NDEF anymore */
     g_assert(nfc_tag_t2_read_data_sync(t2, 0, NDEF_GOOGLE_COM_SIZE_EXACT,
-        NULL) == NFC_TAG_T2_IO_STATUS_NOT_CACHED);
+        NULL) == NFC_TAG_T2_IO_STATUS_OK);
+    g_assert(!tag->ndef);
 
     /* Write data as two chunks */
     g_assert(nfc_tag_t2_write_data(t2, 0, chunk1, test_write_data3_done_chunk1,
@@ -1415,6 +2425,7 @@ test_write_data3(
     /* Check the contents */
     g_assert(!memcmp(test->data.bytes + TEST_TARGET_T2_DATA_OFFSET,
         TEST_ARRAY_AND_SIZE(jolla_rec)));
+    test_write_data_check_jolla(tag);
 
     nfc_tag_remove_handler(tag, id);
     nfc_tag_unref(tag);
@@ -1424,6 +2435,113 @@ test_write_data3(
     g_main_loop_unref(loop);
 }
 
+/*==========================================================================*
+ * write_data_diff
+ *==========================================================================*/
+
+#define TEST_WRITE_DATA_DIFF_SIZE (18) /* TLV including the terminator */
+#define TEST_WRITE_DATA_DIFF_CHANGE (9) /* "google" => "goggle" */
+
+typedef struct test_write_data_diff {
+    GMainLoop* loop;
+    guint size;
+} TestWriteDataDiff;
+
+static
+void
+test_write_data_diff_done(
+    NfcTagType2* tag,
+    NFC_TAG_T2_IO_STATUS status,
+    guint written,
+    void* user_data)
+{
+    TestWriteDataDiff* test = user_data;
+
+    g_assert(status == NFC_TAG_T2_IO_STATUS_OK);
+    g_assert_cmpuint(written, == ,test->size);
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_write_data_diff_run(
+    NfcTagType2* t2,
+    GMainLoop* loop,
+    const void* data,
+    guint size)
+{
+    TestWriteDataDiff test;
+    GBytes* bytes = g_bytes_new(data, size);
+
+    test.loop = loop;
+    test.size = size;
+    g_assert(nfc_tag_t2_write_data(t2, 0, bytes, test_write_data_diff_done,
+        NULL, &test));
+    g_bytes_unref(bytes);
+    test_run(&test_opt, loop);
+}
+
+static
+void
+test_write_data_diff_start(
+    NfcTag* tag,
+    void* loop)
+{
+    g_main_loop_quit((GMainLoop*)loop);
+}
+
+static
+void
+test_write_data_diff(
+    void)
+{
+    TestTargetT2* test = test_target_t2_new
+        (TEST_ARRAY_AND_SIZE(test_data_google));
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    const guint8* ndef = test_data_google + TEST_TARGET_T2_DATA_OFFSET;
+    guint8 buf[TEST_WRITE_DATA_DIFF_SIZE];
+    gulong id = nfc_tag_add_initialized_handler(tag,
+        test_write_data_diff_start, loop);
+
+    test_run(&test_opt, loop);
+    g_assert_cmpuint(test->writes, == ,0);
+
+    /* Writing the same thing is a no-op */
+    test_write_data_diff_run(t2, loop, ndef, sizeof(buf));
+    g_assert_cmpuint(test->writes, == ,0);
+
+    /* Changing one byte only writes one block */
+    memcpy(buf, ndef, sizeof(buf));
+    buf[TEST_WRITE_DATA_DIFF_CHANGE] = 'g';
+    test_write_data_diff_run(t2, loop, buf, sizeof(buf));
+    g_assert_cmpuint(test->writes, == ,1);
+    g_assert_cmpuint(test->last_write, == ,TEST_TARGET_T2_FIRST_DATA_BLOCK +
+        TEST_WRITE_DATA_DIFF_CHANGE / TEST_TARGET_T2_BLOCK_SIZE);
+    g_assert(!memcmp(test->data.bytes + TEST_TARGET_T2_DATA_OFFSET, buf,
+        sizeof(buf)));
+
+    /*
+     * NDEF length is zeroed first and written last. All 5 blocks have
+     * changed, the one with the length is written twice.
+     */
+    test->writes = 0;
+    test_write_data_diff_run(t2, loop, TEST_ARRAY_AND_SIZE(jolla_rec));
+    g_assert_cmpuint(test->writes, == ,6);
+    g_assert_cmpuint(test->first_write, == ,TEST_TARGET_T2_FIRST_DATA_BLOCK);
+    g_assert_cmpuint(test->first_write_data[0], == ,0x03);
+    g_assert_cmpuint(test->first_write_data[1], == ,0x00);
+    g_assert_cmpuint(test->last_write, == ,TEST_TARGET_T2_FIRST_DATA_BLOCK);
+    g_assert(!memcmp(test->data.bytes + TEST_TARGET_T2_DATA_OFFSET,
+        TEST_ARRAY_AND_SIZE(jolla_rec)));
+
+    nfc_tag_remove_handler(tag, id);
+    nfc_tag_unref(tag);
+    nfc_target_unref(&test->target);
+    g_main_loop_unref(loop);
+}
+
 /*==========================================================================*
  * write_err1
  *==========================================================================*/
@@ -1616,6 +2734,183 @@ test_write_data_err2(
     g_main_loop_unref(loop);
 }
 
+/*==========================================================================*
+ * bench_read
+ *==========================================================================*/
+
+#define TEST_BENCH_READ_FRAMES (100)
+#define TEST_BENCH_READ_BLOCKS (4)
+
+typedef struct test_bench_read {
+    GMainLoop* loop;
+    guint count;
+} TestBenchRead;
+
+static
+void
+test_bench_read_init_done(
+    NfcTag* tag,
+    void* user_data)
+{
+    g_main_loop_quit((GMainLoop*)user_data);
+}
+
+static
+void
+test_bench_read_resp(
+    NfcTagType2* t2,
+    NFC_TAG_T2_IO_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestBenchRead* bench = user_data;
+
+    g_assert_cmpint(status, == ,NFC_TAG_T2_IO_STATUS_OK);
+    g_assert_cmpuint(len, == ,TEST_BENCH_READ_BLOCKS * t2->block_size);
+    if (++(bench->count) == TEST_BENCH_READ_FRAMES) {
+        g_main_loop_quit(bench->loop);
+    }
+}
+
+static
+gint64
+test_bench_read_run(
+    gboolean direct)
+{
+    TestTargetT2* test = test_target_t2_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216));
+    NfcTarget* target = &test->target;
+    NfcTagType2* t2 = test_tag_new(test, 0);
+    NfcTag* tag = &t2->tag;
+    NfcTargetSequence* seq;
+    TestBenchRead bench;
+    gint64 start, elapsed;
+    gulong id;
+    guint i;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.loop = g_main_loop_new(NULL, TRUE);
+    id = nfc_tag_add_initialized_handler(tag, test_bench_read_init_done,
+        bench.loop);
+    test_run(&test_opt, bench.loop);
+    nfc_tag_remove_handler(tag, id);
+
+    /* Queue all the reads at once, direct continuation needs a sequence */
+    nfc_target_set_direct_continuation(target, direct);
+    seq = nfc_target_sequence_new(target);
+    start = g_get_monotonic_time();
+    for (i = 0; i < TEST_BENCH_READ_FRAMES; i++) {
+        g_assert(nfc_tag_t2_read_blocks(t2, 0, i, TEST_BENCH_READ_BLOCKS,
+            seq, test_bench_read_resp, NULL, &bench));
+    }
+    test_run(&test_opt, bench.loop);
+    elapsed = g_get_monotonic_time() - start;
+    g_assert_cmpuint(bench.count, == ,TEST_BENCH_READ_FRAMES);
+    nfc_target_sequence_unref(seq);
+
+    nfc_tag_unref(tag);
+    nfc_target_unref(target);
+    g_main_loop_unref(bench.loop);
+    return elapsed;
+}
+
+static
+void
+test_bench_read(
+    void)
+{
+    /* The numbers are informational, only correctness is checked */
+    const gint64 deferred = test_bench_read_run(FALSE);
+    const gint64 direct = test_bench_read_run(TRUE);
+
+    g_test_message("%d frames: %.2f us/frame deferred, %.2f us/frame direct",
+        TEST_BENCH_READ_FRAMES, deferred / (double)TEST_BENCH_READ_FRAMES,
+        direct / (double)TEST_BENCH_READ_FRAMES);
+}
+
+/*==========================================================================*
+ * read_pool
+ *==========================================================================*/
+
+#define TEST_READ_POOL_COUNT (10)
+
+typedef struct test_read_pool {
+    GMainLoop* loop;
+    guint count;
+    guint target_allocs;
+    guint tag_allocs;
+} TestReadPool;
+
+static
+void
+test_read_pool_resp(
+    NfcTagType2* t2,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReadPool* test = user_data;
+    NfcTarget* target = t2->tag.target;
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_assert_cmpuint(len, == ,TEST_TARGET_T2_READ_SIZE);
+    test->count++;
+    if (test->count == 2) {
+        /* By now the pools have enough contexts */
+        test->target_allocs = nfc_target_alloc_count(target);
+        test->tag_allocs = nfc_tag_t2_alloc_count();
+    } else if (test->count > 2) {
+        g_assert_cmpuint(nfc_target_alloc_count(target), == ,
+            test->target_allocs);
+        g_assert_cmpuint(nfc_tag_t2_alloc_count(), == ,test->tag_allocs);
+    }
+    if (test->count < TEST_READ_POOL_COUNT) {
+        /* Read the next block from the completion callback */
+        g_assert(nfc_tag_t2_read(t2, 0, test->count, test_read_pool_resp,
+            NULL, test));
+    } else {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_read_pool(
+    void)
+{
+    TestTargetT2* target = test_target_t2_new
+        (TEST_ARRAY_AND_SIZE(test_data_ntag216));
+    NfcTagType2* t2 = test_tag_new(target, 0);
+    NfcTag* tag = &t2->tag;
+    TestReadPool test;
+    gulong id;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, TRUE);
+    id = nfc_tag_add_initialized_handler(tag, test_bench_read_init_done,
+        test.loop);
+    test_run(&test_opt, test.loop);
+    nfc_tag_remove_handler(tag, id);
+
+    /* Raw block reads are not cached, each one is a round trip */
+    target->reads = 0;
+    g_assert(nfc_tag_t2_read(t2, 0, 0, test_read_pool_resp, NULL, &test));
+    test_run(&test_opt, test.loop);
+    g_assert_cmpuint(test.count, == ,TEST_READ_POOL_COUNT);
+    g_assert_cmpuint(target->reads, == ,TEST_READ_POOL_COUNT);
+
+    /* No allocations after the first two round trips */
+    g_assert_cmpuint(nfc_target_alloc_count(&target->target), == ,
+        test.target_allocs);
+    g_assert_cmpuint(nfc_tag_t2_alloc_count(), == ,test.tag_allocs);
+
+    nfc_tag_unref(tag);
+    nfc_target_unref(&target->target);
+    g_main_loop_unref(test.loop);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -1636,6 +2931,17 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("init_err2"), test_init_err2);
     g_test_add_func(TEST_("read_data"), test_read_data);
     g_test_add_func(TEST_("read_data_872"), test_read_data_872);
+    g_test_add_func(TEST_("read_data_2k"), test_read_data_2k);
+    g_test_add_func(TEST_("read_data_coalesce"), test_read_data_coalesce);
+    g_test_add_func(TEST_("read_data_cancel"), test_read_data_cancel);
+    g_test_add_func(TEST_("fast_read"), test_fast_read);
+    g_test_add_func(TEST_("fast_read_unsup"), test_fast_read_unsup);
+    g_test_add_func(TEST_("prefetch"), test_prefetch);
+    g_test_add_func(TEST_("prefetch_off"), test_prefetch_off);
+    g_test_add_func(TEST_("prefetch_nack"), test_prefetch_nack);
+    g_test_add_func(TEST_("prefetch_seq"), test_prefetch_seq);
+    g_test_add_func(TEST_("prefetch_wait"), test_prefetch_wait);
+    g_test_add_func(TEST_("persistent_cache"), test_persistent_cache);
     g_test_add_func(TEST_("read_data_cached"), test_read_data_cached);
     g_test_add_func(TEST_("read_data_abort"), test_read_data_abort);
     g_test_add_func(TEST_("read_data_err"), test_read_data_err);
@@ -1646,9 +2952,12 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("write_data1"), test_write_data1);
     g_test_add_func(TEST_("write_data2"), test_write_data2);
     g_test_add_func(TEST_("write_data3"), test_write_data3);
+    g_test_add_func(TEST_("write_data_diff"), test_write_data_diff);
     g_test_add_func(TEST_("write_err1"), test_write_err1);
     g_test_add_func(TEST_("write_data_err1"), test_write_data_err1);
     g_test_add_func(TEST_("write_data_err2"), test_write_data_err2);
+    g_test_add_func(TEST_("bench_read"), test_bench_read);
+    g_test_add_func(TEST_("read_pool"), test_read_pool);
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
@@ -40,6 +40,8 @@
 
 #include "nfc_tag_p.h"
 #include "nfc_tag_t4_p.h"
+#include "nfc_tag_cache.h"
+#include "nfc_target_p.h"
 #include "nfc_target_impl.h"
 #include "nfc_ndef.h"
 
@@ -49,11 +51,14 @@
 #include <gutil_log.h>
 #include <gutil_misc.h>
 
+#include <glib/gstdio.h>
+
 static TestOpt test_opt;
 
 static const guint8 test_resp_ok[] = { 0x90, 0x00 };
 static const guint8 test_resp_not_found[] = { 0x6a, 0x82 };
 static const guint8 test_resp_err[] = { 0x6a, 0x00 };
+static const guint8 test_resp_wrong_length[] = { 0x67, 0x00 };
 static const guint8 test_cmd_select_ndef_app[] = {
     0x00, 0xa4, 0x04, 0x00, 0x07,             /* CLA|INS|P1|P2|Lc  */
     0xd2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, /* Data */
@@ -183,6 +188,50 @@ static const guint8 test_resp_read_ndef_2[] = {
     0x73, 0x74, 0x20, 0x74, 0x65, 0x73, 0x74, /* Data */
     0x90, 0x00                                /* SW1|SW2 */
 };
+static const guint8 test_cmd_read_ndef_head[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x3b              /* CLA|INS|P1|P2|Le  */
+};
+static const guint8 test_resp_read_ndef_head[] = {
+    0x00, 0x42,                               /* NLEN */
+    0xd1, 0x01, 0x3e, 0x54, 0x02, 0x65, 0x6e, /* Data */
+    0x54, 0x65, 0x73, 0x74, 0x20, 0x74, 0x65,
+    0x73, 0x74, 0x20, 0x74, 0x65, 0x73, 0x74,
+    0x20, 0x74, 0x65, 0x73, 0x74, 0x20, 0x74,
+    0x65, 0x73, 0x74, 0x20, 0x74, 0x65, 0x73,
+    0x74, 0x20, 0x74, 0x65, 0x73, 0x74, 0x20,
+    0x74, 0x65, 0x73, 0x74, 0x20, 0x74, 0x65,
+    0x73, 0x74, 0x20, 0x74, 0x65, 0x73, 0x74,
+    0x20,
+    0x90, 0x00                                /* SW1|SW2 */
+};
+static const guint8 test_resp_read_ndef_head_wrong_le[] = {
+    0x6c, 0x44                                /* SW1|SW2 */
+};
+static const guint8 test_cmd_read_ndef_head_fixed_le[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x44              /* CLA|INS|P1|P2|Le  */
+};
+static const guint8 test_resp_read_ndef_head_fixed_le[] = {
+    0x00, 0x42,                               /* NLEN */
+    0xd1, 0x01, 0x3e, 0x54, 0x02, 0x65, 0x6e, /* Data */
+    0x54, 0x65, 0x73, 0x74, 0x20, 0x74, 0x65,
+    0x73, 0x74, 0x20, 0x74, 0x65, 0x73, 0x74,
+    0x20, 0x74, 0x65, 0x73, 0x74, 0x20, 0x74,
+    0x65, 0x73, 0x74, 0x20, 0x74, 0x65, 0x73,
+    0x74, 0x20, 0x74, 0x65, 0x73, 0x74, 0x20,
+    0x74, 0x65, 0x73, 0x74, 0x20, 0x74, 0x65,
+    0x73, 0x74, 0x20, 0x74, 0x65, 0x73, 0x74,
+    0x20, 0x74, 0x65, 0x73, 0x74, 0x20, 0x74,
+    0x65, 0x73, 0x74,
+    0x90, 0x00                                /* SW1|SW2 */
+};
+static const guint8 test_cmd_read_ndef_tail[] = {
+    0x00, 0xb0, 0x00, 0x3b, 0x09              /* CLA|INS|P1|P2|Le  */
+};
+static const guint8 test_resp_read_ndef_tail[] = {
+    0x74, 0x65, 0x73, 0x74, 0x20, 0x74, 0x65, /* Data */
+    0x73, 0x74,
+    0x90, 0x00                                /* SW1|SW2 */
+};
 static gint reset_count = 0;
 static gint reset_free_count = 0;
 
@@ -226,6 +275,7 @@ typedef struct test_target2 {
     TestTarget parent;
     gboolean fail_reactivate;
     guint reactivate_id;
+    guint reactivations;
 } TestTarget2;
 
 G_DEFINE_TYPE(TestTarget2, test_target2, TEST_TYPE_TARGET)
@@ -253,6 +303,7 @@ test_target2_reactivate(
     TestTarget2* test = TEST_TARGET2(target);
 
     g_assert(!test->reactivate_id);
+    test->reactivations++;
     if (test->fail_reactivate) {
         GDEBUG("Failing reactivation");
         return FALSE;
@@ -694,7 +745,7 @@ static const GUtilData test_init_data_ndef_read_len_zero[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len_zero) }
 };
 
@@ -707,7 +758,7 @@ static const GUtilData test_init_data_ndef_read_len_wrong[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len_wrong) }
 };
 
@@ -720,6 +771,8 @@ static const GUtilData test_init_data_ndef_read_len_err[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_err) },
     { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
     { TEST_ARRAY_AND_SIZE(test_resp_err) }
 };
@@ -733,7 +786,7 @@ static const GUtilData test_init_data_ndef_read_len_io_err[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) }
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) }
     /* Missing response becomes an I/O error */
 };
 
@@ -746,9 +799,9 @@ static const GUtilData test_init_data_ndef_read_err[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_1) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_tail) },
     { TEST_ARRAY_AND_SIZE(test_resp_err) }
 };
 
@@ -761,9 +814,9 @@ static const GUtilData test_init_data_ndef_read_io_err[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_1) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_tail) },
     /* Missing response becomes an I/O error */
 };
 
@@ -776,9 +829,9 @@ static const GUtilData test_init_data_ndef_short[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len) },
-    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_1) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_tail) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) }
 };
 
@@ -788,7 +841,6 @@ static const GUtilData test_init_data_ndef_short[] = {
 #define test_init_data_ndef_select_submit_error test_init_data_success
 #define test_init_data_ndef_read_submit_error1 test_init_data_success
 #define test_init_data_ndef_read_submit_error2 test_init_data_success
-#define test_init_data_ndef_read_submit_error3 test_init_data_success
 #define test_init_data_success_no_react test_init_data_success
 static const GUtilData test_init_data_success[] = {
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
@@ -799,6 +851,23 @@ static const GUtilData test_init_data_success[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
     { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
     { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_tail) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_tail) }
+};
+
+static const GUtilData test_init_data_ndef_fallback[] = {
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_wrong_length) },
     { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len) },
     { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_1) },
@@ -807,6 +876,21 @@ static const GUtilData test_init_data_success[] = {
     { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_2) }
 };
 
+static const GUtilData test_init_data_ndef_wrong_le[] = {
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head_wrong_le) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head_fixed_le) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head_fixed_le) }
+};
+
 static const TestInitData init_tests[] = {
 #define TEST_INIT(x,y,z) {#x, TEST_ARRAY_AND_COUNT(test_init_data_##x), y, z}
     TEST_INIT(app_not_found, 0, 0),
@@ -844,7 +928,8 @@ static const TestInitData init_tests[] = {
     TEST_INIT(ndef_select_submit_error, 4, 0),
     TEST_INIT(ndef_read_submit_error1, 5, 0),
     TEST_INIT(ndef_read_submit_error2, 6, 0),
-    TEST_INIT(ndef_read_submit_error3, 7, 0),
+    TEST_INIT(ndef_fallback, 0, TEST_INIT_NDEF),
+    TEST_INIT(ndef_wrong_le, 0, TEST_INIT_NDEF),
     TEST_INIT(success, 0, TEST_INIT_NDEF),
     TEST_INIT(success_no_react, 0, TEST_INIT_NDEF | TEST_INIT_FAIL_REACT)
 };
@@ -898,6 +983,177 @@ test_init_seq(
     nfc_target_unref(target);
 }
 
+/*==========================================================================*
+ * deferred_reset
+ *==========================================================================*/
+
+static const guint8 test_cmd_select_mf[] = {
+    0x00, 0xa4, 0x00, 0x00                    /* CLA|INS|P1|P2 */
+};
+
+static
+void
+test_deferred_reset_done(
+    NfcTagType4* t4,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    g_assert(sw == ISO_SW_OK);
+    g_main_loop_quit((GMainLoop*)user_data);
+}
+
+static
+void
+test_deferred_reset(
+    void)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcTarget* target = g_object_new(TEST_TYPE_TARGET2, NULL);
+    TestTarget2* test = TEST_TARGET2(target);
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcParamPollB poll_b;
+    NfcTagType4* t4b;
+    NfcTag* tag;
+    gulong id;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(test_init_data_success); i++) {
+        g_ptr_array_add(test_target->cmd_resp,
+            gutil_data_copy(test_init_data_success + i));
+    }
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_mf),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_mf),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+
+    memset(&poll_b, 0, sizeof(poll_b));
+    poll_b.fsc = 0x0b; /* i.e. 256 */
+    t4b = NFC_TAG_T4(nfc_tag_t4b_new(target, &poll_b, NULL));
+    tag = &t4b->tag;
+    id = nfc_tag_add_initialized_handler(tag, test_tag_quit_loop_cb, loop);
+    test_run(&test_opt, loop);
+    nfc_tag_remove_handler(tag, id);
+
+    /* The tag gets initialized without being reactivated */
+    g_assert(tag->flags & NFC_TAG_FLAG_INITIALIZED);
+    g_assert(tag->ndef);
+    g_assert(test->reactivations == 0);
+
+    /* Reactivation precedes the first APDU */
+    g_assert(nfc_isodep_transmit(t4b, 0x00, 0xa4, 0x00, 0x00, NULL, 0,
+        NULL, test_deferred_reset_done, NULL, loop));
+    test_run(&test_opt, loop);
+    g_assert(test->reactivations == 1);
+
+    /* But only the first one */
+    g_assert(!nfc_isodep_deferred_reset(t4b, NULL));
+    g_assert(nfc_isodep_transmit(t4b, 0x00, 0xa4, 0x00, 0x00, NULL, 0,
+        NULL, test_deferred_reset_done, NULL, loop));
+    test_run(&test_opt, loop);
+    g_assert(test->reactivations == 1);
+    g_assert(!test_target->cmd_resp->len);
+
+    nfc_tag_unref(tag);
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * init_ext_le
+ *==========================================================================*/
+
+#define TEST_EXT_LE_FILE_SIZE (0x400)
+#define TEST_EXT_LE_NDEF_SIZE (TEST_EXT_LE_FILE_SIZE - 2)
+#define TEST_EXT_LE_TEXT_SIZE (TEST_EXT_LE_NDEF_SIZE - 10)
+
+static const guint8 test_ext_le_hb[] = {
+    0x80,                                     /* Category indicator */
+    0x73, 0x00, 0x00, 0x40                    /* Extended Lc and Le */
+};
+static const guint8 test_ext_le_resp_read_ndef_cc[] = {
+    0x00, 0x0f, 0x20, 0x04, 0x00, 0x00, 0x34, /* Data */
+    /*                MLe ^^    ^^           */
+    0x04, 0x06, 0xe1, 0x04, 0x04, 0x00, 0x00,
+    /*             Max NDEF size ^^    ^^    */
+    0xff,
+    0x90, 0x00                                /* SW1|SW2 */
+};
+static const guint8 test_ext_le_cmd_read_ndef[] = {
+    0x00, 0xb0, 0x00, 0x00,                   /* CLA|INS|P1|P2 */
+    0x00, 0x04, 0x00                          /* Extended Le */
+};
+static const guint8 test_ext_le_ndef_header[] = {
+    (guint8)(TEST_EXT_LE_NDEF_SIZE >> 8),     /* NLEN */
+    (guint8)TEST_EXT_LE_NDEF_SIZE,
+    0xc1, 0x01,                               /* Long record, type 'T' */
+    0x00, 0x00,                               /* Payload length */
+    (guint8)((TEST_EXT_LE_TEXT_SIZE + 3) >> 8),
+    (guint8)(TEST_EXT_LE_TEXT_SIZE + 3),
+    0x54, 0x02, 0x65, 0x6e                    /* Type, status, 'en' */
+};
+
+static
+void
+test_init_ext_le(
+    void)
+{
+    static const GUtilData hb = { TEST_ARRAY_AND_SIZE(test_ext_le_hb) };
+    NfcTarget* target = g_object_new(TEST_TYPE_TARGET2, NULL);
+    TestTarget* test_target = TEST_TARGET(target);
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcParamIsoDepPollA iso_dep_poll_a;
+    GByteArray* resp = g_byte_array_new();
+    const guint8 sw[] = { 0x90, 0x00 };
+    NfcTagType4* t4a;
+    NfcTag* tag;
+    gulong id;
+
+    /* The whole NDEF file comes in one response */
+    g_byte_array_append(resp, TEST_ARRAY_AND_SIZE(test_ext_le_ndef_header));
+    g_byte_array_set_size(resp, TEST_EXT_LE_FILE_SIZE);
+    memset(resp->data + sizeof(test_ext_le_ndef_header), 'x',
+        TEST_EXT_LE_FILE_SIZE - sizeof(test_ext_le_ndef_header));
+    g_byte_array_append(resp, sw, sizeof(sw));
+
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_cc),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_cc),
+        TEST_ARRAY_AND_SIZE(test_ext_le_resp_read_ndef_cc));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_ext_le_cmd_read_ndef),
+        resp->data, resp->len);
+
+    memset(&iso_dep_poll_a, 0, sizeof(iso_dep_poll_a));
+    iso_dep_poll_a.fsc = 256;
+    iso_dep_poll_a.t1 = hb;
+    target->technology = NFC_TECHNOLOGY_A;
+    t4a = NFC_TAG_T4(nfc_tag_t4a_new(target, NULL, &iso_dep_poll_a));
+    tag = &t4a->tag;
+
+    id = nfc_tag_add_initialized_handler(tag, test_tag_quit_loop_cb, loop);
+    test_run(&test_opt, loop);
+    nfc_tag_remove_handler(tag, id);
+
+    g_assert(tag->flags & NFC_TAG_FLAG_INITIALIZED);
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    g_assert(!test_target->cmd_resp->len);
+
+    nfc_tag_unref(tag);
+    nfc_target_unref(target);
+    g_byte_array_free(resp, TRUE);
+    g_main_loop_unref(loop);
+}
+
 /*==========================================================================*
  * apdu_ok
  *==========================================================================*/
@@ -1100,6 +1356,809 @@ test_apdu_fail(
     g_main_loop_unref(loop);
 }
 
+/*==========================================================================*
+ * apdu_chain
+ *==========================================================================*/
+
+static const guint8 test_chain_cmd_read[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x04
+};
+static const guint8 test_chain_cmd_get_response[] = {
+    0x00, 0xc0, 0x00, 0x00, 0x02
+};
+static const guint8 test_chain_cmd_read_short[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x02
+};
+static const guint8 test_chain_resp_more_data[] = {
+    0x01, 0x02, 0x61, 0x02
+};
+static const guint8 test_chain_resp_last[] = {
+    0x03, 0x04, 0x90, 0x00
+};
+static const guint8 test_chain_resp_wrong_le[] = {
+    0x6c, 0x02
+};
+static const guint8 test_chain_resp_short[] = {
+    0x01, 0x02, 0x90, 0x00
+};
+static const guint8 test_chain_data_full[] = {
+    0x01, 0x02, 0x03, 0x04
+};
+
+typedef struct test_apdu_chain {
+    GMainLoop* loop;
+    guint sw;
+    GByteArray* data;
+} TestApduChain;
+
+static
+void
+test_apdu_chain_done(
+    NfcTagType4* tag,
+    guint sw,  /* 16 bits (SW1 << 8)|SW2 */
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestApduChain* test = user_data;
+
+    test->sw = sw;
+    g_byte_array_set_size(test->data, 0);
+    g_byte_array_append(test->data, data, len);
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_apdu_chain(
+    void)
+{
+    NfcTarget* target = test_target_new_tech_with_data(NFC_TECHNOLOGY_B,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_more_data));
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcParamPollB poll_b;
+    NfcTagType4* t4b;
+    TestApduChain test;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, TRUE);
+    test.data = g_byte_array_new();
+
+    memset(&poll_b, 0, sizeof(poll_b));
+    poll_b.fsc = 0x0b; /* i.e. 256 */
+    t4b = NFC_TAG_T4(nfc_tag_t4b_new(target, &poll_b, NULL));
+    g_assert(NFC_IS_TAG_T4B(t4b));
+
+    /* Without the flag 61xx is passed to the caller as is */
+    g_assert(nfc_isodep_transmit2(t4b, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAGS_NONE, 0, NULL, test_apdu_chain_done, NULL,
+        &test));
+    test_run(&test_opt, test.loop);
+    g_assert(test.sw == 0x6102);
+    g_assert(test.data->len == 2);
+    g_assert(!test_target->cmd_resp->len);
+
+    /* 61xx followed by GET RESPONSE */
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_more_data));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_get_response),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_last));
+    g_assert(nfc_isodep_transmit2(t4b, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 2000, NULL, test_apdu_chain_done,
+        NULL, &test));
+    test_run(&test_opt, test.loop);
+    g_assert(test.sw == ISO_SW_OK);
+    g_assert(test.data->len == sizeof(test_chain_data_full));
+    g_assert(!memcmp(test.data->data, test_chain_data_full,
+        sizeof(test_chain_data_full)));
+    g_assert(!test_target->cmd_resp->len);
+
+    /* 6Cxx followed by a retry with the right Le */
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_wrong_le));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read_short),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_short));
+    g_assert(nfc_isodep_transmit2(t4b, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 0, NULL, test_apdu_chain_done,
+        NULL, &test));
+    test_run(&test_opt, test.loop);
+    g_assert(test.sw == ISO_SW_OK);
+    g_assert(test.data->len == 2);
+    g_assert(!test_target->cmd_resp->len);
+
+    /* GET RESPONSE failure */
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_more_data));
+    g_assert(nfc_isodep_transmit2(t4b, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 0, NULL, test_apdu_chain_done,
+        NULL, &test));
+    test_run(&test_opt, test.loop);
+    g_assert(test.sw == ISO_SW_IO_ERR);
+
+    nfc_tag_unref(NFC_TAG(t4b));
+    nfc_target_unref(target);
+    g_byte_array_free(test.data, TRUE);
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * apdu_chain_cancel
+ *==========================================================================*/
+
+typedef struct test_apdu_chain_cancel {
+    GMainLoop* loop;
+    NfcTagType4* t4;
+    guint id;
+    guint destroyed;
+} TestApduChainCancel;
+
+static
+void
+test_apdu_chain_cancel_unexpected(
+    NfcTagType4* tag,
+    guint sw,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    g_assert_not_reached();
+}
+
+static
+void
+test_apdu_chain_cancel_destroy(
+    void* user_data)
+{
+    TestApduChainCancel* test = user_data;
+
+    test->destroyed++;
+    g_main_loop_quit(test->loop);
+}
+
+static
+gboolean
+test_apdu_chain_cancel_check(
+    gpointer user_data)
+{
+    TestApduChainCancel* test = user_data;
+    NfcTarget* target = test->t4->tag.target;
+
+    if (test_target_tx_remaining(target) > 1) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    /* GET RESPONSE is being sent, the first command is long gone */
+    g_assert(!nfc_target_cancel_transmit(target, test->id));
+    g_assert(nfc_isodep_cancel(test->t4, test->id));
+    g_assert(!nfc_isodep_cancel(test->t4, test->id));
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+test_apdu_chain_cancel(
+    void)
+{
+    NfcTarget* target = test_target_new_tech_with_data(NFC_TECHNOLOGY_B,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_more_data));
+    NfcParamPollB poll_b;
+    TestApduChainCancel test;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, TRUE);
+    memset(&poll_b, 0, sizeof(poll_b));
+    poll_b.fsc = 0x0b; /* i.e. 256 */
+    test.t4 = NFC_TAG_T4(nfc_tag_t4b_new(target, &poll_b, NULL));
+
+    g_assert(!nfc_isodep_cancel(NULL, 1));
+    g_assert(!nfc_isodep_cancel(test.t4, 0));
+
+    /* Cancel the chain while GET RESPONSE is in flight */
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_get_response),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_last));
+    test.id = nfc_isodep_transmit2(test.t4, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 0, NULL,
+        test_apdu_chain_cancel_unexpected, test_apdu_chain_cancel_destroy,
+        &test);
+    g_assert(test.id);
+    g_idle_add_full(G_PRIORITY_DEFAULT, test_apdu_chain_cancel_check,
+        &test, NULL);
+    test_run(&test_opt, test.loop);
+    g_assert_cmpuint(test.destroyed, == ,1);
+
+    /* Pending chains are cancelled when the tag is gone */
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_chain_resp_more_data));
+    g_assert(nfc_isodep_transmit2(test.t4, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NFC_ISODEP_TX_FLAG_CHAIN_RESPONSE, 0, NULL,
+        test_apdu_chain_cancel_unexpected, test_apdu_chain_cancel_destroy,
+        &test));
+    nfc_tag_unref(NFC_TAG(test.t4));
+    g_assert_cmpuint(test.destroyed, == ,2);
+
+    nfc_target_unref(target);
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * apdu_pool
+ *==========================================================================*/
+
+#define TEST_APDU_POOL_COUNT (10)
+
+typedef struct test_apdu_pool {
+    GMainLoop* loop;
+    guint count;
+    guint target_allocs;
+    guint tag_allocs;
+} TestApduPool;
+
+static
+void
+test_apdu_pool_done(
+    NfcTagType4* tag,
+    guint sw,  /* 16 bits (SW1 << 8)|SW2 */
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestApduPool* test = user_data;
+    NfcTarget* target = tag->tag.target;
+
+    g_assert(sw == ISO_SW_OK);
+    test->count++;
+    if (test->count == 2) {
+        /* By now the pools have enough contexts */
+        test->target_allocs = nfc_target_alloc_count(target);
+        test->tag_allocs = nfc_tag_t4_alloc_count();
+    } else if (test->count > 2) {
+        g_assert(nfc_target_alloc_count(target) == test->target_allocs);
+        g_assert(nfc_tag_t4_alloc_count() == test->tag_allocs);
+    }
+    if (test->count < TEST_APDU_POOL_COUNT) {
+        /* Submit the next one from the completion callback */
+        g_assert(nfc_isodep_transmit(tag, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+            NULL, test_apdu_pool_done, NULL, test));
+    } else {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_apdu_pool(
+    void)
+{
+    NfcTarget* target = test_target_new_tech(NFC_TECHNOLOGY_B, 0);
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcParamPollB poll_b;
+    NfcTagType4* t4b;
+    TestApduPool test;
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, TRUE);
+    for (i = 0; i < TEST_APDU_POOL_COUNT; i++) {
+        test_target_add_data(target,
+            TEST_ARRAY_AND_SIZE(test_chain_cmd_read),
+            TEST_ARRAY_AND_SIZE(test_chain_resp_last));
+    }
+
+    memset(&poll_b, 0, sizeof(poll_b));
+    poll_b.fsc = 0x0b; /* i.e. 256 */
+    t4b = NFC_TAG_T4(nfc_tag_t4b_new(target, &poll_b, NULL));
+    g_assert(NFC_IS_TAG_T4B(t4b));
+
+    g_assert(nfc_isodep_transmit(t4b, 0x00, 0xb0, 0x00, 0x00, NULL, 4,
+        NULL, test_apdu_pool_done, NULL, &test));
+    test_run(&test_opt, test.loop);
+    g_assert(test.count == TEST_APDU_POOL_COUNT);
+    g_assert(!test_target->cmd_resp->len);
+
+    /* No allocations after the first two round trips */
+    g_assert(nfc_target_alloc_count(target) == test.target_allocs);
+    g_assert(nfc_tag_t4_alloc_count() == test.tag_allocs);
+
+    nfc_tag_unref(NFC_TAG(t4b));
+    nfc_target_unref(target);
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * write_ndef
+ *==========================================================================*/
+
+#define TEST_WRITE_MLC (0x34)
+
+static const guint8 test_write_resp_read_ndef_cc[] = {
+    0x00, 0x0f, 0x20, 0x00, 0x3b, 0x00, 0x34, /* Data */
+    /*                          MLc ^^    ^^ */
+    0x04, 0x06, 0xe1, 0x04, 0x0f, 0xff, 0x00,
+    0x00,
+    /* ^^ write access granted               */
+    0x90, 0x00                                /* SW1|SW2 */
+};
+static const guint8 test_write_ndef_short[] = {
+    0xd1, 0x01, 0x06, 0x54, 0x02, 0x65, 0x6e, /* Text record */
+    0x61, 0x62, 0x63
+};
+static const guint8 test_write_cmd_short[] = {
+    0x00, 0xd6, 0x00, 0x00, 0x0c,             /* CLA|INS|P1|P2|Lc  */
+    0x00, 0x0a,                               /* NLEN */
+    0xd1, 0x01, 0x06, 0x54, 0x02, 0x65, 0x6e, /* Data */
+    0x61, 0x62, 0x63
+};
+static const guint8 test_write_cmd_nlen_long[] = {
+    0x00, 0xd6, 0x00, 0x00, 0x02,             /* CLA|INS|P1|P2|Lc  */
+    0x00, 0x64                                /* NLEN */
+};
+static const guint8 test_write_resp_no_ef[] = { 0x69, 0x86 };
+
+typedef struct test_write_ndef {
+    GMainLoop* loop;
+    guint sw;
+} TestWriteNdef;
+
+static
+void
+test_write_ndef_done(
+    NfcTagType4* tag,
+    guint sw,
+    void* user_data)
+{
+    TestWriteNdef* test = user_data;
+
+    test->sw = sw;
+    g_main_loop_quit(test->loop);
+}
+
+static
+guint
+test_write_ndef_sync(
+    NfcTagType4* t4,
+    GBytes* ndef,
+    GMainLoop* loop)
+{
+    TestWriteNdef test;
+
+    test.loop = loop;
+    test.sw = ISO_SW_IO_ERR;
+    g_assert(nfc_tag_t4_write_ndef(t4, ndef, NULL, test_write_ndef_done,
+        NULL, &test));
+    test_run(&test_opt, loop);
+    return test.sw;
+}
+
+static
+NfcTagType4*
+test_write_ndef_tag(
+    NfcTarget* target,
+    const guint8* cc,
+    guint cc_len,
+    GMainLoop* loop)
+{
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcParamPollB poll_b;
+    NfcTagType4* t4b;
+    NfcTag* tag;
+    gulong id;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(test_init_data_success); i++) {
+        const GUtilData* data = test_init_data_success + i;
+
+        if (data->bytes == test_resp_read_ndef_cc) {
+            g_ptr_array_add(test_target->cmd_resp, gutil_data_new(cc, cc_len));
+        } else {
+            g_ptr_array_add(test_target->cmd_resp, gutil_data_copy(data));
+        }
+    }
+
+    memset(&poll_b, 0, sizeof(poll_b));
+    poll_b.fsc = 0x0b; /* i.e. 256 */
+    t4b = NFC_TAG_T4(nfc_tag_t4b_new(target, &poll_b, NULL));
+    tag = &t4b->tag;
+    id = nfc_tag_add_initialized_handler(tag, test_tag_quit_loop_cb, loop);
+    test_run(&test_opt, loop);
+    nfc_tag_remove_handler(tag, id);
+    g_assert(tag->flags & NFC_TAG_FLAG_INITIALIZED);
+    g_assert(tag->ndef);
+    g_assert(!test_target->cmd_resp->len);
+    return t4b;
+}
+
+static
+void
+test_write_ndef_read_only(
+    void)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcTarget* target = g_object_new(TEST_TYPE_TARGET2, NULL);
+    NfcTagType4* t4 = test_write_ndef_tag(target,
+        TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc), loop);
+    GBytes* ndef = g_bytes_new_static(TEST_ARRAY_AND_SIZE
+        (test_write_ndef_short));
+
+    /* Write access is not granted by the CC */
+    g_assert(!nfc_tag_t4_write_ndef(NULL, ndef, NULL, NULL, NULL, NULL));
+    g_assert(!nfc_tag_t4_write_ndef(t4, NULL, NULL, NULL, NULL, NULL));
+    g_assert(!nfc_tag_t4_write_ndef(t4, ndef, NULL, NULL, NULL, NULL));
+
+    g_bytes_unref(ndef);
+    nfc_tag_unref(&t4->tag);
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+}
+
+static
+void
+test_write_ndef(
+    void)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcTarget* target = g_object_new(TEST_TYPE_TARGET2, NULL);
+    TestTarget2* test = TEST_TARGET2(target);
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcTagType4* t4 = test_write_ndef_tag(target,
+        TEST_ARRAY_AND_SIZE(test_write_resp_read_ndef_cc), loop);
+    NfcTag* tag = &t4->tag;
+    GBytes* ndef_short = g_bytes_new_static(TEST_ARRAY_AND_SIZE
+        (test_write_ndef_short));
+    GByteArray* ndef_long = g_byte_array_new();
+    GByteArray* cmd = g_byte_array_new();
+    TestWriteNdef write;
+    GBytes* ndef;
+    GBytes* big;
+    guint8 hdr[5];
+    guint8 zero[2];
+    guint i;
+
+    /* 100 bytes long text record */
+    hdr[0] = 0xd1; hdr[1] = 0x01; hdr[2] = 96; hdr[3] = 0x54;
+    g_byte_array_append(ndef_long, hdr, 4);
+    hdr[0] = 0x02; hdr[1] = 0x65; hdr[2] = 0x6e;
+    g_byte_array_append(ndef_long, hdr, 3);
+    for (i = ndef_long->len; i < 100; i++) {
+        const guint8 c = 'a' + (i % 26);
+
+        g_byte_array_append(ndef_long, &c, 1);
+    }
+    ndef = g_bytes_new(ndef_long->data, ndef_long->len);
+
+    /* Too large for the NDEF file (NLEN + 0xfff > 0xfff) */
+    g_byte_array_set_size(cmd, 0xfff);
+    memset(cmd->data, 0, cmd->len);
+    big = g_bytes_new(cmd->data, cmd->len);
+    g_assert(!nfc_tag_t4_write_ndef(t4, big, NULL, NULL, NULL, NULL));
+    g_bytes_unref(big);
+
+    /* NDEF file is still selected, the message fits into one command */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_short),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(test_write_ndef_sync(t4, ndef_short, loop) == ISO_SW_OK);
+    g_assert(!test_target->cmd_resp->len);
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    g_assert(test->reactivations == 0);
+
+    /* Only one write at a time */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_short),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    write.loop = loop;
+    write.sw = ISO_SW_IO_ERR;
+    g_assert(nfc_tag_t4_write_ndef(t4, ndef_short, NULL, test_write_ndef_done,
+        NULL, &write));
+    g_assert(!nfc_tag_t4_write_ndef(t4, ndef_short, NULL, NULL, NULL, NULL));
+    test_run(&test_opt, loop);
+    g_assert(write.sw == ISO_SW_OK);
+    g_assert(!test_target->cmd_resp->len);
+
+    /* Zeroed NLEN and the first chunk, the second chunk, then NLEN */
+    zero[0] = zero[1] = 0;
+    g_byte_array_set_size(cmd, 0);
+    hdr[0] = 0x00; hdr[1] = 0xd6; hdr[2] = 0x00; hdr[3] = 0x00;
+    hdr[4] = TEST_WRITE_MLC;
+    g_byte_array_append(cmd, hdr, 5);
+    g_byte_array_append(cmd, zero, 2);
+    g_byte_array_append(cmd, ndef_long->data, TEST_WRITE_MLC - 2);
+    test_target_add_data(target, cmd->data, cmd->len,
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_byte_array_set_size(cmd, 0);
+    hdr[3] = TEST_WRITE_MLC;
+    hdr[4] = 102 - TEST_WRITE_MLC;
+    g_byte_array_append(cmd, hdr, 5);
+    g_byte_array_append(cmd, ndef_long->data + TEST_WRITE_MLC - 2,
+        102 - TEST_WRITE_MLC);
+    test_target_add_data(target, cmd->data, cmd->len,
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_nlen_long),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(test_write_ndef_sync(t4, ndef, loop) == ISO_SW_OK);
+    g_assert(!test_target->cmd_resp->len);
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+
+    /* NDEF file is no longer selected, the files get selected again */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_short),
+        TEST_ARRAY_AND_SIZE(test_write_resp_no_ef));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_short),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(test_write_ndef_sync(t4, ndef_short, loop) == ISO_SW_OK);
+    g_assert(!test_target->cmd_resp->len);
+    g_assert(test->reactivations == 0);
+
+    /* Talking to the tag resets it */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_mf),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(nfc_isodep_transmit(t4, 0x00, 0xa4, 0x00, 0x00, NULL, 0,
+        NULL, test_deferred_reset_done, NULL, loop));
+    test_run(&test_opt, loop);
+    g_assert(test->reactivations == 1);
+
+    /* Now the files have to be selected first, and the update fails */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_write_cmd_short),
+        TEST_ARRAY_AND_SIZE(test_resp_err));
+    g_assert(test_write_ndef_sync(t4, ndef_short, loop) == 0x6a00);
+    g_assert(!test_target->cmd_resp->len);
+    g_assert(tag->ndef); /* Nothing has been written */
+
+    /* The next APDU resets the tag again */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_mf),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(nfc_isodep_transmit(t4, 0x00, 0xa4, 0x00, 0x00, NULL, 0,
+        NULL, test_deferred_reset_done, NULL, loop));
+    test_run(&test_opt, loop);
+    g_assert(test->reactivations == 2);
+
+    /* Failure in the middle drops the NDEF */
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    test_target_add_data(target, TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef),
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_byte_array_set_size(cmd, 0);
+    hdr[3] = 0x00;
+    hdr[4] = TEST_WRITE_MLC;
+    g_byte_array_append(cmd, hdr, 5);
+    g_byte_array_append(cmd, zero, 2);
+    g_byte_array_append(cmd, ndef_long->data, TEST_WRITE_MLC - 2);
+    test_target_add_data(target, cmd->data, cmd->len,
+        TEST_ARRAY_AND_SIZE(test_resp_ok));
+    g_assert(test_write_ndef_sync(t4, ndef, loop) == ISO_SW_IO_ERR);
+    g_assert(!test_target->cmd_resp->len);
+    g_assert(!tag->ndef);
+
+    g_bytes_unref(ndef);
+    g_bytes_unref(ndef_short);
+    g_byte_array_free(ndef_long, TRUE);
+    g_byte_array_free(cmd, TRUE);
+    nfc_tag_unref(tag);
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * cache
+ *==========================================================================*/
+
+static const guint8 test_cache_uid[] = {
+    0x04, 0x9b, 0xfb, 0x4a, 0xeb, 0x2b, 0x80
+};
+static const guint8 test_cache_random_uid[] = {
+    0x08, 0x01, 0x02, 0x03
+};
+static const guint8 test_cache_mem_uid[] = {
+    0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06
+};
+#define TEST_CACHE_FILE "t4-049BFB4AEB2B80"
+#define TEST_CACHE_RANDOM_FILE "t4-08010203"
+#define TEST_CACHE_MEM_FILE "t4-04010203040506"
+
+static const GUtilData test_cache_data_hit[] = {
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len) }
+};
+
+static const GUtilData test_cache_data_changed[] = {
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_len) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_len_zero) }
+};
+
+static const GUtilData test_cache_data_stale[] = {
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_app) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_not_found) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_cc) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_select_ndef_ef) },
+    { TEST_ARRAY_AND_SIZE(test_resp_ok) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_head) },
+    { TEST_ARRAY_AND_SIZE(test_cmd_read_ndef_tail) },
+    { TEST_ARRAY_AND_SIZE(test_resp_read_ndef_tail) }
+};
+
+/* Runs the initialization and returns the tag */
+static
+NfcTag*
+test_cache_run(
+    const guint8* uid,
+    guint uid_len,
+    const GUtilData* script,
+    guint count)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcTarget* target = g_object_new(TEST_TYPE_TARGET2, NULL);
+    TestTarget* test_target = TEST_TARGET(target);
+    NfcParamIsoDepPollA iso_dep_poll_a;
+    NfcParamPollA poll_a;
+    NfcTag* tag;
+    gulong id;
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        g_ptr_array_add(test_target->cmd_resp, gutil_data_copy(script + i));
+    }
+
+    memset(&poll_a, 0, sizeof(poll_a));
+    poll_a.nfcid1.bytes = uid;
+    poll_a.nfcid1.size = uid_len;
+    memset(&iso_dep_poll_a, 0, sizeof(iso_dep_poll_a));
+    iso_dep_poll_a.fsc = 256;
+    target->technology = NFC_TECHNOLOGY_A;
+    tag = NFC_TAG(nfc_tag_t4a_new(target, &poll_a, &iso_dep_poll_a));
+
+    id = nfc_tag_add_initialized_handler(tag, test_tag_quit_loop_cb, loop);
+    test_run(&test_opt, loop);
+    nfc_tag_remove_handler(tag, id);
+
+    g_assert(tag->flags & NFC_TAG_FLAG_INITIALIZED);
+    g_assert(!test_target->cmd_resp->len);
+
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+    return tag;
+}
+
+static
+void
+test_cache(
+    void)
+{
+    char* dir = g_dir_make_tmp("test_tag_t4_cache_XXXXXX", NULL);
+    char* file = g_build_filename(dir, NFC_TAG_CACHE_SUBDIR,
+        TEST_CACHE_FILE, NULL);
+    char* random_file = g_build_filename(dir, NFC_TAG_CACHE_SUBDIR,
+        TEST_CACHE_RANDOM_FILE, NULL);
+    NfcTag* tag;
+
+    nfc_tag_cache_configure(dir, 0);
+
+    /* The first time NDEF is read and stored in the cache */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    g_assert(g_file_test(file, G_FILE_TEST_IS_REGULAR));
+    nfc_tag_unref(tag);
+
+    /* The second time CC and NDEF come from the cache */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_uid),
+        TEST_ARRAY_AND_SIZE(test_cache_data_hit));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+
+    /* NLEN doesn't match, NDEF is read again (and it's empty) */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_uid),
+        TEST_ARRAY_AND_SIZE(test_cache_data_changed));
+    g_assert(!tag->ndef);
+    nfc_tag_unref(tag);
+
+    /* Empty NDEF is cached too */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_uid),
+        TEST_ARRAY_AND_SIZE(test_cache_data_changed));
+    g_assert(!tag->ndef);
+    nfc_tag_unref(tag);
+
+    /* NDEF file is not where the cache says, start from scratch */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_uid),
+        TEST_ARRAY_AND_SIZE(test_cache_data_stale));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+
+    /* Random UIDs are not cached */
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_random_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    g_assert(!g_file_test(random_file, G_FILE_TEST_EXISTS));
+    nfc_tag_unref(tag);
+
+    nfc_tag_cache_configure(NULL, 0);
+    test_rmdir(dir);
+    g_free(random_file);
+    g_free(file);
+    g_free(dir);
+}
+
+/*==========================================================================*
+ * cache_mem
+ *==========================================================================*/
+
+static
+void
+test_cache_mem(
+    void)
+{
+    char* dir = g_dir_make_tmp("test_tag_t4_cache_XXXXXX", NULL);
+    char* file = g_build_filename(dir, NFC_TAG_CACHE_SUBDIR,
+        TEST_CACHE_MEM_FILE, NULL);
+    NfcTag* tag;
+
+    /* Nothing is cached by default, not even in memory */
+    nfc_tag_cache_configure(NULL, 0);
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_mem_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_mem_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+
+    /* Once the cache is configured, the tag is remembered */
+    nfc_tag_cache_configure(dir, 0);
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_mem_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    g_assert(g_file_test(file, G_FILE_TEST_IS_REGULAR));
+    nfc_tag_unref(tag);
+
+    /* Even if the file is gone, the entry is still in memory */
+    g_assert(!g_unlink(file));
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_mem_uid),
+        TEST_ARRAY_AND_SIZE(test_cache_data_hit));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+
+    /* Memory is cleared when the cache gets reconfigured */
+    nfc_tag_cache_configure(NULL, 0);
+    g_unlink(file);
+    nfc_tag_cache_configure(dir, 0);
+    tag = test_cache_run(TEST_ARRAY_AND_SIZE(test_cache_mem_uid),
+        TEST_ARRAY_AND_SIZE(test_init_data_success));
+    g_assert(NFC_IS_NDEF_REC_T(tag->ndef));
+    nfc_tag_unref(tag);
+
+    nfc_tag_cache_configure(NULL, 0);
+    test_rmdir(dir);
+    g_free(file);
+    g_free(dir);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -1133,7 +2192,16 @@ int main(int argc, char* argv[])
         g_test_add_data_func(path, test, test_apdu_ok);
         g_free(path);
     }
+    g_test_add_func(TEST_("deferred_reset"), test_deferred_reset);
+    g_test_add_func(TEST_("init_ext_le"), test_init_ext_le);
     g_test_add_func(TEST_("apdu_fail"), test_apdu_fail);
+    g_test_add_func(TEST_("apdu_chain"), test_apdu_chain);
+    g_test_add_func(TEST_("apdu_chain_cancel"), test_apdu_chain_cancel);
+    g_test_add_func(TEST_("apdu_pool"), test_apdu_pool);
+    g_test_add_func(TEST_("write_ndef"), test_write_ndef);
+    g_test_add_func(TEST_("write_ndef_read_only"), test_write_ndef_read_only);
+    g_test_add_func(TEST_("cache"), test_cache);
+    g_test_add_func(TEST_("cache_mem"), test_cache_mem);
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
@@ -163,6 +163,7 @@ typedef struct test_target {
     gboolean deactivated;
     gboolean fail_transmit;
     guint transmit_id;
+    guint direct;
     GSList* transmit_responses;
     guint succeeded;
     guint failed;
@@ -200,6 +201,10 @@ test_target_transmit_cb(
     } else {
         nfc_target_transmit_done(target, NFC_TRANSMIT_STATUS_OK, NULL, 0);
     }
+    if (self->transmit_id) {
+        /* The next request has been submitted by transmit_done() */
+        self->direct++;
+    }
     return G_SOURCE_REMOVE;
 }
 
@@ -369,6 +374,187 @@ test_target2_class_init(
     klass->reactivate = test_target2_reactivate;
 }
 
+/*==========================================================================*
+ * Test target with transmit_bytes
+ *==========================================================================*/
+
+typedef TestTargetClass TestTarget3Class;
+typedef struct test_target3 {
+    TestTarget parent;
+    GPtrArray* sent;
+} TestTarget3;
+
+G_DEFINE_TYPE(TestTarget3, test_target3, TEST_TYPE_TARGET)
+#define TEST_TYPE_TARGET3 (test_target3_get_type())
+#define TEST_TARGET3(obj) (G_TYPE_CHECK_INSTANCE_CAST(obj, \
+        TEST_TYPE_TARGET3, TestTarget3))
+
+static
+TestTarget3*
+test_target3_new(
+    void)
+{
+    return g_object_new(TEST_TYPE_TARGET3, NULL);
+}
+
+static
+gboolean
+test_target3_transmit_bytes(
+    NfcTarget* target,
+    GBytes* bytes)
+{
+    TestTarget3* test = TEST_TARGET3(target);
+    gsize size;
+    const void* data = g_bytes_get_data(bytes, &size);
+
+    g_ptr_array_add(test->sent, g_bytes_ref(bytes));
+    return test_target_transmit(target, data, size);
+}
+
+static
+void
+test_target3_init(
+    TestTarget3* self)
+{
+    self->sent = g_ptr_array_new_with_free_func((GDestroyNotify)
+        g_bytes_unref);
+}
+
+static
+void
+test_target3_finalize(
+    GObject* object)
+{
+    TestTarget3* test = TEST_TARGET3(object);
+
+    g_ptr_array_free(test->sent, TRUE);
+    G_OBJECT_CLASS(test_target3_parent_class)->finalize(object);
+}
+
+static
+void
+test_target3_class_init(
+    NfcTargetClass* klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = test_target3_finalize;
+    klass->transmit_bytes = test_target3_transmit_bytes;
+}
+
+/*==========================================================================*
+ * Test target with transmit_batch
+ *==========================================================================*/
+
+typedef TestTargetClass TestTarget4Class;
+typedef struct test_target4 {
+    TestTarget parent;
+    GPtrArray* batch;
+    guint batch_calls;
+    guint batch_id;
+    gboolean batch_cancelled;
+} TestTarget4;
+
+G_DEFINE_TYPE(TestTarget4, test_target4, TEST_TYPE_TARGET)
+#define TEST_TYPE_TARGET4 (test_target4_get_type())
+#define TEST_TARGET4(obj) (G_TYPE_CHECK_INSTANCE_CAST(obj, \
+        TEST_TYPE_TARGET4, TestTarget4))
+
+static
+TestTarget4*
+test_target4_new(
+    void)
+{
+    return g_object_new(TEST_TYPE_TARGET4, NULL);
+}
+
+static
+gboolean
+test_target4_batch_done(
+    gpointer user_data)
+{
+    TestTarget4* test = TEST_TARGET4(user_data);
+    NfcTarget* target = &test->parent.target;
+    GPtrArray* batch = test->batch;
+    guint i;
+
+    /* Echo the frames back */
+    test->batch_id = 0;
+    test->batch = NULL;
+    test->batch_cancelled = FALSE;
+    nfc_target_ref(target);
+    for (i = 0; i < batch->len && !test->batch_cancelled; i++) {
+        gsize size;
+        const void* data = g_bytes_get_data(batch->pdata[i], &size);
+
+        nfc_target_transmit_done(target, NFC_TRANSMIT_STATUS_OK, data, size);
+    }
+    g_ptr_array_free(batch, TRUE);
+    nfc_target_unref(target);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+test_target4_transmit_batch(
+    NfcTarget* target,
+    GBytes* const* frames,
+    guint count)
+{
+    TestTarget4* test = TEST_TARGET4(target);
+    guint i;
+
+    g_assert(!test->batch_id);
+    test->batch_calls++;
+    test->batch = g_ptr_array_new_with_free_func((GDestroyNotify)
+        g_bytes_unref);
+    for (i = 0; i < count; i++) {
+        g_ptr_array_add(test->batch, g_bytes_ref(frames[i]));
+    }
+    test->batch_id = g_idle_add(test_target4_batch_done, test);
+    return TRUE;
+}
+
+static
+void
+test_target4_cancel_transmit(
+    NfcTarget* target)
+{
+    TEST_TARGET4(target)->batch_cancelled = TRUE;
+    NFC_TARGET_CLASS(test_target4_parent_class)->cancel_transmit(target);
+}
+
+static
+void
+test_target4_init(
+    TestTarget4* self)
+{
+}
+
+static
+void
+test_target4_finalize(
+    GObject* object)
+{
+    TestTarget4* test = TEST_TARGET4(object);
+
+    if (test->batch_id) {
+        g_source_remove(test->batch_id);
+    }
+    if (test->batch) {
+        g_ptr_array_free(test->batch, TRUE);
+    }
+    G_OBJECT_CLASS(test_target4_parent_class)->finalize(object);
+}
+
+static
+void
+test_target4_class_init(
+    NfcTargetClass* klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = test_target4_finalize;
+    klass->transmit_batch = test_target4_transmit_batch;
+    klass->cancel_transmit = test_target4_cancel_transmit;
+}
+
 /*==========================================================================*
  * null
  *==========================================================================*/
@@ -381,6 +567,16 @@ test_null(
     /* Public interfaces are NULL tolerant */
     g_assert(!nfc_target_ref(NULL));
     g_assert(!nfc_target_transmit(NULL, NULL, 0, NULL, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit_bytes(NULL, NULL, NULL, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit_bytes_full(NULL, NULL, NULL,
+        NFC_TARGET_PRIORITY_NORMAL, 0, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit2(NULL, NULL, 0, NULL, 0, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit_timeout(NULL));
+    g_assert(!nfc_target_transmit_full(NULL, NULL, 0, NULL,
+        NFC_TARGET_PRIORITY_NORMAL, 0, NULL, NULL, NULL));
+    g_assert(!nfc_target_queue_depth(NULL, NFC_TARGET_PRIORITY_NORMAL));
+    g_assert(!nfc_target_stats(NULL));
+    g_assert(!nfc_target_transmit_batch(NULL, NULL, 0, NULL, NULL, NULL));
     g_assert(!nfc_target_add_gone_handler(NULL, NULL, NULL));
     g_assert(!nfc_target_add_sequence_handler(NULL, NULL, NULL));
     g_assert(!nfc_target_generate_id(NULL));
@@ -392,6 +588,7 @@ test_null(
     nfc_target_remove_handler(NULL, 0);
     g_assert(!nfc_target_cancel_transmit(NULL, 0));
     nfc_target_transmit_done(NULL, NFC_TRANSMIT_STATUS_ERROR, NULL, 0);
+    nfc_target_set_direct_continuation(NULL, FALSE);
     nfc_target_reactivated(NULL);
     nfc_target_gone(NULL);
     nfc_target_unref(NULL);
@@ -519,6 +716,369 @@ test_transmit_ok(
     g_main_loop_unref(loop);
 }
 
+/*==========================================================================*
+ * transmit_bytes
+ *==========================================================================*/
+
+static
+void
+test_transmit_bytes(
+    void)
+{
+    static const guint8 data1[] = { 0x01 };
+    static const guint8 data2[] = { 0x01, 0x02 };
+    static const guint8 data3[] = { 0x01, 0x02, 0x03 };
+    GUtilData resp1, resp2;
+    TestTarget3* test3 = test_target3_new();
+    TestTarget* test = &test3->parent;
+    NfcTarget* target = &test->target;
+    GBytes* bytes1 = g_bytes_new_static(data1, sizeof(data1));
+    GBytes* bytes2 = g_bytes_new(data2, sizeof(data2));
+    GBytes* sent;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+
+    if (!(test_opt.flags & TEST_FLAG_DEBUG)) {
+        nfc_target_set_transmit_timeout(target, TEST_TIMEOUT_SEC * 1000);
+    }
+
+    TEST_BYTES_SET(resp1, data1);
+    TEST_BYTES_SET(resp2, data2);
+    test->transmit_responses = g_slist_append(g_slist_append(
+        test->transmit_responses,
+        test_transmit_response_new_from_bytes(&resp1)),
+        test_transmit_response_new_from_bytes(&resp2));
+
+    /* Missing data and invalid priority */
+    g_assert(!nfc_target_transmit_bytes(target, NULL, NULL, NULL, NULL,
+        NULL));
+    g_assert(!nfc_target_transmit_bytes_full(target, bytes1, NULL,
+        (NFC_TARGET_PRIORITY)(-1), 0, NULL, NULL, NULL));
+
+    /*
+     * The first one gets submitted right away, the others are queued.
+     * The high priority one overtakes the plain data.
+     */
+    g_assert(nfc_target_transmit_bytes(target, bytes1, NULL,
+        test_transmit_ok_resp, test_clear_bytes, &resp1));
+    g_assert(nfc_target_transmit(target, data3, sizeof(data3), NULL, NULL,
+        test_quit_loop, loop));
+    g_assert(nfc_target_transmit_bytes_full(target, bytes2, NULL,
+        NFC_TARGET_PRIORITY_HIGH, 0, test_transmit_ok_resp,
+        test_clear_bytes, &resp2));
+    g_bytes_unref(bytes1);
+    g_bytes_unref(bytes2);
+
+    test_run(&test_opt, loop);
+
+    g_assert(test->succeeded == 2);
+    g_assert(!resp1.bytes);
+    g_assert(!resp2.bytes);
+
+    /* GBytes have been passed through as is, without copying */
+    g_assert_cmpuint(test3->sent->len, == ,3);
+    g_assert(test3->sent->pdata[0] == bytes1);
+    g_assert(test3->sent->pdata[1] == bytes2);
+
+    /* Plain data has been wrapped */
+    sent = test3->sent->pdata[2];
+    g_assert_cmpuint(g_bytes_get_size(sent), == ,sizeof(data3));
+    g_assert(!memcmp(g_bytes_get_data(sent, NULL), data3, sizeof(data3)));
+
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * transmit_pool
+ *==========================================================================*/
+
+#define TEST_TRANSMIT_POOL_COUNT (10)
+
+typedef struct test_transmit_pool {
+    GMainLoop* loop;
+    GPtrArray* sent;
+    guint count;
+    guint allocs;
+} TestTransmitPool;
+
+static
+void
+test_transmit_pool_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    static const guint8 cmd[] = { 0x01 };
+    TestTransmitPool* test = user_data;
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    if (test->sent) {
+        /* Let the frame buffers go */
+        g_ptr_array_set_size(test->sent, 0);
+    }
+    test->count++;
+    if (test->count == 2) {
+        /* By now the pool has enough requests */
+        test->allocs = nfc_target_alloc_count(target);
+        g_assert(test->allocs);
+    } else if (test->count > 2) {
+        g_assert_cmpuint(nfc_target_alloc_count(target), == ,test->allocs);
+    }
+    if (test->count < TEST_TRANSMIT_POOL_COUNT) {
+        /* Submit the next one from the completion callback */
+        g_assert(nfc_target_transmit(target, cmd, sizeof(cmd), NULL,
+            test_transmit_pool_resp, NULL, test));
+    } else {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_transmit_pool_run(
+    NfcTarget* target,
+    GPtrArray* sent)
+{
+    static const guint8 cmd[] = { 0x01 };
+    TestTransmitPool pool;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.loop = g_main_loop_new(NULL, TRUE);
+    pool.sent = sent;
+    g_assert(!nfc_target_alloc_count(target));
+
+    g_assert(nfc_target_transmit(target, cmd, sizeof(cmd), NULL,
+        test_transmit_pool_resp, NULL, &pool));
+    test_run(&test_opt, pool.loop);
+
+    /* No allocations after the first two round trips */
+    g_assert_cmpuint(pool.count, == ,TEST_TRANSMIT_POOL_COUNT);
+    g_assert_cmpuint(nfc_target_alloc_count(target), == ,pool.allocs);
+    g_main_loop_unref(pool.loop);
+}
+
+static
+void
+test_transmit_pool(
+    void)
+{
+    static const guint8 cmd[] = { 0x02 };
+    TestTarget* test = test_target_new();
+    TestTarget3* test3 = test_target3_new();
+    GBytes* held;
+
+    g_assert(!nfc_target_alloc_count(NULL));
+    test_transmit_pool_run(&test->target, NULL);
+    nfc_target_unref(&test->target);
+
+    /* Frame copies made for transmit_bytes are recycled too */
+    test_transmit_pool_run(&test3->parent.target, test3->sent);
+
+    /* And may outlive the target */
+    g_assert(nfc_target_transmit(&test3->parent.target, cmd, sizeof(cmd),
+        NULL, NULL, NULL, NULL));
+    g_assert_cmpuint(test3->sent->len, == ,1);
+    held = g_bytes_ref(g_ptr_array_index(test3->sent, 0));
+    nfc_target_unref(&test3->parent.target);
+    g_assert_cmpuint(g_bytes_get_size(held), == ,sizeof(cmd));
+    g_assert(!memcmp(g_bytes_get_data(held, NULL), cmd, sizeof(cmd)));
+    g_bytes_unref(held);
+}
+
+/*==========================================================================*
+ * transmit_timeout
+ *==========================================================================*/
+
+static
+void
+test_transmit_timeout(
+    void)
+{
+    static const guint8 data[] = { 0x01 };
+    TestTarget* test = test_target_new();
+    NfcTarget* target = &test->target;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    guint ms;
+
+    /* Default timeout is used until something gets measured */
+    g_assert_cmpuint(nfc_target_transmit_timeout(target), == ,500);
+    nfc_target_set_transmit_timeout(target, 1000);
+    g_assert_cmpuint(nfc_target_transmit_timeout(target), == ,1000);
+    nfc_target_set_transmit_timeout(target, 0);
+    g_assert_cmpuint(nfc_target_transmit_timeout(target), == ,0);
+    nfc_target_set_transmit_timeout(target, -1);
+    g_assert_cmpuint(nfc_target_transmit_timeout(target), == ,500);
+
+    /* Fast responses shrink the timeout below the initial default */
+    g_assert(nfc_target_transmit(target, data, sizeof(data), NULL, NULL,
+        NULL, NULL));
+    g_assert(nfc_target_transmit2(target, data, sizeof(data), NULL, 5000,
+        NULL, NULL, NULL));
+    g_assert(nfc_target_transmit(target, data, sizeof(data), NULL, NULL,
+        test_quit_loop, loop));
+
+    test_run(&test_opt, loop);
+
+    ms = nfc_target_transmit_timeout(target);
+    GDEBUG("Adaptive timeout %u ms", ms);
+    g_assert_cmpuint(ms, < ,500);
+    g_assert_cmpuint(ms, >= ,100);
+
+    /* Fixed timeout is not affected by measurements */
+    nfc_target_set_transmit_timeout(target, 1000);
+    g_assert_cmpuint(nfc_target_transmit_timeout(target), == ,1000);
+
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * transmit_batch
+ *==========================================================================*/
+
+typedef struct test_batch {
+    GMainLoop* loop;
+    GString* order;
+    guint cancel_id;
+} TestBatch;
+
+static
+void
+test_batch_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestBatch* test = g_object_get_data(G_OBJECT(target), "test-batch");
+    const char* tag = user_data;
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_string_append(test->order, tag);
+    if (test->cancel_id) {
+        g_assert(nfc_target_cancel_transmit(target, test->cancel_id));
+        test->cancel_id = 0;
+    }
+}
+
+static
+void
+test_batch_run(
+    NfcTarget* target,
+    gboolean cancel,
+    const char* expected)
+{
+    static const guint8 d1[] = { 0x01 };
+    static const guint8 d2[] = { 0x01, 0x02 };
+    static const guint8 d3[] = { 0x01, 0x02, 0x03 };
+    NfcTargetBatchFrame frames[3];
+    TestBatch batch;
+    guint id;
+
+    memset(&batch, 0, sizeof(batch));
+    memset(frames, 0, sizeof(frames));
+    batch.loop = g_main_loop_new(NULL, TRUE);
+    batch.order = g_string_new(NULL);
+    g_object_set_data(G_OBJECT(target), "test-batch", &batch);
+    nfc_target_set_transmit_timeout(target, 0);
+
+    frames[0].data = d1;
+    frames[0].len = sizeof(d1);
+    frames[0].complete = test_batch_resp;
+    frames[0].user_data = "a";
+    frames[1].data = d2;
+    frames[1].len = sizeof(d2);
+    frames[1].complete = test_batch_resp;
+    frames[1].user_data = "b";
+    frames[2].data = d3;
+    frames[2].len = sizeof(d3);
+    frames[2].complete = test_batch_resp;
+    frames[2].user_data = "c";
+
+    g_assert(!nfc_target_transmit_batch(target, NULL, 1, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit_batch(target, frames, 0, NULL, NULL, NULL));
+    id = nfc_target_transmit_batch(target, frames, G_N_ELEMENTS(frames),
+        NULL, test_quit_loop, batch.loop);
+    g_assert(id);
+    if (cancel) {
+        batch.cancel_id = id;
+    }
+
+    test_run(&test_opt, batch.loop);
+
+    g_assert_cmpstr(batch.order->str, == ,expected);
+    g_object_set_data(G_OBJECT(target), "test-batch", NULL);
+    g_string_free(batch.order, TRUE);
+    g_main_loop_unref(batch.loop);
+}
+
+static
+void
+test_batch_not_reached(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    g_assert_not_reached();
+}
+
+static
+void
+test_batch_destroy_not_reached(
+    void* user_data)
+{
+    g_assert_not_reached();
+}
+
+static
+void
+test_batch_fail(
+    NfcTarget* target)
+{
+    static const guint8 d1[] = { 0x01 };
+    NfcTargetBatchFrame frames[2];
+
+    memset(frames, 0, sizeof(frames));
+    frames[0].data = frames[1].data = d1;
+    frames[0].len = frames[1].len = sizeof(d1);
+    frames[0].complete = frames[1].complete = test_batch_not_reached;
+
+    /* Nothing is called if the batch fails to submit */
+    g_assert(!nfc_target_transmit_batch(target, frames,
+        G_N_ELEMENTS(frames), NULL, test_batch_destroy_not_reached, NULL));
+}
+
+static
+void
+test_transmit_batch(
+    void)
+{
+    TestTarget* test = test_target_new();
+    TestTarget4* test4 = test_target4_new();
+
+    /* Sequential fallback */
+    test_batch_run(&test->target, FALSE, "abc");
+    test_batch_run(&test->target, TRUE, "a");
+
+    /* Real thing */
+    test_batch_run(&test4->parent.target, FALSE, "abc");
+    g_assert_cmpuint(test4->batch_calls, == ,1);
+    test_batch_run(&test4->parent.target, TRUE, "a");
+    g_assert_cmpuint(test4->batch_calls, == ,2);
+
+    /* Submission failure */
+    test->fail_transmit = TRUE;
+    test_batch_fail(&test->target);
+
+    nfc_target_unref(&test->target);
+    nfc_target_unref(&test4->parent.target);
+}
+
 /*==========================================================================*
  * transmit_fail
  *==========================================================================*/
@@ -561,7 +1121,8 @@ test_transmit_fail(
     GUtilData resp1, resp2, resp3;
     TestTarget* test = test_target_new();
     NfcTarget* target = &test->target;
-    guint id1, id2, id3, id4;
+    const NfcTargetStats* stats;
+    guint id1, id2, id3, id4, i, total = 0;
     GMainLoop* loop = g_main_loop_new(NULL, TRUE);
 
     if (!(test_opt.flags & TEST_FLAG_DEBUG)) {
@@ -598,6 +1159,18 @@ test_transmit_fail(
     g_assert(!resp2.bytes);
     g_assert(!resp3.bytes);
 
+    /* The last 3 requests fail to submit and have no latency */
+    stats = nfc_target_stats(target);
+    g_assert_cmpuint(stats->transmit.ok, == ,1);
+    g_assert_cmpuint(stats->transmit.errors, == ,3);
+    g_assert_cmpuint(stats->transmit.timeouts, == ,0);
+    g_assert_cmpuint(stats->transmit.cancelled, == ,0);
+    g_assert_cmpuint(stats->max_queue_depth, == ,3);
+    for (i = 0; i < NFC_TARGET_LATENCY_BUCKETS; i++) {
+        total += stats->transmit.latency[i];
+    }
+    g_assert_cmpuint(total, == ,1);
+
     nfc_target_unref(target);
     g_main_loop_unref(loop);
 }
@@ -634,6 +1207,7 @@ test_transmit_cancel(
     g_assert(nfc_target_cancel_transmit(target, id1));
     g_assert(nfc_target_cancel_transmit(target, id2));
     g_assert(!nfc_target_cancel_transmit(target, id1));
+    g_assert_cmpuint(nfc_target_stats(target)->transmit.cancelled, == ,4);
 
     /* This is a wrong call but it will be ignored: */
     nfc_target_transmit_done(target, NFC_TRANSMIT_STATUS_OK, NULL, 0);
@@ -815,6 +1389,240 @@ test_sequence_ok(
     g_main_loop_unref(loop);
 }
 
+/*==========================================================================*
+ * direct_continuation
+ *==========================================================================*/
+
+static
+guint
+test_direct_continuation_run(
+    gboolean direct,
+    gboolean sequence)
+{
+    TestTarget* test = test_target_new();
+    NfcTarget* target = &test->target;
+    GMainLoop* loop = g_main_loop_new(NULL, TRUE);
+    NfcTargetSequence* seq = sequence ? nfc_target_sequence_new(target) :
+        NULL;
+    guint count;
+
+    nfc_target_set_transmit_timeout(target, 0);
+    nfc_target_set_direct_continuation(target, direct);
+    g_assert(nfc_target_transmit(target, NULL, 0, seq, NULL, NULL, NULL));
+    g_assert(nfc_target_transmit(target, NULL, 0, seq, NULL, NULL, NULL));
+    g_assert(nfc_target_transmit(target, NULL, 0, seq, NULL,
+        test_quit_loop, loop));
+    test_run(&test_opt, loop);
+
+    count = test->direct;
+    nfc_target_sequence_unref(seq);
+    nfc_target_unref(target);
+    g_main_loop_unref(loop);
+    return count;
+}
+
+static
+void
+test_direct_continuation(
+    void)
+{
+    /* Off by default, and only applies to the active sequence */
+    g_assert(test_direct_continuation_run(FALSE, TRUE) == 0);
+    g_assert(test_direct_continuation_run(TRUE, FALSE) == 0);
+    g_assert(test_direct_continuation_run(TRUE, TRUE) == 2);
+}
+
+/*==========================================================================*
+ * sequence_cancel
+ *==========================================================================*/
+
+typedef struct test_sequence_order {
+    GMainLoop* loop;
+    NfcTargetSequence* seq;
+    GString* order;
+} TestSequenceOrder;
+
+typedef struct test_sequence_order_req {
+    TestSequenceOrder* test;
+    char tag;
+} TestSequenceOrderReq;
+
+static
+void
+test_sequence_order_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestSequenceOrderReq* req = user_data;
+    TestSequenceOrder* test = req->test;
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_string_append_c(test->order, req->tag);
+    if (req->tag == 'D') {
+        /* Done with the sequence */
+        nfc_target_sequence_free(test->seq);
+        test->seq = NULL;
+    } else if (req->tag == 'E') {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_sequence_cancel(
+    void)
+{
+    static const guint8 data[] = { 0x01 };
+    TestTarget* test = test_target_new();
+    NfcTarget* target = &test->target;
+    TestSequenceOrder order;
+    TestSequenceOrderReq a, b, c, d, e, f;
+    guint id_c, id_f;
+
+    memset(&order, 0, sizeof(order));
+    order.loop = g_main_loop_new(NULL, TRUE);
+    order.order = g_string_new(NULL);
+    order.seq = nfc_target_sequence_new(target);
+    a.test = b.test = c.test = d.test = e.test = f.test = &order;
+    a.tag = 'A'; b.tag = 'B'; c.tag = 'C';
+    d.tag = 'D'; e.tag = 'E'; f.tag = 'F';
+    nfc_target_set_transmit_timeout(target, 0);
+
+    /* A, E and F wait for the sequence to finish, B gets submitted */
+    g_assert(nfc_target_transmit(target, data, sizeof(data), NULL,
+        test_sequence_order_resp, NULL, &a));
+    g_assert(nfc_target_transmit(target, data, sizeof(data), order.seq,
+        test_sequence_order_resp, NULL, &b));
+    id_f = nfc_target_transmit(target, data, sizeof(data), NULL,
+        test_sequence_order_resp, NULL, &f);
+    id_c = nfc_target_transmit(target, data, sizeof(data), order.seq,
+        test_sequence_order_resp, NULL, &c);
+    g_assert(nfc_target_transmit(target, data, sizeof(data), order.seq,
+        test_sequence_order_resp, NULL, &d));
+    g_assert(nfc_target_transmit(target, data, sizeof(data), NULL,
+        test_sequence_order_resp, NULL, &e));
+    g_assert(id_c);
+    g_assert(id_f);
+
+    /* Cancel requests in the middle of both queues */
+    g_assert(nfc_target_cancel_transmit(target, id_c));
+    g_assert(nfc_target_cancel_transmit(target, id_f));
+    g_assert(!nfc_target_cancel_transmit(target, id_c));
+    g_assert(!nfc_target_cancel_transmit(target, id_f));
+
+    test_run(&test_opt, order.loop);
+
+    g_assert_cmpstr(order.order->str, == ,"BDAE");
+    g_assert(!order.seq);
+
+    nfc_target_unref(target);
+    g_string_free(order.order, TRUE);
+    g_main_loop_unref(order.loop);
+}
+
+/*==========================================================================*
+ * priority
+ *==========================================================================*/
+
+typedef struct test_priority {
+    GMainLoop* loop;
+    GString* order;
+    const char* expected;
+} TestPriority;
+
+typedef struct test_priority_req {
+    TestPriority* test;
+    char tag;
+} TestPriorityReq;
+
+static
+void
+test_priority_resp(
+    NfcTarget* target,
+    NFC_TRANSMIT_STATUS status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestPriorityReq* req = user_data;
+    TestPriority* test = req->test;
+
+    g_assert(status == NFC_TRANSMIT_STATUS_OK);
+    g_string_append_c(test->order, req->tag);
+    if (test->order->len == strlen(test->expected)) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_priority(
+    void)
+{
+    static const guint8 data[] = { 0x01 };
+    TestTarget* test = test_target_new();
+    NfcTarget* target = &test->target;
+    TestPriority prio;
+    TestPriorityReq normal, low[2], high[8];
+    guint i;
+
+    memset(&prio, 0, sizeof(prio));
+    prio.loop = g_main_loop_new(NULL, TRUE);
+    prio.order = g_string_new(NULL);
+
+    /*
+     * Low priority requests may be overtaken by high priority ones
+     * but only so many times in a row.
+     */
+    prio.expected = "NHHHHLHHHHL";
+    nfc_target_set_transmit_timeout(target, 0);
+
+    g_assert(!nfc_target_transmit_full(target, data, sizeof(data), NULL,
+        (NFC_TARGET_PRIORITY)-1, 0, NULL, NULL, NULL));
+    g_assert(!nfc_target_transmit_full(target, data, sizeof(data), NULL,
+        NFC_TARGET_PRIORITY_LOW + 1, 0, NULL, NULL, NULL));
+    g_assert(!nfc_target_queue_depth(target, NFC_TARGET_PRIORITY_LOW + 1));
+
+    /* This one gets submitted right away */
+    normal.test = &prio;
+    normal.tag = 'N';
+    g_assert(nfc_target_transmit(target, data, sizeof(data), NULL,
+        test_priority_resp, NULL, &normal));
+
+    for (i = 0; i < G_N_ELEMENTS(low); i++) {
+        low[i].test = &prio;
+        low[i].tag = 'L';
+        g_assert(nfc_target_transmit_full(target, data, sizeof(data), NULL,
+            NFC_TARGET_PRIORITY_LOW, 0, test_priority_resp, NULL, low + i));
+    }
+    for (i = 0; i < G_N_ELEMENTS(high); i++) {
+        high[i].test = &prio;
+        high[i].tag = 'H';
+        g_assert(nfc_target_transmit_full(target, data, sizeof(data), NULL,
+            NFC_TARGET_PRIORITY_HIGH, 0, test_priority_resp, NULL, high + i));
+    }
+
+    g_assert_cmpuint(nfc_target_queue_depth(target,
+        NFC_TARGET_PRIORITY_HIGH), == ,G_N_ELEMENTS(high));
+    g_assert_cmpuint(nfc_target_queue_depth(target,
+        NFC_TARGET_PRIORITY_NORMAL), == ,0);
+    g_assert_cmpuint(nfc_target_queue_depth(target,
+        NFC_TARGET_PRIORITY_LOW), == ,G_N_ELEMENTS(low));
+
+    test_run(&test_opt, prio.loop);
+
+    g_assert_cmpstr(prio.order->str, == ,prio.expected);
+    g_assert(!nfc_target_queue_depth(target, NFC_TARGET_PRIORITY_HIGH));
+    g_assert(!nfc_target_queue_depth(target, NFC_TARGET_PRIORITY_LOW));
+
+    nfc_target_unref(target);
+    g_string_free(prio.order, TRUE);
+    g_main_loop_unref(prio.loop);
+}
+
 /*==========================================================================*
  * sequence2
  *==========================================================================*/
@@ -947,6 +1755,7 @@ test_reactivate_ok(
         test_reactivate_ok_done, NULL, loop));
 
     test_run(&test_opt, loop);
+    g_assert_cmpuint(nfc_target_stats(target)->reactivate.ok, == ,1);
 
     nfc_target_unref(target);
     g_main_loop_unref(loop);
@@ -1022,6 +1831,8 @@ test_reactivate_timeout(
     GMainLoop* loop = g_main_loop_new(NULL, TRUE);
     gulong gone_id = nfc_target_add_gone_handler(target,
         test_reactivate_timeout_expired, loop);
+    const NfcTargetOpStats* stats;
+    guint i, total = 0;
 
     test->mode = TEST_REACTIVATE_MODE_TIMEOUT;
     nfc_target_set_reactivate_timeout(target, 100); /* Default is quite long */
@@ -1030,6 +1841,17 @@ test_reactivate_timeout(
         test_reactivate_timeout_cb, NULL, NULL));
 
     test_run(&test_opt, loop);
+    stats = &nfc_target_stats(target)->reactivate;
+    g_assert_cmpuint(stats->timeouts, == ,1);
+
+    /* Timed out request is included in the histogram, at >= 64 ms */
+    for (i = 0; i < 7; i++) {
+        g_assert_cmpuint(stats->latency[i], == ,0);
+    }
+    for (i = 7; i < NFC_TARGET_LATENCY_BUCKETS; i++) {
+        total += stats->latency[i];
+    }
+    g_assert_cmpuint(total, == ,1);
 
     nfc_target_remove_handler(target, gone_id);
     nfc_target_unref(target);
@@ -1051,12 +1873,20 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("null"), test_null);
     g_test_add_func(TEST_("basic"), test_basic);
     g_test_add_func(TEST_("transmit_ok"), test_transmit_ok);
+    g_test_add_func(TEST_("transmit_bytes"), test_transmit_bytes);
+    g_test_add_func(TEST_("transmit_pool"), test_transmit_pool);
+    g_test_add_func(TEST_("transmit_timeout"), test_transmit_timeout);
+    g_test_add_func(TEST_("transmit_batch"), test_transmit_batch);
     g_test_add_func(TEST_("transmit_fail"), test_transmit_fail);
     g_test_add_func(TEST_("transmit_cancel"), test_transmit_cancel);
     g_test_add_func(TEST_("transmit_destroy"), test_transmit_destroy);
     g_test_add_func(TEST_("sequence_basic"), test_sequence_basic);
     g_test_add_func(TEST_("sequence_ok"), test_sequence_ok);
+    g_test_add_func(TEST_("sequence_cancel"), test_sequence_cancel);
+    g_test_add_func(TEST_("direct_continuation"),
+        test_direct_continuation);
     g_test_add_func(TEST_("sequence2"), test_sequence2);
+    g_test_add_func(TEST_("priority"), test_priority);
     g_test_add_func(TEST_("reactivate"), test_reactivate);
     g_test_add_func(TEST_("reactivate_ok"), test_reactivate_ok);
     g_test_add_func(TEST_("reactivate_gone"), test_reactivate_gone);
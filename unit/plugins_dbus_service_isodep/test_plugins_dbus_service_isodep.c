@@ -50,7 +50,7 @@
 #include <gutil_idlepool.h>
 
 #define NFC_ISODEP_INTERFACE "org.sailfishos.nfc.IsoDep"
-#define MIN_INTERFACE_VERSION (3)
+#define MIN_INTERFACE_VERSION (6)
 
 static TestOpt test_opt;
 static const char test_sender[] = ":1.1";
@@ -904,6 +904,276 @@ test_transmit_fail_early(
     test_dbus_free(dbus);
 }
 
+/*==========================================================================*
+ * transmit2/chain
+ *==========================================================================*/
+
+static const guint8 test_transmit2_cmd_read[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x04
+};
+static const guint8 test_transmit2_resp_more_data[] = {
+    0x01, 0x02, 0x61, 0x02
+};
+static const guint8 test_transmit2_cmd_get_response[] = {
+    0x00, 0xc0, 0x00, 0x00, 0x02
+};
+static const guint8 test_transmit2_resp_last[] = {
+    0x03, 0x04, 0x90, 0x00
+};
+static const guint8 test_transmit2_data[] = {
+    0x01, 0x02, 0x03, 0x04
+};
+
+static
+void
+test_transmit2_chain_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GVariant* data = NULL;
+    guint8 sw1, sw2;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, NULL);
+
+    g_assert(var);
+    g_variant_get(var, "(@ayyy)", &data, &sw1, &sw2);
+    g_assert(data);
+    g_assert_cmpuint(sw1, == ,0x90);
+    g_assert_cmpuint(sw2, == ,0x00);
+    g_assert_cmpuint(g_variant_get_size(data), == ,
+        sizeof(test_transmit2_data));
+    g_assert(!memcmp(g_variant_get_data(data), test_transmit2_data,
+        sizeof(test_transmit2_data)));
+
+    g_variant_unref(data);
+    g_variant_unref(var);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_transmit2_chain_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+    const guint8* cmd = test_transmit2_cmd_read;
+
+    nfc_tag_set_initialized(test->adapter->tags[0]);
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+    g_dbus_connection_call(test->connection, NULL,
+        test_tag_path(test, test->adapter->tags[0]), NFC_ISODEP_INTERFACE,
+        "Transmit2", g_variant_new("(yyyy@ayuuu)", cmd[0], cmd[1], cmd[2],
+        cmd[3], g_variant_new_from_data(G_VARIANT_TYPE_BYTESTRING, NULL, 0,
+        TRUE, NULL, NULL), cmd[4], 0x01, 2000), NULL, G_DBUS_CALL_FLAGS_NONE,
+        TEST_DBUS_TIMEOUT, NULL, test_transmit2_chain_done, test);
+}
+
+static
+void
+test_transmit2_chain(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+    NfcTarget* target = test_target_create(0);
+
+    test_data_init_with_target_a(&test, target, 0);
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_transmit2_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_transmit2_resp_more_data));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_transmit2_cmd_get_response),
+        TEST_ARRAY_AND_SIZE(test_transmit2_resp_last));
+    nfc_target_unref(target);
+
+    dbus = test_dbus_new(test_transmit2_chain_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
+/*==========================================================================*
+ * transmit_batch/stop
+ * transmit_batch/empty
+ *==========================================================================*/
+
+static const guint8 test_batch_cmd_select[] = {
+    0x00, 0xa4, 0x00, 0x00, 0x02, 0x3f, 0x00
+};
+static const guint8 test_batch_cmd_read[] = {
+    0x00, 0xb0, 0x00, 0x00, 0x02
+};
+static const guint8 test_batch_resp_not_found[] = {
+    0x6a, 0x82
+};
+
+static
+void
+test_transmit_batch_stop_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GVariant* responses = NULL;
+    GVariant* data = NULL;
+    guint8 sw1, sw2;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, NULL);
+
+    g_assert(var);
+    g_variant_get(var, "(@a(ayyy))", &responses);
+    g_assert(responses);
+
+    /* The second APDU stops the batch, the third one isn't sent */
+    g_assert_cmpuint(g_variant_n_children(responses), == ,2);
+    g_variant_get_child(responses, 0, "(@ayyy)", &data, &sw1, &sw2);
+    g_assert_cmpuint(g_variant_get_size(data), == ,0);
+    g_assert_cmpuint(sw1, == ,0x90);
+    g_assert_cmpuint(sw2, == ,0x00);
+    g_variant_unref(data);
+    g_variant_get_child(responses, 1, "(@ayyy)", &data, &sw1, &sw2);
+    g_assert_cmpuint(g_variant_get_size(data), == ,0);
+    g_assert_cmpuint(sw1, == ,0x6a);
+    g_assert_cmpuint(sw2, == ,0x82);
+    g_variant_unref(data);
+
+    g_variant_unref(responses);
+    g_variant_unref(var);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_transmit_batch_add(
+    GVariantBuilder* builder,
+    const guint8* cmd,
+    guint le,
+    guint16 sw,
+    guint16 mask)
+{
+    g_variant_builder_add(builder, "(yyyy@ayuqq)", cmd[0], cmd[1], cmd[2],
+        cmd[3], g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, cmd + 5,
+        le ? 0 : cmd[4], 1), le, sw, mask);
+}
+
+static
+void
+test_transmit_batch_stop_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+    GVariantBuilder builder;
+
+    nfc_tag_set_initialized(test->adapter->tags[0]);
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(yyyyayuqq)"));
+    test_transmit_batch_add(&builder, test_batch_cmd_select, 0,
+        0x9000, 0xffff);
+    test_transmit_batch_add(&builder, test_batch_cmd_read, 2,
+        0x9000, 0xff00);
+    test_transmit_batch_add(&builder, test_batch_cmd_read, 2,
+        0x9000, 0xffff);
+    g_dbus_connection_call(test->connection, NULL,
+        test_tag_path(test, test->adapter->tags[0]), NFC_ISODEP_INTERFACE,
+        "TransmitBatch", g_variant_new("(@a(yyyyayuqq)uu)",
+        g_variant_builder_end(&builder), 0, 0), NULL, G_DBUS_CALL_FLAGS_NONE,
+        TEST_DBUS_TIMEOUT, NULL, test_transmit_batch_stop_done, test);
+}
+
+static
+void
+test_transmit_batch_stop(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+    NfcTarget* target = test_target_create(0);
+
+    test_data_init_with_target_a(&test, target, 0);
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_batch_cmd_select),
+        TEST_ARRAY_AND_SIZE(test_transmit_resp_ok));
+    test_target_add_data(target,
+        TEST_ARRAY_AND_SIZE(test_batch_cmd_read),
+        TEST_ARRAY_AND_SIZE(test_batch_resp_not_found));
+    nfc_target_unref(target);
+
+    dbus = test_dbus_new(test_transmit_batch_stop_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
+static
+void
+test_transmit_batch_empty_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GVariant* responses = NULL;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, NULL);
+
+    g_assert(var);
+    g_variant_get(var, "(@a(ayyy))", &responses);
+    g_assert(responses);
+    g_assert_cmpuint(g_variant_n_children(responses), == ,0);
+
+    g_variant_unref(responses);
+    g_variant_unref(var);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_transmit_batch_empty_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+
+    nfc_tag_set_initialized(test->adapter->tags[0]);
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+    g_dbus_connection_call(test->connection, NULL,
+        test_tag_path(test, test->adapter->tags[0]), NFC_ISODEP_INTERFACE,
+        "TransmitBatch", g_variant_new("(@a(yyyyayuqq)uu)",
+        g_variant_new_array(G_VARIANT_TYPE("(yyyyayuqq)"), NULL, 0), 0, 0),
+        NULL, G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL,
+        test_transmit_batch_empty_done, test);
+}
+
+static
+void
+test_transmit_batch_empty(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test, 0);
+    dbus = test_dbus_new(test_transmit_batch_empty_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
 /*==========================================================================*
  * reset/ok
  *==========================================================================*/
@@ -1010,6 +1280,61 @@ test_reset_unsupported(
     test_dbus_free(dbus);
 }
 
+/*==========================================================================*
+ * write_ndef/fail
+ *==========================================================================*/
+
+static
+void
+test_write_ndef_fail_done(
+    GObject* connection,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+
+    test_complete_error_failed(connection, result);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_write_ndef_fail_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    static const guint8 ndef[] = { 0xd0, 0x00, 0x00 };
+    TestData* test = user_data;
+
+    /* The tag has no NDEF file */
+    nfc_tag_set_initialized(test->adapter->tags[0]);
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+    g_dbus_connection_call(test->connection, NULL,
+        test_tag_path(test, test->adapter->tags[0]), NFC_ISODEP_INTERFACE,
+        "WriteNdef", g_variant_new("(@ay)",
+        g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, ndef, sizeof(ndef), 1)),
+        NULL, G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL,
+        test_write_ndef_fail_done, test);
+}
+
+static
+void
+test_write_ndef_fail(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test, 0);
+    dbus = test_dbus_new(test_write_ndef_fail_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -1032,9 +1357,13 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("transmit/ok"), test_transmit_ok);
     g_test_add_func(TEST_("transmit/fail"), test_transmit_fail);
     g_test_add_func(TEST_("transmit/fail_early"), test_transmit_fail_early);
+    g_test_add_func(TEST_("transmit2/chain"), test_transmit2_chain);
+    g_test_add_func(TEST_("transmit_batch/stop"), test_transmit_batch_stop);
+    g_test_add_func(TEST_("transmit_batch/empty"), test_transmit_batch_empty);
     g_test_add_func(TEST_("reset/ok"), test_reset_ok);
     g_test_add_func(TEST_("reset/fail"), test_reset_fail);
     g_test_add_func(TEST_("reset/unsupported"), test_reset_unsupported);
+    g_test_add_func(TEST_("write_ndef/fail"), test_write_ndef_fail);
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
@@ -40,6 +40,7 @@
 #include "nfc_types_p.h"
 #include "internal/nfc_manager_i.h"
 #include "nfc_adapter.h"
+#include "nfc_capture.h"
 #include "nfc_version.h"
 
 #include "dbus_service/dbus_service.h"
@@ -54,7 +55,7 @@
 
 #define NFC_DAEMON_PATH "/"
 #define NFC_DAEMON_INTERFACE "org.sailfishos.nfc.Daemon"
-#define NFC_DAEMON_INTERFACE_VERSION  (4)
+#define NFC_DAEMON_INTERFACE_VERSION  (5)
 
 static TestOpt test_opt;
 static const char* dbus_sender = ":1.0";
@@ -1756,6 +1757,146 @@ test_register_host_app(
     test_dbus_free(dbus);
 }
 
+/*==========================================================================*
+ * capture
+ *==========================================================================*/
+
+static
+void
+test_capture_get_fail(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GError* error = NULL;
+
+    g_assert(!g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, &error));
+    g_assert(g_error_matches(error, DBUS_SERVICE_ERROR,
+        DBUS_SERVICE_ERROR_FAILED));
+    g_error_free(error);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_capture_stop_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GError* error = NULL;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, &error);
+
+    g_assert(var);
+    g_assert(!error);
+    g_variant_unref(var);
+    g_assert(!nfc_capture_active());
+
+    /* Nothing to get anymore */
+    test_call(test, "GetCapture", NULL, test_capture_get_fail);
+}
+
+static
+void
+test_capture_get_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    static const guint8 shb[] = { 0x0a, 0x0d, 0x0d, 0x0a };
+    TestData* test = user_data;
+    GError* error = NULL;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, &error);
+    GVariant* pcapng;
+    gsize size;
+    const guint8* data;
+
+    g_assert(var);
+    g_assert(!error);
+    g_variant_get(var, "(@ay)", &pcapng);
+    data = g_variant_get_fixed_array(pcapng, &size, 1);
+    GDEBUG("%u bytes", (guint)size);
+    g_assert_cmpuint(size, > ,sizeof(shb));
+    g_assert(!memcmp(data, shb, sizeof(shb)));
+    g_variant_unref(pcapng);
+    g_variant_unref(var);
+
+    test_call(test, "StopCapture", NULL, test_capture_stop_done);
+}
+
+static
+void
+test_capture_start_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GError* error = NULL;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, &error);
+
+    g_assert(var);
+    g_assert(!error);
+    g_variant_unref(var);
+    g_assert(nfc_capture_active());
+
+    test_call(test, "GetCapture", NULL, test_capture_get_done);
+}
+
+static
+void
+test_capture_start_fail(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GError* error = NULL;
+
+    g_assert(!g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, &error));
+    g_assert(g_error_matches(error, DBUS_SERVICE_ERROR,
+        DBUS_SERVICE_ERROR_INVALID_ARGS));
+    g_error_free(error);
+    g_assert(!nfc_capture_active());
+
+    test_call(test, "StartCapture", g_variant_new("(u)", 8),
+        test_capture_start_done);
+}
+
+static
+void
+test_capture_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* test)
+{
+    /* Too many frames */
+    test_call((TestData*)test, "StartCapture", g_variant_new("(u)",
+        G_MAXUINT), test_capture_start_fail);
+}
+
+static
+void
+test_capture(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test);
+    dbus = test_dbus_new2(test_start, test_capture_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -1788,6 +1929,7 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("request_techs"), test_request_techs);
     g_test_add_func(TEST_("register_host_service"), test_register_host_service);
     g_test_add_func(TEST_("register_host_app"), test_register_host_app);
+    g_test_add_func(TEST_("capture"), test_capture);
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
@@ -2312,6 +2312,118 @@ test_transceive_error3(
     test_dbus_free(dbus);
 }
 
+/*==========================================================================*
+ * stats
+ *==========================================================================*/
+
+static
+void
+test_stats_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+    GVariant* var = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object),
+        result, NULL);
+    GVariant* tx_latency = NULL;
+    GVariant* ra_latency = NULL;
+    gint version = 0;
+    guint tx_ok = 0, tx_errors = 0, tx_timeouts = 0, tx_cancelled = 0;
+    guint ra_ok = 0, ra_errors = 0, ra_timeouts = 0, ra_cancelled = 0;
+    guint max_depth = 0, total = 0;
+    const guint32* buckets;
+    gsize i, n = 0;
+
+    g_assert(var);
+    g_variant_get(var, "(i(uuuu@au)(uuuu@au)u)", &version,
+        &tx_ok, &tx_errors, &tx_timeouts, &tx_cancelled, &tx_latency,
+        &ra_ok, &ra_errors, &ra_timeouts, &ra_cancelled, &ra_latency,
+        &max_depth);
+    GDEBUG("version=%d transmit=%u/%u/%u/%u", version, tx_ok, tx_errors,
+        tx_timeouts, tx_cancelled);
+    g_assert_cmpint(version, >= ,1);
+    g_assert_cmpuint(tx_ok, == ,1);
+    g_assert_cmpuint(tx_errors, == ,0);
+    g_assert_cmpuint(tx_timeouts, == ,0);
+    g_assert_cmpuint(tx_cancelled, == ,0);
+    g_assert_cmpuint(ra_ok + ra_errors + ra_timeouts + ra_cancelled, == ,0);
+    g_assert_cmpuint(max_depth, <= ,1);
+
+    /* The only transmission must be in the histogram */
+    buckets = g_variant_get_fixed_array(tx_latency, &n, sizeof(guint32));
+    g_assert_cmpuint(n, == ,NFC_TARGET_LATENCY_BUCKETS);
+    for (i = 0; i < n; i++) {
+        total += buckets[i];
+    }
+    g_assert_cmpuint(total, == ,1);
+    g_assert_cmpuint(g_variant_n_children(ra_latency), == ,
+        NFC_TARGET_LATENCY_BUCKETS);
+
+    g_variant_unref(tx_latency);
+    g_variant_unref(ra_latency);
+    g_variant_unref(var);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_stats_transceive_done(
+    GObject* object,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+
+    test_complete_ok(object, result);
+    g_dbus_connection_call(test->connection, NULL,
+        test_tag_path(test, test->adapter->tags[0]),
+        "org.sailfishos.nfc.Stats", "GetAll", NULL, NULL,
+        G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL,
+        test_stats_done, test);
+}
+
+static
+void
+test_stats_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+    NfcTag* tag = test->adapter->tags[0];
+
+    nfc_tag_set_initialized(test->adapter->tags[0]);
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+
+    g_dbus_connection_call(test->connection, NULL, test_tag_path(test, tag),
+        NFC_TAG_INTERFACE, "Transceive", g_variant_new("(@ay)",
+        dbus_service_dup_byte_array_as_variant(
+        TEST_ARRAY_AND_SIZE(test_transceive_in))),
+        NULL, G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL,
+        test_stats_transceive_done, test);
+}
+
+static
+void
+test_stats(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test);
+    test_target_add_data(test.adapter->tags[0]->target,
+        TEST_ARRAY_AND_SIZE(test_transceive_in),
+        TEST_ARRAY_AND_SIZE(test_transceive_out));
+    dbus = test_dbus_new(test_stats_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -2354,6 +2466,7 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("transceive/error1"), test_transceive_error1);
     g_test_add_func(TEST_("transceive/error2"), test_transceive_error2);
     g_test_add_func(TEST_("transceive/error3"), test_transceive_error3);
+    g_test_add_func(TEST_("stats"), test_stats);
     test_init(&test_opt, argc, argv);
     return g_test_run();
 }
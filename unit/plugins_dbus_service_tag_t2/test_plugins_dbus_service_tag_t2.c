@@ -240,6 +240,22 @@ test_call_read(
         NULL, G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL, callback, test);
 }
 
+static
+void
+test_call_read_blocks(
+    TestData* test,
+    guint sector,
+    guint block,
+    guint count,
+    GAsyncReadyCallback callback)
+{
+    g_assert(test->connection);
+    g_dbus_connection_call(test->connection, NULL, test_tag_path(test),
+        NFC_TAG_T2_INTERFACE, "ReadBlocks", g_variant_new("(uuu)", sector,
+        block, count), NULL, G_DBUS_CALL_FLAGS_NONE, TEST_DBUS_TIMEOUT, NULL,
+        callback, test);
+}
+
 static
 void
 test_call_read_data(
@@ -709,6 +725,93 @@ test_read_txfail(
     test_dbus_free(dbus);
 }
 
+/*==========================================================================*
+ * read_blocks/ok
+ *==========================================================================*/
+
+#define TEST_READ_BLOCKS_COUNT (6)
+
+static
+void
+test_read_blocks_ok_done(
+    GObject* conn,
+    GAsyncResult* result,
+    gpointer user_data)
+{
+    TestData* test = user_data;
+
+    /* Takes two READs, the test target doesn't support FAST_READ */
+    test_complete_ok_data(conn, result, test_tag_data,
+        TEST_READ_BLOCKS_COUNT * TEST_TARGET_T2_BLOCK_SIZE);
+    test_quit_later(test->loop);
+}
+
+static
+void
+test_read_blocks_ok_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+    test_call_read_blocks(test, 0, 0, TEST_READ_BLOCKS_COUNT,
+        test_read_blocks_ok_done);
+}
+
+static
+void
+test_read_blocks_ok(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test);
+    dbus = test_dbus_new(test_read_blocks_ok_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
+/*==========================================================================*
+ * read_blocks/bad_range
+ *==========================================================================*/
+
+static
+void
+test_read_blocks_bad_range_start(
+    GDBusConnection* client,
+    GDBusConnection* server,
+    void* user_data)
+{
+    TestData* test = user_data;
+
+    g_object_ref(test->connection = client);
+    test->service = dbus_service_adapter_new(test->adapter, server);
+    g_assert(test->service);
+    /* Crosses the sector boundary */
+    test_call_read_blocks(test, 0, 250, 10, test_expect_error_failed);
+}
+
+static
+void
+test_read_blocks_bad_range(
+    void)
+{
+    TestData test;
+    TestDBus* dbus;
+
+    test_data_init(&test);
+    dbus = test_dbus_new(test_read_blocks_bad_range_start, &test);
+    test_run(&test_opt, test.loop);
+    test_data_cleanup(&test);
+    test_dbus_free(dbus);
+}
+
 /*==========================================================================*
  * read_data/bad_block
  *==========================================================================*/
@@ -1279,6 +1382,8 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_("read/ok"), test_read_ok);
     g_test_add_func(TEST_("read/nack"), test_read_nack);
     g_test_add_func(TEST_("read/txfail"), test_read_txfail);
+    g_test_add_func(TEST_("read_blocks/ok"), test_read_blocks_ok);
+    g_test_add_func(TEST_("read_blocks/bad_range"), test_read_blocks_bad_range);
     g_test_add_func(TEST_("read_data/ok"), test_read_data_ok);
     g_test_add_func(TEST_("read_data/nack"), test_read_data_nack);
     g_test_add_func(TEST_("read_data/txfail"), test_read_data_txfail);